@@ -933,3 +933,101 @@ chafa_canvas_config_set_passthrough (ChafaCanvasConfig *config, ChafaPassthrough
 
     config->passthrough = passthrough;
 }
+
+/**
+ * chafa_canvas_config_get_compression_level:
+ * @config: A #ChafaCanvasConfig
+ *
+ * Returns @config's compression level. This defaults to 0 (no compression).
+ *
+ * See chafa_canvas_config_set_compression_level() for details.
+ *
+ * Returns: The compression level [0-9]
+ *
+ * Since: 1.20
+ **/
+gint
+chafa_canvas_config_get_compression_level (const ChafaCanvasConfig *config)
+{
+    g_return_val_if_fail (config != NULL, 0);
+    g_return_val_if_fail (config->refs > 0, 0);
+
+    return config->compression_level;
+}
+
+/**
+ * chafa_canvas_config_set_compression_level:
+ * @config: A #ChafaCanvasConfig
+ * @compression_level: Compression level [0-9]
+ *
+ * Sets the compression level to use for pixel data in graphics protocols
+ * that support it. 0 disables compression, 1 is the fastest and 9 yields
+ * the smallest output. This defaults to 0.
+ *
+ * Compression trades CPU time for a smaller output, which is worthwhile
+ * when the terminal is at the far end of a slow link. It currently applies
+ * to #CHAFA_PIXEL_MODE_KITTY and #CHAFA_PIXEL_MODE_ITERM2, which will
+ * transmit images as PNG. If Chafa was built without zlib, this setting
+ * has no effect.
+ *
+ * Since: 1.20
+ **/
+void
+chafa_canvas_config_set_compression_level (ChafaCanvasConfig *config, gint compression_level)
+{
+    g_return_if_fail (config != NULL);
+    g_return_if_fail (config->refs > 0);
+
+    config->compression_level = CLAMP (compression_level, 0, 9);
+}
+
+/**
+ * chafa_canvas_config_get_local_transfer_enabled:
+ * @config: A #ChafaCanvasConfig
+ *
+ * Queries whether images may be handed to the terminal through shared
+ * memory or temporary files. This defaults to %FALSE.
+ *
+ * See chafa_canvas_config_set_local_transfer_enabled() for details.
+ *
+ * Returns: %TRUE if local transfer is enabled, %FALSE otherwise.
+ *
+ * Since: 1.20
+ **/
+gboolean
+chafa_canvas_config_get_local_transfer_enabled (const ChafaCanvasConfig *config)
+{
+    g_return_val_if_fail (config != NULL, FALSE);
+    g_return_val_if_fail (config->refs > 0, FALSE);
+
+    return config->local_transfer_enabled;
+}
+
+/**
+ * chafa_canvas_config_set_local_transfer_enabled:
+ * @config: A #ChafaCanvasConfig
+ * @local_transfer_enabled: Whether to allow local transfer
+ *
+ * Indicates whether images may be handed to the terminal through shared
+ * memory or temporary files instead of being sent inline. This is much
+ * faster for large images, but only works when the terminal is running
+ * on the same host. It is relevant only when the #ChafaPixelMode is set
+ * to #CHAFA_PIXEL_MODE_KITTY. This defaults to %FALSE.
+ *
+ * Only chafa_term_print_canvas() does local transfers, since it must read
+ * the terminal's reply to find out if the transfer worked. If it didn't,
+ * the image is sent inline instead. Other print functions always send
+ * images inline, since the output may be buffered, dropped or replayed
+ * elsewhere, which would leave shared memory objects and files behind.
+ *
+ * Since: 1.20
+ **/
+void
+chafa_canvas_config_set_local_transfer_enabled (ChafaCanvasConfig *config,
+                                                gboolean local_transfer_enabled)
+{
+    g_return_if_fail (config != NULL);
+    g_return_if_fail (config->refs > 0);
+
+    config->local_transfer_enabled = local_transfer_enabled;
+}
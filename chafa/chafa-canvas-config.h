@@ -136,6 +136,17 @@ ChafaPassthrough chafa_canvas_config_get_passthrough (const ChafaCanvasConfig *c
 CHAFA_AVAILABLE_IN_1_14
 void chafa_canvas_config_set_passthrough (ChafaCanvasConfig *config, ChafaPassthrough passthrough);
 
+CHAFA_AVAILABLE_IN_1_20
+gint chafa_canvas_config_get_compression_level (const ChafaCanvasConfig *config);
+CHAFA_AVAILABLE_IN_1_20
+void chafa_canvas_config_set_compression_level (ChafaCanvasConfig *config, gint compression_level);
+
+CHAFA_AVAILABLE_IN_1_20
+gboolean chafa_canvas_config_get_local_transfer_enabled (const ChafaCanvasConfig *config);
+CHAFA_AVAILABLE_IN_1_20
+void chafa_canvas_config_set_local_transfer_enabled (ChafaCanvasConfig *config,
+                                                     gboolean local_transfer_enabled);
+
 G_END_DECLS
 
 #endif /* __CHAFA_CANVAS_CONFIG_H__ */
@@ -846,40 +846,34 @@ chafa_canvas_build_ansi (ChafaCanvas *canvas)
     return chafa_canvas_print (canvas, NULL);
 }
 
-/**
- * chafa_canvas_print:
- * @canvas: The canvas to generate a printable representation of
- * @term_info: Terminal to format for, or %NULL for fallback
- *
- * Builds a UTF-8 string of terminal control sequences and symbols
- * representing the canvas' current contents. This can be printed
- * to a terminal. The exact choice of escape sequences and symbols,
- * dimensions, etc. is determined by the configuration assigned to
- * @canvas on its creation.
- *
- * All output lines except for the last one will end in a newline.
- *
- * Returns: A UTF-8 string of terminal control sequences and symbols
- *
- * Since: 1.6
- **/
-GString *
-chafa_canvas_print (ChafaCanvas *canvas, ChafaTermInfo *term_info)
+/* prev_canvas is used in symbol mode, where unchanged cells are skipped if
+ * CHAFA_OPTIMIZATION_SKIP_CELLS is set, and in kitty mode, where changes are
+ * sent as animation frames. Sixel deltas are streamed; see print_to_func().
+ *
+ * Local transfer is only allowed if the caller passes reply_out and checks
+ * the terminal's reply; see chafa_kitty_renderer_build_ansi(). */
+static GString *
+print_canvas (ChafaCanvas *canvas, ChafaCanvas *prev_canvas, ChafaTermInfo *term_info,
+              ChafaKittyCache *kitty_cache, gboolean allow_local, ChafaKittyReply *reply_out)
 {
     GString *str;
 
-    g_return_val_if_fail (canvas != NULL, NULL);
-    g_return_val_if_fail (canvas->refs > 0, NULL);
-
-    if (term_info)
-        chafa_term_info_ref (term_info);
-    else
-        term_info = chafa_term_db_get_fallback_info (chafa_term_db_get_default ());
-
     if (canvas->config.pixel_mode == CHAFA_PIXEL_MODE_SYMBOLS)
     {
         maybe_clear (canvas);
-        str = chafa_canvas_print_symbols (canvas, term_info);
+
+        if (prev_canvas
+            && (canvas->config.optimizations & CHAFA_OPTIMIZATION_SKIP_CELLS)
+            && chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_CURSOR_DOWN)
+            && chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_CURSOR_LEFT)
+            && chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_CURSOR_RIGHT))
+        {
+            str = chafa_canvas_print_symbols_delta (canvas, prev_canvas, term_info);
+        }
+        else
+        {
+            str = chafa_canvas_print_symbols (canvas, term_info);
+        }
     }
     else if (canvas->config.pixel_mode == CHAFA_PIXEL_MODE_SIXELS
              && chafa_term_info_get_seq (term_info, CHAFA_TERM_SEQ_BEGIN_SIXELS)
@@ -898,10 +892,16 @@ chafa_canvas_print (ChafaCanvas *canvas, ChafaTermInfo *term_info)
         /* Kitty mode */
 
         str = g_string_new ("");
-        chafa_kitty_renderer_build_ansi (canvas->pixel_renderer, term_info, str,
+        chafa_kitty_renderer_build_ansi (canvas->pixel_renderer,
+                                         prev_canvas ? prev_canvas->pixel_renderer : NULL,
+                                         term_info, str,
                                          canvas->config.width, canvas->config.height,
                                          canvas->placement ? canvas->placement->id : -1,
-                                         canvas->config.passthrough);
+                                         canvas->config.passthrough,
+                                         canvas->config.compression_level,
+                                         kitty_cache,
+                                         allow_local && canvas->config.local_transfer_enabled,
+                                         reply_out);
     }
     else if (canvas->config.pixel_mode == CHAFA_PIXEL_MODE_ITERM2
              && canvas->pixel_renderer)
@@ -910,13 +910,74 @@ chafa_canvas_print (ChafaCanvas *canvas, ChafaTermInfo *term_info)
 
         str = g_string_new ("");
         chafa_iterm2_renderer_build_ansi (canvas->pixel_renderer, term_info, str,
-                                          canvas->config.width, canvas->config.height);
+                                          canvas->config.width, canvas->config.height,
+                                          canvas->config.compression_level);
     }
     else
     {
         str = g_string_new ("");
     }
 
+    return str;
+}
+
+/**
+ * chafa_canvas_print:
+ * @canvas: The canvas to generate a printable representation of
+ * @term_info: Terminal to format for, or %NULL for fallback
+ *
+ * Builds a UTF-8 string of terminal control sequences and symbols
+ * representing the canvas' current contents. This can be printed
+ * to a terminal. The exact choice of escape sequences and symbols,
+ * dimensions, etc. is determined by the configuration assigned to
+ * @canvas on its creation.
+ *
+ * All output lines except for the last one will end in a newline.
+ *
+ * Returns: A UTF-8 string of terminal control sequences and symbols
+ *
+ * Since: 1.6
+ **/
+GString *
+chafa_canvas_print (ChafaCanvas *canvas, ChafaTermInfo *term_info)
+{
+    GString *str;
+
+    g_return_val_if_fail (canvas != NULL, NULL);
+    g_return_val_if_fail (canvas->refs > 0, NULL);
+
+    if (term_info)
+        chafa_term_info_ref (term_info);
+    else
+        term_info = chafa_term_db_get_fallback_info (chafa_term_db_get_default ());
+
+    str = print_canvas (canvas, NULL, term_info, NULL, FALSE, NULL);
+
+    chafa_term_info_unref (term_info);
+    return str;
+}
+
+/* Used by ChafaTerm to place images the terminal already has by ID, and to
+ * hand images over locally if allow_local is set and the config permits it.
+ * Both require the caller to read the terminal's replies, so they're only
+ * done if reply_out is not NULL. It's filled in with the reply to expect. */
+GString *
+chafa_canvas_print_with_kitty_cache (ChafaCanvas *canvas, ChafaTermInfo *term_info,
+                                     ChafaKittyCache *kitty_cache, gboolean allow_local,
+                                     ChafaKittyReply *reply_out)
+{
+    GString *str;
+
+    g_return_val_if_fail (canvas != NULL, NULL);
+    g_return_val_if_fail (canvas->refs > 0, NULL);
+
+    if (term_info)
+        chafa_term_info_ref (term_info);
+    else
+        term_info = chafa_term_db_get_fallback_info (chafa_term_db_get_default ());
+
+    str = print_canvas (canvas, NULL, term_info, kitty_cache, allow_local, reply_out);
+
     chafa_term_info_unref (term_info);
     return str;
 }
@@ -1031,6 +1092,184 @@ chafa_canvas_print_rows_strv (ChafaCanvas *canvas, ChafaTermInfo *term_info)
     return strv;
 }
 
+static void
+append_to_gstring_cb (gconstpointer data, gint len, gpointer user_data)
+{
+    g_string_append_len ((GString *) user_data, data, len);
+}
+
+static gboolean
+can_print_delta (ChafaCanvas *canvas, ChafaCanvas *prev_canvas)
+{
+    return prev_canvas
+        && prev_canvas != canvas
+        && prev_canvas->config.pixel_mode == canvas->config.pixel_mode
+        && prev_canvas->config.width == canvas->config.width
+        && prev_canvas->config.height == canvas->config.height
+        && prev_canvas->width_pixels == canvas->width_pixels
+        && prev_canvas->height_pixels == canvas->height_pixels
+        && ((prev_canvas->pixel_renderer != NULL) == (canvas->pixel_renderer != NULL));
+}
+
+static void
+print_to_func (ChafaCanvas *canvas, ChafaCanvas *prev_canvas, ChafaTermInfo *term_info,
+               ChafaCanvasWriteFunc write_func, gpointer user_data)
+{
+    if (term_info)
+        chafa_term_info_ref (term_info);
+    else
+        term_info = chafa_term_db_get_fallback_info (chafa_term_db_get_default ());
+
+    if (!can_print_delta (canvas, prev_canvas))
+        prev_canvas = NULL;
+
+    if (canvas->config.pixel_mode == CHAFA_PIXEL_MODE_SIXELS
+        && chafa_term_info_get_seq (term_info, CHAFA_TERM_SEQ_BEGIN_SIXELS)
+        && canvas->pixel_renderer)
+    {
+        /* Sixel deltas rely on terminal behavior that isn't guaranteed, so
+         * they must be enabled explicitly */
+        if (!(canvas->config.optimizations & CHAFA_OPTIMIZATION_SKIP_CELLS))
+            prev_canvas = NULL;
+
+        chafa_sixel_renderer_write_ansi (canvas->pixel_renderer,
+                                         prev_canvas ? prev_canvas->pixel_renderer : NULL,
+                                         term_info,
+                                         canvas->config.passthrough,
+                                         write_func, user_data);
+    }
+    else
+    {
+        GString *str = print_canvas (canvas, prev_canvas, term_info, NULL, FALSE, NULL);
+
+        if (str->len > 0)
+            write_func (str->str, str->len, user_data);
+
+        g_string_free (str, TRUE);
+    }
+
+    chafa_term_info_unref (term_info);
+}
+
+/**
+ * chafa_canvas_print_to_func:
+ * @canvas: The canvas to generate a printable representation of
+ * @term_info: Terminal to format for, or %NULL for fallback
+ * @write_func: Callback to receive the output
+ * @user_data: User data to pass to @write_func
+ *
+ * Like chafa_canvas_print(), but hands the output to @write_func in
+ * one or more chunks instead of returning it as a single string. The
+ * chunks must be written out in sequence, exactly as they appear.
+ *
+ * In %CHAFA_PIXEL_MODE_SIXELS, the output is streamed as it is being
+ * generated. This uses a bounded amount of memory regardless of the
+ * image's height, and lets the first bytes reach the terminal sooner.
+ * If @write_func blocks, e.g. to wait for the terminal to catch up,
+ * generation will be paused accordingly.
+ *
+ * Since: 1.20
+ **/
+void
+chafa_canvas_print_to_func (ChafaCanvas *canvas, ChafaTermInfo *term_info,
+                            ChafaCanvasWriteFunc write_func, gpointer user_data)
+{
+    g_return_if_fail (canvas != NULL);
+    g_return_if_fail (canvas->refs > 0);
+    g_return_if_fail (write_func != NULL);
+
+    print_to_func (canvas, NULL, term_info, write_func, user_data);
+}
+
+/**
+ * chafa_canvas_print_delta_to_func:
+ * @canvas: The canvas to generate a printable representation of
+ * @prev_canvas: The canvas currently displayed at the output location, or %NULL
+ * @term_info: Terminal to format for, or %NULL for fallback
+ * @write_func: Callback to receive the output
+ * @user_data: User data to pass to @write_func
+ *
+ * Like chafa_canvas_print_to_func(), but only emits what changed since
+ * @prev_canvas was printed to the same location. This is useful for
+ * animations, where consecutive frames often differ in small areas only.
+ *
+ * @prev_canvas must have the same configuration as @canvas, and it must
+ * still be on display exactly as it was printed. If it's incompatible or
+ * %NULL, the entire canvas will be printed.
+ *
+ * In %CHAFA_PIXEL_MODE_SIXELS, unchanged bands and pixels are left
+ * transparent, so the previous frame shows through. This relies on the
+ * terminal keeping the colors of pixels already drawn when the color
+ * registers are redefined, which is the case for modern emulators. Pixels
+ * that turned transparent since @prev_canvas cannot be erased this way.
+ * Since this is not guaranteed to work, it must be enabled with
+ * %CHAFA_OPTIMIZATION_SKIP_CELLS.
+ *
+ * In %CHAFA_PIXEL_MODE_KITTY, if the terminal supports
+ * #CHAFA_TERM_SEQ_BEGIN_KITTY_ANIMATION_FRAME_V1 and both canvases have a
+ * placement with the same ID, the changed rectangle is appended to
+ * @prev_canvas' image as a new animation frame, which is then shown in its
+ * place. Frames are numbered consecutively from 1, starting with the first
+ * canvas printed without a @prev_canvas. The caller can use these numbers
+ * to let the terminal loop the animation on its own with
+ * #CHAFA_TERM_SEQ_SET_KITTY_ANIMATION_FRAME_GAP_V1 and
+ * #CHAFA_TERM_SEQ_START_KITTY_ANIMATION_V1.
+ *
+ * In %CHAFA_PIXEL_MODE_SYMBOLS, if %CHAFA_OPTIMIZATION_SKIP_CELLS is
+ * enabled, the cursor is moved past unchanged cells instead of
+ * rewriting them. Rows are rewritten in full when that's cheaper, and
+ * rows with no changes are skipped altogether. All cursor movement is
+ * relative, and the cursor is left where a full print would have left it.
+ * If the canvas reaches the terminal's right margin, it must also start
+ * at the left margin, since the cursor position after writing the last
+ * column can't be known otherwise.
+ *
+ * In other modes, the entire canvas is currently printed.
+ *
+ * Since: 1.20
+ **/
+void
+chafa_canvas_print_delta_to_func (ChafaCanvas *canvas, ChafaCanvas *prev_canvas,
+                                  ChafaTermInfo *term_info,
+                                  ChafaCanvasWriteFunc write_func, gpointer user_data)
+{
+    g_return_if_fail (canvas != NULL);
+    g_return_if_fail (canvas->refs > 0);
+    g_return_if_fail (prev_canvas == NULL || prev_canvas->refs > 0);
+    g_return_if_fail (write_func != NULL);
+
+    print_to_func (canvas, prev_canvas, term_info, write_func, user_data);
+}
+
+/**
+ * chafa_canvas_print_delta:
+ * @canvas: The canvas to generate a printable representation of
+ * @prev_canvas: The canvas currently displayed at the output location, or %NULL
+ * @term_info: Terminal to format for, or %NULL for fallback
+ *
+ * Like chafa_canvas_print(), but only emits what changed since
+ * @prev_canvas was printed to the same location. See
+ * chafa_canvas_print_delta_to_func() for details.
+ *
+ * Returns: A UTF-8 string of terminal control sequences and symbols
+ *
+ * Since: 1.20
+ **/
+GString *
+chafa_canvas_print_delta (ChafaCanvas *canvas, ChafaCanvas *prev_canvas,
+                          ChafaTermInfo *term_info)
+{
+    GString *str;
+
+    g_return_val_if_fail (canvas != NULL, NULL);
+    g_return_val_if_fail (canvas->refs > 0, NULL);
+    g_return_val_if_fail (prev_canvas == NULL || prev_canvas->refs > 0, NULL);
+
+    str = g_string_new ("");
+    print_to_func (canvas, prev_canvas, term_info, append_to_gstring_cb, str);
+    return str;
+}
+
 /**
  * chafa_canvas_get_char_at:
  * @canvas: The canvas to inspect
@@ -30,6 +30,19 @@ G_BEGIN_DECLS
 
 typedef struct ChafaCanvas ChafaCanvas;
 
+/**
+ * ChafaCanvasWriteFunc:
+ * @data: Pointer to a chunk of output
+ * @len: Length of the chunk in bytes
+ * @user_data: User data that was passed along with the callback
+ *
+ * Callback that receives successive chunks of printable output. The data
+ * is only valid for the duration of the call.
+ *
+ * Since: 1.20
+ **/
+typedef void (*ChafaCanvasWriteFunc) (gconstpointer data, gint len, gpointer user_data);
+
 CHAFA_AVAILABLE_IN_ALL
 ChafaCanvas *chafa_canvas_new (const ChafaCanvasConfig *config);
 CHAFA_AVAILABLE_IN_ALL
@@ -56,6 +69,16 @@ void chafa_canvas_print_rows (ChafaCanvas *canvas, ChafaTermInfo *term_info,
                               GString ***array_out, gint *array_len_out);
 CHAFA_AVAILABLE_IN_1_14
 gchar **chafa_canvas_print_rows_strv (ChafaCanvas *canvas, ChafaTermInfo *term_info);
+CHAFA_AVAILABLE_IN_1_20
+void chafa_canvas_print_to_func (ChafaCanvas *canvas, ChafaTermInfo *term_info,
+                                 ChafaCanvasWriteFunc write_func, gpointer user_data);
+CHAFA_AVAILABLE_IN_1_20
+GString *chafa_canvas_print_delta (ChafaCanvas *canvas, ChafaCanvas *prev_canvas,
+                                   ChafaTermInfo *term_info);
+CHAFA_AVAILABLE_IN_1_20
+void chafa_canvas_print_delta_to_func (ChafaCanvas *canvas, ChafaCanvas *prev_canvas,
+                                       ChafaTermInfo *term_info,
+                                       ChafaCanvasWriteFunc write_func, gpointer user_data);
 
 CHAFA_AVAILABLE_IN_1_8
 gunichar chafa_canvas_get_char_at (ChafaCanvas *canvas, gint x, gint y);
@@ -178,7 +178,7 @@ ChafaDitherMode;
 /**
  * ChafaOptimizations:
  * @CHAFA_OPTIMIZATION_REUSE_ATTRIBUTES: Suppress redundant SGR control sequences.
- * @CHAFA_OPTIMIZATION_SKIP_CELLS: Reserved for future use.
+ * @CHAFA_OPTIMIZATION_SKIP_CELLS: Leave unchanged cells alone when printing deltas. See chafa_canvas_print_delta_to_func().
  * @CHAFA_OPTIMIZATION_REPEAT_CELLS: Use REP sequence to compress repeated runs of similar cells.
  * @CHAFA_OPTIMIZATION_NONE: All optimizations disabled.
  * @CHAFA_OPTIMIZATION_ALL: All optimizations enabled.
@@ -54,6 +54,7 @@ static gboolean have_mmx;
 static gboolean have_sse41;
 static gboolean have_popcnt;
 static gboolean have_avx2;
+static ChafaFeatures detected_features;
 
 static gint n_threads = -1;
 
@@ -96,6 +97,11 @@ init_features (void)
         have_avx2 = TRUE;
 # endif
 #endif
+
+    detected_features = (have_mmx ? CHAFA_FEATURE_MMX : 0)
+      | (have_sse41 ? CHAFA_FEATURE_SSE41 : 0)
+      | (have_popcnt ? CHAFA_FEATURE_POPCNT : 0)
+      | (have_avx2 ? CHAFA_FEATURE_AVX2 : 0);
 }
 
 static gpointer
@@ -141,6 +147,22 @@ chafa_have_avx2 (void)
     return have_avx2;
 }
 
+/* Limits the runtime features we use to those in @features, so tests can
+ * compare the fallback paths' output to that of the optimized ones. Must
+ * not be called while other threads are using the library. */
+void
+chafa_restrict_features (ChafaFeatures features)
+{
+    chafa_init ();
+
+    features &= detected_features;
+
+    have_mmx = (features & CHAFA_FEATURE_MMX) ? TRUE : FALSE;
+    have_sse41 = (features & CHAFA_FEATURE_SSE41) ? TRUE : FALSE;
+    have_popcnt = (features & CHAFA_FEATURE_POPCNT) ? TRUE : FALSE;
+    have_avx2 = (features & CHAFA_FEATURE_AVX2) ? TRUE : FALSE;
+}
+
 /* Public API */
 
 /**
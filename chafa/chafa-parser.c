@@ -21,6 +21,7 @@
 
 #include <string.h>  /* memcpy, memset */
 #include "chafa.h"
+#include "internal/chafa-private.h"
 
 struct ChafaEvent
 {
@@ -34,12 +35,41 @@ struct ChafaEvent
 struct ChafaParser
 {
     ChafaTermInfo *term_info;
+
+    /* Compiled from term_info's sequences. Rebuilt if they change. */
+    ChafaSeqTrie *seq_trie;
+    guint seq_serial;
+
+    /* Unparsed input starts at buf_ofs. Consumed bytes are only erased from
+     * the front once they outnumber the remaining ones, so the cost of moving
+     * data is amortized to O(1) per byte. */
     GString *buf;
     gint buf_ofs;
     guint eof_pushed : 1;
     guint eof_dispatched : 1;
+
+    /* Set after a sequence that is followed by free-form text. The text is
+     * discarded up to and including the next ST. */
+    guint skip_to_st : 1;
 };
 
+ChafaEvent *
+chafa_event_new (void)
+{
+    ChafaEvent *event;
+
+    event = g_new0 (ChafaEvent, 1);
+    event->type = CHAFA_EOF_EVENT;
+    event->seq = -1;
+    return event;
+}
+
+void
+chafa_event_destroy (ChafaEvent *event)
+{
+    g_free (event);
+}
+
 ChafaEventType
 chafa_event_get_type (ChafaEvent *event)
 {
@@ -95,7 +125,10 @@ chafa_parser_init (ChafaParser *parser_out, ChafaTermInfo *term_info)
 
     parser_out->term_info = term_info;
     chafa_term_info_ref (term_info);
+    parser_out->seq_trie = chafa_term_info_build_seq_trie (term_info);
+    parser_out->seq_serial = chafa_term_info_get_seq_serial (term_info);
     parser_out->buf = g_string_new ("");
+    parser_out->buf_ofs = 0;
 }
 
 void
@@ -104,6 +137,7 @@ chafa_parser_deinit (ChafaParser *parser)
     g_return_if_fail (parser != NULL);
 
     chafa_term_info_unref (parser->term_info);
+    chafa_seq_trie_destroy (parser->seq_trie);
     g_string_free (parser->buf, TRUE);
 }
 
@@ -134,6 +168,13 @@ chafa_parser_push_data (ChafaParser *parser, gconstpointer data, gint data_len)
     g_return_if_fail (data_len >= 0);
     g_return_if_fail (parser->eof_pushed == FALSE);
 
+    if (parser->buf_ofs > 0
+        && parser->buf_ofs >= (gint) parser->buf->len - parser->buf_ofs)
+    {
+        g_string_erase (parser->buf, 0, parser->buf_ofs);
+        parser->buf_ofs = 0;
+    }
+
     g_string_append_len (parser->buf, data, data_len);
 }
 
@@ -146,44 +187,85 @@ chafa_parser_push_eof (ChafaParser *parser)
     parser->eof_pushed = TRUE;
 }
 
-ChafaEvent *
-chafa_parser_pop_event (ChafaParser *parser)
+static gboolean
+seq_is_followed_by_text (ChafaTermSeq seq)
+{
+    return seq == CHAFA_TERM_SEQ_KITTY_IMAGE_ERROR_V1;
+}
+
+/* Consumes input up to and including the next ST. Returns TRUE if it was
+ * found. Otherwise, all the input is consumed except for a trailing ESC that
+ * may be the start of an ST split across reads. */
+static gboolean
+skip_to_st (ChafaParser *parser, gchar **p0, gint *len)
 {
-    ChafaEvent *event = NULL;
-    gboolean have_again = FALSE;
+    gchar *p = *p0, *end = *p0 + *len;
+
+    while ((p = memchr (p, '\033', end - p)))
+    {
+        if (p + 1 == end)
+            break;
+
+        if (p [1] == '\\')
+        {
+            parser->skip_to_st = FALSE;
+            p += 2;
+            *len -= p - *p0;
+            *p0 = p;
+            return TRUE;
+        }
+
+        p++;
+    }
+
+    if (!p)
+        p = end;
+
+    *len -= p - *p0;
+    *p0 = p;
+    return FALSE;
+}
+
+gboolean
+chafa_parser_pop_event_into (ChafaParser *parser, ChafaEvent *event_out)
+{
+    gboolean have_event = FALSE;
+    ChafaParseResult result;
     gchar *p0;
     gint len;
-    gint i;
 
     g_return_val_if_fail (parser != NULL, FALSE);
+    g_return_val_if_fail (event_out != NULL, FALSE);
 
-    p0 = parser->buf->str;
-    len = parser->buf->len;
+    if (parser->seq_serial != chafa_term_info_get_seq_serial (parser->term_info))
+    {
+        chafa_seq_trie_destroy (parser->seq_trie);
+        parser->seq_trie = chafa_term_info_build_seq_trie (parser->term_info);
+        parser->seq_serial = chafa_term_info_get_seq_serial (parser->term_info);
+    }
+
+    p0 = parser->buf->str + parser->buf_ofs;
+    len = parser->buf->len - parser->buf_ofs;
+
+    if (parser->skip_to_st && !skip_to_st (parser, &p0, &len))
+        goto out;
 
-    for (i = 0; i < CHAFA_TERM_SEQ_MAX; i++)
+    result = chafa_seq_trie_parse (parser->seq_trie, &p0, &len,
+                                   &event_out->seq,
+                                   event_out->seq_args,
+                                   &event_out->n_seq_args);
+    if (result == CHAFA_PARSE_SUCCESS)
     {
-        ChafaParseResult result;
-        ChafaEvent temp_event;
-
-        result = chafa_term_info_parse_seq_varargs (parser->term_info, i,
-                                                    &p0, &len,
-                                                    temp_event.seq_args,
-                                                    &temp_event.n_seq_args);
-        if (result == CHAFA_PARSE_SUCCESS)
-        {
-            event = g_memdup (&temp_event, sizeof (ChafaEvent));
-            event->type = CHAFA_SEQ_EVENT;
-            event->seq = i;
-            event->c = 0;
-            goto out;
-        }
-        else if (result == CHAFA_PARSE_AGAIN)
-        {
-            have_again = TRUE;
-        }
+        event_out->type = CHAFA_SEQ_EVENT;
+        event_out->c = 0;
+        have_event = TRUE;
+
+        if (seq_is_followed_by_text (event_out->seq))
+            parser->skip_to_st = TRUE;
+        goto out;
     }
 
-    while (!have_again && len > 0)
+    while (result != CHAFA_PARSE_AGAIN && len > 0)
     {
         gunichar c;
 
@@ -207,35 +289,53 @@ chafa_parser_pop_event (ChafaParser *parser)
             else
             {
                 /* Incomplete */
-                have_again = TRUE;
+                result = CHAFA_PARSE_AGAIN;
             }
         }
         else
         {
             /* Good char */
-            event = g_new0 (ChafaEvent, 1);
-            event->type = CHAFA_UNICHAR_EVENT;
-            event->seq = -1;
-            event->c = c;
+            event_out->type = CHAFA_UNICHAR_EVENT;
+            event_out->seq = -1;
+            event_out->c = c;
+            event_out->n_seq_args = 0;
             p0 = g_utf8_next_char (p0);
+            have_event = TRUE;
             goto out;
         }
     }
 
 out:
-    if (!event && parser->eof_pushed && !parser->eof_dispatched)
+    if (!have_event && parser->eof_pushed && !parser->eof_dispatched)
     {
-        event = g_new0 (ChafaEvent, 1);
-        event->type = CHAFA_EOF_EVENT;
-        event->seq = -1;
+        event_out->type = CHAFA_EOF_EVENT;
+        event_out->seq = -1;
+        event_out->c = 0;
+        event_out->n_seq_args = 0;
         parser->eof_dispatched = TRUE;
+        have_event = TRUE;
     }
 
-    if (p0 != parser->buf->str)
+    parser->buf_ofs = (ptrdiff_t) p0 - (ptrdiff_t) parser->buf->str;
+
+    if (parser->buf_ofs == (gint) parser->buf->len)
     {
-        /* FIXME: This will be slow. Switch to a better data structure */
-        g_string_erase (parser->buf, 0, (ptrdiff_t) p0 - (ptrdiff_t) parser->buf->str);
+        g_string_truncate (parser->buf, 0);
+        parser->buf_ofs = 0;
     }
 
-    return event;
+    return have_event;
+}
+
+ChafaEvent *
+chafa_parser_pop_event (ChafaParser *parser)
+{
+    ChafaEvent event;
+
+    g_return_val_if_fail (parser != NULL, NULL);
+
+    if (!chafa_parser_pop_event_into (parser, &event))
+        return NULL;
+
+    return g_memdup (&event, sizeof (ChafaEvent));
 }
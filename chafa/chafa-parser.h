@@ -39,6 +39,11 @@ ChafaEventType;
 typedef struct ChafaEvent ChafaEvent;
 typedef struct ChafaParser ChafaParser;
 
+CHAFA_AVAILABLE_IN_1_20
+ChafaEvent *chafa_event_new (void);
+CHAFA_AVAILABLE_IN_1_20
+void chafa_event_destroy (ChafaEvent *event);
+
 CHAFA_AVAILABLE_IN_1_20
 ChafaEventType chafa_event_get_type (ChafaEvent *event);
 CHAFA_AVAILABLE_IN_1_20
@@ -65,6 +70,8 @@ CHAFA_AVAILABLE_IN_1_20
 void chafa_parser_push_eof (ChafaParser *parser);
 CHAFA_AVAILABLE_IN_1_20
 ChafaEvent *chafa_parser_pop_event (ChafaParser *parser);
+CHAFA_AVAILABLE_IN_1_20
+gboolean chafa_parser_pop_event_into (ChafaParser *parser, ChafaEvent *event_out);
 
 G_END_DECLS
 
@@ -0,0 +1,529 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>  /* fcntl */
+#include <unistd.h>  /* close */
+
+#include "chafa.h"
+#include "internal/chafa-private.h"
+#include "internal/chafa-wakeup.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
+
+/* A reactor lets many stream readers and writers share a few I/O threads
+ * instead of running one thread each. Sources are one-shot: Once a
+ * source's callback has been dispatched, it gets no further events until
+ * it's re-armed. This lets the callback apply backpressure simply by not
+ * re-arming.
+ *
+ * On Linux, the threads share an epoll set. Elsewhere, a single thread
+ * runs g_poll () over all armed sources. */
+
+/* ------------------- *
+ * Defines and structs *
+ * ------------------- */
+
+#define EPOLL_EVENTS_MAX 64
+
+/* Source ID 0 is the wakeup */
+#define WAKEUP_ID 0
+
+struct ChafaReactorSource
+{
+    ChafaReactor *reactor;
+    guint64 id;
+    gint fd;
+
+    /* The fd we're watching; a duplicate if fd was already registered */
+    gint watch_fd;
+
+    ChafaReactorFunc func;
+    gpointer data;
+
+    /* Armed events. Cleared when dispatched. */
+    GIOCondition events;
+    gint n_dispatching;
+    guint removed : 1;
+};
+
+struct ChafaReactor
+{
+    gint refs;
+
+    GMutex mutex;
+    GCond cond;
+    ChafaWakeup *wakeup;
+
+    /* ID -> ChafaReactorSource. Events are matched to sources by ID, so
+     * stale events for removed sources are harmless. */
+    GHashTable *sources;
+    guint64 next_id;
+
+    GThread **threads;
+    gint n_threads;
+
+    /* -1 if we're using g_poll () */
+    gint epoll_fd;
+
+    guint shutdown_reqd : 1;
+};
+
+/* ---------------- *
+ * Polling backends *
+ * ---------------- */
+
+#ifdef HAVE_SYS_EPOLL_H
+
+static guint32
+condition_to_epoll (GIOCondition condition)
+{
+    guint32 events = 0;
+
+    if (condition & G_IO_IN)
+        events |= EPOLLIN;
+    if (condition & G_IO_PRI)
+        events |= EPOLLPRI;
+    if (condition & G_IO_OUT)
+        events |= EPOLLOUT;
+
+    /* EPOLLERR and EPOLLHUP are always reported */
+    return events;
+}
+
+static GIOCondition
+epoll_to_condition (guint32 events)
+{
+    GIOCondition condition = 0;
+
+    if (events & EPOLLIN)
+        condition |= G_IO_IN;
+    if (events & EPOLLPRI)
+        condition |= G_IO_PRI;
+    if (events & EPOLLOUT)
+        condition |= G_IO_OUT;
+    if (events & EPOLLERR)
+        condition |= G_IO_ERR;
+    if (events & EPOLLHUP)
+        condition |= G_IO_HUP;
+
+    return condition;
+}
+
+static gboolean
+epoll_ctl_source (ChafaReactor *reactor, ChafaReactorSource *source, gint op)
+{
+    struct epoll_event ev;
+
+    ev.events = condition_to_epoll (source->events) | EPOLLONESHOT;
+    ev.data.u64 = source->id;
+
+    return epoll_ctl (reactor->epoll_fd, op, source->watch_fd, &ev) == 0 ? TRUE : FALSE;
+}
+
+#endif
+
+static void
+dispatch (ChafaReactor *reactor, guint64 id, GIOCondition revents)
+{
+    ChafaReactorSource *source;
+
+    g_mutex_lock (&reactor->mutex);
+
+    source = g_hash_table_lookup (reactor->sources, &id);
+    if (!source || !source->events)
+    {
+        g_mutex_unlock (&reactor->mutex);
+        return;
+    }
+
+    source->events = 0;
+    source->n_dispatching++;
+
+    g_mutex_unlock (&reactor->mutex);
+
+    source->func (source->data, revents);
+
+    g_mutex_lock (&reactor->mutex);
+
+    source->n_dispatching--;
+
+#ifdef HAVE_SYS_EPOLL_H
+    /* Re-arming was deferred while we were dispatching */
+    if (reactor->epoll_fd >= 0 && source->events
+        && source->n_dispatching == 0 && !source->removed)
+        epoll_ctl_source (reactor, source, EPOLL_CTL_MOD);
+#endif
+
+    g_cond_broadcast (&reactor->cond);
+    g_mutex_unlock (&reactor->mutex);
+}
+
+static gboolean
+is_shutdown_reqd (ChafaReactor *reactor)
+{
+    gboolean shutdown_reqd;
+
+    g_mutex_lock (&reactor->mutex);
+    shutdown_reqd = reactor->shutdown_reqd;
+    g_mutex_unlock (&reactor->mutex);
+
+    return shutdown_reqd;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+static gpointer
+epoll_thread_main (gpointer data)
+{
+    ChafaReactor *reactor = data;
+    struct epoll_event events [EPOLL_EVENTS_MAX];
+
+    for (;;)
+    {
+        gint n, i;
+
+        n = epoll_wait (reactor->epoll_fd, events, EPOLL_EVENTS_MAX, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            /* The wakeup is level-triggered and never acknowledged, so
+             * it'll reach every thread */
+            if (events [i].data.u64 == WAKEUP_ID)
+            {
+                if (is_shutdown_reqd (reactor))
+                    return NULL;
+                continue;
+            }
+
+            dispatch (reactor, events [i].data.u64, epoll_to_condition (events [i].events));
+        }
+    }
+
+    return NULL;
+}
+
+#endif
+
+static gpointer
+poll_thread_main (gpointer data)
+{
+    ChafaReactor *reactor = data;
+    GArray *poll_fds, *ids;
+
+    poll_fds = g_array_new (FALSE, FALSE, sizeof (GPollFD));
+    ids = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+    for (;;)
+    {
+        GHashTableIter iter;
+        gpointer value;
+        GPollFD pfd;
+        guint64 id;
+        guint i;
+
+        g_array_set_size (poll_fds, 0);
+        g_array_set_size (ids, 0);
+
+        g_mutex_lock (&reactor->mutex);
+
+        if (reactor->shutdown_reqd)
+        {
+            g_mutex_unlock (&reactor->mutex);
+            break;
+        }
+
+        chafa_wakeup_get_pollfd (reactor->wakeup, &pfd);
+        pfd.revents = 0;
+        id = WAKEUP_ID;
+        g_array_append_val (poll_fds, pfd);
+        g_array_append_val (ids, id);
+
+        g_hash_table_iter_init (&iter, reactor->sources);
+        while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+            ChafaReactorSource *source = value;
+
+            if (!source->events)
+                continue;
+
+            pfd.fd = source->watch_fd;
+            pfd.events = source->events | G_IO_HUP | G_IO_ERR;
+            pfd.revents = 0;
+            g_array_append_val (poll_fds, pfd);
+            g_array_append_val (ids, source->id);
+        }
+
+        g_mutex_unlock (&reactor->mutex);
+
+        g_poll ((GPollFD *) poll_fds->data, poll_fds->len, -1);
+
+        if (g_array_index (poll_fds, GPollFD, 0).revents)
+            chafa_wakeup_acknowledge (reactor->wakeup);
+
+        for (i = 1; i < poll_fds->len; i++)
+        {
+            GIOCondition revents = g_array_index (poll_fds, GPollFD, i).revents;
+
+            if (revents)
+                dispatch (reactor, g_array_index (ids, guint64, i), revents);
+        }
+    }
+
+    g_array_free (poll_fds, TRUE);
+    g_array_free (ids, TRUE);
+    return NULL;
+}
+
+/* --------------------- *
+ * Construct and destroy *
+ * --------------------- */
+
+static void
+chafa_reactor_destroy (ChafaReactor *reactor)
+{
+    gint i;
+
+    g_mutex_lock (&reactor->mutex);
+    reactor->shutdown_reqd = TRUE;
+    g_mutex_unlock (&reactor->mutex);
+
+    chafa_wakeup_signal (reactor->wakeup);
+
+    for (i = 0; i < reactor->n_threads; i++)
+        g_thread_join (reactor->threads [i]);
+
+    /* Readers and writers hold references, so they must be gone by now */
+    g_warn_if_fail (g_hash_table_size (reactor->sources) == 0);
+
+    if (reactor->epoll_fd >= 0)
+        close (reactor->epoll_fd);
+
+    g_hash_table_destroy (reactor->sources);
+    chafa_wakeup_free (reactor->wakeup);
+    g_mutex_clear (&reactor->mutex);
+    g_cond_clear (&reactor->cond);
+    g_free (reactor->threads);
+    g_free (reactor);
+}
+
+/* ------------------------ *
+ * Internal API for streams *
+ * ------------------------ */
+
+/* Returns NULL if fd can't be watched, e.g. if it's a regular file and
+ * we're using epoll. The caller should fall back to a thread of its own. */
+ChafaReactorSource *
+chafa_reactor_add_fd (ChafaReactor *reactor, gint fd,
+                      ChafaReactorFunc func, gpointer data)
+{
+    ChafaReactorSource *source;
+
+    g_return_val_if_fail (reactor != NULL, NULL);
+    g_return_val_if_fail (fd >= 0, NULL);
+    g_return_val_if_fail (func != NULL, NULL);
+
+    source = g_new0 (ChafaReactorSource, 1);
+    source->reactor = reactor;
+    source->fd = fd;
+    source->watch_fd = fd;
+    source->func = func;
+    source->data = data;
+
+    g_mutex_lock (&reactor->mutex);
+
+    source->id = ++reactor->next_id;
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (reactor->epoll_fd >= 0
+        && !epoll_ctl_source (reactor, source, EPOLL_CTL_ADD))
+    {
+        gboolean success = FALSE;
+
+        if (errno == EEXIST)
+        {
+            /* The fd is already registered, e.g. as the other half of a
+             * read/write pair. epoll keys registrations on the fd, so
+             * watch a duplicate. */
+            source->watch_fd = fcntl (fd, F_DUPFD_CLOEXEC, 0);
+            if (source->watch_fd >= 0)
+                success = epoll_ctl_source (reactor, source, EPOLL_CTL_ADD);
+        }
+
+        if (!success)
+        {
+            g_mutex_unlock (&reactor->mutex);
+            if (source->watch_fd >= 0 && source->watch_fd != fd)
+                close (source->watch_fd);
+            g_free (source);
+            return NULL;
+        }
+    }
+#endif
+
+    g_hash_table_insert (reactor->sources, &source->id, source);
+
+    g_mutex_unlock (&reactor->mutex);
+    return source;
+}
+
+/* Arms source for a single dispatch of the given events. Can be called
+ * from any thread, including from the source's callback. */
+void
+chafa_reactor_source_arm (ChafaReactorSource *source, GIOCondition events)
+{
+    ChafaReactor *reactor = source->reactor;
+
+    g_mutex_lock (&reactor->mutex);
+
+    source->events = events;
+
+    if (reactor->epoll_fd < 0)
+    {
+        /* Have the poll thread pick up the change */
+        chafa_wakeup_signal (reactor->wakeup);
+    }
+#ifdef HAVE_SYS_EPOLL_H
+    else if (source->n_dispatching == 0)
+    {
+        epoll_ctl_source (reactor, source, EPOLL_CTL_MOD);
+    }
+#endif
+
+    g_mutex_unlock (&reactor->mutex);
+}
+
+/* Removes and frees source. When this returns, its callback is not running
+ * and won't be called again. Must not be called from the callback. */
+void
+chafa_reactor_source_remove (ChafaReactorSource *source)
+{
+    ChafaReactor *reactor = source->reactor;
+
+    g_mutex_lock (&reactor->mutex);
+
+    source->removed = TRUE;
+    source->events = 0;
+    g_hash_table_remove (reactor->sources, &source->id);
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (reactor->epoll_fd >= 0)
+        epoll_ctl (reactor->epoll_fd, EPOLL_CTL_DEL, source->watch_fd, NULL);
+#endif
+
+    while (source->n_dispatching > 0)
+        g_cond_wait (&reactor->cond, &reactor->mutex);
+
+    g_mutex_unlock (&reactor->mutex);
+
+    if (source->watch_fd != source->fd)
+        close (source->watch_fd);
+
+    g_free (source);
+}
+
+/* ---------- *
+ * Public API *
+ * ---------- */
+
+ChafaReactor *
+chafa_reactor_new (gint n_threads)
+{
+    ChafaReactor *reactor;
+    GThreadFunc thread_func = poll_thread_main;
+    gint i;
+
+    reactor = g_new0 (ChafaReactor, 1);
+    reactor->refs = 1;
+    reactor->wakeup = chafa_wakeup_new ();
+    reactor->sources = g_hash_table_new (g_int64_hash, g_int64_equal);
+    reactor->epoll_fd = -1;
+    g_mutex_init (&reactor->mutex);
+    g_cond_init (&reactor->cond);
+
+#ifdef HAVE_SYS_EPOLL_H
+    reactor->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+    if (reactor->epoll_fd >= 0)
+    {
+        struct epoll_event ev;
+        GPollFD pfd;
+
+        chafa_wakeup_get_pollfd (reactor->wakeup, &pfd);
+        ev.events = EPOLLIN;
+        ev.data.u64 = WAKEUP_ID;
+        epoll_ctl (reactor->epoll_fd, EPOLL_CTL_ADD, pfd.fd, &ev);
+
+        thread_func = epoll_thread_main;
+    }
+#endif
+
+    /* A g_poll () set can't be shared between threads */
+    reactor->n_threads = reactor->epoll_fd >= 0 ? MAX (n_threads, 1) : 1;
+    reactor->threads = g_new0 (GThread *, reactor->n_threads);
+
+    for (i = 0; i < reactor->n_threads; i++)
+        reactor->threads [i] = g_thread_new ("reactor", thread_func, reactor);
+
+    return reactor;
+}
+
+void
+chafa_reactor_ref (ChafaReactor *reactor)
+{
+    gint refs;
+
+    g_return_if_fail (reactor != NULL);
+    refs = g_atomic_int_get (&reactor->refs);
+    g_return_if_fail (refs > 0);
+
+    g_atomic_int_inc (&reactor->refs);
+}
+
+void
+chafa_reactor_unref (ChafaReactor *reactor)
+{
+    gint refs;
+
+    g_return_if_fail (reactor != NULL);
+    refs = g_atomic_int_get (&reactor->refs);
+    g_return_if_fail (refs > 0);
+
+    if (g_atomic_int_dec_and_test (&reactor->refs))
+    {
+        chafa_reactor_destroy (reactor);
+    }
+}
+
+gint
+chafa_reactor_get_n_threads (ChafaReactor *reactor)
+{
+    g_return_val_if_fail (reactor != NULL, 0);
+
+    return reactor->n_threads;
+}
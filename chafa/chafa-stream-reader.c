@@ -25,6 +25,7 @@
 #include <unistd.h>  /* STDOUT_FILENO */
 
 #include "chafa.h"
+#include "internal/chafa-private.h"
 #include "internal/chafa-byte-fifo.h"
 #include "internal/chafa-wakeup.h"
 
@@ -64,6 +65,10 @@ struct ChafaStreamReader
     DWORD saved_console_mode;
 #endif
 
+    /* If set, we read from the reactor's threads instead of our own */
+    ChafaReactor *reactor;
+    ChafaReactorSource *source;
+
     gint64 token_restart_pos;
     gpointer token_separator;
     gint token_separator_len;
@@ -79,6 +84,9 @@ struct ChafaStreamReader
 
     guint shutdown_reqd : 1;
     guint shutdown_done : 1;
+
+    /* TRUE if the reactor source was left unarmed due to a full buffer */
+    guint source_paused : 1;
 };
 
 /* ------------------ *
@@ -122,6 +130,46 @@ win32_stream_reader_deinit (ChafaStreamReader *stream_reader)
  * Low-level I/O and tty whispering *
  * -------------------------------- */
 
+#ifndef G_OS_WIN32
+
+/* Returns the number of bytes read, 0 if no data was available or -1 on
+ * error or EOF. */
+static gint
+read_nonblocking (ChafaStreamReader *stream_reader, guchar *out, gint max)
+{
+    gint result;
+    gint saved_errno;
+
+    /* Do a non-blocking read. We're forced to turn it on and off again:
+     *
+     * - If we're reading from stdin, we can't leave it in non-blocking
+     *   mode, as it'll confuse subsequent shell commands (github#293).
+     *
+     * - We can't do blocking reads because there'd be no way to
+     *   interrupt the read(); GThread doesn't support signals akin to
+     *   pthread_sigqueue(), and we can't use the pthreads API directly
+     *   since GLib may be using a different implementation behind the
+     *   scenes. A reactor thread must not block on any single fd either.
+     *
+     * So we have this awkward workaround. There's a chance we get
+     * killed while fd is still non-blocking, but in practice it's
+     * very small. */
+
+    g_unix_set_fd_nonblocking (stream_reader->fd, TRUE, NULL);
+    result = read (stream_reader->fd, out, max);
+    saved_errno = errno;
+    g_unix_set_fd_nonblocking (stream_reader->fd, FALSE, NULL);
+
+    if (result < 1)
+    {
+        result = (saved_errno == EAGAIN || saved_errno == EINTR) ? 0 : -1;
+    }
+
+    return result;
+}
+
+#endif
+
 static gint
 read_from_stream (ChafaStreamReader *stream_reader, guchar *out, gint max)
 {
@@ -164,32 +212,7 @@ read_from_stream (ChafaStreamReader *stream_reader, guchar *out, gint max)
         else if (GetLastError () != ERROR_IO_PENDING)
             result = -1;
 #else /* !G_OS_WIN32 */
-        gint saved_errno;
-
-        /* Do a non-blocking read. We're forced to turn it on and off again:
-         *
-         * - If we're reading from stdin, we can't leave it in non-blocking
-         *   mode, as it'll confuse subsequent shell commands (github#293).
-         *
-         * - We can't do blocking reads because there'd be no way to
-         *   interrupt the read(); GThread doesn't support signals akin to
-         *   pthread_sigqueue(), and we can't use the pthreads API directly
-         *   since GLib may be using a different implementation behind the
-         *   scenes.
-         *
-         * So we have this awkward workaround. There's a chance we get
-         * killed while fd is still non-blocking, but in practice it's
-         * very small. */
-
-        g_unix_set_fd_nonblocking (stream_reader->fd, TRUE, NULL);
-        result = read (stream_reader->fd, out, max);
-        saved_errno = errno;
-        g_unix_set_fd_nonblocking (stream_reader->fd, FALSE, NULL);
-
-        if (result < 1)
-        {
-            result = (saved_errno == EAGAIN || saved_errno == EINTR) ? 0 : -1;
-        }
+        result = read_nonblocking (stream_reader, out, max);
 #endif
     }
     else if (poll_fds [0].revents & (G_IO_HUP | G_IO_ERR))
@@ -235,6 +258,15 @@ in_idle_func (gpointer data)
     return G_SOURCE_REMOVE;
 }
 
+static void
+push_input_locked (ChafaStreamReader *stream_reader, const guchar *buf, gint len)
+{
+    chafa_byte_fifo_push (stream_reader->fifo, buf, len);
+    g_cond_broadcast (&stream_reader->cond);
+    if (!stream_reader->idle_id)
+        stream_reader->idle_id = g_idle_add (in_idle_func, stream_reader);
+}
+
 static gpointer
 thread_main (gpointer data)
 {
@@ -258,10 +290,7 @@ thread_main (gpointer data)
         }
         else if (len > 0)
         {
-            chafa_byte_fifo_push (stream_reader->fifo, buf, len);
-            g_cond_broadcast (&stream_reader->cond);
-            if (!stream_reader->idle_id)
-                stream_reader->idle_id = g_idle_add (in_idle_func, stream_reader);
+            push_input_locked (stream_reader, buf, len);
         }
 
         while (chafa_byte_fifo_get_len (stream_reader->fifo) > FIFO_DEFAULT_MAX
@@ -280,12 +309,70 @@ thread_main (gpointer data)
     return NULL;
 }
 
+#ifndef G_OS_WIN32
+
+/* Called from a reactor thread when the fd is readable. Does a single read
+ * and re-arms the source unless the buffer is full, in which case
+ * popped_fifo () will do it later. */
+static void
+reactor_func (gpointer data, GIOCondition revents)
+{
+    ChafaStreamReader *stream_reader = data;
+    guchar buf [READ_BUF_MAX];
+    gint len = -1;
+
+    if (revents & G_IO_IN)
+        len = read_nonblocking (stream_reader, buf, READ_BUF_MAX);
+
+    g_mutex_lock (&stream_reader->mutex);
+
+    if (len < 0)
+    {
+        stream_reader->eof_seen = TRUE;
+        stream_reader->shutdown_done = TRUE;
+        g_cond_broadcast (&stream_reader->cond);
+    }
+    else
+    {
+        if (len > 0)
+            push_input_locked (stream_reader, buf, len);
+
+        if (chafa_byte_fifo_get_len (stream_reader->fifo) > FIFO_DEFAULT_MAX)
+            stream_reader->source_paused = TRUE;
+        else
+            chafa_reactor_source_arm (stream_reader->source,
+                                      G_IO_IN | G_IO_HUP | G_IO_ERR);
+    }
+
+    g_mutex_unlock (&stream_reader->mutex);
+}
+
+#endif
+
 static void
 maybe_start_thread (ChafaStreamReader *stream_reader)
 {
-    if (stream_reader->thread)
+    if (stream_reader->thread || stream_reader->source)
         return;
 
+#ifndef G_OS_WIN32
+    if (stream_reader->reactor)
+    {
+        stream_reader->source = chafa_reactor_add_fd (stream_reader->reactor,
+                                                      stream_reader->fd,
+                                                      reactor_func,
+                                                      stream_reader);
+        if (stream_reader->source)
+        {
+            chafa_reactor_source_arm (stream_reader->source,
+                                      G_IO_IN | G_IO_HUP | G_IO_ERR);
+            return;
+        }
+
+        /* Can't be polled; fall back to a thread */
+    }
+#endif
+
     stream_reader->thread = g_thread_new ("stream-reader", thread_main, stream_reader);
 }
 
@@ -337,6 +424,11 @@ chafa_stream_reader_destroy (ChafaStreamReader *stream_reader)
 {
     g_return_if_fail (stream_reader != NULL);
 
+    /* This waits for any callback in progress, so it must be done before
+     * we take the lock */
+    if (stream_reader->source)
+        chafa_reactor_source_remove (stream_reader->source);
+
     g_mutex_lock (&stream_reader->mutex);
 
     if (stream_reader->idle_id)
@@ -368,6 +460,9 @@ chafa_stream_reader_destroy (ChafaStreamReader *stream_reader)
     chafa_byte_fifo_unref (stream_reader->fifo);
     g_free (stream_reader->token_separator);
 
+    if (stream_reader->reactor)
+        chafa_reactor_unref (stream_reader->reactor);
+
     g_free (stream_reader);
 }
 
@@ -445,12 +540,37 @@ chafa_stream_reader_is_console (ChafaStreamReader *stream_reader)
     return stream_reader->is_console;
 }
 
+/* Must be called before the first read or wait. The reactor is ignored on
+ * MS Windows. */
+void
+chafa_stream_reader_set_reactor (ChafaStreamReader *stream_reader, ChafaReactor *reactor)
+{
+    g_return_if_fail (stream_reader != NULL);
+    g_return_if_fail (stream_reader->thread == NULL);
+    g_return_if_fail (stream_reader->source == NULL);
+
+    if (reactor)
+        chafa_reactor_ref (reactor);
+    if (stream_reader->reactor)
+        chafa_reactor_unref (stream_reader->reactor);
+    stream_reader->reactor = reactor;
+}
+
 static void
 popped_fifo (ChafaStreamReader *stream_reader)
 {
     /* If there's space in the buffer, tell thread to resume reading */
     if (chafa_byte_fifo_get_len (stream_reader->fifo) <= FIFO_DEFAULT_MAX)
+    {
         g_cond_broadcast (&stream_reader->cond);
+
+        if (stream_reader->source_paused)
+        {
+            stream_reader->source_paused = FALSE;
+            chafa_reactor_source_arm (stream_reader->source,
+                                      G_IO_IN | G_IO_HUP | G_IO_ERR);
+        }
+    }
 }
 
 gint
@@ -46,6 +46,9 @@ gint chafa_stream_reader_get_fd (ChafaStreamReader *stream_reader);
 CHAFA_AVAILABLE_IN_1_20
 gboolean chafa_stream_reader_is_console (ChafaStreamReader *stream_reader);
 
+CHAFA_AVAILABLE_IN_1_20
+void chafa_stream_reader_set_reactor (ChafaStreamReader *stream_reader, ChafaReactor *reactor);
+
 CHAFA_AVAILABLE_IN_1_20
 gint chafa_stream_reader_read (ChafaStreamReader *stream_reader, gpointer out, gint max_len);
 CHAFA_AVAILABLE_IN_1_20
@@ -23,9 +23,11 @@
 #include <sys/stat.h>  /* stat */
 #include <fcntl.h>  /* open */
 #include <unistd.h>  /* STDOUT_FILENO */
+#include <limits.h>  /* IOV_MAX */
 #include <glib/gprintf.h>  /* g_vasprintf */
 
 #include "chafa.h"
+#include "internal/chafa-private.h"
 #include "internal/chafa-byte-fifo.h"
 #include "internal/chafa-wakeup.h"
 
@@ -37,6 +39,7 @@
 # include <wchar.h>
 # include <io.h>
 #else
+# include <sys/uio.h>  /* writev */
 # include <glib-unix.h>
 #endif
 
@@ -50,6 +53,13 @@
 /* Max fifo size before forced sync */
 #define FIFO_DEFAULT_MAX (1 << 20)
 
+/* Max vectors per writev () call */
+#if defined (IOV_MAX) && IOV_MAX < 256
+# define WRITEV_VECTORS_MAX IOV_MAX
+#else
+# define WRITEV_VECTORS_MAX 256
+#endif
+
 struct ChafaStreamWriter
 {
     gint refs;
@@ -64,13 +74,29 @@ struct ChafaStreamWriter
     HANDLE fd_win32;
     DWORD saved_console_mode;
 #endif
+
+    /* If set, we write from the reactor's threads instead of our own */
+    ChafaReactor *reactor;
+    ChafaReactorSource *source;
+
     gint fd;
     gint buf_max;
 
+    /* Vectors handed over by chafa_stream_writer_writev (). They're written
+     * before anything queued after them. */
+    const ChafaOutputVector *vectors;
+    gint n_vectors;
+    gsize vectors_ofs;
+    guint64 n_writevs_queued;
+    guint64 n_writevs_done;
+
     guint is_console : 1;
     guint drained : 1;
     guint shutdown_reqd : 1;
     guint shutdown_done : 1;
+
+    /* TRUE if the reactor source is armed and will drain the fifo */
+    guint source_armed : 1;
 };
 
 /* ------------------ *
@@ -221,6 +247,128 @@ out:
     return success;
 }
 
+/* Returns the number of bytes written, 0 if the fd wasn't ready or -1 on
+ * error. See read_nonblocking () in chafa-stream-reader.c for why we toggle
+ * O_NONBLOCK around the call. */
+static gint
+write_nonblocking (gint fd, gconstpointer buf, gint len)
+{
+    gint result;
+    gint saved_errno;
+
+    g_unix_set_fd_nonblocking (fd, TRUE, NULL);
+    result = write (fd, buf, len);
+    saved_errno = errno;
+    g_unix_set_fd_nonblocking (fd, FALSE, NULL);
+
+    if (result < 0)
+    {
+        result = (saved_errno == EAGAIN || saved_errno == EINTR) ? 0 : -1;
+    }
+
+    return result;
+}
+
+static gint
+fill_iov (struct iovec *iov, const ChafaOutputVector *vectors, gint n_vectors,
+          gsize first_ofs)
+{
+    gint n_iov;
+
+    for (n_iov = 0; n_iov < n_vectors && n_iov < WRITEV_VECTORS_MAX; n_iov++)
+    {
+        iov [n_iov].iov_base = (gchar *) vectors [n_iov].data;
+        iov [n_iov].iov_len = vectors [n_iov].len;
+    }
+
+    iov [0].iov_base = (gchar *) iov [0].iov_base + first_ofs;
+    iov [0].iov_len -= first_ofs;
+
+    return n_iov;
+}
+
+/* Skips past the vectors that were written in full. This also drops any
+ * empty vectors. */
+static void
+advance_vectors (const ChafaOutputVector **vectors, gint *n_vectors, gsize *first_ofs,
+                 gsize n_written)
+{
+    while (*n_vectors > 0 && n_written >= (*vectors) [0].len - *first_ofs)
+    {
+        n_written -= (*vectors) [0].len - *first_ofs;
+        *first_ofs = 0;
+        (*vectors)++;
+        (*n_vectors)--;
+    }
+
+    *first_ofs += n_written;
+}
+
+/* Like write_nonblocking (), but for vectors */
+static gssize
+writev_nonblocking (gint fd, const ChafaOutputVector *vectors, gint n_vectors,
+                    gsize first_ofs)
+{
+    struct iovec iov [WRITEV_VECTORS_MAX];
+    gssize result;
+    gint saved_errno;
+    gint n_iov;
+
+    n_iov = fill_iov (iov, vectors, n_vectors, first_ofs);
+
+    g_unix_set_fd_nonblocking (fd, TRUE, NULL);
+    result = writev (fd, iov, n_iov);
+    saved_errno = errno;
+    g_unix_set_fd_nonblocking (fd, FALSE, NULL);
+
+    if (result < 0)
+    {
+        result = (saved_errno == EAGAIN || saved_errno == EINTR) ? 0 : -1;
+    }
+
+    return result;
+}
+
+static gboolean
+safe_writev (gint fd, const ChafaOutputVector *vectors, gint n_vectors)
+{
+    struct iovec iov [WRITEV_VECTORS_MAX];
+    gsize first_ofs = 0;
+
+    while (n_vectors > 0)
+    {
+        gssize n_written;
+        gint n_iov;
+
+        n_iov = fill_iov (iov, vectors, n_vectors, first_ofs);
+        n_written = writev (fd, iov, n_iov);
+
+        if (n_written < 0)
+        {
+            if (errno == EAGAIN)
+            {
+# if defined(__gnu_hurd__) || defined(__OpenBSD__)
+                /* See safe_write () */
+                return FALSE;
+# else
+                if (!wait_for_pipe (fd))
+                    return FALSE;
+# endif
+            }
+            else if (errno != EINTR)
+            {
+                return FALSE;
+            }
+
+            continue;
+        }
+
+        advance_vectors (&vectors, &n_vectors, &first_ofs, n_written);
+    }
+
+    return TRUE;
+}
+
 #endif
 
 /* -------------------------------- *
@@ -277,6 +425,26 @@ write_to_stream (ChafaStreamWriter *stream_writer, gconstpointer buf, gsize len)
     return result;
 }
 
+static gboolean
+write_vectors_to_stream (ChafaStreamWriter *stream_writer,
+                         const ChafaOutputVector *vectors, gint n_vectors)
+{
+#ifdef G_OS_WIN32
+    gint i;
+
+    /* Line feeds must be converted, so there's no shortcut here */
+    for (i = 0; i < n_vectors; i++)
+    {
+        if (!write_to_stream (stream_writer, vectors [i].data, vectors [i].len))
+            return FALSE;
+    }
+
+    return TRUE;
+#else
+    return safe_writev (stream_writer->fd, vectors, n_vectors);
+#endif
+}
+
 /* ----------------------- *
  * Mid-level I/O machinery *
  * ----------------------- */
@@ -290,6 +458,8 @@ thread_main (gpointer data)
     for (;;)
     {
         guchar buf [WRITE_BUF_MAX];
+        const ChafaOutputVector *vectors = NULL;
+        gint n_vectors = 0;
         gint len;
 
         g_mutex_lock (&stream_writer->mutex);
@@ -297,7 +467,7 @@ thread_main (gpointer data)
         if (io_error || stream_writer->shutdown_reqd)
             break;
 
-        if (!chafa_byte_fifo_get_len (stream_writer->fifo))
+        if (!chafa_byte_fifo_get_len (stream_writer->fifo) && !stream_writer->vectors)
         {
             /* Pending output has now left the process. Signal main thread; it
              * may be waiting to finish a flush */
@@ -309,6 +479,13 @@ thread_main (gpointer data)
 
         while (!stream_writer->shutdown_reqd)
         {
+            if (stream_writer->vectors)
+            {
+                vectors = stream_writer->vectors;
+                n_vectors = stream_writer->n_vectors;
+                break;
+            }
+
             len = chafa_byte_fifo_pop (stream_writer->fifo, buf, WRITE_BUF_MAX);
             if (len)
                 break;
@@ -318,8 +495,26 @@ thread_main (gpointer data)
 
         g_mutex_unlock (&stream_writer->mutex);
 
-        if (!write_to_stream (stream_writer, buf, len))
+        if (vectors)
+        {
+            /* The caller is waiting for these, so we're free to use them
+             * without the lock */
+            if (!write_vectors_to_stream (stream_writer, vectors, n_vectors))
+            {
+                io_error = TRUE;
+                continue;
+            }
+
+            g_mutex_lock (&stream_writer->mutex);
+            stream_writer->vectors = NULL;
+            stream_writer->n_writevs_done++;
+            g_cond_broadcast (&stream_writer->cond);
+            g_mutex_unlock (&stream_writer->mutex);
+        }
+        else if (!write_to_stream (stream_writer, buf, len))
+        {
             io_error = TRUE;
+        }
     }
 
     stream_writer->shutdown_done = TRUE;
@@ -328,15 +523,136 @@ thread_main (gpointer data)
     return NULL;
 }
 
+#ifndef G_OS_WIN32
+
+/* Called from a reactor thread when the fd is writable. Writes as much as
+ * the fd will take without blocking, then re-arms the source if there's
+ * anything left. */
+static void
+reactor_func (gpointer data, GIOCondition revents)
+{
+    ChafaStreamWriter *stream_writer = data;
+    gboolean io_error = FALSE;
+
+    g_mutex_lock (&stream_writer->mutex);
+
+    if (revents & G_IO_OUT)
+    {
+        while (stream_writer->vectors)
+        {
+            gssize n_written;
+
+            n_written = writev_nonblocking (stream_writer->fd,
+                                            stream_writer->vectors,
+                                            stream_writer->n_vectors,
+                                            stream_writer->vectors_ofs);
+            if (n_written < 0)
+                io_error = TRUE;
+            if (n_written < 1)
+                break;
+
+            advance_vectors (&stream_writer->vectors, &stream_writer->n_vectors,
+                             &stream_writer->vectors_ofs, n_written);
+
+            if (stream_writer->n_vectors == 0)
+            {
+                stream_writer->vectors = NULL;
+                stream_writer->n_writevs_done++;
+            }
+        }
+
+        for (;;)
+        {
+            gconstpointer p;
+            gint len, n_written;
+
+            if (stream_writer->vectors)
+                break;
+
+            p = chafa_byte_fifo_peek (stream_writer->fifo, &len);
+            if (!p || len < 1)
+                break;
+
+            n_written = write_nonblocking (stream_writer->fd, p, len);
+            if (n_written < 0)
+                io_error = TRUE;
+            if (n_written < 1)
+                break;
+
+            chafa_byte_fifo_drop (stream_writer->fifo, n_written);
+        }
+    }
+    else
+    {
+        io_error = TRUE;
+    }
+
+    if (io_error)
+    {
+        stream_writer->source_armed = FALSE;
+        stream_writer->shutdown_done = TRUE;
+    }
+    else if (!chafa_byte_fifo_get_len (stream_writer->fifo) && !stream_writer->vectors)
+    {
+        /* Pending output has now left the process */
+        stream_writer->source_armed = FALSE;
+        stream_writer->drained = TRUE;
+    }
+    else
+    {
+        chafa_reactor_source_arm (stream_writer->source,
+                                  G_IO_OUT | G_IO_HUP | G_IO_ERR);
+    }
+
+    g_cond_broadcast (&stream_writer->cond);
+    g_mutex_unlock (&stream_writer->mutex);
+}
+
+#endif
+
 static void
 maybe_start_thread (ChafaStreamWriter *stream_writer)
 {
-    if (stream_writer->thread)
+    if (stream_writer->thread || stream_writer->source)
         return;
 
+#ifndef G_OS_WIN32
+    if (stream_writer->reactor)
+    {
+        stream_writer->source = chafa_reactor_add_fd (stream_writer->reactor,
+                                                      stream_writer->fd,
+                                                      reactor_func,
+                                                      stream_writer);
+        if (stream_writer->source)
+        {
+            /* The source is armed on demand, when there's output */
+            g_mutex_lock (&stream_writer->mutex);
+            if (!chafa_byte_fifo_get_len (stream_writer->fifo))
+                stream_writer->drained = TRUE;
+            g_mutex_unlock (&stream_writer->mutex);
+            return;
+        }
+
+        /* Can't be polled; fall back to a thread */
+    }
+#endif
+
     stream_writer->thread = g_thread_new ("stream-writer", thread_main, stream_writer);
 }
 
+static void
+maybe_arm_source_locked (ChafaStreamWriter *stream_writer)
+{
+    if (!stream_writer->source
+        || stream_writer->source_armed
+        || stream_writer->shutdown_done)
+        return;
+
+    stream_writer->source_armed = TRUE;
+    chafa_reactor_source_arm (stream_writer->source,
+                              G_IO_OUT | G_IO_HUP | G_IO_ERR);
+}
+
 /* --------------------- *
  * Construct and destroy *
  * --------------------- */
@@ -366,6 +682,11 @@ chafa_stream_writer_destroy (ChafaStreamWriter *stream_writer)
 {
     g_return_if_fail (stream_writer != NULL);
 
+    /* This waits for any callback in progress, so it must be done before
+     * we take the lock */
+    if (stream_writer->source)
+        chafa_reactor_source_remove (stream_writer->source);
+
     g_mutex_lock (&stream_writer->mutex);
 
     stream_writer->shutdown_reqd = TRUE;
@@ -390,6 +711,9 @@ chafa_stream_writer_destroy (ChafaStreamWriter *stream_writer)
 
     chafa_byte_fifo_unref (stream_writer->fifo);
 
+    if (stream_writer->reactor)
+        chafa_reactor_unref (stream_writer->reactor);
+
     g_free (stream_writer);
 }
 
@@ -453,6 +777,22 @@ chafa_stream_writer_is_console (ChafaStreamWriter *stream_writer)
     return stream_writer->is_console;
 }
 
+/* Must be called before the first write or flush. The reactor is ignored on
+ * MS Windows. */
+void
+chafa_stream_writer_set_reactor (ChafaStreamWriter *stream_writer, ChafaReactor *reactor)
+{
+    g_return_if_fail (stream_writer != NULL);
+    g_return_if_fail (stream_writer->thread == NULL);
+    g_return_if_fail (stream_writer->source == NULL);
+
+    if (reactor)
+        chafa_reactor_ref (reactor);
+    if (stream_writer->reactor)
+        chafa_reactor_unref (stream_writer->reactor);
+    stream_writer->reactor = reactor;
+}
+
 gint
 chafa_stream_writer_get_buffer_max (ChafaStreamWriter *stream_writer)
 {
@@ -510,6 +850,7 @@ chafa_stream_writer_write (ChafaStreamWriter *stream_writer, gconstpointer data,
         data = ((const gchar *) data) + n_written;
 
         g_cond_broadcast (&stream_writer->cond);
+        maybe_arm_source_locked (stream_writer);
         g_mutex_unlock (&stream_writer->mutex);
     }
 
@@ -517,6 +858,59 @@ out:
     return;
 }
 
+/* Writes the vectors in order without copying them, bypassing the fifo.
+ * Any queued output is drained first. The vectors are then handed to the
+ * writer thread or reactor, and the call returns when the data has left
+ * the process, so the caller is free to release the buffers. Returns FALSE
+ * if the data couldn't be written in full, e.g. due to a closed pipe. */
+gboolean
+chafa_stream_writer_writev (ChafaStreamWriter *stream_writer,
+                            const ChafaOutputVector *vectors, gint n_vectors)
+{
+    gboolean success;
+    guint64 n;
+
+    g_return_val_if_fail (stream_writer != NULL, FALSE);
+    g_return_val_if_fail (vectors != NULL || n_vectors == 0, FALSE);
+
+    if (n_vectors <= 0)
+        return TRUE;
+
+    maybe_start_thread (stream_writer);
+
+    g_mutex_lock (&stream_writer->mutex);
+
+    while (!stream_writer->shutdown_done
+           && (!stream_writer->drained || stream_writer->vectors))
+        g_cond_wait (&stream_writer->cond, &stream_writer->mutex);
+
+    if (stream_writer->shutdown_done)
+    {
+        g_mutex_unlock (&stream_writer->mutex);
+        return FALSE;
+    }
+
+    stream_writer->vectors = vectors;
+    stream_writer->n_vectors = n_vectors;
+    stream_writer->vectors_ofs = 0;
+    stream_writer->drained = FALSE;
+    n = ++stream_writer->n_writevs_queued;
+
+    g_cond_broadcast (&stream_writer->cond);
+    maybe_arm_source_locked (stream_writer);
+
+    while (!stream_writer->shutdown_done && stream_writer->n_writevs_done < n)
+        g_cond_wait (&stream_writer->cond, &stream_writer->mutex);
+
+    success = stream_writer->n_writevs_done >= n ? TRUE : FALSE;
+
+    /* On failure, the vectors may still be referenced */
+    stream_writer->vectors = NULL;
+    g_mutex_unlock (&stream_writer->mutex);
+
+    return success;
+}
+
 gint
 chafa_stream_writer_print (ChafaStreamWriter *stream_writer, const gchar *format, ...)
 {
@@ -30,6 +30,13 @@ G_BEGIN_DECLS
 
 typedef struct ChafaStreamWriter ChafaStreamWriter;
 
+typedef struct
+{
+    gconstpointer data;
+    gsize len;
+}
+ChafaOutputVector;
+
 CHAFA_AVAILABLE_IN_1_20
 ChafaStreamWriter *chafa_stream_writer_new_from_fd (gint fd);
 CHAFA_AVAILABLE_IN_1_20
@@ -42,6 +49,9 @@ gint chafa_stream_writer_get_fd (ChafaStreamWriter *stream_writer);
 CHAFA_AVAILABLE_IN_1_20
 gboolean chafa_stream_writer_is_console (ChafaStreamWriter *stream_writer);
 
+CHAFA_AVAILABLE_IN_1_20
+void chafa_stream_writer_set_reactor (ChafaStreamWriter *stream_writer, ChafaReactor *reactor);
+
 CHAFA_AVAILABLE_IN_1_20
 gint chafa_stream_writer_get_buffer_max (ChafaStreamWriter *stream_writer);
 CHAFA_AVAILABLE_IN_1_20
@@ -50,6 +60,9 @@ void chafa_stream_writer_set_buffer_max (ChafaStreamWriter *stream_writer, gint
 CHAFA_AVAILABLE_IN_1_20
 void chafa_stream_writer_write (ChafaStreamWriter *stream_writer, gconstpointer data, gint len);
 CHAFA_AVAILABLE_IN_1_20
+gboolean chafa_stream_writer_writev (ChafaStreamWriter *stream_writer,
+                                     const ChafaOutputVector *vectors, gint n_vectors);
+CHAFA_AVAILABLE_IN_1_20
 gint chafa_stream_writer_print (ChafaStreamWriter *stream_writer, const gchar *format, ...);
 CHAFA_AVAILABLE_IN_1_20
 gboolean chafa_stream_writer_flush (ChafaStreamWriter *stream_writer);
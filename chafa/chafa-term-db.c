@@ -438,6 +438,61 @@ static const SeqStr kitty_virt_seqs [] =
     { CHAFA_TERM_SEQ_MAX, NULL }
 };
 
+static const SeqStr kitty_id_seqs [] =
+{
+    { CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_WITH_ID_V1, "\033_Ga=T,f=%1,s=%2,v=%3,c=%4,r=%5,i=%6,m=1,q=2\033\\" },
+    /* Not quiet, since the terminal may have evicted the image */
+    { CHAFA_TERM_SEQ_PUT_KITTY_IMAGE_V1, "\033_Ga=p,i=%1,c=%2,r=%3\033\\" },
+
+    /* Replies to commands that carry an image ID and don't set q=2 */
+    { CHAFA_TERM_SEQ_KITTY_IMAGE_OK_V1, "\033_Gi=%1;OK\033\\" },
+    { CHAFA_TERM_SEQ_KITTY_IMAGE_ERROR_V1, "\033_Gi=%1;E" },
+
+    { CHAFA_TERM_SEQ_MAX, NULL }
+};
+
+static const SeqStr kitty_animation_seqs [] =
+{
+    { CHAFA_TERM_SEQ_BEGIN_KITTY_ANIMATION_FRAME_V1, "\033_Ga=f,i=%1,f=%2,x=%3,y=%4,s=%5,v=%6,c=%7,X=1,m=1,q=2\033\\" },
+    { CHAFA_TERM_SEQ_SET_KITTY_ANIMATION_FRAME_V1, "\033_Ga=a,i=%1,c=%2,q=2\033\\" },
+    { CHAFA_TERM_SEQ_SET_KITTY_ANIMATION_FRAME_GAP_V1, "\033_Ga=a,i=%1,r=%2,z=%3,q=2\033\\" },
+    { CHAFA_TERM_SEQ_START_KITTY_ANIMATION_V1, "\033_Ga=a,i=%1,s=3,v=%2,q=2\033\\" },
+    { CHAFA_TERM_SEQ_STOP_KITTY_ANIMATION_V1, "\033_Ga=a,i=%1,s=1,q=2\033\\" },
+
+    { CHAFA_TERM_SEQ_MAX, NULL }
+};
+
+/* These only work if the terminal can access our filesystem and shared
+ * memory, i.e. it's running on the same host. They are stripped from the
+ * detected term info in remote sessions; see strip_local_only_seqs().
+ *
+ * They're not quiet, since the reply is the only way to find out if the
+ * terminal could read the data. */
+static const SeqStr kitty_local_seqs [] =
+{
+    { CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_SHM_V1, "\033_Ga=T,t=s,f=%1,s=%2,v=%3,c=%4,r=%5,i=%6;" },
+    { CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_TEMP_FILE_V1, "\033_Ga=T,t=t,f=%1,s=%2,v=%3,c=%4,r=%5,i=%6;" },
+
+    { CHAFA_TERM_SEQ_MAX, NULL }
+};
+
+static const ChafaTermSeq local_only_seqs [] =
+{
+    CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_SHM_V1,
+    CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_TEMP_FILE_V1,
+
+    CHAFA_TERM_SEQ_MAX
+};
+
+/* If any of these are set, we're probably talking to a remote terminal */
+static const gchar *remote_session_env_vars [] =
+{
+    "SSH_CONNECTION",
+    "SSH_CLIENT",
+    "SSH_TTY",
+    NULL
+};
+
 static const SeqStr iterm2_seqs [] =
 {
     { CHAFA_TERM_SEQ_BEGIN_ITERM2_IMAGE, "\033]1337;File=inline=1;width=%1;height=%2;preserveAspectRatio=0:" },
@@ -665,8 +720,8 @@ static const TermDef term_def [] =
         { ENV_OP_INCL, ENV_CMP_EXACT,  "TERM_PROGRAM", "ghostty", 0 },
         { ENV_OP_INCL, ENV_CMP_ISSET,  "GHOSTTY_BIN_DIR", NULL, 0 } },
       { vt220_seqs, color_direct_seqs, color_256_seqs, color_16_seqs, color_8_seqs,
-        kitty_seqs, kitty_virt_seqs }, INHERIT_NONE, CHAFA_PASSTHROUGH_NONE,
-      PIXEL_PT_NONE, QUIRKS_NONE, LINUX_DESKTOP_SYMS },
+        kitty_seqs, kitty_virt_seqs, kitty_local_seqs, kitty_id_seqs }, INHERIT_NONE,
+      CHAFA_PASSTHROUGH_NONE, PIXEL_PT_NONE, QUIRKS_NONE, LINUX_DESKTOP_SYMS },
 
     /* GNU/Hurd console */
     { TERM_TYPE_TERM, "hurd", VARIANT_NONE, VERSION_NONE,
@@ -686,8 +741,9 @@ static const TermDef term_def [] =
       { { ENV_OP_INCL, ENV_CMP_EXACT,  "TERM", "xterm-kitty", 10 },
         { ENV_OP_INCL, ENV_CMP_ISSET,  "KITTY_PID", NULL, 0 } },
       { vt220_seqs, color_direct_seqs, color_256_seqs, color_16_seqs, color_8_seqs,
-        kitty_seqs, kitty_virt_seqs }, INHERIT_NONE, CHAFA_PASSTHROUGH_NONE,
-      PIXEL_PT_NONE, QUIRKS_NONE, LINUX_DESKTOP_SYMS },
+        kitty_seqs, kitty_virt_seqs, kitty_local_seqs, kitty_id_seqs,
+        kitty_animation_seqs }, INHERIT_NONE,
+      CHAFA_PASSTHROUGH_NONE, PIXEL_PT_NONE, QUIRKS_NONE, LINUX_DESKTOP_SYMS },
 
     { TERM_TYPE_TERM, "konsole", VARIANT_NONE, VERSION_NONE,
       { { ENV_OP_INCL, ENV_CMP_ISSET,  "KONSOLE_VERSION", NULL, 0 } },
@@ -1124,6 +1180,29 @@ detect_term_of_type (TermType term_type, gchar **envp)
     return ti;
 }
 
+static gboolean
+is_remote_session (gchar **envp)
+{
+    gint i;
+
+    for (i = 0; remote_session_env_vars [i]; i++)
+    {
+        if (g_environ_getenv (envp, remote_session_env_vars [i]))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void
+strip_local_only_seqs (ChafaTermInfo *ti)
+{
+    gint i;
+
+    for (i = 0; local_only_seqs [i] < CHAFA_TERM_SEQ_MAX; i++)
+        chafa_term_info_set_seq (ti, local_only_seqs [i], NULL, NULL);
+}
+
 static ChafaTermInfo *
 detect_capabilities (gchar **envp)
 {
@@ -1160,6 +1239,9 @@ detect_capabilities (gchar **envp)
         chafa_term_info_set_safe_symbol_tags (ret_ti, CHAFA_SYMBOL_TAG_ASCII);
     }
 
+    if (is_remote_session (envp))
+        strip_local_only_seqs (ret_ti);
+
     return ret_ti;
 }
 
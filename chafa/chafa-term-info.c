@@ -201,6 +201,17 @@
  * @CHAFA_TERM_SEQ_BEGIN_HYPERLINK: Begins an OSC 8-style hyperlink. The URL follows this.
  * @CHAFA_TERM_SEQ_BEGIN_HYPERLINK_ANCHOR: Separates an OSC 8-style hyperlink URL from its anchor (label). The label follows this.
  * @CHAFA_TERM_SEQ_END_HYPERLINK: Ends an OSC 8-style hyperlink. Closes both the preceding #CHAFA_TERM_SEQ_BEGIN_HYPERLINK and #CHAFA_TERM_SEQ_BEGIN_HYPERLINK_ANCHOR.
+ * @CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_SHM_V1: Begin transfer of Kitty image through POSIX shared memory for immediate display at cursor.
+ * @CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_TEMP_FILE_V1: Begin transfer of Kitty image through a temporary file for immediate display at cursor.
+ * @CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_WITH_ID_V1: Begin Kitty image transfer with an image ID for immediate display at cursor.
+ * @CHAFA_TERM_SEQ_BEGIN_KITTY_ANIMATION_FRAME_V1: Begin transfer of a Kitty animation frame.
+ * @CHAFA_TERM_SEQ_SET_KITTY_ANIMATION_FRAME_V1: Show a specific Kitty animation frame.
+ * @CHAFA_TERM_SEQ_SET_KITTY_ANIMATION_FRAME_GAP_V1: Set the display time of a Kitty animation frame.
+ * @CHAFA_TERM_SEQ_START_KITTY_ANIMATION_V1: Start looping Kitty animation playback.
+ * @CHAFA_TERM_SEQ_STOP_KITTY_ANIMATION_V1: Stop Kitty animation playback.
+ * @CHAFA_TERM_SEQ_PUT_KITTY_IMAGE_V1: Display a previously transmitted Kitty image at cursor.
+ * @CHAFA_TERM_SEQ_KITTY_IMAGE_OK_V1: Reply to a successful Kitty image command.
+ * @CHAFA_TERM_SEQ_KITTY_IMAGE_ERROR_V1: Reply to a failed Kitty image command. An error code and message follow this.
  * @CHAFA_TERM_SEQ_MAX: Last control sequence plus one.
  *
  * An enumeration of the control sequences supported by #ChafaTermInfo.
@@ -227,6 +238,10 @@ struct ChafaTermInfo
     guint8 inherit_seq [CHAFA_TERM_SEQ_MAX];
     ChafaTermQuirks quirks;
     ChafaSymbolTags safe_symbol_tags;
+
+    /* Incremented whenever a sequence changes, so parsers know when to
+     * rebuild their sequence tries */
+    guint seq_serial;
 };
 
 typedef enum
@@ -298,6 +313,7 @@ copy_seq (const ChafaTermInfo *src, ChafaTermInfo *dest, gint seq)
             CHAFA_TERM_SEQ_ARGS_MAX * sizeof (SeqArgInfo));
 
     dest->inherit_seq [seq] = src->inherit_seq [seq];
+    dest->seq_serial++;
 }
 
 static gboolean
@@ -571,6 +587,21 @@ emit_seq_6_args_uint (const ChafaTermInfo *term_info, gchar *out, ChafaTermSeq s
     return emit_seq_guint (term_info, out, seq, args, 6);
 }
 
+static gchar *
+emit_seq_7_args_uint (const ChafaTermInfo *term_info, gchar *out, ChafaTermSeq seq, guint arg0, guint arg1, guint arg2, guint arg3, guint arg4, guint arg5, guint arg6)
+{
+    guint args [7];
+
+    args [0] = arg0;
+    args [1] = arg1;
+    args [2] = arg2;
+    args [3] = arg3;
+    args [4] = arg4;
+    args [5] = arg5;
+    args [6] = arg6;
+    return emit_seq_guint (term_info, out, seq, args, 7);
+}
+
 static gchar *
 emit_seq_3_args_uint8 (const ChafaTermInfo *term_info, gchar *out, ChafaTermSeq seq, guint8 arg0, guint8 arg1, guint8 arg2)
 {
@@ -615,57 +646,6 @@ emit_seq_varargs_uint (const ChafaTermInfo *term_info, gchar *out, ChafaTermSeq
 
 /* Stream parsing */
 
-static gint
-parse_dec (const gchar *in, gint in_len, guint *args_out)
-{
-    gint i = 0;
-    guint result = 0;
-
-    while (in_len > 0 && *in >= '0' && *in <= '9')
-    {
-        result *= 10;
-        result += *in - '0';
-        in++;
-        in_len--;
-        i++;
-    }
-
-    *args_out = result;
-    return i;
-}
-
-static gint
-parse_hex4 (const gchar *in, gint in_len, guint *args_out)
-{
-    gint i = 0;
-    guint result = 0;
-
-    while (in_len > 0)
-    {
-        gchar c = g_ascii_tolower (*in);
-
-        if (c >= '0' && c <= '9')
-        {
-            result *= 16;
-            result += c - '0';
-        }
-        else if (c >= 'a' && c <= 'f')
-        {
-            result *= 16;
-            result += c - 'a' + 10;
-        }
-        else
-            break;
-
-        in++;
-        in_len--;
-        i++;
-    }
-
-    *args_out = result;
-    return i;
-}
-
 static ChafaParseResult
 try_parse_seq (const ChafaTermInfo *term_info, ChafaTermSeq seq,
                gchar **input, gint *input_len, guint *args_out, gint *n_args_out)
@@ -714,11 +694,11 @@ try_parse_seq (const ChafaTermInfo *term_info, ChafaTermSeq seq,
             *n_args_out = arg_ofs + 1;
 
             if (seq_meta [seq].type_size == 1)
-                len = parse_dec (in, in_len, args_out + arg_ofs);
+                len = chafa_parse_dec_uint (in, in_len, args_out + arg_ofs);
             else if (seq_meta [seq].type_size == 2)
-                len = parse_hex4 (in, in_len, args_out + arg_ofs);
+                len = chafa_parse_hex4_uint (in, in_len, args_out + arg_ofs);
             else
-                len = parse_dec (in, in_len, args_out + arg_ofs);
+                len = chafa_parse_dec_uint (in, in_len, args_out + arg_ofs);
 
             /* Blank args are interpreted to mean zero */
             if (len == 0)
@@ -747,6 +727,73 @@ try_parse_seq (const ChafaTermInfo *term_info, ChafaTermSeq seq,
     return CHAFA_PARSE_SUCCESS;
 }
 
+/* Adds seq to the trie, mirroring the steps taken by try_parse_seq (). */
+static void
+add_seq_to_trie (const ChafaTermInfo *term_info, ChafaTermSeq seq, ChafaSeqTrie *trie)
+{
+    const gchar *seq_str;
+    const SeqArgInfo *seq_args;
+    ChafaSeqTrieArgType arg_type;
+    gboolean parsed_varargs = FALSE;
+    gint node = CHAFA_SEQ_TRIE_ROOT;
+    gint pofs = 0;
+    guint i = 0;
+
+    seq_str = &term_info->seq_str [seq] [0];
+    seq_args = &term_info->seq_args [seq] [0];
+
+    for ( ; ; i++)
+    {
+        node = chafa_seq_trie_add_bytes (trie, node, &seq_str [pofs], seq_args [i].pre_len);
+        pofs += seq_args [i].pre_len;
+
+        if (parsed_varargs || i >= seq_meta [seq].n_args)
+            break;
+
+        /* Sequences that are missing arguments never match, but their
+         * prefixes still make the parser wait for more input. */
+        if (seq_args [i].arg_index > CHAFA_TERM_SEQ_ARGS_MAX - 1)
+            return;
+
+        if (seq_args [i].is_varargs)
+            parsed_varargs = TRUE;
+
+        if (seq_meta [seq].type_size == 2)
+            arg_type = parsed_varargs ? CHAFA_SEQ_TRIE_ARG_HEX_VARARGS : CHAFA_SEQ_TRIE_ARG_HEX;
+        else
+            arg_type = parsed_varargs ? CHAFA_SEQ_TRIE_ARG_DEC_VARARGS : CHAFA_SEQ_TRIE_ARG_DEC;
+
+        node = chafa_seq_trie_add_arg (trie, node, arg_type, seq_args [i].arg_index);
+    }
+
+    chafa_seq_trie_set_seq (trie, node, seq);
+}
+
+/* Internal */
+
+ChafaSeqTrie *
+chafa_term_info_build_seq_trie (const ChafaTermInfo *term_info)
+{
+    ChafaSeqTrie *trie;
+    gint i;
+
+    trie = chafa_seq_trie_new ();
+
+    for (i = 0; i < CHAFA_TERM_SEQ_MAX; i++)
+    {
+        if (term_info->unparsed_str [i])
+            add_seq_to_trie (term_info, i, trie);
+    }
+
+    return trie;
+}
+
+guint
+chafa_term_info_get_seq_serial (const ChafaTermInfo *term_info)
+{
+    return term_info->seq_serial;
+}
+
 /* Public */
 
 G_DEFINE_QUARK (chafa-term-info-error-quark, chafa_term_info_error)
@@ -1290,6 +1337,7 @@ chafa_term_info_set_seq (ChafaTermInfo *term_info, ChafaTermSeq seq, const gchar
 
         g_free (term_info->unparsed_str [seq]);
         term_info->unparsed_str [seq] = NULL;
+        term_info->seq_serial++;
         result = TRUE;
     }
     else
@@ -1308,6 +1356,7 @@ chafa_term_info_set_seq (ChafaTermInfo *term_info, ChafaTermSeq seq, const gchar
 
             g_free (term_info->unparsed_str [seq]);
             term_info->unparsed_str [seq] = g_strdup (str);
+            term_info->seq_serial++;
         }
     }
 
@@ -1613,6 +1662,7 @@ chafa_term_info_supplement (ChafaTermInfo *term_info, ChafaTermInfo *source)
                     CHAFA_TERM_SEQ_LENGTH_MAX);
             memcpy (&term_info->seq_args [i] [0], &source->seq_args [i] [0],
                     CHAFA_TERM_SEQ_ARGS_MAX * sizeof (SeqArgInfo));
+            term_info->seq_serial++;
         }
     }
 }
@@ -1757,6 +1807,10 @@ gchar *chafa_term_info_emit_##func_name(const ChafaTermInfo *term_info, gchar *d
 gchar *chafa_term_info_emit_##func_name(const ChafaTermInfo *term_info, gchar *dest, guint arg0, guint arg1, guint arg2, guint arg3, guint arg4, guint arg5) \
 { return emit_seq_6_args_uint (term_info, dest, CHAFA_TERM_SEQ_##seq_name, arg0, arg1, arg2, arg3, arg4, arg5); }
 
+#define DEFINE_EMIT_SEQ_7_none_guint(func_name, seq_name) \
+gchar *chafa_term_info_emit_##func_name(const ChafaTermInfo *term_info, gchar *dest, guint arg0, guint arg1, guint arg2, guint arg3, guint arg4, guint arg5, guint arg6) \
+{ return emit_seq_7_args_uint (term_info, dest, CHAFA_TERM_SEQ_##seq_name, arg0, arg1, arg2, arg3, arg4, arg5, arg6); }
+
 #define DEFINE_EMIT_SEQ_3_none_guint8(func_name, seq_name) \
 gchar *chafa_term_info_emit_##func_name(const ChafaTermInfo *term_info, gchar *dest, guint8 arg0, guint8 arg1, guint8 arg2) \
 { return emit_seq_3_args_uint8 (term_info, dest, CHAFA_TERM_SEQ_##seq_name, arg0, arg1, arg2); }
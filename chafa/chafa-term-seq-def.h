@@ -2889,5 +2889,292 @@ CHAFA_TERM_SEQ_DEF(begin_hyperlink_anchor, BEGIN_HYPERLINK_ANCHOR, 0, none, char
  **/
 CHAFA_TERM_SEQ_DEF(end_hyperlink, END_HYPERLINK, 0, none, char, (CHAFA_TERM_SEQ_PFX))
 
+/* --- Available in 1.20+ --- */
+
+#undef CHAFA_TERM_SEQ_AVAILABILITY
+#define CHAFA_TERM_SEQ_AVAILABILITY CHAFA_AVAILABLE_IN_1_20
+
+/**
+ * chafa_term_info_emit_begin_kitty_immediate_image_shm_v1:
+ * @term_info: A #ChafaTermInfo
+ * @dest: String destination
+ * @bpp: Bits per pixel
+ * @width_pixels: Image width in pixels
+ * @height_pixels: Image height in pixels
+ * @width_cells: Target width in cells
+ * @height_cells: Target height in cells
+ * @id: Image ID
+ *
+ * Prints the control sequence for #CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_SHM_V1.
+ *
+ * @dest must have enough space to hold
+ * #CHAFA_TERM_SEQ_LENGTH_MAX bytes, even if the emitted sequence is
+ * shorter. The output will not be zero-terminated.
+ *
+ * @bpp must be set to either 24 for RGB data, 32 for RGBA, or 100 to embed a
+ * PNG file.
+ *
+ * This sequence must be followed by the base-64 encoded name of a POSIX
+ * shared memory object holding the image data, and then
+ * #CHAFA_TERM_SEQ_END_KITTY_IMAGE_CHUNK. The terminal will unlink the
+ * object once it has been read. This only works when the terminal is
+ * running on the same host.
+ *
+ * The image is assigned @id, and the terminal replies with
+ * #CHAFA_TERM_SEQ_KITTY_IMAGE_OK_V1 or #CHAFA_TERM_SEQ_KITTY_IMAGE_ERROR_V1.
+ * If the transfer fails, nothing is displayed, and the object may be left
+ * behind for the caller to clean up.
+ *
+ * Returns: Pointer to first byte after emitted string
+ *
+ * Since: 1.20
+ **/
+CHAFA_TERM_SEQ_DEF(begin_kitty_immediate_image_shm_v1, BEGIN_KITTY_IMMEDIATE_IMAGE_SHM_V1, 6, none, guint, (CHAFA_TERM_SEQ_PFX, guint bpp, guint width_pixels, guint height_pixels, guint width_cells, guint height_cells, guint id))
+
+/**
+ * chafa_term_info_emit_begin_kitty_immediate_image_temp_file_v1:
+ * @term_info: A #ChafaTermInfo
+ * @dest: String destination
+ * @bpp: Bits per pixel
+ * @width_pixels: Image width in pixels
+ * @height_pixels: Image height in pixels
+ * @width_cells: Target width in cells
+ * @height_cells: Target height in cells
+ * @id: Image ID
+ *
+ * Prints the control sequence for #CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_TEMP_FILE_V1.
+ *
+ * @dest must have enough space to hold
+ * #CHAFA_TERM_SEQ_LENGTH_MAX bytes, even if the emitted sequence is
+ * shorter. The output will not be zero-terminated.
+ *
+ * @bpp must be set to either 24 for RGB data, 32 for RGBA, or 100 to embed a
+ * PNG file.
+ *
+ * This sequence must be followed by the base-64 encoded path of a temporary
+ * file holding the image data, and then #CHAFA_TERM_SEQ_END_KITTY_IMAGE_CHUNK.
+ * The terminal will delete the file once it has been read, provided it is
+ * located in a temporary directory and its name contains the string
+ * "tty-graphics-protocol". This only works when the terminal is running on
+ * the same host.
+ *
+ * The image is assigned @id, and the terminal replies with
+ * #CHAFA_TERM_SEQ_KITTY_IMAGE_OK_V1 or #CHAFA_TERM_SEQ_KITTY_IMAGE_ERROR_V1.
+ * If the transfer fails, nothing is displayed, and the file may be left
+ * behind for the caller to clean up.
+ *
+ * Returns: Pointer to first byte after emitted string
+ *
+ * Since: 1.20
+ **/
+CHAFA_TERM_SEQ_DEF(begin_kitty_immediate_image_temp_file_v1, BEGIN_KITTY_IMMEDIATE_IMAGE_TEMP_FILE_V1, 6, none, guint, (CHAFA_TERM_SEQ_PFX, guint bpp, guint width_pixels, guint height_pixels, guint width_cells, guint height_cells, guint id))
+
+/**
+ * chafa_term_info_emit_begin_kitty_immediate_image_with_id_v1:
+ * @term_info: A #ChafaTermInfo
+ * @dest: String destination
+ * @bpp: Bits per pixel
+ * @width_pixels: Image width in pixels
+ * @height_pixels: Image height in pixels
+ * @width_cells: Target width in cells
+ * @height_cells: Target height in cells
+ * @id: Image ID
+ *
+ * Prints the control sequence for #CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_WITH_ID_V1.
+ *
+ * @dest must have enough space to hold
+ * #CHAFA_TERM_SEQ_LENGTH_MAX bytes, even if the emitted sequence is
+ * shorter. The output will not be zero-terminated.
+ *
+ * This is like #CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_V1, but assigns
+ * @id to the image so it can be referred to later, e.g. to add animation
+ * frames. Any existing image with the same ID will be replaced.
+ *
+ * Returns: Pointer to first byte after emitted string
+ *
+ * Since: 1.20
+ **/
+CHAFA_TERM_SEQ_DEF(begin_kitty_immediate_image_with_id_v1, BEGIN_KITTY_IMMEDIATE_IMAGE_WITH_ID_V1, 6, none, guint, (CHAFA_TERM_SEQ_PFX, guint bpp, guint width_pixels, guint height_pixels, guint width_cells, guint height_cells, guint id))
+
+/**
+ * chafa_term_info_emit_begin_kitty_animation_frame_v1:
+ * @term_info: A #ChafaTermInfo
+ * @dest: String destination
+ * @id: Image ID
+ * @bpp: Bits per pixel
+ * @x: Left edge of the updated rectangle, in pixels
+ * @y: Top edge of the updated rectangle, in pixels
+ * @width_pixels: Width of the updated rectangle in pixels
+ * @height_pixels: Height of the updated rectangle in pixels
+ * @base_frame: 1-based index of the frame to copy the remaining pixels from
+ *
+ * Prints the control sequence for #CHAFA_TERM_SEQ_BEGIN_KITTY_ANIMATION_FRAME_V1.
+ *
+ * @dest must have enough space to hold
+ * #CHAFA_TERM_SEQ_LENGTH_MAX bytes, even if the emitted sequence is
+ * shorter. The output will not be zero-terminated.
+ *
+ * This appends a new frame to the image with ID @id. The frame starts out
+ * as a copy of @base_frame, and the transferred pixels overwrite the given
+ * rectangle. The pixel data must be sent in the same way as for
+ * #CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_V1.
+ *
+ * Returns: Pointer to first byte after emitted string
+ *
+ * Since: 1.20
+ **/
+CHAFA_TERM_SEQ_DEF(begin_kitty_animation_frame_v1, BEGIN_KITTY_ANIMATION_FRAME_V1, 7, none, guint, (CHAFA_TERM_SEQ_PFX, guint id, guint bpp, guint x, guint y, guint width_pixels, guint height_pixels, guint base_frame))
+
+/**
+ * chafa_term_info_emit_set_kitty_animation_frame_v1:
+ * @term_info: A #ChafaTermInfo
+ * @dest: String destination
+ * @id: Image ID
+ * @frame: 1-based index of the frame to show
+ *
+ * Prints the control sequence for #CHAFA_TERM_SEQ_SET_KITTY_ANIMATION_FRAME_V1.
+ *
+ * @dest must have enough space to hold
+ * #CHAFA_TERM_SEQ_LENGTH_MAX bytes, even if the emitted sequence is
+ * shorter. The output will not be zero-terminated.
+ *
+ * Returns: Pointer to first byte after emitted string
+ *
+ * Since: 1.20
+ **/
+CHAFA_TERM_SEQ_DEF(set_kitty_animation_frame_v1, SET_KITTY_ANIMATION_FRAME_V1, 2, none, guint, (CHAFA_TERM_SEQ_PFX, guint id, guint frame))
+
+/**
+ * chafa_term_info_emit_set_kitty_animation_frame_gap_v1:
+ * @term_info: A #ChafaTermInfo
+ * @dest: String destination
+ * @id: Image ID
+ * @frame: 1-based index of the frame to modify
+ * @gap_ms: Time to show the frame for, in milliseconds
+ *
+ * Prints the control sequence for #CHAFA_TERM_SEQ_SET_KITTY_ANIMATION_FRAME_GAP_V1.
+ *
+ * @dest must have enough space to hold
+ * #CHAFA_TERM_SEQ_LENGTH_MAX bytes, even if the emitted sequence is
+ * shorter. The output will not be zero-terminated.
+ *
+ * Returns: Pointer to first byte after emitted string
+ *
+ * Since: 1.20
+ **/
+CHAFA_TERM_SEQ_DEF(set_kitty_animation_frame_gap_v1, SET_KITTY_ANIMATION_FRAME_GAP_V1, 3, none, guint, (CHAFA_TERM_SEQ_PFX, guint id, guint frame, guint gap_ms))
+
+/**
+ * chafa_term_info_emit_start_kitty_animation_v1:
+ * @term_info: A #ChafaTermInfo
+ * @dest: String destination
+ * @id: Image ID
+ * @n_loops: Number of times to play the animation plus one, or 1 to loop forever
+ *
+ * Prints the control sequence for #CHAFA_TERM_SEQ_START_KITTY_ANIMATION_V1.
+ *
+ * @dest must have enough space to hold
+ * #CHAFA_TERM_SEQ_LENGTH_MAX bytes, even if the emitted sequence is
+ * shorter. The output will not be zero-terminated.
+ *
+ * This makes the terminal play back the frames of image @id on its own,
+ * using the gaps set with #CHAFA_TERM_SEQ_SET_KITTY_ANIMATION_FRAME_GAP_V1.
+ *
+ * Returns: Pointer to first byte after emitted string
+ *
+ * Since: 1.20
+ **/
+CHAFA_TERM_SEQ_DEF(start_kitty_animation_v1, START_KITTY_ANIMATION_V1, 2, none, guint, (CHAFA_TERM_SEQ_PFX, guint id, guint n_loops))
+
+/**
+ * chafa_term_info_emit_stop_kitty_animation_v1:
+ * @term_info: A #ChafaTermInfo
+ * @dest: String destination
+ * @id: Image ID
+ *
+ * Prints the control sequence for #CHAFA_TERM_SEQ_STOP_KITTY_ANIMATION_V1.
+ *
+ * @dest must have enough space to hold
+ * #CHAFA_TERM_SEQ_LENGTH_MAX bytes, even if the emitted sequence is
+ * shorter. The output will not be zero-terminated.
+ *
+ * Returns: Pointer to first byte after emitted string
+ *
+ * Since: 1.20
+ **/
+CHAFA_TERM_SEQ_DEF(stop_kitty_animation_v1, STOP_KITTY_ANIMATION_V1, 1, none, guint, (CHAFA_TERM_SEQ_PFX, guint id))
+
+/**
+ * chafa_term_info_emit_put_kitty_image_v1:
+ * @term_info: A #ChafaTermInfo
+ * @dest: String destination
+ * @id: Image ID
+ * @width_cells: Target width in cells
+ * @height_cells: Target height in cells
+ *
+ * Prints the control sequence for #CHAFA_TERM_SEQ_PUT_KITTY_IMAGE_V1.
+ *
+ * @dest must have enough space to hold
+ * #CHAFA_TERM_SEQ_LENGTH_MAX bytes, even if the emitted sequence is
+ * shorter. The output will not be zero-terminated.
+ *
+ * This displays an image previously transmitted with
+ * #CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_WITH_ID_V1 at the cursor
+ * position, without sending the pixel data again.
+ *
+ * The terminal replies with #CHAFA_TERM_SEQ_KITTY_IMAGE_OK_V1, or with
+ * #CHAFA_TERM_SEQ_KITTY_IMAGE_ERROR_V1 if it no longer has the image.
+ *
+ * Returns: Pointer to first byte after emitted string
+ *
+ * Since: 1.20
+ **/
+CHAFA_TERM_SEQ_DEF(put_kitty_image_v1, PUT_KITTY_IMAGE_V1, 3, none, guint, (CHAFA_TERM_SEQ_PFX, guint id, guint width_cells, guint height_cells))
+
+/**
+ * chafa_term_info_emit_kitty_image_ok_v1:
+ * @term_info: A #ChafaTermInfo
+ * @dest: String destination
+ * @id: Image ID
+ *
+ * Prints the control sequence for #CHAFA_TERM_SEQ_KITTY_IMAGE_OK_V1.
+ *
+ * @dest must have enough space to hold
+ * #CHAFA_TERM_SEQ_LENGTH_MAX bytes, even if the emitted sequence is
+ * shorter. The output will not be zero-terminated.
+ *
+ * This is sent by the terminal when a command referring to image @id
+ * succeeded, unless the command asked it to be quiet.
+ *
+ * Returns: Pointer to first byte after emitted string
+ *
+ * Since: 1.20
+ **/
+CHAFA_TERM_SEQ_DEF(kitty_image_ok_v1, KITTY_IMAGE_OK_V1, 1, none, guint, (CHAFA_TERM_SEQ_PFX, guint id))
+
+/**
+ * chafa_term_info_emit_kitty_image_error_v1:
+ * @term_info: A #ChafaTermInfo
+ * @dest: String destination
+ * @id: Image ID
+ *
+ * Prints the control sequence for #CHAFA_TERM_SEQ_KITTY_IMAGE_ERROR_V1.
+ *
+ * @dest must have enough space to hold
+ * #CHAFA_TERM_SEQ_LENGTH_MAX bytes, even if the emitted sequence is
+ * shorter. The output will not be zero-terminated.
+ *
+ * This is sent by the terminal when a command referring to image @id
+ * failed, unless the command asked it to be quiet. It is followed by the
+ * rest of an error code, e.g. "NOENT", a colon, a human-readable message
+ * and #CHAFA_TERM_SEQ_END_KITTY_IMAGE_CHUNK. When parsing input, the
+ * remainder is skipped.
+ *
+ * Returns: Pointer to first byte after emitted string
+ *
+ * Since: 1.20
+ **/
+CHAFA_TERM_SEQ_DEF(kitty_image_error_v1, KITTY_IMAGE_ERROR_V1, 1, none, guint, (CHAFA_TERM_SEQ_PFX, guint id))
+
 #undef CHAFA_TERM_SEQ_AVAILABILITY
 #undef CHAFA_TERM_SEQ_PFX
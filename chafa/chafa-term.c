@@ -33,6 +33,8 @@
 #include <glib/gstdio.h>  /* g_open, g_close */
 
 #include "chafa.h"
+#include "internal/chafa-private.h"
+#include "internal/chafa-probe-cache.h"
 
 /* Include after glib.h for G_OS_WIN32 */
 #ifdef G_OS_WIN32
@@ -57,6 +59,22 @@
 /* Stack buffer size */
 #define READ_BUF_MAX 4096
 
+/* How much image data we assume the terminal will hold on to for us. Kitty's
+ * default quota is 320MB; stay below that, since we can't see its
+ * evictions. */
+#define KITTY_CACHE_BYTES_MAX (256 * 1024 * 1024)
+
+/* How long to wait for the terminal to acknowledge an image transfer */
+#define KITTY_REPLY_TIMEOUT_MS 1000
+
+typedef enum
+{
+    KITTY_REPLY_OK,
+    KITTY_REPLY_ERROR,
+    KITTY_REPLY_TIMEOUT
+}
+KittyReplyResult;
+
 struct ChafaTerm
 {
     ChafaTermInfo *term_info;
@@ -66,6 +84,11 @@ struct ChafaTerm
     ChafaStreamWriter *writer;
     ChafaStreamWriter *err_writer;
 
+    /* Images resident in the terminal. Only kept for console output, since
+     * anything else may be replayed out of order or to a different
+     * terminal. */
+    ChafaKittyCache *kitty_cache;
+
     gint width_cells, height_cells;
     gint width_px, height_px;
     gint cell_width_px, cell_height_px;
@@ -92,6 +115,24 @@ struct ChafaTerm
     /* TRUE if sixel capability was detected by the last probe */
     guint probe_found_sixel : 1;
 
+    /* TRUE if probe results may be shared with other processes */
+    guint probe_cache_enabled : 1;
+
+    /* TRUE if the current probe results were loaded from the cache */
+    guint probe_from_cache : 1;
+
+    /* TRUE if a local image transfer failed. We don't try again for the
+     * lifetime of the term */
+    guint kitty_local_failed : 1;
+
+    /* TRUE if the terminal didn't answer an image command in time. We stop
+     * issuing commands that need answers */
+    guint kitty_reply_timed_out : 1;
+
+    /* Identifies the terminal in the probe cache. NULL if not looked up
+     * yet, or if the terminal can't be identified. */
+    gchar *probe_cache_key;
+
     /* I/O bookkeeping */
 
     GQueue *event_queue;
@@ -567,6 +608,82 @@ handle_event (ChafaTerm *term, ChafaEvent *event)
     }
 }
 
+/* ----------- *
+ * Probe cache *
+ * ----------- */
+
+static const gchar *
+get_probe_cache_key (ChafaTerm *term)
+{
+    if (!term->probe_cache_key && term->reader)
+        term->probe_cache_key = chafa_probe_cache_get_key (chafa_stream_reader_get_fd (term->reader));
+
+    return term->probe_cache_key;
+}
+
+static gboolean
+load_cached_probe_results (ChafaTerm *term)
+{
+    ChafaProbeResults results;
+    const gchar *key;
+
+    key = get_probe_cache_key (term);
+    if (!key || !chafa_probe_cache_load (key, &results))
+        return FALSE;
+
+    if (!term->have_tty_size)
+        get_tty_size (term);
+
+    /* If the text area changed size, the font may have changed too. Let
+     * the caller probe again. */
+    if (results.width_cells != term->width_cells
+        || results.height_cells != term->height_cells)
+        return FALSE;
+
+    term->default_fg_rgb = results.default_fg_rgb;
+    term->default_bg_rgb = results.default_bg_rgb;
+
+    if (term->width_px <= 0 || term->height_px <= 0)
+    {
+        term->width_px = results.width_px;
+        term->height_px = results.height_px;
+    }
+
+    term->cell_width_px = results.cell_width_px;
+    term->cell_height_px = results.cell_height_px;
+
+    term->probe_found_sixel = results.found_sixel;
+    term->probe_attempt = TRUE;
+    term->probe_success = TRUE;
+    term->probe_from_cache = TRUE;
+
+    apply_probe_results (term);
+    return TRUE;
+}
+
+static void
+store_probe_results (ChafaTerm *term)
+{
+    ChafaProbeResults results;
+    const gchar *key;
+
+    key = get_probe_cache_key (term);
+    if (!key)
+        return;
+
+    results.default_fg_rgb = term->default_fg_rgb;
+    results.default_bg_rgb = term->default_bg_rgb;
+    results.width_cells = term->width_cells;
+    results.height_cells = term->height_cells;
+    results.width_px = term->width_px;
+    results.height_px = term->height_px;
+    results.cell_width_px = term->cell_width_px;
+    results.cell_height_px = term->cell_height_px;
+    results.found_sixel = term->probe_found_sixel;
+
+    chafa_probe_cache_store (key, &results);
+}
+
 /* ----------------------- *
  * Mid-level I/O machinery *
  * ----------------------- */
@@ -688,6 +805,9 @@ term_new_full (ChafaTermInfo *term_info, gint in_fd, gint out_fd, gint err_fd)
         && term->writer && chafa_stream_writer_is_console (term->writer))
         term->interactive_supported = TRUE;
 
+    if (term->writer && chafa_stream_writer_is_console (term->writer))
+        term->kitty_cache = chafa_kitty_cache_new (KITTY_CACHE_BYTES_MAX);
+
     get_tty_size (term);
     return term;
 }
@@ -733,6 +853,11 @@ chafa_term_destroy (ChafaTerm *term)
 
     g_queue_free_full (term->event_queue, g_free);
 
+    if (term->kitty_cache)
+        chafa_kitty_cache_destroy (term->kitty_cache);
+
+    g_free (term->probe_cache_key);
+
     chafa_term_info_unref (term->term_info);
     if (term->default_term_info)
         chafa_term_info_unref (term->default_term_info);
@@ -769,6 +894,18 @@ chafa_term_set_buffer_max (ChafaTerm *term, gint buf_max)
         chafa_stream_writer_set_buffer_max (term->writer, buf_max);
 }
 
+/* Must be called before any I/O is done on the terminal */
+void
+chafa_term_set_reactor (ChafaTerm *term, ChafaReactor *reactor)
+{
+    if (term->reader)
+        chafa_stream_reader_set_reactor (term->reader, reactor);
+    if (term->writer)
+        chafa_stream_writer_set_reactor (term->writer, reactor);
+    if (term->err_writer)
+        chafa_stream_writer_set_reactor (term->err_writer, reactor);
+}
+
 ChafaTermInfo *
 chafa_term_get_term_info (ChafaTerm *term)
 {
@@ -817,6 +954,15 @@ chafa_term_write (ChafaTerm *term, gconstpointer data, gint len)
     chafa_stream_writer_write (term->writer, data, len);
 }
 
+gboolean
+chafa_term_writev (ChafaTerm *term, const ChafaOutputVector *vectors, gint n_vectors)
+{
+    if (!term->writer)
+        return FALSE;
+
+    return chafa_stream_writer_writev (term->writer, vectors, n_vectors);
+}
+
 gint
 chafa_term_print (ChafaTerm *term, const gchar *format, ...)
 {
@@ -862,6 +1008,138 @@ chafa_term_print_seq (ChafaTerm *term, ChafaTermSeq seq, ...)
     return len;
 }
 
+/* We can only act on the terminal's replies if we can read them, and if
+ * our parser knows what they look like */
+static gboolean
+kitty_replies_usable (ChafaTerm *term)
+{
+    return term->interactive_supported
+        && !term->in_eof_seen
+        && !term->kitty_reply_timed_out
+        && chafa_term_info_have_seq (term->term_info, CHAFA_TERM_SEQ_KITTY_IMAGE_OK_V1)
+        && chafa_term_info_have_seq (term->term_info, CHAFA_TERM_SEQ_KITTY_IMAGE_ERROR_V1);
+}
+
+/* Waits for the terminal to reply to a command for image_id. Unrelated
+ * events are queued for chafa_term_read_event(). */
+static KittyReplyResult
+await_kitty_reply (ChafaTerm *term, guint32 image_id)
+{
+    ChafaEvent *event;
+    gint64 end_time;
+    gint remain_ms = KITTY_REPLY_TIMEOUT_MS;
+    KittyReplyResult result = KITTY_REPLY_TIMEOUT;
+#ifdef HAVE_TERMIOS_H
+    struct termios saved_termios;
+    gboolean termios_changed = FALSE;
+#endif
+
+    chafa_stream_writer_flush (term->writer);
+    end_time = g_get_monotonic_time () + remain_ms * 1000;
+
+#ifdef HAVE_TERMIOS_H
+    ensure_raw_mode_enabled (term, &saved_termios, &termios_changed);
+#endif
+
+    while ((event = in_sync_pull (term, remain_ms)))
+    {
+        ChafaTermSeq seq = chafa_event_get_seq (event);
+
+        if (seq == CHAFA_TERM_SEQ_KITTY_IMAGE_OK_V1
+            || seq == CHAFA_TERM_SEQ_KITTY_IMAGE_ERROR_V1)
+        {
+            /* Replies to earlier commands are of no use to anyone */
+            if ((guint32) chafa_event_get_seq_arg (event, 0) == image_id)
+            {
+                result = (seq == CHAFA_TERM_SEQ_KITTY_IMAGE_OK_V1)
+                    ? KITTY_REPLY_OK : KITTY_REPLY_ERROR;
+                chafa_event_destroy (event);
+                break;
+            }
+
+            chafa_event_destroy (event);
+        }
+        else
+        {
+            g_queue_push_head (term->event_queue, event);
+            handle_event (term, event);
+
+            if (term->in_eof_seen)
+                break;
+        }
+
+        remain_ms = (end_time - g_get_monotonic_time ()) / 1000;
+        if (remain_ms <= 0)
+            break;
+    }
+
+#ifdef HAVE_TERMIOS_H
+    restore_termios (term, &saved_termios, &termios_changed);
+#endif
+
+    return result;
+}
+
+/* Like chafa_canvas_print(), but reuses images already transmitted to this
+ * terminal when possible. If term_info is NULL, the terminal's own is used.
+ *
+ * If the canvas config allows it, images may be transferred through shared
+ * memory or a temporary file. We wait for the terminal to confirm those,
+ * and for placements of images we think it has. If it couldn't read the
+ * image or no longer has it, nothing was displayed, so we send it again. */
+void
+chafa_term_print_canvas (ChafaTerm *term, ChafaCanvas *canvas, ChafaTermInfo *term_info)
+{
+    ChafaKittyReply reply;
+
+    if (!term->writer)
+        return;
+
+    if (!term_info)
+        term_info = term->term_info;
+
+    /* Each retry rules out the command that failed, so this ends with an
+     * inline transfer at the latest */
+    for (;;)
+    {
+        gboolean want_reply = kitty_replies_usable (term);
+        KittyReplyResult result;
+        GString *gs;
+
+        reply.image_id = 0;
+
+        gs = chafa_canvas_print_with_kitty_cache (canvas, term_info, term->kitty_cache,
+                                                  !term->kitty_local_failed,
+                                                  want_reply ? &reply : NULL);
+        if (gs->len > 0)
+            chafa_stream_writer_write (term->writer, gs->str, gs->len);
+
+        g_string_free (gs, TRUE);
+
+        if (reply.image_id == 0)
+            break;
+
+        result = await_kitty_reply (term, reply.image_id);
+        if (result == KITTY_REPLY_OK)
+            break;
+
+        if (result == KITTY_REPLY_TIMEOUT)
+        {
+            /* If the reply is merely late, the image may end up being shown
+             * twice. That's better than not at all. */
+            term->kitty_reply_timed_out = TRUE;
+        }
+        else if (reply.is_local)
+        {
+            /* The terminal is probably on a different host */
+            term->kitty_local_failed = TRUE;
+        }
+
+        if (term->kitty_cache)
+            chafa_kitty_cache_remove (term->kitty_cache, reply.image_id);
+    }
+}
+
 gboolean
 chafa_term_flush (ChafaTerm *term)
 {
@@ -949,6 +1227,9 @@ chafa_term_sync_probe (ChafaTerm *term, gint timeout_ms)
     if (!term->interactive_supported)
         return FALSE;
 
+    if (term->probe_cache_enabled && load_cached_probe_results (term))
+        return TRUE;
+
     if (timeout_ms > 0)
         start_time = g_get_monotonic_time ();
 
@@ -990,13 +1271,44 @@ out:
     restore_termios (term, &saved_termios, &termios_changed);
 #endif
 
+    if (term->probe_success && term->probe_cache_enabled)
+        store_probe_results (term);
+
     return term->probe_success;
 }
 
 void
 chafa_term_notify_size_changed (ChafaTerm *term)
 {
+    gint old_width_cells = term->width_cells;
+    gint old_height_cells = term->height_cells;
+
     get_tty_size (term);
+
+    /* Cached results are only good for the size they were probed at. Drop
+     * the entry, so the next sync probe will be a real one. */
+    if (term->probe_from_cache
+        && (term->width_cells != old_width_cells
+            || term->height_cells != old_height_cells))
+    {
+        chafa_probe_cache_remove (term->probe_cache_key);
+        term->probe_from_cache = FALSE;
+        term->probe_success = FALSE;
+    }
+}
+
+/* Probe results are cached in $XDG_RUNTIME_DIR and shared with other
+ * processes using the same terminal. Disabled by default. */
+void
+chafa_term_set_probe_cache_enabled (ChafaTerm *term, gboolean enabled)
+{
+    term->probe_cache_enabled = enabled ? TRUE : FALSE;
+}
+
+gboolean
+chafa_term_get_probe_cache_enabled (ChafaTerm *term)
+{
+    return term->probe_cache_enabled;
 }
 
 gint32
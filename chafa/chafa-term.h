@@ -44,6 +44,9 @@ gint chafa_term_get_buffer_max (ChafaTerm *term);
 CHAFA_AVAILABLE_IN_1_20
 void chafa_term_set_buffer_max (ChafaTerm *term, gint max);
 
+CHAFA_AVAILABLE_IN_1_20
+void chafa_term_set_reactor (ChafaTerm *term, ChafaReactor *reactor);
+
 CHAFA_AVAILABLE_IN_1_20
 ChafaTermInfo *chafa_term_get_term_info (ChafaTerm *term);
 CHAFA_AVAILABLE_IN_1_20
@@ -55,10 +58,14 @@ ChafaEvent *chafa_term_read_event (ChafaTerm *term, guint timeout_ms);
 CHAFA_AVAILABLE_IN_1_20
 void chafa_term_write (ChafaTerm *term, gconstpointer data, gint len);
 CHAFA_AVAILABLE_IN_1_20
+gboolean chafa_term_writev (ChafaTerm *term, const ChafaOutputVector *vectors, gint n_vectors);
+CHAFA_AVAILABLE_IN_1_20
 gint chafa_term_print (ChafaTerm *term, const gchar *format, ...) G_GNUC_PRINTF (2, 3);
 CHAFA_AVAILABLE_IN_1_20
 gint chafa_term_print_seq (ChafaTerm *term, ChafaTermSeq seq, ...);
 CHAFA_AVAILABLE_IN_1_20
+void chafa_term_print_canvas (ChafaTerm *term, ChafaCanvas *canvas, ChafaTermInfo *term_info);
+CHAFA_AVAILABLE_IN_1_20
 gboolean chafa_term_flush (ChafaTerm *term);
 
 CHAFA_AVAILABLE_IN_1_20
@@ -77,6 +84,11 @@ gboolean chafa_term_sync_probe (ChafaTerm *term, gint timeout_ms);
 CHAFA_AVAILABLE_IN_1_20
 void chafa_term_notify_size_changed (ChafaTerm *term);
 
+CHAFA_AVAILABLE_IN_1_20
+void chafa_term_set_probe_cache_enabled (ChafaTerm *term, gboolean enabled);
+CHAFA_AVAILABLE_IN_1_20
+gboolean chafa_term_get_probe_cache_enabled (ChafaTerm *term);
+
 CHAFA_AVAILABLE_IN_1_20
 gint32 chafa_term_get_default_fg_color (ChafaTerm *term);
 CHAFA_AVAILABLE_IN_1_20
@@ -40,6 +40,7 @@ G_BEGIN_DECLS
 #include <chafa-term-db.h>
 #include <chafa-util.h>
 #include <chafa-parser.h>
+#include <chafa-reactor.h>
 #include <chafa-stream-reader.h>
 #include <chafa-stream-writer.h>
 #include <chafa-term.h>
@@ -163,3 +163,159 @@ chafa_color_accum_div_scalar_avx2 (ChafaColorAccum *accum, guint16 divisor)
     accum_u64 = extract_128_epi64 (accum_128, 0);
     memcpy (accum, &accum_u64, sizeof (guint64));
 }
+
+/* Computes the sixel characters for a single pen over a six-row band of
+ * indexed pixels. Each row of the band is width bytes long, and the rows are
+ * consecutive in memory. The pen's six rows are compared 32 columns at a
+ * time and the resulting masks are combined into bitplanes; bit n of each
+ * output character corresponds to row n of the band.
+ *
+ * If mask is not NULL, it holds one byte per column, and the pen's bits are
+ * cleared wherever the corresponding mask bits are clear.
+ *
+ * Returns the number of columns up to and including the rightmost one where
+ * the pen occurs, or 0 if the pen is not present in the band at all. */
+gint
+chafa_sixel_band_to_schars_avx2 (const guint8 *pixels, gint width, guint8 pen,
+                                 const guint8 *mask, guint8 *schars_out)
+{
+    const __m256i pen_32x = _mm256_set1_epi8 ((gchar) pen);
+    const __m256i blank_32x = _mm256_set1_epi8 ('?');
+    const __m256i zero_32x = _mm256_setzero_si256 ();
+    __m256i bit_32x [6];
+    gint n_used = 0;
+    gint x, i;
+
+    for (i = 0; i < 6; i++)
+        bit_32x [i] = _mm256_set1_epi8 (1 << i);
+
+    for (x = 0; x + 32 <= width; x += 32)
+    {
+        __m256i acc_32x = zero_32x;
+        guint32 blank_mask;
+
+        for (i = 0; i < 6; i++)
+        {
+            __m256i row_32x = _mm256_loadu_si256 ((const __m256i *) (pixels + (gsize) i * width + x));
+            acc_32x = _mm256_or_si256 (acc_32x,
+                                       _mm256_and_si256 (_mm256_cmpeq_epi8 (row_32x, pen_32x),
+                                                         bit_32x [i]));
+        }
+
+        if (mask)
+            acc_32x = _mm256_and_si256 (acc_32x, _mm256_loadu_si256 ((const __m256i *) (mask + x)));
+
+        _mm256_storeu_si256 ((__m256i *) (schars_out + x), _mm256_add_epi8 (acc_32x, blank_32x));
+
+        /* OR-reduction; any nonzero byte means the pen is present here */
+        blank_mask = (guint32) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (acc_32x, zero_32x));
+        if (blank_mask != 0xffffffff)
+            n_used = x + 32 - __builtin_clz (~blank_mask);
+    }
+
+    for ( ; x < width; x++)
+    {
+        guint8 c = 0;
+
+        for (i = 0; i < 6; i++)
+            c |= (pixels [(gsize) i * width + x] == pen) << i;
+
+        if (mask)
+            c &= mask [x];
+
+        schars_out [x] = '?' + c;
+        if (c)
+            n_used = x + 1;
+    }
+
+    return n_used;
+}
+
+/* Returns the index of the first byte in p [start..end) that differs from
+ * p [start], or end if the run extends to the end of the range. */
+gint
+chafa_find_byte_run_end_avx2 (const guint8 *p, gint start, gint end)
+{
+    const __m256i c_32x = _mm256_set1_epi8 ((gchar) p [start]);
+    gint i;
+
+    for (i = start + 1; i + 32 <= end; i += 32)
+    {
+        guint32 diff_mask = ~(guint32) _mm256_movemask_epi8 (
+            _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) (p + i)), c_32x));
+
+        if (diff_mask)
+            return i + __builtin_ctz (diff_mask);
+    }
+
+    for ( ; i < end; i++)
+    {
+        if (p [i] != p [start])
+            break;
+    }
+
+    return i;
+}
+
+/* Base64 encoding, 24 input bytes to 32 output bytes at a time. Each 128-bit
+ * lane does the same work as the SSE4.1 version. */
+
+static inline __m256i
+base64_reshuffle_avx2 (__m256i in)
+{
+    __m256i t0, t1, t2, t3;
+
+    in = _mm256_shuffle_epi8 (in, _mm256_set_epi8 (10, 11,  9, 10,
+                                                   7,  8,  6,  7,
+                                                   4,  5,  3,  4,
+                                                   1,  2,  0,  1,
+                                                   10, 11,  9, 10,
+                                                   7,  8,  6,  7,
+                                                   4,  5,  3,  4,
+                                                   1,  2,  0,  1));
+
+    t0 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x0fc0fc00));
+    t1 = _mm256_mulhi_epu16 (t0, _mm256_set1_epi32 (0x04000040));
+    t2 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x003f03f0));
+    t3 = _mm256_mullo_epi16 (t2, _mm256_set1_epi32 (0x01000010));
+
+    return _mm256_or_si256 (t1, t3);
+}
+
+static inline __m256i
+base64_translate_avx2 (__m256i in)
+{
+    const __m256i lut = _mm256_setr_epi8 (65, 71, -4, -4, -4, -4, -4, -4,
+                                          -4, -4, -4, -4, -19, -16, 0, 0,
+                                          65, 71, -4, -4, -4, -4, -4, -4,
+                                          -4, -4, -4, -4, -19, -16, 0, 0);
+    __m256i indices, mask;
+
+    indices = _mm256_subs_epu8 (in, _mm256_set1_epi8 (51));
+    mask = _mm256_cmpgt_epi8 (in, _mm256_set1_epi8 (25));
+    indices = _mm256_sub_epi8 (indices, mask);
+
+    return _mm256_add_epi8 (in, _mm256_shuffle_epi8 (lut, indices));
+}
+
+/* Same contract as chafa_base64_encode_sse41 (). */
+gsize
+chafa_base64_encode_avx2 (const guint8 *in, gsize in_len, gchar *out)
+{
+    gsize i;
+
+    /* The second lane's load reaches 28 bytes past the start */
+    for (i = 0; i + 28 <= in_len; i += 24)
+    {
+        __m256i t;
+
+        t = _mm256_inserti128_si256 (_mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *) (in + i))),
+                                     _mm_loadu_si128 ((const __m128i *) (in + i + 12)),
+                                     1);
+        t = base64_translate_avx2 (base64_reshuffle_avx2 (t));
+        _mm256_storeu_si256 ((__m256i *) out, t);
+        out += 32;
+    }
+
+    return i;
+}
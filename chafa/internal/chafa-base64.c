@@ -24,6 +24,21 @@
 
 #include "chafa.h"
 #include "internal/chafa-base64.h"
+#include "internal/chafa-batch.h"
+#include "internal/chafa-private.h"
+
+/* Inputs bigger than this are split into blocks that are encoded in
+ * parallel. Block length must be a multiple of 3. */
+#define PARALLEL_LEN_MIN (1 << 20)
+#define PARALLEL_BLOCK_LEN (3 * 65536)
+
+typedef struct
+{
+    const guint8 *in;
+    gsize in_len;
+    gchar *out;
+}
+EncodeCtx;
 
 static const gchar base64_dict [] =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -43,13 +58,103 @@ chafa_base64_deinit (ChafaBase64 *base64)
     base64->buf_len = -1;
 }
 
+static inline gchar *
+encode_3_bytes (gchar *out, guint32 bytes)
+{
+    out [0] = base64_dict [(bytes >> (3 * 6)) & 0x3f];
+    out [1] = base64_dict [(bytes >> (2 * 6)) & 0x3f];
+    out [2] = base64_dict [(bytes >> (1 * 6)) & 0x3f];
+    out [3] = base64_dict [bytes & 0x3f];
+    return out + 4;
+}
+
+/* Encodes whole 3-byte groups. in_len must be a multiple of 3. */
+static gchar *
+encode_groups (const guint8 *in, gsize in_len, gchar *out)
+{
+    const guint8 *end = in + in_len;
+    gsize n = 0;
+
+#ifdef HAVE_AVX2_INTRINSICS
+    if (chafa_have_avx2 ())
+        n = chafa_base64_encode_avx2 (in, in_len, out);
+#endif
+#ifdef HAVE_SSE41_INTRINSICS
+    if (n == 0 && chafa_have_sse41 ())
+        n = chafa_base64_encode_sse41 (in, in_len, out);
+#endif
+
+    in += n;
+    out += (n / 3) * 4;
+
+    for ( ; in < end; in += 3)
+        out = encode_3_bytes (out, (in [0] << 16) | (in [1] << 8) | in [2]);
+
+    return out;
+}
+
+static gchar *
+encode_tail (const guint8 *in, gsize in_len, gchar *out)
+{
+    if (in_len == 1)
+    {
+        *(out++) = base64_dict [in [0] >> 2];
+        *(out++) = base64_dict [(in [0] << 4) & 0x30];
+        *(out++) = '=';
+        *(out++) = '=';
+    }
+    else if (in_len == 2)
+    {
+        *(out++) = base64_dict [in [0] >> 2];
+        *(out++) = base64_dict [((in [0] << 4) | (in [1] >> 4)) & 0x3f];
+        *(out++) = base64_dict [(in [1] << 2) & 0x3c];
+        *(out++) = '=';
+    }
+
+    return out;
+}
+
+static void
+encode_worker (ChafaBatchInfo *batch, const EncodeCtx *ctx)
+{
+    gsize ofs = (gsize) batch->first_row * PARALLEL_BLOCK_LEN;
+    gsize len = MIN ((gsize) batch->n_rows * PARALLEL_BLOCK_LEN, ctx->in_len - ofs);
+
+    encode_groups (ctx->in + ofs, len, ctx->out + (ofs / 3) * 4);
+}
+
+/* Like encode_groups (), but uses the thread pool for large inputs */
 static void
-encode_3_bytes (GString *gs_out, guint32 bytes)
+encode_groups_parallel (const guint8 *in, gsize in_len, gchar *out)
 {
-    g_string_append_c (gs_out, base64_dict [(bytes >> (3 * 6)) & 0x3f]);
-    g_string_append_c (gs_out, base64_dict [(bytes >> (2 * 6)) & 0x3f]);
-    g_string_append_c (gs_out, base64_dict [(bytes >> (1 * 6)) & 0x3f]);
-    g_string_append_c (gs_out, base64_dict [bytes & 0x3f]);
+    EncodeCtx ctx;
+
+    if (in_len < PARALLEL_LEN_MIN)
+    {
+        encode_groups (in, in_len, out);
+        return;
+    }
+
+    ctx.in = in;
+    ctx.in_len = in_len;
+    ctx.out = out;
+
+    chafa_process_batches (&ctx,
+                           (GFunc) encode_worker,
+                           NULL,
+                           (in_len + PARALLEL_BLOCK_LEN - 1) / PARALLEL_BLOCK_LEN,
+                           chafa_get_n_actual_threads (),
+                           1);
+}
+
+gchar *
+chafa_base64_encode_buf (gconstpointer in, gsize in_len, gchar *out)
+{
+    const guint8 *in_u8 = in;
+    gsize n = (in_len / 3) * 3;
+
+    out = encode_groups (in_u8, n, out);
+    return encode_tail (in_u8 + n, in_len - n, out);
 }
 
 void
@@ -57,7 +162,8 @@ chafa_base64_encode (ChafaBase64 *base64, GString *gs_out, gconstpointer in, gsi
 {
     const guint8 *in_u8 = in;
     const guint8 *end_u8 = in_u8 + in_len;
-    guint32 r;
+    gchar out [4];
+    gsize n;
 
     if (base64->buf_len + in_len < 3)
     {
@@ -68,24 +174,28 @@ chafa_base64_encode (ChafaBase64 *base64, GString *gs_out, gconstpointer in, gsi
 
     if (base64->buf_len == 1)
     {
-        r = (base64->buf [0] << 16) | (in_u8 [0] << 8) | in_u8 [1];
+        encode_3_bytes (out, (base64->buf [0] << 16) | (in_u8 [0] << 8) | in_u8 [1]);
+        g_string_append_len (gs_out, out, 4);
         in_u8 += 2;
-        encode_3_bytes (gs_out, r);
     }
     else if (base64->buf_len == 2)
     {
-        r = (base64->buf [0] << 16) | (base64->buf [1] << 8) | in_u8 [0];
+        encode_3_bytes (out, (base64->buf [0] << 16) | (base64->buf [1] << 8) | in_u8 [0]);
+        g_string_append_len (gs_out, out, 4);
         in_u8++;
-        encode_3_bytes (gs_out, r);
     }
 
     base64->buf_len = 0;
 
-    while (end_u8 - in_u8 >= 3)
+    /* Encode straight into the string's buffer */
+    n = ((end_u8 - in_u8) / 3) * 3;
+    if (n > 0)
     {
-        r = (in_u8 [0] << 16) | (in_u8 [1] << 8) | in_u8 [2];
-        encode_3_bytes (gs_out, r);
-        in_u8 += 3;
+        gsize ofs = gs_out->len;
+
+        g_string_set_size (gs_out, ofs + (n / 3) * 4);
+        encode_groups_parallel (in_u8, n, gs_out->str + ofs);
+        in_u8 += n;
     }
 
     while (end_u8 - in_u8 > 0)
@@ -97,19 +207,11 @@ chafa_base64_encode (ChafaBase64 *base64, GString *gs_out, gconstpointer in, gsi
 void
 chafa_base64_encode_end (ChafaBase64 *base64, GString *gs_out)
 {
-    if (base64->buf_len == 1)
-    {
-        g_string_append_c (gs_out, base64_dict [base64->buf [0] >> 2]);
-        g_string_append_c (gs_out, base64_dict [(base64->buf [0] << 4) & 0x30]);
-        g_string_append (gs_out, "==");
-    }
-    else if (base64->buf_len == 2)
-    {
-        g_string_append_c (gs_out, base64_dict [base64->buf [0] >> 2]);
-        g_string_append_c (gs_out, base64_dict [((base64->buf [0] << 4) | (base64->buf [1] >> 4)) & 0x3f]);
-        g_string_append_c (gs_out, base64_dict [(base64->buf [1] << 2) & 0x3c]);
-        g_string_append_c (gs_out, '=');
-    }
+    gchar out [4];
+    gchar *p;
+
+    p = encode_tail (base64->buf, base64->buf_len, out);
+    g_string_append_len (gs_out, out, p - out);
 
     base64->buf_len = 0;
 }
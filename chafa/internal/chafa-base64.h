@@ -34,12 +34,21 @@ typedef struct
 }
 ChafaBase64;
 
+/* Length of the encoded output for a given input length, including padding */
+#define CHAFA_BASE64_ENCODED_LEN(in_len) ((((gsize) (in_len) + 2) / 3) * 4)
+
 void chafa_base64_init (ChafaBase64 *base64);
 void chafa_base64_deinit (ChafaBase64 *base64);
 
 void chafa_base64_encode (ChafaBase64 *base64, GString *gs_out, gconstpointer in, gsize in_len);
 void chafa_base64_encode_end (ChafaBase64 *base64, GString *gs_out);
 
+/* Encodes a complete buffer, with padding, into out, which must have room
+ * for CHAFA_BASE64_ENCODED_LEN (in_len) bytes. The output is not
+ * terminated. Returns a pointer to the first byte after the output. This is
+ * safe to call from worker threads. */
+gchar *chafa_base64_encode_buf (gconstpointer in, gsize in_len, gchar *out);
+
 G_END_DECLS
 
 #endif /* __CHAFA_BASE64_H__ */
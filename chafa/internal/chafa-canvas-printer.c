@@ -20,8 +20,37 @@
 #include "config.h"
 
 #include "chafa.h"
+#include "internal/chafa-batch.h"
 #include "internal/chafa-canvas-printer.h"
 
+/* Formatted color sequences longer than this are not kept in the tables.
+ * Typical SGR sequences are well below it. */
+#define SGR_STR_MAX 31
+
+/* Smallest number of cells worth handing to a separate batch. Below this,
+ * the thread pool overhead outweighs the gains. */
+#define BATCH_CELLS_MIN 4096
+
+typedef struct
+{
+    guint8 len;
+    gchar str [SGR_STR_MAX];
+}
+SgrStr;
+
+/* Color sequences for the indexed modes, formatted when a pen is first
+ * used. In 16- and 8-color modes, pairs are indexed by fg * 16 + bg. In
+ * 256-color mode there are too many pairs, so each one is assembled from a
+ * head formatted for the foreground and a tail for the background. */
+typedef struct
+{
+    SgrStr fg [256];
+    SgrStr bg [256];
+    SgrStr pair [256];
+    SgrStr tail [256];
+}
+SgrTables;
+
 typedef struct
 {
     ChafaCanvas *canvas;
@@ -37,6 +66,10 @@ typedef struct
     /* For direct-color mode */
     ChafaColor cur_fg_direct;
     ChafaColor cur_bg_direct;
+
+    /* For indexed modes; see emit_color() */
+    SgrTables *sgr;
+    guint sgr_have_split : 1;
 }
 PrintCtx;
 
@@ -53,6 +86,200 @@ threshold_alpha (ChafaColor col, gint alpha_threshold)
     return col;
 }
 
+static gchar *
+format_color (ChafaTermInfo *ti, gchar *out, ChafaTermSeq seq, guint8 fg, guint8 bg)
+{
+    switch (seq)
+    {
+        case CHAFA_TERM_SEQ_SET_COLOR_FGBG_256:
+            return chafa_term_info_emit_set_color_fgbg_256 (ti, out, fg, bg);
+        case CHAFA_TERM_SEQ_SET_COLOR_FG_256:
+            return chafa_term_info_emit_set_color_fg_256 (ti, out, fg);
+        case CHAFA_TERM_SEQ_SET_COLOR_BG_256:
+            return chafa_term_info_emit_set_color_bg_256 (ti, out, bg);
+        case CHAFA_TERM_SEQ_SET_COLOR_FGBG_16:
+            return chafa_term_info_emit_set_color_fgbg_16 (ti, out, fg, bg);
+        case CHAFA_TERM_SEQ_SET_COLOR_FG_16:
+            return chafa_term_info_emit_set_color_fg_16 (ti, out, fg);
+        case CHAFA_TERM_SEQ_SET_COLOR_BG_16:
+            return chafa_term_info_emit_set_color_bg_16 (ti, out, bg);
+        case CHAFA_TERM_SEQ_SET_COLOR_FGBG_8:
+            return chafa_term_info_emit_set_color_fgbg_8 (ti, out, fg, bg);
+        case CHAFA_TERM_SEQ_SET_COLOR_FG_8:
+            return chafa_term_info_emit_set_color_fg_8 (ti, out, fg);
+        case CHAFA_TERM_SEQ_SET_COLOR_BG_8:
+            return chafa_term_info_emit_set_color_bg_8 (ti, out, bg);
+        default:
+            g_assert_not_reached ();
+    }
+
+    return out;
+}
+
+static void
+set_sgr_str (SgrStr *s, const gchar *str, gint len)
+{
+    if (len > SGR_STR_MAX)
+        return;
+
+    memcpy (s->str, str, len);
+    s->len = len;
+}
+
+/* Finds where the background part of the 256-color pair sequence starts,
+ * by comparing two sequences that differ only in the background. This
+ * works if the foreground is formatted before the background. Other
+ * orders are caught when heads and tails are checked in emit_fgbg_256 (). */
+static void
+split_fgbg_256 (PrintCtx *ctx)
+{
+    gchar a [CHAFA_TERM_SEQ_LENGTH_MAX];
+    gchar b [CHAFA_TERM_SEQ_LENGTH_MAX];
+    gint a_len, b_len, i;
+
+    a_len = format_color (ctx->term_info, a, CHAFA_TERM_SEQ_SET_COLOR_FGBG_256, 0, 0) - a;
+    b_len = format_color (ctx->term_info, b, CHAFA_TERM_SEQ_SET_COLOR_FGBG_256, 0, 1) - b;
+
+    for (i = 0; i < a_len && i < b_len && a [i] == b [i]; i++)
+        ;
+
+    if (i == 0 || i > SGR_STR_MAX || a_len - i > SGR_STR_MAX)
+        return;
+
+    set_sgr_str (&ctx->sgr->pair [0], a, i);
+    set_sgr_str (&ctx->sgr->tail [0], a + i, a_len - i);
+    ctx->sgr_have_split = TRUE;
+}
+
+static void
+init_print_ctx (PrintCtx *ctx, ChafaCanvas *canvas, ChafaTermInfo *ti)
+{
+    memset (ctx, 0, sizeof (*ctx));
+    ctx->canvas = canvas;
+    ctx->term_info = ti;
+
+    switch (canvas->config.canvas_mode)
+    {
+        case CHAFA_CANVAS_MODE_INDEXED_256:
+        case CHAFA_CANVAS_MODE_INDEXED_240:
+            ctx->sgr = g_new0 (SgrTables, 1);
+            split_fgbg_256 (ctx);
+            break;
+        case CHAFA_CANVAS_MODE_INDEXED_16:
+        case CHAFA_CANVAS_MODE_INDEXED_16_8:
+        case CHAFA_CANVAS_MODE_INDEXED_8:
+            ctx->sgr = g_new0 (SgrTables, 1);
+            break;
+        default:
+            break;
+    }
+}
+
+static void
+deinit_print_ctx (PrintCtx *ctx)
+{
+    g_free (ctx->sgr);
+    ctx->sgr = NULL;
+}
+
+G_GNUC_WARN_UNUSED_RESULT static gchar *
+copy_sgr_str (gchar *out, const SgrStr *s)
+{
+    /* Copying the whole string is faster than a variable-length copy.
+     * There's always room, since each cell reserves
+     * CHAFA_TERM_SEQ_LENGTH_MAX bytes per sequence. */
+    memcpy (out, s->str, SGR_STR_MAX);
+    return out + s->len;
+}
+
+G_GNUC_WARN_UNUSED_RESULT static gchar *
+emit_fgbg_256 (PrintCtx *ctx, gchar *out, guint8 fg, guint8 bg)
+{
+    SgrStr *head = &ctx->sgr->pair [fg];
+    SgrStr *tail = &ctx->sgr->tail [bg];
+    gchar buf [CHAFA_TERM_SEQ_LENGTH_MAX];
+    gint len;
+
+    if (!ctx->sgr_have_split)
+        return format_color (ctx->term_info, out, CHAFA_TERM_SEQ_SET_COLOR_FGBG_256, fg, bg);
+
+    /* The head for fg must be followed by the tail for bg 0, and the
+     * tail for bg must follow the head for fg 0 */
+    if (head->len == 0)
+    {
+        const SgrStr *tail_0 = &ctx->sgr->tail [0];
+
+        len = format_color (ctx->term_info, buf, CHAFA_TERM_SEQ_SET_COLOR_FGBG_256, fg, 0) - buf;
+        if (len < tail_0->len
+            || memcmp (buf + len - tail_0->len, tail_0->str, tail_0->len))
+        {
+            ctx->sgr_have_split = FALSE;
+            return format_color (ctx->term_info, out, CHAFA_TERM_SEQ_SET_COLOR_FGBG_256, fg, bg);
+        }
+
+        set_sgr_str (head, buf, len - tail_0->len);
+        if (head->len == 0)
+            return format_color (ctx->term_info, out, CHAFA_TERM_SEQ_SET_COLOR_FGBG_256, fg, bg);
+    }
+
+    if (tail->len == 0 && bg != 0)
+    {
+        const SgrStr *head_0 = &ctx->sgr->pair [0];
+
+        len = format_color (ctx->term_info, buf, CHAFA_TERM_SEQ_SET_COLOR_FGBG_256, 0, bg) - buf;
+        if (len < head_0->len
+            || memcmp (buf, head_0->str, head_0->len))
+        {
+            ctx->sgr_have_split = FALSE;
+            return format_color (ctx->term_info, out, CHAFA_TERM_SEQ_SET_COLOR_FGBG_256, fg, bg);
+        }
+
+        set_sgr_str (tail, buf + head_0->len, len - head_0->len);
+        if (tail->len == 0 && len > head_0->len)
+            return format_color (ctx->term_info, out, CHAFA_TERM_SEQ_SET_COLOR_FGBG_256, fg, bg);
+    }
+
+    out = copy_sgr_str (out, head);
+    return copy_sgr_str (out, tail);
+}
+
+/* Emits an indexed color sequence, formatting it only the first time a
+ * pen or pair is used. Unused arguments must be zero. */
+G_GNUC_WARN_UNUSED_RESULT static gchar *
+emit_color (PrintCtx *ctx, gchar *out, ChafaTermSeq seq, guint8 fg, guint8 bg)
+{
+    SgrStr *s;
+    gchar *end;
+
+    switch (seq)
+    {
+        case CHAFA_TERM_SEQ_SET_COLOR_FGBG_256:
+            return emit_fgbg_256 (ctx, out, fg, bg);
+        case CHAFA_TERM_SEQ_SET_COLOR_FG_256:
+        case CHAFA_TERM_SEQ_SET_COLOR_FG_16:
+        case CHAFA_TERM_SEQ_SET_COLOR_FG_8:
+            s = &ctx->sgr->fg [fg];
+            break;
+        case CHAFA_TERM_SEQ_SET_COLOR_BG_256:
+        case CHAFA_TERM_SEQ_SET_COLOR_BG_16:
+        case CHAFA_TERM_SEQ_SET_COLOR_BG_8:
+            s = &ctx->sgr->bg [bg];
+            break;
+        default:
+            if (fg > 15 || bg > 15)
+                return format_color (ctx->term_info, out, seq, fg, bg);
+            s = &ctx->sgr->pair [fg * 16 + bg];
+            break;
+    }
+
+    if (s->len != 0)
+        return copy_sgr_str (out, s);
+
+    end = format_color (ctx->term_info, out, seq, fg, bg);
+    set_sgr_str (s, out, end - out);
+    return end;
+}
+
 G_GNUC_WARN_UNUSED_RESULT static gchar *
 flush_chars (PrintCtx *ctx, gchar *out)
 {
@@ -298,18 +525,18 @@ emit_attributes_256 (PrintCtx *ctx, gchar *out,
             if (bg != ctx->cur_bg && bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
             {
                 out = flush_chars (ctx, out);
-                out = chafa_term_info_emit_set_color_fgbg_256 (ctx->term_info, out, fg, bg);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FGBG_256, fg, bg);
             }
             else if (fg != CHAFA_PALETTE_INDEX_TRANSPARENT)
             {
                 out = flush_chars (ctx, out);
-                out = chafa_term_info_emit_set_color_fg_256 (ctx->term_info, out, fg);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FG_256, fg, 0);
             }
         }
         else if (bg != ctx->cur_bg && bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
         {
             out = flush_chars (ctx, out);
-            out = chafa_term_info_emit_set_color_bg_256 (ctx->term_info, out, bg);
+            out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_BG_256, 0, bg);
         }
     }
     else
@@ -323,16 +550,16 @@ emit_attributes_256 (PrintCtx *ctx, gchar *out,
         {
             if (bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
             {
-                out = chafa_term_info_emit_set_color_fgbg_256 (ctx->term_info, out, fg, bg);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FGBG_256, fg, bg);
             }
             else
             {
-                out = chafa_term_info_emit_set_color_fg_256 (ctx->term_info, out, fg);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FG_256, fg, 0);
             }
         }
         else if (bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
         {
-            out = chafa_term_info_emit_set_color_bg_256 (ctx->term_info, out, bg);
+            out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_BG_256, 0, bg);
         }
     }
 
@@ -390,18 +617,18 @@ emit_attributes_16 (PrintCtx *ctx, gchar *out,
             if (bg != ctx->cur_bg && bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
             {
                 out = flush_chars (ctx, out);
-                out = chafa_term_info_emit_set_color_fgbg_16 (ctx->term_info, out, fg, bg);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FGBG_16, fg, bg);
             }
             else if (fg != CHAFA_PALETTE_INDEX_TRANSPARENT)
             {
                 out = flush_chars (ctx, out);
-                out = chafa_term_info_emit_set_color_fg_16 (ctx->term_info, out, fg);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FG_16, fg, 0);
             }
         }
         else if (bg != ctx->cur_bg && bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
         {
             out = flush_chars (ctx, out);
-            out = chafa_term_info_emit_set_color_bg_16 (ctx->term_info, out, bg);
+            out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_BG_16, 0, bg);
         }
     }
     else
@@ -415,16 +642,16 @@ emit_attributes_16 (PrintCtx *ctx, gchar *out,
         {
             if (bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
             {
-                out = chafa_term_info_emit_set_color_fgbg_16 (ctx->term_info, out, fg, bg);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FGBG_16, fg, bg);
             }
             else
             {
-                out = chafa_term_info_emit_set_color_fg_16 (ctx->term_info, out, fg);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FG_16, fg, 0);
             }
         }
         else if (bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
         {
-            out = chafa_term_info_emit_set_color_bg_16 (ctx->term_info, out, bg);
+            out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_BG_16, 0, bg);
         }
     }
 
@@ -483,18 +710,18 @@ emit_attributes_16_8 (PrintCtx *ctx, gchar *out,
             if (bg != ctx->cur_bg && bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
             {
                 out = flush_chars (ctx, out);
-                out = chafa_term_info_emit_set_color_fgbg_8 (ctx->term_info, out, fg & 7, bg);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FGBG_8, fg & 7, bg);
             }
             else if (fg != CHAFA_PALETTE_INDEX_TRANSPARENT)
             {
                 out = flush_chars (ctx, out);
-                out = chafa_term_info_emit_set_color_fg_8 (ctx->term_info, out, fg & 7);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FG_8, fg & 7, 0);
             }
         }
         else if (bg != ctx->cur_bg && bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
         {
             out = flush_chars (ctx, out);
-            out = chafa_term_info_emit_set_color_bg_8 (ctx->term_info, out, bg);
+            out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_BG_8, 0, bg);
         }
     }
     else
@@ -510,16 +737,16 @@ emit_attributes_16_8 (PrintCtx *ctx, gchar *out,
         {
             if (bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
             {
-                out = chafa_term_info_emit_set_color_fgbg_8 (ctx->term_info, out, fg & 7, bg);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FGBG_8, fg & 7, bg);
             }
             else
             {
-                out = chafa_term_info_emit_set_color_fg_8 (ctx->term_info, out, fg & 7);
+                out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_FG_8, fg & 7, 0);
             }
         }
         else if (bg != CHAFA_PALETTE_INDEX_TRANSPARENT)
         {
-            out = chafa_term_info_emit_set_color_bg_8 (ctx->term_info, out, bg);
+            out = emit_color (ctx, out, CHAFA_TERM_SEQ_SET_COLOR_BG_8, 0, bg);
         }
     }
 
@@ -669,17 +896,29 @@ prealloc_string (GString *gs, gint n_cells)
 }
 
 G_GNUC_WARN_UNUSED_RESULT static gchar *
-build_ansi_row (PrintCtx *ctx, gint row, gchar *out)
+reset_row_start (PrintCtx *ctx, gchar *out)
 {
-    ChafaCanvas *canvas;
-    gsize i, i_max;
+    ChafaCanvas *canvas = ctx->canvas;
 
-    canvas = ctx->canvas;
-    i = (gsize) row * (gsize) canvas->config.width;
-    i_max = (gsize) (row + 1) * (gsize) canvas->config.width;
+    if (canvas->config.canvas_mode != CHAFA_CANVAS_MODE_FGBG)
+    {
+        if (canvas->config.fg_only_enabled)
+            out = reset_fg (ctx, out);
+        else
+            out = reset_attributes (ctx, out);
+    }
+
+    return out;
+}
+
+G_GNUC_WARN_UNUSED_RESULT static gchar *
+reset_row_end (PrintCtx *ctx, gchar *out)
+{
+    ChafaCanvas *canvas = ctx->canvas;
 
-    if (row == 0
-        && canvas->config.canvas_mode != CHAFA_CANVAS_MODE_FGBG)
+    /* Avoid control codes in FGBG mode. Don't reset attributes when BG
+     * is held, to preserve any BG color set previously. */
+    if (canvas->config.canvas_mode != CHAFA_CANVAS_MODE_FGBG)
     {
         if (canvas->config.fg_only_enabled)
             out = reset_fg (ctx, out);
@@ -687,7 +926,15 @@ build_ansi_row (PrintCtx *ctx, gint row, gchar *out)
             out = reset_attributes (ctx, out);
     }
 
-    switch (canvas->config.canvas_mode)
+    return out;
+}
+
+/* Emits cells [i, i_max) of the canvas. The range must not split a
+ * wide character. */
+G_GNUC_WARN_UNUSED_RESULT static gchar *
+emit_cells (PrintCtx *ctx, gchar *out, gsize i, gsize i_max)
+{
+    switch (ctx->canvas->config.canvas_mode)
     {
         case CHAFA_CANVAS_MODE_TRUECOLOR:
             out = emit_ansi_truecolor (ctx, out, i, i_max);
@@ -716,85 +963,399 @@ build_ansi_row (PrintCtx *ctx, gint row, gchar *out)
             break;
     }
 
-    out = flush_chars (ctx, out);
+    return flush_chars (ctx, out);
+}
 
-    /* Avoid control codes in FGBG mode. Don't reset attributes when BG
-     * is held, to preserve any BG color set previously. */
-    if (canvas->config.canvas_mode != CHAFA_CANVAS_MODE_FGBG)
-    {
-        if (canvas->config.fg_only_enabled)
-            out = reset_fg (ctx, out);
-        else
-            out = reset_attributes (ctx, out);
-    }
+G_GNUC_WARN_UNUSED_RESULT static gchar *
+build_ansi_row (PrintCtx *ctx, gint row, gchar *out)
+{
+    ChafaCanvas *canvas;
+    gsize i, i_max;
+
+    canvas = ctx->canvas;
+    i = (gsize) row * (gsize) canvas->config.width;
+    i_max = (gsize) (row + 1) * (gsize) canvas->config.width;
+
+    if (row == 0)
+        out = reset_row_start (ctx, out);
+
+    out = emit_cells (ctx, out, i, i_max);
+    out = reset_row_end (ctx, out);
 
     return out;
 }
 
-static GString *
-build_ansi_gstring (ChafaCanvas *canvas, ChafaTermInfo *ti)
+/* Brings the attributes in ctx to the state they would be in after printing
+ * the given row. Every row ends in an attribute reset, and the state left
+ * after printing a cell does not depend on the state before it, so the
+ * row's last cell is all we need to replay. */
+static void
+prime_row_state (PrintCtx *ctx, gint row)
 {
-    GString *gs = g_string_new ("");
-    PrintCtx ctx = { 0 };
+    ChafaCanvas *canvas = ctx->canvas;
+    gchar buf [CHAFA_TERM_SEQ_LENGTH_MAX * 5 + 16];
+    gchar *out = buf;
+    gsize row_start, i, i_max;
+
+    row_start = (gsize) row * (gsize) canvas->config.width;
+    i_max = row_start + canvas->config.width;
+
+    /* Don't start on the right half of a wide symbol */
+    for (i = i_max - 1; i > row_start && canvas->cells [i].c == 0; i--)
+        ;
+
+    out = emit_cells (ctx, out, i, i_max);
+    out = reset_row_end (ctx, out);
+
+    g_assert (out - buf <= (gint) sizeof (buf));
+}
+
+typedef struct
+{
+    ChafaCanvas *canvas;
+    ChafaTermInfo *term_info;
+
+    /* Either one string per row, or all rows concatenated in gs */
+    GString **rows;
+    GString *gs;
+}
+BuildAnsiCtx;
+
+static void
+build_ansi_rows_worker (ChafaBatchInfo *batch, const BuildAnsiCtx *ctx)
+{
+    ChafaCanvas *canvas = ctx->canvas;
+    PrintCtx print_ctx;
+    GString *gs = NULL;
     gint i;
 
-    ctx.canvas = canvas;
-    ctx.term_info = ti;
+    init_print_ctx (&print_ctx, canvas, ctx->term_info);
 
-    for (i = 0; i < canvas->config.height; i++)
+    if (batch->first_row > 0)
+        prime_row_state (&print_ctx, batch->first_row - 1);
+
+    for (i = batch->first_row; i < batch->first_row + batch->n_rows; i++)
     {
         gchar *out;
 
+        if (ctx->rows)
+            gs = ctx->rows [i] = g_string_new ("");
+        else if (!gs)
+            gs = g_string_new ("");
+
         prealloc_string (gs, canvas->config.width);
         out = gs->str + gs->len;
 
-        out = build_ansi_row (&ctx, i, out);
+        out = build_ansi_row (&print_ctx, i, out);
 
         /* Rows end in a newline, except for the last one. This allows for
          * filling the display area while avoiding a blank bottom row. */
-        if (i < canvas->config.height - 1)
+        if (!ctx->rows && i < canvas->config.height - 1)
             *(out++) = '\n';
 
         *out = '\0';
         gs->len = out - gs->str;
     }
 
-    return gs;
+    deinit_print_ctx (&print_ctx);
+
+    if (!ctx->rows)
+        batch->ret_p = gs;
+}
+
+static void
+build_ansi_rows_post (ChafaBatchInfo *batch, BuildAnsiCtx *ctx)
+{
+    GString *gs = batch->ret_p;
+
+    /* Batches are posted in order */
+    if (!ctx->gs)
+    {
+        ctx->gs = gs;
+    }
+    else
+    {
+        g_string_append_len (ctx->gs, gs->str, gs->len);
+        g_string_free (gs, TRUE);
+    }
+}
+
+static void
+build_ansi_rows (BuildAnsiCtx *ctx)
+{
+    ChafaCanvas *canvas = ctx->canvas;
+    gsize n_cells = (gsize) canvas->config.width * (gsize) canvas->config.height;
+    gint n_batches;
+
+    /* Each batch starts from a known attribute state (see prime_row_state()),
+     * so the output does not depend on how the rows are divided up. */
+    n_batches = MIN ((gsize) chafa_get_n_actual_threads (), n_cells / BATCH_CELLS_MIN);
+    n_batches = MAX (n_batches, 1);
+
+    chafa_process_batches (ctx,
+                           (GFunc) build_ansi_rows_worker,
+                           ctx->rows ? NULL : (GFunc) build_ansi_rows_post,
+                           canvas->config.height,
+                           n_batches,
+                           1);
+}
+
+static GString *
+build_ansi_gstring (ChafaCanvas *canvas, ChafaTermInfo *ti)
+{
+    BuildAnsiCtx ctx = { 0 };
+
+    ctx.canvas = canvas;
+    ctx.term_info = ti;
+
+    build_ansi_rows (&ctx);
+
+    return ctx.gs ? ctx.gs : g_string_new ("");
 }
 
 static void
 build_ansi_gstring_array (ChafaCanvas *canvas, ChafaTermInfo *ti,
                           GString ***array_out, gint *array_len_out)
 {
-    PrintCtx ctx = { 0 };
+    BuildAnsiCtx ctx = { 0 };
     GString **array;
-    gint i;
+
+    array = g_new (GString *, canvas->config.height + 1);
+    array [canvas->config.height] = NULL;
 
     ctx.canvas = canvas;
     ctx.term_info = ti;
+    ctx.rows = array;
 
-    array = g_new (GString *, canvas->config.height + 1);
+    build_ansi_rows (&ctx);
+
+    *array_out = array;
 
-    for (i = 0; i < canvas->config.height; i++)
+    if (array_len_out)
+        *array_len_out = canvas->config.height;
+}
+
+/* ------------ *
+ * Delta output *
+ * ------------ */
+
+/* Unchanged runs shorter than this between two changed spans are rewritten
+ * rather than skipped, since moving the cursor costs a few bytes too. */
+#define DELTA_GAP_CELLS_MIN 4
+
+typedef struct
+{
+    PrintCtx print_ctx;
+    gint cur_row;
+    gint cur_col;
+}
+DeltaCtx;
+
+static gboolean
+cells_differ (const ChafaCanvasCell *a, const ChafaCanvasCell *b)
+{
+    return a->c != b->c
+        || a->fg_color != b->fg_color
+        || a->bg_color != b->bg_color;
+}
+
+/* Flags the changed cells in a row. Both halves of a wide character are
+ * flagged if either one is, so spans never split them. Returns TRUE if
+ * anything changed. */
+static gboolean
+find_changed_cells (ChafaCanvas *canvas, ChafaCanvas *prev_canvas, gint row,
+                    guint8 *changed)
+{
+    const ChafaCanvasCell *cells, *prev_cells;
+    gint width = canvas->config.width;
+    gboolean any_changed = FALSE;
+    gint x;
+
+    cells = &canvas->cells [(gsize) row * (gsize) width];
+    prev_cells = &prev_canvas->cells [(gsize) row * (gsize) width];
+
+    for (x = 0; x < width; x++)
     {
-        GString *gs = g_string_new ("");
-        gchar *out;
+        changed [x] = cells_differ (&cells [x], &prev_cells [x]);
+        any_changed |= changed [x];
+    }
 
-        prealloc_string (gs, canvas->config.width);
-        out = gs->str + gs->len;
+    for (x = 1; x < width; x++)
+    {
+        if ((cells [x].c == 0 || prev_cells [x].c == 0)
+            && (changed [x] || changed [x - 1]))
+        {
+            changed [x - 1] = changed [x] = TRUE;
+        }
+    }
 
-        out = build_ansi_row (&ctx, i, out);
-        *out = '\0';
+    return any_changed;
+}
 
-        gs->len = out - gs->str;
-        array [i] = gs;
+/* Cursor movement is strictly relative to the canvas' top left corner, so
+ * the output can be placed anywhere, e.g. with an indent. The cursor is
+ * never moved up, since rows are visited in order.
+ *
+ * After the last column has been written, the cursor is either just past it,
+ * or on it with a wrap pending if the canvas reaches the terminal's right
+ * margin. We can't tell which, so we move left by the full width. That lands
+ * on the first column in both cases, provided a canvas that reaches the
+ * right margin also starts at the left one. */
+G_GNUC_WARN_UNUSED_RESULT static gchar *
+move_cursor (DeltaCtx *dctx, gchar *out, gint row, gint col)
+{
+    ChafaTermInfo *ti = dctx->print_ctx.term_info;
+    gint width = dctx->print_ctx.canvas->config.width;
+    gint cur_col = dctx->cur_col;
+
+    if (row > dctx->cur_row)
+        out = chafa_term_info_emit_cursor_down (ti, out, row - dctx->cur_row);
+
+    if (cur_col >= width && col < cur_col)
+    {
+        out = chafa_term_info_emit_cursor_left (ti, out, width);
+        cur_col = 0;
     }
 
-    array [canvas->config.height] = NULL;
-    *array_out = array;
+    if (col > cur_col)
+        out = chafa_term_info_emit_cursor_right (ti, out, col - cur_col);
+    else if (col < cur_col)
+        out = chafa_term_info_emit_cursor_left (ti, out, cur_col - col);
 
-    if (array_len_out)
-        *array_len_out = canvas->config.height;
+    dctx->cur_row = row;
+    dctx->cur_col = col;
+    return out;
+}
+
+G_GNUC_WARN_UNUSED_RESULT static gchar *
+build_delta_row_spans (DeltaCtx *dctx, const guint8 *changed, gint row, gchar *out)
+{
+    gint width = dctx->print_ctx.canvas->config.width;
+    gsize row_ofs = (gsize) row * (gsize) width;
+    gint x = 0;
+
+    while (x < width)
+    {
+        gint x1;
+
+        if (!changed [x])
+        {
+            x++;
+            continue;
+        }
+
+        /* Extend the span across short gaps */
+
+        x1 = x + 1;
+
+        for (;;)
+        {
+            gint gap;
+
+            while (x1 < width && changed [x1])
+                x1++;
+
+            for (gap = x1; gap < width && !changed [gap] && gap - x1 < DELTA_GAP_CELLS_MIN; gap++)
+                ;
+
+            if (gap >= width || !changed [gap])
+                break;
+
+            x1 = gap;
+        }
+
+        out = move_cursor (dctx, out, row, x);
+        out = emit_cells (&dctx->print_ctx, out, row_ofs + x, row_ofs + x1);
+        dctx->cur_col = x1;
+        x = x1;
+    }
+
+    return reset_row_end (&dctx->print_ctx, out);
+}
+
+G_GNUC_WARN_UNUSED_RESULT static gchar *
+build_delta_row_full (DeltaCtx *dctx, gint row, gchar *out)
+{
+    gint width = dctx->print_ctx.canvas->config.width;
+    gsize row_ofs = (gsize) row * (gsize) width;
+
+    out = move_cursor (dctx, out, row, 0);
+    out = emit_cells (&dctx->print_ctx, out, row_ofs, row_ofs + width);
+    dctx->cur_col = width;
+
+    return reset_row_end (&dctx->print_ctx, out);
+}
+
+static void
+append_buf (GString *gs, const gchar *buf, const gchar *buf_end)
+{
+    g_string_append_len (gs, buf, buf_end - buf);
+}
+
+static GString *
+build_ansi_delta_gstring (ChafaCanvas *canvas, ChafaCanvas *prev_canvas, ChafaTermInfo *ti)
+{
+    GString *gs = g_string_new ("");
+    DeltaCtx dctx;
+    gint width = canvas->config.width;
+    gint height = canvas->config.height;
+    guint8 *changed;
+    gchar *spans_buf, *full_buf, *p;
+    gsize buf_len;
+    gint i;
+
+    init_print_ctx (&dctx.print_ctx, canvas, ti);
+    dctx.cur_row = 0;
+    dctx.cur_col = 0;
+
+    /* A row of spans may cost up to two cursor movements per cell on top
+     * of what prealloc_string() assumes */
+    buf_len = ((gsize) width * 2 + 2) * (CHAFA_TERM_SEQ_LENGTH_MAX * 3 + 6) + 1;
+    changed = g_malloc (width);
+    spans_buf = g_malloc (buf_len);
+    full_buf = g_malloc (buf_len);
+
+    p = reset_row_start (&dctx.print_ctx, spans_buf);
+    append_buf (gs, spans_buf, p);
+
+    for (i = 0; i < height; i++)
+    {
+        DeltaCtx spans_dctx, full_dctx;
+        gchar *spans_end, *full_end;
+
+        if (!find_changed_cells (canvas, prev_canvas, i, changed))
+            continue;
+
+        /* Either skip over the unchanged cells, or rewrite the entire row if
+         * that turns out cheaper, e.g. when few cells are left alone */
+
+        spans_dctx = dctx;
+        spans_end = build_delta_row_spans (&spans_dctx, changed, i, spans_buf);
+
+        full_dctx = dctx;
+        full_end = build_delta_row_full (&full_dctx, i, full_buf);
+
+        if (spans_end - spans_buf <= full_end - full_buf)
+        {
+            append_buf (gs, spans_buf, spans_end);
+            dctx = spans_dctx;
+        }
+        else
+        {
+            append_buf (gs, full_buf, full_end);
+            dctx = full_dctx;
+        }
+    }
+
+    /* Leave the cursor where a full print would have */
+    p = move_cursor (&dctx, full_buf, height - 1, width);
+    append_buf (gs, full_buf, p);
+
+    deinit_print_ctx (&dctx.print_ctx);
+    g_free (full_buf);
+    g_free (spans_buf);
+    g_free (changed);
+    return gs;
 }
 
 GString *
@@ -816,3 +1377,14 @@ chafa_canvas_print_symbol_rows (ChafaCanvas *canvas, ChafaTermInfo *ti,
 
     build_ansi_gstring_array (canvas, ti, array_out, array_len_out);
 }
+
+GString *
+chafa_canvas_print_symbols_delta (ChafaCanvas *canvas, ChafaCanvas *prev_canvas,
+                                  ChafaTermInfo *ti)
+{
+    g_assert (canvas != NULL);
+    g_assert (prev_canvas != NULL);
+    g_assert (ti != NULL);
+
+    return build_ansi_delta_gstring (canvas, prev_canvas, ti);
+}
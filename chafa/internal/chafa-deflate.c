@@ -0,0 +1,497 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include "config.h"
+
+#include <stdlib.h>  /* abs */
+#include <string.h>
+#include <glib.h>
+
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
+
+#include "chafa.h"
+#include "internal/chafa-batch.h"
+#include "internal/chafa-deflate.h"
+
+#ifdef HAVE_ZLIB
+
+/* Each band is primed with up to 32KiB of the preceding input, so splitting
+ * costs very little in terms of ratio. Keep bands large enough that the
+ * per-stream overhead stays negligible, though. */
+#define BAND_LEN_MIN (128 * 1024)
+#define DICT_LEN_MAX 32768
+
+/* zlib's length arguments are uInt; feed it in pieces no larger than this */
+#define ZLIB_CHUNK_MAX (1U << 30)
+
+typedef struct
+{
+    const guint8 *data;
+    gsize row_len;
+    gint n_rows;
+    gint level;
+
+    guint8 *out;
+    gsize out_len;
+    gsize out_alloc;
+    guint32 adler;
+    gboolean failed;
+}
+DeflateCtx;
+
+typedef struct
+{
+    guint8 *buf;
+    gsize len;
+    gsize in_len;
+    guint32 adler;
+}
+DeflateBand;
+
+static guint32
+calc_adler32 (guint32 adler, const guint8 *p, gsize len)
+{
+    while (len > 0)
+    {
+        uInt n = MIN (len, ZLIB_CHUNK_MAX);
+
+        adler = adler32 (adler, p, n);
+        p += n;
+        len -= n;
+    }
+
+    return adler;
+}
+
+static guint32
+calc_crc32 (guint32 crc, const guint8 *p, gsize len)
+{
+    while (len > 0)
+    {
+        uInt n = MIN (len, ZLIB_CHUNK_MAX);
+
+        crc = crc32 (crc, p, n);
+        p += n;
+        len -= n;
+    }
+
+    return crc;
+}
+
+static gboolean
+run_deflate (z_stream *zs, gint flush, DeflateBand *band, gsize *alloc)
+{
+    gint ret;
+
+    do
+    {
+        if (*alloc - band->len < 64)
+        {
+            *alloc *= 2;
+            band->buf = g_realloc (band->buf, *alloc);
+        }
+
+        zs->next_out = band->buf + band->len;
+        zs->avail_out = MIN (*alloc - band->len, ZLIB_CHUNK_MAX);
+
+        ret = deflate (zs, flush);
+        if (ret == Z_STREAM_ERROR)
+            return FALSE;
+
+        band->len = zs->next_out - band->buf;
+    }
+    while (zs->avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+
+    return TRUE;
+}
+
+static void
+deflate_worker (ChafaBatchInfo *batch, const DeflateCtx *ctx)
+{
+    const guint8 *p = ctx->data + (gsize) batch->first_row * ctx->row_len;
+    gsize len = (gsize) batch->n_rows * ctx->row_len;
+    gboolean is_last = (batch->first_row + batch->n_rows >= ctx->n_rows);
+    gsize dict_len;
+    gsize alloc;
+    DeflateBand *band;
+    z_stream zs;
+
+    band = g_new0 (DeflateBand, 1);
+    batch->ret_p = band;
+
+    band->in_len = len;
+    band->adler = calc_adler32 (adler32 (0, NULL, 0), p, len);
+
+    memset (&zs, 0, sizeof (zs));
+
+    /* Raw deflate; the zlib wrapper is added when the bands are joined */
+    if (deflateInit2 (&zs, ctx->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return;
+
+    dict_len = MIN ((gsize) batch->first_row * ctx->row_len, DICT_LEN_MAX);
+    if (dict_len > 0)
+        deflateSetDictionary (&zs, p - dict_len, dict_len);
+
+    alloc = deflateBound (&zs, MIN (len, ZLIB_CHUNK_MAX)) + 64;
+    band->buf = g_malloc (alloc);
+
+    for (;;)
+    {
+        uInt n = MIN (len, ZLIB_CHUNK_MAX);
+        gint flush;
+
+        zs.next_in = (Bytef *) p;
+        zs.avail_in = n;
+        p += n;
+        len -= n;
+
+        /* Non-final bands end on a byte boundary with an empty stored block
+         * (sync flush), so the raw streams can simply be concatenated. Only
+         * the last band gets the final block bit. */
+        flush = len > 0 ? Z_NO_FLUSH : (is_last ? Z_FINISH : Z_SYNC_FLUSH);
+
+        if (!run_deflate (&zs, flush, band, &alloc))
+        {
+            g_free (band->buf);
+            band->buf = NULL;
+            break;
+        }
+
+        if (len == 0)
+            break;
+    }
+
+    deflateEnd (&zs);
+}
+
+static void
+deflate_post (ChafaBatchInfo *batch, DeflateCtx *ctx)
+{
+    DeflateBand *band = batch->ret_p;
+
+    if (!band->buf)
+        ctx->failed = TRUE;
+
+    if (!ctx->failed)
+    {
+        if (ctx->out_alloc - ctx->out_len < band->len)
+        {
+            ctx->out_alloc = MAX (ctx->out_alloc * 2, ctx->out_len + band->len + 4);
+            ctx->out = g_realloc (ctx->out, ctx->out_alloc);
+        }
+
+        memcpy (ctx->out + ctx->out_len, band->buf, band->len);
+        ctx->out_len += band->len;
+        ctx->adler = adler32_combine (ctx->adler, band->adler, band->in_len);
+    }
+
+    g_free (band->buf);
+    g_free (band);
+}
+
+static void
+store_be32 (guint8 *p, guint32 n)
+{
+    p [0] = n >> 24;
+    p [1] = n >> 16;
+    p [2] = n >> 8;
+    p [3] = n;
+}
+
+guint8 *
+chafa_deflate_rows (gconstpointer data, gsize row_len, gint n_rows,
+                    gint level, gsize *len_out)
+{
+    DeflateCtx ctx;
+    guint header;
+    gint n_batches;
+
+    g_return_val_if_fail (data != NULL || n_rows == 0, NULL);
+    g_return_val_if_fail (len_out != NULL, NULL);
+
+    level = CLAMP (level, 1, CHAFA_DEFLATE_LEVEL_MAX);
+    n_rows = MAX (n_rows, 0);
+
+    memset (&ctx, 0, sizeof (ctx));
+    ctx.data = data;
+    ctx.row_len = row_len;
+    ctx.n_rows = n_rows;
+    ctx.level = level;
+    ctx.adler = adler32 (0, NULL, 0);
+    ctx.out_alloc = 256;
+    ctx.out = g_malloc (ctx.out_alloc);
+
+    /* RFC 1950 header. FLEVEL is informative only; FCHECK makes the
+     * 16-bit header a multiple of 31. */
+    header = (0x78 << 8) | ((level == 1 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6);
+    header += 31 - (header % 31);
+    ctx.out [0] = header >> 8;
+    ctx.out [1] = header & 0xff;
+    ctx.out_len = 2;
+
+    if (n_rows > 0)
+    {
+        n_batches = ((gsize) n_rows * row_len) / BAND_LEN_MIN;
+        n_batches = CLAMP (n_batches, 1, chafa_get_n_actual_threads ());
+
+        chafa_process_batches (&ctx,
+                               (GFunc) deflate_worker,
+                               (GFunc) deflate_post,
+                               n_rows,
+                               n_batches,
+                               1);
+    }
+    else
+    {
+        /* Empty input still needs a final block */
+        static const guint8 empty_final_block [] = { 0x03, 0x00 };
+
+        memcpy (ctx.out + ctx.out_len, empty_final_block, 2);
+        ctx.out_len += 2;
+    }
+
+    if (ctx.failed)
+    {
+        g_free (ctx.out);
+        return NULL;
+    }
+
+    if (ctx.out_alloc - ctx.out_len < 4)
+        ctx.out = g_realloc (ctx.out, ctx.out_len + 4);
+    store_be32 (ctx.out + ctx.out_len, ctx.adler);
+    ctx.out_len += 4;
+
+    *len_out = ctx.out_len;
+    return ctx.out;
+}
+
+/* --- PNG --- */
+
+typedef struct
+{
+    const guint8 *pixels;
+    gint width;
+    gint rowstride;
+    guint8 *filtered;
+}
+FilterCtx;
+
+enum
+{
+    PNG_FILTER_NONE,
+    PNG_FILTER_SUB,
+    PNG_FILTER_UP,
+    PNG_FILTER_AVERAGE,
+    PNG_FILTER_PAETH,
+
+    PNG_FILTER_MAX
+};
+
+static inline guint8
+paeth_predictor (gint a, gint b, gint c)
+{
+    gint p = a + b - c;
+    gint pa = abs (p - a);
+    gint pb = abs (p - b);
+    gint pc = abs (p - c);
+
+    if (pa <= pb && pa <= pc)
+        return a;
+    if (pb <= pc)
+        return b;
+    return c;
+}
+
+static guint
+filter_row (gint filter, const guint8 *row, const guint8 *prev, gint len, guint8 *out)
+{
+    guint sum = 0;
+    gint i;
+
+    for (i = 0; i < len; i++)
+    {
+        gint a = i >= 4 ? row [i - 4] : 0;
+        gint b = prev ? prev [i] : 0;
+        gint c = (prev && i >= 4) ? prev [i - 4] : 0;
+        guint8 pred;
+
+        switch (filter)
+        {
+            case PNG_FILTER_SUB:
+                pred = a;
+                break;
+            case PNG_FILTER_UP:
+                pred = b;
+                break;
+            case PNG_FILTER_AVERAGE:
+                pred = (a + b) >> 1;
+                break;
+            case PNG_FILTER_PAETH:
+                pred = paeth_predictor (a, b, c);
+                break;
+            default:
+                pred = 0;
+                break;
+        }
+
+        out [i] = row [i] - pred;
+        sum += abs ((gint8) out [i]);
+    }
+
+    return sum;
+}
+
+static void
+filter_worker (ChafaBatchInfo *batch, const FilterCtx *ctx)
+{
+    gint len = ctx->width * 4;
+    guint8 *trial;
+    gint i;
+
+    trial = g_malloc (len);
+
+    for (i = batch->first_row; i < batch->first_row + batch->n_rows; i++)
+    {
+        const guint8 *row = ctx->pixels + (gsize) i * ctx->rowstride;
+        const guint8 *prev = i > 0 ? row - ctx->rowstride : NULL;
+        guint8 *out = ctx->filtered + (gsize) i * (len + 1);
+        guint best_sum;
+        gint f;
+
+        /* Pick the filter with the minimum sum of absolute differences,
+         * the usual heuristic for truecolor images */
+        out [0] = PNG_FILTER_NONE;
+        best_sum = filter_row (PNG_FILTER_NONE, row, prev, len, out + 1);
+
+        for (f = PNG_FILTER_SUB; f < PNG_FILTER_MAX; f++)
+        {
+            guint sum = filter_row (f, row, prev, len, trial);
+
+            if (sum < best_sum)
+            {
+                best_sum = sum;
+                out [0] = f;
+                memcpy (out + 1, trial, len);
+            }
+        }
+    }
+
+    g_free (trial);
+}
+
+static void
+append_png_chunk (GByteArray *png, const gchar *type, const guint8 *data, gsize len)
+{
+    guint8 buf [4];
+    guint32 crc;
+
+    store_be32 (buf, len);
+    g_byte_array_append (png, buf, 4);
+    g_byte_array_append (png, (const guint8 *) type, 4);
+    if (len > 0)
+        g_byte_array_append (png, data, len);
+
+    crc = crc32 (0, (const Bytef *) type, 4);
+    crc = calc_crc32 (crc, data, len);
+    store_be32 (buf, crc);
+    g_byte_array_append (png, buf, 4);
+}
+
+guint8 *
+chafa_png_encode_rgba8 (gconstpointer pixels, gint width, gint height,
+                        gint rowstride, gint level, gsize *len_out)
+{
+    static const guint8 signature [8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    FilterCtx ctx;
+    GByteArray *png;
+    guint8 ihdr [13];
+    guint8 *idat;
+    gsize idat_len;
+
+    g_return_val_if_fail (pixels != NULL, NULL);
+    g_return_val_if_fail (width > 0, NULL);
+    g_return_val_if_fail (height > 0, NULL);
+    g_return_val_if_fail (len_out != NULL, NULL);
+
+    ctx.pixels = pixels;
+    ctx.width = width;
+    ctx.rowstride = rowstride;
+    ctx.filtered = g_try_malloc ((gsize) height * ((gsize) width * 4 + 1));
+    if (!ctx.filtered)
+        return NULL;
+
+    chafa_process_batches (&ctx,
+                           (GFunc) filter_worker,
+                           NULL,
+                           height,
+                           chafa_get_n_actual_threads (),
+                           1);
+
+    idat = chafa_deflate_rows (ctx.filtered, (gsize) width * 4 + 1, height,
+                               level, &idat_len);
+    g_free (ctx.filtered);
+
+    if (!idat)
+        return NULL;
+
+    store_be32 (ihdr, width);
+    store_be32 (ihdr + 4, height);
+    ihdr [8] = 8;   /* Bit depth */
+    ihdr [9] = 6;   /* Color type: RGBA */
+    ihdr [10] = 0;  /* Compression method */
+    ihdr [11] = 0;  /* Filter method */
+    ihdr [12] = 0;  /* Interlace method */
+
+    png = g_byte_array_sized_new (idat_len + 64);
+    g_byte_array_append (png, signature, sizeof (signature));
+    append_png_chunk (png, "IHDR", ihdr, sizeof (ihdr));
+    append_png_chunk (png, "IDAT", idat, idat_len);
+    append_png_chunk (png, "IEND", NULL, 0);
+    g_free (idat);
+
+    *len_out = png->len;
+    return g_byte_array_free (png, FALSE);
+}
+
+#else /* !HAVE_ZLIB */
+
+guint8 *
+chafa_deflate_rows (G_GNUC_UNUSED gconstpointer data,
+                    G_GNUC_UNUSED gsize row_len,
+                    G_GNUC_UNUSED gint n_rows,
+                    G_GNUC_UNUSED gint level,
+                    G_GNUC_UNUSED gsize *len_out)
+{
+    return NULL;
+}
+
+guint8 *
+chafa_png_encode_rgba8 (G_GNUC_UNUSED gconstpointer pixels,
+                        G_GNUC_UNUSED gint width,
+                        G_GNUC_UNUSED gint height,
+                        G_GNUC_UNUSED gint rowstride,
+                        G_GNUC_UNUSED gint level,
+                        G_GNUC_UNUSED gsize *len_out)
+{
+    return NULL;
+}
+
+#endif /* !HAVE_ZLIB */
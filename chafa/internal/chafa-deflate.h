@@ -0,0 +1,43 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __CHAFA_DEFLATE_H__
+#define __CHAFA_DEFLATE_H__
+
+#include <glib.h>
+#include "chafa.h"
+
+G_BEGIN_DECLS
+
+#define CHAFA_DEFLATE_LEVEL_MAX 9
+
+/* Compresses n_rows rows of row_len bytes each into a single zlib stream.
+ * Bands of rows are compressed in parallel. Returns NULL if zlib support
+ * was not built in or compression fails. Free the result with g_free (). */
+guint8 *chafa_deflate_rows (gconstpointer data, gsize row_len, gint n_rows,
+                            gint level, gsize *len_out);
+
+/* Encodes an unassociated RGBA8 image as PNG. The IDAT payload is produced
+ * by chafa_deflate_rows (). Returns NULL on failure. */
+guint8 *chafa_png_encode_rgba8 (gconstpointer pixels, gint width, gint height,
+                                gint rowstride, gint level, gsize *len_out);
+
+G_END_DECLS
+
+#endif /* __CHAFA_DEFLATE_H__ */
@@ -24,12 +24,14 @@
 #include "internal/chafa-base64.h"
 #include "internal/chafa-batch.h"
 #include "internal/chafa-bitfield.h"
+#include "internal/chafa-deflate.h"
 #include "internal/chafa-indexed-image.h"
 #include "internal/chafa-iterm2-renderer.h"
 #include "internal/chafa-math-util.h"
 #include "internal/chafa-string-util.h"
 
-/* We support iTerm2 images by embedding them as uncompressed TIFF files.
+/* We support iTerm2 images by embedding them as uncompressed TIFF files,
+ * or as PNG files when compression is requested.
  *
  * See: https://www.adobe.io/open/standards/TIFF.html */
 
@@ -251,8 +253,42 @@ generate_tag (ChafaBase64 *base64, GString *gs,
     encode_tag (base64, gs, &tag);
 }
 
-void
-chafa_iterm2_renderer_build_ansi (ChafaIterm2Renderer *iterm2_renderer, ChafaTermInfo *term_info, GString *out_str, gint width_cells, gint height_cells)
+static gboolean
+build_png (ChafaIterm2Renderer *iterm2_renderer, ChafaTermInfo *term_info, GString *out_str,
+           gint width_cells, gint height_cells, gint compression_level)
+{
+    gchar seq [CHAFA_TERM_SEQ_LENGTH_MAX + 1];
+    ChafaBase64 base64;
+    guint8 *png;
+    gsize png_len;
+
+    png = chafa_png_encode_rgba8 (iterm2_renderer->rgba_image,
+                                  iterm2_renderer->width,
+                                  iterm2_renderer->height,
+                                  iterm2_renderer->width * sizeof (guint32),
+                                  compression_level,
+                                  &png_len);
+    if (!png)
+        return FALSE;
+
+    *chafa_term_info_emit_begin_iterm2_image (term_info, seq, width_cells, height_cells) = '\0';
+    g_string_append (out_str, seq);
+
+    chafa_base64_init (&base64);
+    chafa_base64_encode (&base64, out_str, png, png_len);
+    chafa_base64_encode_end (&base64, out_str);
+    chafa_base64_deinit (&base64);
+
+    *chafa_term_info_emit_end_iterm2_image (term_info, seq) = '\0';
+    g_string_append (out_str, seq);
+
+    g_free (png);
+    return TRUE;
+}
+
+static void
+build_tiff (ChafaIterm2Renderer *iterm2_renderer, ChafaTermInfo *term_info, GString *out_str,
+            gint width_cells, gint height_cells)
 {
     gchar seq [CHAFA_TERM_SEQ_LENGTH_MAX + 1];
     ChafaBase64 base64;
@@ -327,3 +363,17 @@ chafa_iterm2_renderer_build_ansi (ChafaIterm2Renderer *iterm2_renderer, ChafaTer
     *chafa_term_info_emit_end_iterm2_image (term_info, seq) = '\0';
     g_string_append (out_str, seq);
 }
+
+void
+chafa_iterm2_renderer_build_ansi (ChafaIterm2Renderer *iterm2_renderer, ChafaTermInfo *term_info, GString *out_str,
+                                  gint width_cells, gint height_cells, gint compression_level)
+{
+    /* PNG gets us per-row prediction, and the deflate step runs in parallel.
+     * Fall back to TIFF if we were built without zlib. */
+    if (compression_level > 0
+        && build_png (iterm2_renderer, term_info, out_str,
+                      width_cells, height_cells, compression_level))
+        return;
+
+    build_tiff (iterm2_renderer, term_info, out_str, width_cells, height_cells);
+}
@@ -41,7 +41,7 @@ void chafa_iterm2_renderer_draw_all_pixels (ChafaIterm2Renderer *iterm2_renderer
                                             ChafaAlign halign, ChafaAlign valign,
                                             ChafaTuck tuck);
 void chafa_iterm2_renderer_build_ansi (ChafaIterm2Renderer *iterm2_renderer, ChafaTermInfo *term_info, GString *out_str,
-                                       gint width_cells, gint height_cells);
+                                       gint width_cells, gint height_cells, gint compression_level);
 
 G_END_DECLS
 
@@ -0,0 +1,201 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+
+#include "config.h"
+
+#include <string.h>  /* memcpy */
+#include "chafa.h"
+#include "internal/chafa-kitty-cache.h"
+
+/* IDs we assign ourselves, keeping clear of the small IDs used for Unicode
+ * placeholders and by applications. Sequence arguments are formatted with
+ * at most four digits, so we can't go higher. */
+#define ALLOC_ID_MIN 5000U
+#define ALLOC_ID_MAX 9999U
+
+typedef struct
+{
+    guint64 hash;
+    guint32 id;
+    gsize n_bytes;
+    GList *link;
+}
+Entry;
+
+struct ChafaKittyCache
+{
+    GHashTable *by_hash;
+    GHashTable *by_id;
+
+    /* Least recently used at head */
+    GQueue lru;
+
+    gsize n_bytes, max_bytes;
+    guint32 next_id;
+};
+
+static void
+remove_entry (ChafaKittyCache *kitty_cache, Entry *entry)
+{
+    g_hash_table_remove (kitty_cache->by_hash, &entry->hash);
+    g_hash_table_remove (kitty_cache->by_id, GUINT_TO_POINTER (entry->id));
+    g_queue_delete_link (&kitty_cache->lru, entry->link);
+    kitty_cache->n_bytes -= entry->n_bytes;
+    g_free (entry);
+}
+
+ChafaKittyCache *
+chafa_kitty_cache_new (gsize max_bytes)
+{
+    ChafaKittyCache *kitty_cache;
+
+    kitty_cache = g_new0 (ChafaKittyCache, 1);
+    kitty_cache->by_hash = g_hash_table_new (g_int64_hash, g_int64_equal);
+    kitty_cache->by_id = g_hash_table_new (g_direct_hash, g_direct_equal);
+    g_queue_init (&kitty_cache->lru);
+    kitty_cache->max_bytes = max_bytes;
+
+    /* Random start, so concurrent sessions are unlikely to collide */
+    kitty_cache->next_id = g_random_int_range (ALLOC_ID_MIN, ALLOC_ID_MAX + 1);
+
+    return kitty_cache;
+}
+
+void
+chafa_kitty_cache_destroy (ChafaKittyCache *kitty_cache)
+{
+    g_hash_table_destroy (kitty_cache->by_hash);
+    g_hash_table_destroy (kitty_cache->by_id);
+    g_queue_foreach (&kitty_cache->lru, (GFunc) g_free, NULL);
+    g_queue_clear (&kitty_cache->lru);
+    g_free (kitty_cache);
+}
+
+static inline guint64
+mix_u64 (guint64 h, guint64 v)
+{
+    h ^= v * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15);
+    h = (h << 27) | (h >> 37);
+    return h * G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+}
+
+guint64
+chafa_kitty_cache_hash_image (gconstpointer rgba, gint width, gint height)
+{
+    const guint8 *p = rgba;
+    gsize len = (gsize) width * height * sizeof (guint32);
+    const guint8 *end = p + (len & ~(gsize) 7);
+    guint64 h = mix_u64 ((guint64) width << 32 | (guint32) height, len);
+
+    for ( ; p < end; p += 8)
+    {
+        guint64 v;
+
+        memcpy (&v, p, 8);
+        h = mix_u64 (h, v);
+    }
+
+    if (len & 7)
+    {
+        guint32 v;
+
+        memcpy (&v, p, 4);
+        h = mix_u64 (h, v);
+    }
+
+    /* Final avalanche */
+    h ^= h >> 33;
+    h *= G_GUINT64_CONSTANT (0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return h;
+}
+
+guint32
+chafa_kitty_cache_lookup (ChafaKittyCache *kitty_cache, guint64 hash)
+{
+    Entry *entry;
+
+    entry = g_hash_table_lookup (kitty_cache->by_hash, &hash);
+    if (!entry)
+        return 0;
+
+    /* Mark as most recently used */
+    g_queue_unlink (&kitty_cache->lru, entry->link);
+    g_queue_push_tail_link (&kitty_cache->lru, entry->link);
+
+    return entry->id;
+}
+
+guint32
+chafa_kitty_cache_alloc_id (ChafaKittyCache *kitty_cache)
+{
+    guint32 id = kitty_cache->next_id++;
+
+    if (kitty_cache->next_id > ALLOC_ID_MAX)
+        kitty_cache->next_id = ALLOC_ID_MIN;
+
+    return id;
+}
+
+void
+chafa_kitty_cache_insert (ChafaKittyCache *kitty_cache, guint64 hash, guint32 id,
+                          gsize n_bytes)
+{
+    Entry *entry;
+
+    g_return_if_fail (id != 0);
+
+    entry = g_hash_table_lookup (kitty_cache->by_hash, &hash);
+    if (entry)
+        remove_entry (kitty_cache, entry);
+
+    entry = g_hash_table_lookup (kitty_cache->by_id, GUINT_TO_POINTER (id));
+    if (entry)
+        remove_entry (kitty_cache, entry);
+
+    entry = g_new (Entry, 1);
+    entry->hash = hash;
+    entry->id = id;
+    entry->n_bytes = n_bytes;
+
+    g_queue_push_tail (&kitty_cache->lru, entry);
+    entry->link = kitty_cache->lru.tail;
+    kitty_cache->n_bytes += n_bytes;
+
+    g_hash_table_insert (kitty_cache->by_hash, &entry->hash, entry);
+    g_hash_table_insert (kitty_cache->by_id, GUINT_TO_POINTER (id), entry);
+
+    /* Assume the oldest images were evicted by the terminal */
+    while (kitty_cache->n_bytes > kitty_cache->max_bytes
+           && kitty_cache->lru.length > 1)
+    {
+        remove_entry (kitty_cache, kitty_cache->lru.head->data);
+    }
+}
+
+void
+chafa_kitty_cache_remove (ChafaKittyCache *kitty_cache, guint32 id)
+{
+    Entry *entry;
+
+    entry = g_hash_table_lookup (kitty_cache->by_id, GUINT_TO_POINTER (id));
+    if (entry)
+        remove_entry (kitty_cache, entry);
+}
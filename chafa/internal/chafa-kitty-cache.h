@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+
+#ifndef __CHAFA_KITTY_CACHE_H__
+#define __CHAFA_KITTY_CACHE_H__
+
+#include <glib.h>
+#include "chafa.h"
+
+G_BEGIN_DECLS
+
+/* Keeps track of the images we've uploaded to a Kitty terminal during a
+ * session, so that identical images can be placed by ID instead of being
+ * sent again. The terminal may discard images under memory pressure
+ * without telling us, so we only remember up to a budget well below the
+ * terminal's quota, dropping the least recently used entries first. A
+ * forgotten image will simply be uploaded again. */
+
+typedef struct ChafaKittyCache ChafaKittyCache;
+
+ChafaKittyCache *chafa_kitty_cache_new (gsize max_bytes);
+void chafa_kitty_cache_destroy (ChafaKittyCache *kitty_cache);
+
+guint64 chafa_kitty_cache_hash_image (gconstpointer rgba, gint width, gint height);
+
+/* Returns the ID of a resident image with the given hash, or 0 */
+guint32 chafa_kitty_cache_lookup (ChafaKittyCache *kitty_cache, guint64 hash);
+
+/* Returns a new ID for an image that isn't under the caller's control */
+guint32 chafa_kitty_cache_alloc_id (ChafaKittyCache *kitty_cache);
+
+/* Records that an image was uploaded with the given ID. Any previous image
+ * with the same ID is forgotten, since the terminal will have replaced it. */
+void chafa_kitty_cache_insert (ChafaKittyCache *kitty_cache, guint64 hash, guint32 id,
+                               gsize n_bytes);
+
+/* Forgets the image with the given ID, if any. Used when the terminal tells
+ * us it doesn't have it. */
+void chafa_kitty_cache_remove (ChafaKittyCache *kitty_cache, guint32 id);
+
+G_END_DECLS
+
+#endif /* __CHAFA_KITTY_CACHE_H__ */
@@ -19,11 +19,24 @@
 
 #include "config.h"
 
+#include <string.h>
+#include <glib/gstdio.h>  /* g_unlink */
+
+#ifdef G_OS_UNIX
+# include <errno.h>
+# include <fcntl.h>
+# include <unistd.h>
+# ifdef HAVE_MMAP
+#  include <sys/mman.h>
+# endif
+#endif
+
 #include "chafa.h"
 #include "smolscale/smolscale.h"
 #include "internal/chafa-base64.h"
 #include "internal/chafa-batch.h"
 #include "internal/chafa-bitfield.h"
+#include "internal/chafa-deflate.h"
 #include "internal/chafa-indexed-image.h"
 #include "internal/chafa-math-util.h"
 #include "internal/chafa-kitty-renderer.h"
@@ -45,6 +58,20 @@ typedef struct
 }
 DrawCtx;
 
+/* Payload bytes per chunk when talking to the terminal directly. This
+ * encodes to 4096 bytes, the most Kitty accepts in one chunk. */
+#define DIRECT_CHUNK_LEN 3072
+
+typedef struct
+{
+    const guint8 *data;
+    gsize data_len;
+    gchar *out;
+    const gchar *begin_seq, *end_seq;
+    gint begin_len, end_len;
+}
+ChunkCtx;
+
 /* Kitty's cell-based placeholders use Unicode diacritics to encode each
  * cell's row/col offsets. The below table maps integers to code points
  * using this scheme. */
@@ -252,16 +279,114 @@ end_passthrough (ChafaPassthroughEncoder *ptenc)
     chafa_passthrough_encoder_flush (ptenc);
 }
 
+/* Returns the payload to transmit. If compression is requested and
+ * available, this will be a newly allocated PNG file; otherwise it's the
+ * raw RGBA buffer. */
+static const guint8 *
+get_payload (ChafaKittyRenderer *kitty_renderer, gint compression_level,
+             gint *bpp_out, gsize *len_out, guint8 **free_out)
+{
+    *free_out = NULL;
+
+    if (compression_level > 0)
+    {
+        *free_out = chafa_png_encode_rgba8 (kitty_renderer->rgba_image,
+                                            kitty_renderer->width,
+                                            kitty_renderer->height,
+                                            kitty_renderer->width * sizeof (guint32),
+                                            compression_level,
+                                            len_out);
+        if (*free_out)
+        {
+            *bpp_out = 100;
+            return *free_out;
+        }
+    }
+
+    *bpp_out = 32;
+    *len_out = (gsize) kitty_renderer->width * (gsize) kitty_renderer->height * sizeof (guint32);
+    return kitty_renderer->rgba_image;
+}
+
+static void
+encode_chunks_worker (ChafaBatchInfo *batch, const ChunkCtx *ctx)
+{
+    gsize stride = ctx->begin_len + CHAFA_BASE64_ENCODED_LEN (DIRECT_CHUNK_LEN) + ctx->end_len;
+    gint i;
+
+    for (i = batch->first_row; i < batch->first_row + batch->n_rows; i++)
+    {
+        gsize ofs = (gsize) i * DIRECT_CHUNK_LEN;
+        gchar *p = ctx->out + (gsize) i * stride;
+
+        memcpy (p, ctx->begin_seq, ctx->begin_len);
+        p += ctx->begin_len;
+        p = chafa_base64_encode_buf (ctx->data + ofs,
+                                     MIN (DIRECT_CHUNK_LEN, ctx->data_len - ofs),
+                                     p);
+        memcpy (p, ctx->end_seq, ctx->end_len);
+    }
+}
+
+/* Without passthrough, every chunk has the same framing and a known size,
+ * so we can size the output up front and encode the chunks in parallel. */
 static void
-build_image_chunks (ChafaKittyRenderer *kitty_renderer, ChafaPassthroughEncoder *ptenc)
+build_image_chunks_direct (const guint8 *data, gsize data_len, ChafaTermInfo *term_info,
+                           GString *out_str)
+{
+    gchar begin_seq [CHAFA_TERM_SEQ_LENGTH_MAX + 1];
+    gchar end_seq [CHAFA_TERM_SEQ_LENGTH_MAX + 1];
+    ChunkCtx ctx;
+    gint n_chunks;
+    gsize ofs;
+
+    n_chunks = (data_len + DIRECT_CHUNK_LEN - 1) / DIRECT_CHUNK_LEN;
+
+    ctx.data = data;
+    ctx.data_len = data_len;
+    ctx.begin_seq = begin_seq;
+    ctx.end_seq = end_seq;
+    ctx.begin_len = chafa_term_info_emit_begin_kitty_image_chunk (term_info, begin_seq) - begin_seq;
+    ctx.end_len = chafa_term_info_emit_end_kitty_image_chunk (term_info, end_seq) - end_seq;
+
+    if (n_chunks > 0)
+    {
+        gsize last_len = data_len - (gsize) (n_chunks - 1) * DIRECT_CHUNK_LEN;
+
+        ofs = out_str->len;
+        g_string_set_size (out_str, ofs
+                           + (gsize) n_chunks * (ctx.begin_len + ctx.end_len)
+                           + (gsize) (n_chunks - 1) * CHAFA_BASE64_ENCODED_LEN (DIRECT_CHUNK_LEN)
+                           + CHAFA_BASE64_ENCODED_LEN (last_len));
+        ctx.out = out_str->str + ofs;
+
+        chafa_process_batches (&ctx,
+                               (GFunc) encode_chunks_worker,
+                               NULL,
+                               n_chunks,
+                               chafa_get_n_actual_threads (),
+                               1);
+    }
+
+    *chafa_term_info_emit_end_kitty_image (term_info, end_seq) = '\0';
+    g_string_append (out_str, end_seq);
+}
+
+static void
+build_image_chunks (const guint8 *data, gsize data_len, ChafaPassthroughEncoder *ptenc)
 {
     const guint8 *p, *last;
     gchar seq [CHAFA_TERM_SEQ_LENGTH_MAX + 1];
 
-    last = ((guint8 *) kitty_renderer->rgba_image)
-        + (gsize) kitty_renderer->width * (gsize) kitty_renderer->height * sizeof (guint32);
+    if (ptenc->mode == CHAFA_PASSTHROUGH_NONE)
+    {
+        build_image_chunks_direct (data, data_len, ptenc->term_info, ptenc->out);
+        return;
+    }
+
+    last = data + data_len;
 
-    for (p = kitty_renderer->rgba_image; p < last; )
+    for (p = data; p < last; )
     {
         const guint8 *end;
 
@@ -288,29 +413,369 @@ build_image_chunks (ChafaKittyRenderer *kitty_renderer, ChafaPassthroughEncoder
     end_passthrough (ptenc);
 }
 
+/* If image_id is positive, the image is transmitted with that ID so it can
+ * be used as the first frame of an animation. */
 static void
 build_immediate (ChafaKittyRenderer *kitty_renderer, ChafaTermInfo *term_info, GString *out_str,
-                 gint width_cells, gint height_cells)
+                 gint width_cells, gint height_cells, gint image_id, gint compression_level)
 {
     ChafaPassthroughEncoder ptenc;
     gchar seq [CHAFA_TERM_SEQ_LENGTH_MAX + 1];
+    const guint8 *payload;
+    guint8 *payload_alloc;
+    gsize payload_len;
+    gint bpp;
+
+    payload = get_payload (kitty_renderer, compression_level,
+                           &bpp, &payload_len, &payload_alloc);
 
     chafa_passthrough_encoder_begin (&ptenc, CHAFA_PASSTHROUGH_NONE, term_info, out_str);
 
-    *chafa_term_info_emit_begin_kitty_immediate_image_v1 (term_info, seq,
-                                                          32,
-                                                          kitty_renderer->width,
-                                                          kitty_renderer->height,
-                                                          width_cells,
-                                                          height_cells) = '\0';
+    if (image_id > 0)
+    {
+        *chafa_term_info_emit_begin_kitty_immediate_image_with_id_v1 (term_info, seq,
+                                                                      bpp,
+                                                                      kitty_renderer->width,
+                                                                      kitty_renderer->height,
+                                                                      width_cells,
+                                                                      height_cells,
+                                                                      image_id) = '\0';
+        kitty_renderer->image_id = image_id;
+        kitty_renderer->frame_index = 1;
+    }
+    else
+    {
+        *chafa_term_info_emit_begin_kitty_immediate_image_v1 (term_info, seq,
+                                                              bpp,
+                                                              kitty_renderer->width,
+                                                              kitty_renderer->height,
+                                                              width_cells,
+                                                              height_cells) = '\0';
+    }
+
     chafa_passthrough_encoder_append (&ptenc, seq);
     chafa_passthrough_encoder_flush (&ptenc);
 
-    build_image_chunks (kitty_renderer, &ptenc);
+    build_image_chunks (payload, payload_len, &ptenc);
 
     chafa_passthrough_encoder_end (&ptenc);
+    g_free (payload_alloc);
+}
+
+static gboolean
+can_build_frame (ChafaKittyRenderer *kitty_renderer, ChafaKittyRenderer *prev_kitty_renderer,
+                 ChafaTermInfo *term_info, gint image_id)
+{
+    return image_id > 0
+        && prev_kitty_renderer->image_id == image_id
+        && prev_kitty_renderer->frame_index > 0
+        && prev_kitty_renderer->width == kitty_renderer->width
+        && prev_kitty_renderer->height == kitty_renderer->height
+        && chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_BEGIN_KITTY_ANIMATION_FRAME_V1)
+        && chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_SET_KITTY_ANIMATION_FRAME_V1);
+}
+
+/* Finds the bounding rectangle of pixels that differ between the two images.
+ * Returns FALSE if they're identical. */
+static gboolean
+find_changed_rect (ChafaKittyRenderer *kitty_renderer, ChafaKittyRenderer *prev_kitty_renderer,
+                   gint *x_out, gint *y_out, gint *width_out, gint *height_out)
+{
+    const guint32 *cur = kitty_renderer->rgba_image;
+    const guint32 *prev = prev_kitty_renderer->rgba_image;
+    gint width = kitty_renderer->width;
+    gint x0 = width, x1 = -1, y0 = -1, y1 = -1;
+    gint row;
+
+    for (row = 0; row < kitty_renderer->height; row++)
+    {
+        const guint32 *cur_row = cur + (gsize) row * width;
+        const guint32 *prev_row = prev + (gsize) row * width;
+        gint i;
+
+        if (!memcmp (cur_row, prev_row, width * sizeof (guint32)))
+            continue;
+
+        if (y0 < 0)
+            y0 = row;
+        y1 = row;
+
+        for (i = 0; i < x0 && cur_row [i] == prev_row [i]; i++)
+            ;
+        x0 = i;
+
+        for (i = width - 1; i > x1 && cur_row [i] == prev_row [i]; i--)
+            ;
+        x1 = i;
+    }
+
+    if (y0 < 0)
+        return FALSE;
+
+    *x_out = x0;
+    *y_out = y0;
+    *width_out = x1 - x0 + 1;
+    *height_out = y1 - y0 + 1;
+    return TRUE;
+}
+
+/* Appends the image as a new frame to the animation that prev_kitty_renderer
+ * belongs to, transferring only the rectangle that changed, and makes it the
+ * current frame. The cursor is left where an immediate placement would have
+ * left it. */
+static void
+build_frame (ChafaKittyRenderer *kitty_renderer, ChafaKittyRenderer *prev_kitty_renderer,
+             ChafaTermInfo *term_info, GString *out_str,
+             gint width_cells, gint height_cells, gint image_id, gint compression_level)
+{
+    ChafaPassthroughEncoder ptenc;
+    gchar seq [CHAFA_TERM_SEQ_LENGTH_MAX * 3 + 1];
+    const guint32 *src;
+    guint8 *rect, *payload_alloc = NULL;
+    const guint8 *payload;
+    gsize payload_len;
+    gint x, y, width, height;
+    gint bpp = 32;
+    gint row;
+    gchar *p0;
+
+    /* Kitty has no way to add a frame without pixel data, so if nothing
+     * changed we send one pixel's worth of it. */
+    if (!find_changed_rect (kitty_renderer, prev_kitty_renderer,
+                            &x, &y, &width, &height))
+    {
+        x = y = 0;
+        width = height = 1;
+    }
+
+    rect = g_malloc ((gsize) width * height * sizeof (guint32));
+    src = (const guint32 *) kitty_renderer->rgba_image
+        + (gsize) y * kitty_renderer->width + x;
+
+    for (row = 0; row < height; row++)
+    {
+        memcpy (rect + (gsize) row * width * sizeof (guint32),
+                src + (gsize) row * kitty_renderer->width,
+                width * sizeof (guint32));
+    }
+
+    payload = rect;
+    payload_len = (gsize) width * height * sizeof (guint32);
+
+    if (compression_level > 0)
+    {
+        payload_alloc = chafa_png_encode_rgba8 (rect, width, height,
+                                                width * sizeof (guint32),
+                                                compression_level,
+                                                &payload_len);
+        if (payload_alloc)
+        {
+            payload = payload_alloc;
+            bpp = 100;
+        }
+        else
+        {
+            payload_len = (gsize) width * height * sizeof (guint32);
+        }
+    }
+
+    chafa_passthrough_encoder_begin (&ptenc, CHAFA_PASSTHROUGH_NONE, term_info, out_str);
+
+    *chafa_term_info_emit_begin_kitty_animation_frame_v1 (term_info, seq,
+                                                          image_id, bpp,
+                                                          x, y, width, height,
+                                                          prev_kitty_renderer->frame_index) = '\0';
+    chafa_passthrough_encoder_append (&ptenc, seq);
+    chafa_passthrough_encoder_flush (&ptenc);
+
+    build_image_chunks (payload, payload_len, &ptenc);
+
+    chafa_passthrough_encoder_end (&ptenc);
+    g_free (payload_alloc);
+    g_free (rect);
+
+    kitty_renderer->image_id = image_id;
+    kitty_renderer->frame_index = prev_kitty_renderer->frame_index + 1;
+
+    p0 = chafa_term_info_emit_set_kitty_animation_frame_v1 (term_info, seq, image_id,
+                                                            kitty_renderer->frame_index);
+    if (width_cells > 0)
+        p0 = chafa_term_info_emit_cursor_right (term_info, p0, width_cells);
+    if (height_cells > 1)
+        p0 = chafa_term_info_emit_cursor_down (term_info, p0, height_cells - 1);
+    g_string_append_len (out_str, seq, p0 - seq);
+}
+
+#ifdef G_OS_UNIX
+
+static gboolean
+write_all (gint fd, const guint8 *data, gsize len)
+{
+    while (len > 0)
+    {
+        gssize n = write (fd, data, len);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return TRUE;
 }
 
+#if defined (HAVE_SHM_OPEN) && defined (HAVE_MMAP)
+
+/* Copies the image into a new POSIX shared memory object and returns its
+ * name. The terminal unlinks the object after reading it. */
+static gchar *
+store_in_shm (const guint8 *data, gsize len)
+{
+    gchar name [64];
+    gpointer map;
+    gint fd = -1;
+    gint i;
+
+    for (i = 0; i < 8 && fd < 0; i++)
+    {
+        g_snprintf (name, sizeof (name), "/chafa-%lu-%08x",
+                    (gulong) getpid (), g_random_int ());
+        fd = shm_open (name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 && errno != EEXIST)
+            return NULL;
+    }
+
+    if (fd < 0)
+        return NULL;
+
+    if (ftruncate (fd, len) < 0)
+        goto fail;
+
+    map = mmap (NULL, len, PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        goto fail;
+
+    memcpy (map, data, len);
+    munmap (map, len);
+    close (fd);
+
+    return g_strdup (name);
+
+fail:
+    close (fd);
+    shm_unlink (name);
+    return NULL;
+}
+
+#endif
+
+/* Writes the image to a temporary file and returns its path. The terminal
+ * deletes the file after reading it, but only if its name contains the
+ * string "tty-graphics-protocol". */
+static gchar *
+store_in_temp_file (const guint8 *data, gsize len)
+{
+    gchar *path = NULL;
+    gint fd;
+
+    fd = g_file_open_tmp ("tty-graphics-protocol-XXXXXX", &path, NULL);
+    if (fd < 0)
+        return NULL;
+
+    if (!write_all (fd, data, len))
+    {
+        close (fd);
+        g_unlink (path);
+        g_free (path);
+        return NULL;
+    }
+
+    close (fd);
+    return path;
+}
+
+/* Hands the image over out of band, through shared memory or a temporary
+ * file. The term info will only have the required sequences if the terminal
+ * is local. Returns FALSE without emitting anything if this isn't possible,
+ * in which case the caller should fall back to inline transmission.
+ *
+ * The terminal will reply to the command, and the caller must read the
+ * reply to find out if the transfer worked. If it didn't, nothing is
+ * displayed, and the image must be sent again inline.
+ *
+ * We always send raw pixels here; compression would only cost CPU. */
+static gboolean
+build_local (ChafaKittyRenderer *kitty_renderer, ChafaTermInfo *term_info, GString *out_str,
+             gint width_cells, gint height_cells, gint image_id)
+{
+    gchar seq [CHAFA_TERM_SEQ_LENGTH_MAX + 1];
+    const guint8 *data = kitty_renderer->rgba_image;
+    gsize len = (gsize) kitty_renderer->width * (gsize) kitty_renderer->height * sizeof (guint32);
+    gchar *name = NULL;
+    gchar *p0 = seq;
+
+#if defined (HAVE_SHM_OPEN) && defined (HAVE_MMAP)
+    if (chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_SHM_V1)
+        && (name = store_in_shm (data, len)))
+    {
+        p0 = chafa_term_info_emit_begin_kitty_immediate_image_shm_v1 (term_info, seq,
+                                                                      32,
+                                                                      kitty_renderer->width,
+                                                                      kitty_renderer->height,
+                                                                      width_cells,
+                                                                      height_cells,
+                                                                      image_id);
+    }
+#endif
+
+    if (!name
+        && chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_TEMP_FILE_V1)
+        && (name = store_in_temp_file (data, len)))
+    {
+        p0 = chafa_term_info_emit_begin_kitty_immediate_image_temp_file_v1 (term_info, seq,
+                                                                            32,
+                                                                            kitty_renderer->width,
+                                                                            kitty_renderer->height,
+                                                                            width_cells,
+                                                                            height_cells,
+                                                                            image_id);
+    }
+
+    if (!name)
+        return FALSE;
+
+    g_string_append_len (out_str, seq, p0 - seq);
+    encode_chunk (out_str, (const guint8 *) name, (const guint8 *) name + strlen (name));
+    p0 = chafa_term_info_emit_end_kitty_image_chunk (term_info, seq);
+    g_string_append_len (out_str, seq, p0 - seq);
+
+    g_free (name);
+
+    kitty_renderer->image_id = image_id;
+    kitty_renderer->frame_index = 1;
+    return TRUE;
+}
+
+#else
+
+static gboolean
+build_local (G_GNUC_UNUSED ChafaKittyRenderer *kitty_renderer,
+             G_GNUC_UNUSED ChafaTermInfo *term_info,
+             G_GNUC_UNUSED GString *out_str,
+             G_GNUC_UNUSED gint width_cells,
+             G_GNUC_UNUSED gint height_cells,
+             G_GNUC_UNUSED gint image_id)
+{
+    return FALSE;
+}
+
+#endif /* !G_OS_UNIX */
+
 static gboolean
 screen_is_wide_diacritic (gint diacritic_index)
 {
@@ -419,15 +884,22 @@ build_unicode_placement (ChafaTermInfo *term_info,
 static void
 build_unicode_virtual (ChafaKittyRenderer *kitty_renderer, ChafaTermInfo *term_info, GString *out_str,
                        gint width_cells, gint height_cells, gint placement_id,
-                       ChafaPassthrough passthrough)
+                       ChafaPassthrough passthrough, gint compression_level)
 {
     ChafaPassthroughEncoder ptenc;
     gchar seq [CHAFA_TERM_SEQ_LENGTH_MAX + 1];
+    const guint8 *payload;
+    guint8 *payload_alloc;
+    gsize payload_len;
+    gint bpp;
+
+    payload = get_payload (kitty_renderer, compression_level,
+                           &bpp, &payload_len, &payload_alloc);
 
     chafa_passthrough_encoder_begin (&ptenc, passthrough, term_info, out_str);
 
     *chafa_term_info_emit_begin_kitty_immediate_virt_image_v1 (term_info, seq,
-                                                               32,
+                                                               bpp,
                                                                kitty_renderer->width,
                                                                kitty_renderer->height,
                                                                width_cells,
@@ -437,26 +909,176 @@ build_unicode_virtual (ChafaKittyRenderer *kitty_renderer, ChafaTermInfo *term_i
     chafa_passthrough_encoder_reset (&ptenc);
     end_passthrough (&ptenc);
 
-    build_image_chunks (kitty_renderer, &ptenc);
+    build_image_chunks (payload, payload_len, &ptenc);
 
     end_passthrough (&ptenc);
     chafa_passthrough_encoder_end (&ptenc);
+    g_free (payload_alloc);
 
     build_unicode_placement (term_info, out_str, width_cells, height_cells,
                              placement_id, passthrough);
 }
 
+/* Places an image that's already resident in the terminal. Returns its ID,
+ * or 0 if we don't know of one with identical contents.
+ *
+ * In the direct case, the terminal replies to the placement. The image may
+ * have been evicted, in which case the caller must send it again. */
+static guint32
+build_cached (ChafaKittyCache *kitty_cache, guint64 hash,
+              ChafaTermInfo *term_info, GString *out_str,
+              gint width_cells, gint height_cells,
+              ChafaPassthrough passthrough)
+{
+    gchar seq [CHAFA_TERM_SEQ_LENGTH_MAX + 1];
+    guint32 image_id;
+
+    image_id = chafa_kitty_cache_lookup (kitty_cache, hash);
+    if (image_id == 0)
+        return 0;
+
+    if (passthrough == CHAFA_PASSTHROUGH_NONE)
+    {
+        gchar *p0;
+
+        p0 = chafa_term_info_emit_put_kitty_image_v1 (term_info, seq, image_id,
+                                                      width_cells, height_cells);
+        g_string_append_len (out_str, seq, p0 - seq);
+    }
+    else
+    {
+        /* The virtual placement made at upload time is still valid, so we
+         * only need to print the placeholders */
+        build_unicode_placement (term_info, out_str, width_cells, height_cells,
+                                 image_id, passthrough);
+    }
+
+    return image_id;
+}
+
+/* If reply_out is not NULL, the caller reads the terminal's replies and
+ * will act on them. This is required for placing cached images directly,
+ * since they may have been evicted, and for local transfers, which may
+ * fail. reply_out is then filled in with the reply to expect. */
 void
 chafa_kitty_renderer_build_ansi (ChafaKittyRenderer *kitty_renderer,
-                               ChafaTermInfo *term_info, GString *out_str,
-                               gint width_cells, gint height_cells,
-                               gint placement_id,
-                               ChafaPassthrough passthrough)
+                                 ChafaKittyRenderer *prev_kitty_renderer,
+                                 ChafaTermInfo *term_info, GString *out_str,
+                                 gint width_cells, gint height_cells,
+                                 gint placement_id,
+                                 ChafaPassthrough passthrough,
+                                 gint compression_level,
+                                 ChafaKittyCache *kitty_cache,
+                                 gboolean local_transfer,
+                                 ChafaKittyReply *reply_out)
 {
+    guint64 hash = 0;
+
+    kitty_renderer->image_id = 0;
+    kitty_renderer->frame_index = 0;
+
+    if (reply_out)
+    {
+        reply_out->image_id = 0;
+        reply_out->is_local = FALSE;
+    }
+    else
+    {
+        local_transfer = FALSE;
+    }
+
+    /* An upload with the caller's ID replaces any cached image with the
+     * same one */
+    if (kitty_cache && passthrough == CHAFA_PASSTHROUGH_NONE && placement_id > 0)
+        chafa_kitty_cache_remove (kitty_cache, placement_id);
+
+    /* Animations modify the uploaded image, so they can't be shared. In the
+     * direct case, an explicit ID means the caller intends to add frames. We
+     * also need a sequence to place images by ID, and someone to tell us if
+     * the terminal no longer has the image. */
+    if (kitty_cache
+        && (prev_kitty_renderer
+            || (passthrough == CHAFA_PASSTHROUGH_NONE
+                && (placement_id > 0
+                    || !reply_out
+                    || !chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_PUT_KITTY_IMAGE_V1)
+                    || !chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_WITH_ID_V1)))))
+        kitty_cache = NULL;
+
+    if (kitty_cache)
+    {
+        guint32 image_id;
+
+        hash = chafa_kitty_cache_hash_image (kitty_renderer->rgba_image,
+                                             kitty_renderer->width,
+                                             kitty_renderer->height);
+
+        /* Virtual placements are made with a fixed cell extent */
+        if (passthrough != CHAFA_PASSTHROUGH_NONE)
+            hash ^= ((guint64) width_cells << 48) ^ ((guint64) height_cells << 32);
+
+        image_id = build_cached (kitty_cache, hash, term_info, out_str,
+                                 width_cells, height_cells, passthrough);
+        if (image_id != 0)
+        {
+            if (passthrough == CHAFA_PASSTHROUGH_NONE)
+                reply_out->image_id = image_id;
+            return;
+        }
+    }
+
     if (passthrough == CHAFA_PASSTHROUGH_NONE)
     {
-        build_immediate (kitty_renderer, term_info, out_str,
-                         width_cells, height_cells);
+        /* Animation frames are only sent directly to the terminal. Muxers
+         * don't pass the required sequences through. */
+        if (prev_kitty_renderer
+            && can_build_frame (kitty_renderer, prev_kitty_renderer, term_info, placement_id))
+        {
+            build_frame (kitty_renderer, prev_kitty_renderer, term_info, out_str,
+                         width_cells, height_cells, placement_id, compression_level);
+        }
+        else if (kitty_cache)
+        {
+            /* Needs an ID, so it can be placed again later */
+            gint image_id = chafa_kitty_cache_alloc_id (kitty_cache);
+
+            if (local_transfer
+                && build_local (kitty_renderer, term_info, out_str,
+                                width_cells, height_cells, image_id))
+            {
+                reply_out->image_id = image_id;
+                reply_out->is_local = TRUE;
+            }
+            else
+            {
+                build_immediate (kitty_renderer, term_info, out_str,
+                                 width_cells, height_cells, image_id, compression_level);
+            }
+
+            kitty_renderer->image_id = 0;
+            kitty_renderer->frame_index = 0;
+            chafa_kitty_cache_insert (kitty_cache, hash, image_id,
+                                      (gsize) kitty_renderer->width * kitty_renderer->height
+                                      * sizeof (guint32));
+        }
+        else if (placement_id > 0 && local_transfer
+                 && build_local (kitty_renderer, term_info, out_str,
+                                 width_cells, height_cells, placement_id))
+        {
+            reply_out->image_id = placement_id;
+            reply_out->is_local = TRUE;
+        }
+        else if (placement_id > 0
+                 && chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_WITH_ID_V1))
+        {
+            build_immediate (kitty_renderer, term_info, out_str,
+                             width_cells, height_cells, placement_id, compression_level);
+        }
+        else
+        {
+            build_immediate (kitty_renderer, term_info, out_str,
+                             width_cells, height_cells, -1, compression_level);
+        }
     }
     else
     {
@@ -469,6 +1091,12 @@ chafa_kitty_renderer_build_ansi (ChafaKittyRenderer *kitty_renderer,
 
         build_unicode_virtual (kitty_renderer, term_info, out_str,
                                width_cells, height_cells,
-                               placement_id, passthrough);
+                               placement_id, passthrough, compression_level);
+
+        /* This replaces any older image with the same ID */
+        if (kitty_cache)
+            chafa_kitty_cache_insert (kitty_cache, hash, placement_id,
+                                      (gsize) kitty_renderer->width * kitty_renderer->height
+                                      * sizeof (guint32));
     }
 }
@@ -21,6 +21,7 @@
 #define __CHAFA_KITTY_RENDERER_H__
 
 #include "chafa.h"
+#include "internal/chafa-kitty-cache.h"
 
 G_BEGIN_DECLS
 
@@ -28,9 +29,29 @@ typedef struct
 {
     gint width, height;
     gpointer rgba_image;
+
+    /* Set when the image was transmitted with an ID, so that subsequent
+     * frames can be sent as deltas against it. Frame indexes are 1-based;
+     * 0 means no animation frame is associated with this image. */
+    gint image_id;
+    gint frame_index;
 }
 ChafaKittyRenderer;
 
+/* Describes the reply the terminal will send for the generated output.
+ * Only the most recent command is of interest; if it failed, nothing was
+ * displayed, and the image must be sent again. */
+typedef struct
+{
+    /* ID the terminal will reply for, or 0 if no reply is expected */
+    guint32 image_id;
+
+    /* TRUE if the command was a local transfer, FALSE if it placed an
+     * image from the cache */
+    guint is_local : 1;
+}
+ChafaKittyReply;
+
 ChafaKittyRenderer *chafa_kitty_renderer_new (gint width, gint height);
 void chafa_kitty_renderer_destroy (ChafaKittyRenderer *kitty_renderer);
 
@@ -41,10 +62,16 @@ void chafa_kitty_renderer_draw_all_pixels (ChafaKittyRenderer *kitty_renderer,
                                            ChafaColor bg_color,
                                            ChafaAlign halign, ChafaAlign valign,
                                            ChafaTuck tuck);
-void chafa_kitty_renderer_build_ansi (ChafaKittyRenderer *kitty_renderer, ChafaTermInfo *term_info, GString *out_str,
+void chafa_kitty_renderer_build_ansi (ChafaKittyRenderer *kitty_renderer,
+                                      ChafaKittyRenderer *prev_kitty_renderer,
+                                      ChafaTermInfo *term_info, GString *out_str,
                                       gint width_cells, gint height_cells,
                                       gint placement_id,
-                                      ChafaPassthrough passthrough);
+                                      ChafaPassthrough passthrough,
+                                      gint compression_level,
+                                      ChafaKittyCache *kitty_cache,
+                                      gboolean local_transfer,
+                                      ChafaKittyReply *reply_out);
 
 G_END_DECLS
 
@@ -30,6 +30,7 @@
 #include "internal/chafa-math-util.h"
 #include "internal/chafa-noise.h"
 #include "internal/chafa-palette.h"
+#include "internal/chafa-seq-trie.h"
 #include "internal/chafa-sixel-renderer.h"
 
 G_BEGIN_DECLS
@@ -115,8 +116,10 @@ struct ChafaCanvasConfig
     ChafaSymbolMap fill_symbol_map;
     guint preprocessing_enabled : 1;
     guint fg_only_enabled : 1;
+    guint local_transfer_enabled : 1;
     ChafaOptimizations optimizations;
     ChafaPassthrough passthrough;
+    gint compression_level;
 };
 
 /* Frame */
@@ -170,6 +173,7 @@ gboolean chafa_have_mmx (void) G_GNUC_PURE;
 gboolean chafa_have_sse41 (void) G_GNUC_PURE;
 gboolean chafa_have_popcnt (void) G_GNUC_PURE;
 gboolean chafa_have_avx2 (void) G_GNUC_PURE;
+void chafa_restrict_features (ChafaFeatures features);
 
 void chafa_symbol_map_init (ChafaSymbolMap *symbol_map);
 void chafa_symbol_map_deinit (ChafaSymbolMap *symbol_map);
@@ -201,6 +205,23 @@ void chafa_canvas_config_init (ChafaCanvasConfig *canvas_config);
 void chafa_canvas_config_deinit (ChafaCanvasConfig *canvas_config);
 void chafa_canvas_config_copy_contents (ChafaCanvasConfig *dest, const ChafaCanvasConfig *src);
 
+GString *chafa_canvas_print_with_kitty_cache (ChafaCanvas *canvas, ChafaTermInfo *term_info,
+                                              ChafaKittyCache *kitty_cache, gboolean allow_local,
+                                              ChafaKittyReply *reply_out);
+
+ChafaSeqTrie *chafa_term_info_build_seq_trie (const ChafaTermInfo *term_info);
+guint chafa_term_info_get_seq_serial (const ChafaTermInfo *term_info);
+
+/* I/O reactor */
+
+typedef struct ChafaReactorSource ChafaReactorSource;
+typedef void (*ChafaReactorFunc) (gpointer data, GIOCondition revents);
+
+ChafaReactorSource *chafa_reactor_add_fd (ChafaReactor *reactor, gint fd,
+                                          ChafaReactorFunc func, gpointer data);
+void chafa_reactor_source_arm (ChafaReactorSource *source, GIOCondition events);
+void chafa_reactor_source_remove (ChafaReactorSource *source);
+
 gint *chafa_gen_bayer_matrix (gint matrix_size, gfloat magnitude);
 
 /* Math stuff */
@@ -211,6 +232,7 @@ void chafa_extract_cell_mean_colors_mmx (const ChafaPixel *pixels, ChafaColorAcc
 
 #ifdef HAVE_SSE41_INTRINSICS
 gint chafa_calc_cell_error_sse41 (const ChafaPixel *pixels, const ChafaColorPair *color_pair, const guint8 *cov);
+gsize chafa_base64_encode_sse41 (const guint8 *in, gsize in_len, gchar *out);
 #endif
 
 #ifdef HAVE_AVX2_INTRINSICS
@@ -219,6 +241,10 @@ gint chafa_calc_cell_error_avx2 (const ChafaPixel *pixels, const ChafaColorPair
 void chafa_extract_cell_mean_colors_avx2 (const ChafaPixel *pixels, ChafaColorAccum *accums_out,
                                           const guint32 *sym_mask_u32);
 void chafa_color_accum_div_scalar_avx2 (ChafaColorAccum *accum, guint16 divisor);
+gint chafa_sixel_band_to_schars_avx2 (const guint8 *pixels, gint width, guint8 pen,
+                                      const guint8 *mask, guint8 *schars_out);
+gint chafa_find_byte_run_end_avx2 (const guint8 *p, gint start, gint end);
+gsize chafa_base64_encode_avx2 (const guint8 *in, gsize in_len, gchar *out);
 #endif
 
 #if defined(HAVE_POPCNT64_INTRINSICS) || defined(HAVE_POPCNT32_INTRINSICS)
@@ -0,0 +1,241 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include "config.h"
+
+#include <string.h>  /* strcmp */
+#include <sys/types.h>  /* stat */
+#include <sys/stat.h>  /* stat */
+#include <unistd.h>  /* ttyname, getsid */
+#include <glib/gstdio.h>  /* g_unlink */
+
+#include "chafa.h"
+#include "internal/chafa-probe-cache.h"
+
+#define CACHE_DIR_NAME "chafa"
+#define CACHE_GROUP "probe"
+
+/* Bump this if the meaning of the stored values changes */
+#define CACHE_VERSION 1
+
+/* Environment variables that tell terminals apart. The tty device and
+ * session are added to these. */
+static const gchar *identity_env_vars [] =
+{
+    "TERM",
+    "COLORTERM",
+    "TERM_PROGRAM",
+    "TERM_PROGRAM_VERSION",
+    "LC_TERMINAL",
+    "LC_TERMINAL_VERSION",
+    "VTE_VERSION",
+    "KONSOLE_VERSION",
+    "TMUX",
+    "STY",
+    NULL
+};
+
+static const gchar *
+get_runtime_dir (void)
+{
+    const gchar *dir = g_getenv ("XDG_RUNTIME_DIR");
+
+    /* Don't fall back to anything that outlives the session */
+    if (!dir || !*dir || !g_path_is_absolute (dir))
+        return NULL;
+
+    return dir;
+}
+
+static gchar *
+get_entry_path (const gchar *key)
+{
+    const gchar *runtime_dir;
+    gchar *checksum, *name, *path;
+
+    runtime_dir = get_runtime_dir ();
+    if (!runtime_dir)
+        return NULL;
+
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key, -1);
+    name = g_strconcat ("probe-", checksum, NULL);
+    path = g_build_filename (runtime_dir, CACHE_DIR_NAME, name, NULL);
+
+    g_free (name);
+    g_free (checksum);
+    return path;
+}
+
+static gint
+get_int (GKeyFile *key_file, const gchar *name, gint fallback)
+{
+    GError *error = NULL;
+    gint value;
+
+    value = g_key_file_get_integer (key_file, CACHE_GROUP, name, &error);
+    if (error)
+    {
+        g_error_free (error);
+        return fallback;
+    }
+
+    return value;
+}
+
+gchar *
+chafa_probe_cache_get_key (gint tty_fd)
+{
+#ifdef G_OS_WIN32
+    (void) tty_fd;
+    return NULL;
+#else
+    GString *key;
+    const gchar *tty_name;
+    struct stat st;
+    gint i;
+
+    if (!get_runtime_dir ())
+        return NULL;
+
+    tty_name = ttyname (tty_fd);
+    if (!tty_name || fstat (tty_fd, &st) < 0)
+        return NULL;
+
+    key = g_string_new (NULL);
+
+    for (i = 0; identity_env_vars [i]; i++)
+    {
+        const gchar *value = g_getenv (identity_env_vars [i]);
+
+        /* Tell unset and empty apart */
+        if (value)
+            g_string_append_printf (key, "%s=%s\n", identity_env_vars [i], value);
+        else
+            g_string_append_printf (key, "%s\n", identity_env_vars [i]);
+    }
+
+    g_string_append_printf (key, "tty=%s:%lu\n", tty_name, (gulong) st.st_rdev);
+    g_string_append_printf (key, "sid=%ld\n", (glong) getsid (0));
+
+    return g_string_free (key, FALSE);
+#endif
+}
+
+gboolean
+chafa_probe_cache_load (const gchar *key, ChafaProbeResults *results_out)
+{
+    GKeyFile *key_file = NULL;
+    gchar *path, *stored_key = NULL;
+    gboolean success = FALSE;
+
+    g_return_val_if_fail (key != NULL, FALSE);
+    g_return_val_if_fail (results_out != NULL, FALSE);
+
+    path = get_entry_path (key);
+    if (!path)
+        goto out;
+
+    key_file = g_key_file_new ();
+    if (!g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, NULL))
+        goto out;
+
+    if (get_int (key_file, "version", -1) != CACHE_VERSION)
+        goto out;
+
+    /* Guard against checksum collisions */
+    stored_key = g_key_file_get_string (key_file, CACHE_GROUP, "key", NULL);
+    if (!stored_key || strcmp (stored_key, key))
+        goto out;
+
+    results_out->default_fg_rgb = get_int (key_file, "default-fg", -1);
+    results_out->default_bg_rgb = get_int (key_file, "default-bg", -1);
+    results_out->width_cells = get_int (key_file, "width-cells", -1);
+    results_out->height_cells = get_int (key_file, "height-cells", -1);
+    results_out->width_px = get_int (key_file, "width-px", -1);
+    results_out->height_px = get_int (key_file, "height-px", -1);
+    results_out->cell_width_px = get_int (key_file, "cell-width-px", -1);
+    results_out->cell_height_px = get_int (key_file, "cell-height-px", -1);
+    results_out->found_sixel = get_int (key_file, "sixel", 0) ? TRUE : FALSE;
+
+    success = TRUE;
+
+out:
+    g_free (stored_key);
+    if (key_file)
+        g_key_file_free (key_file);
+    g_free (path);
+    return success;
+}
+
+void
+chafa_probe_cache_store (const gchar *key, const ChafaProbeResults *results)
+{
+    GKeyFile *key_file;
+    gchar *path, *dir, *data;
+    gsize data_len;
+
+    g_return_if_fail (key != NULL);
+    g_return_if_fail (results != NULL);
+
+    path = get_entry_path (key);
+    if (!path)
+        return;
+
+    key_file = g_key_file_new ();
+
+    g_key_file_set_integer (key_file, CACHE_GROUP, "version", CACHE_VERSION);
+    g_key_file_set_string (key_file, CACHE_GROUP, "key", key);
+    g_key_file_set_integer (key_file, CACHE_GROUP, "default-fg", results->default_fg_rgb);
+    g_key_file_set_integer (key_file, CACHE_GROUP, "default-bg", results->default_bg_rgb);
+    g_key_file_set_integer (key_file, CACHE_GROUP, "width-cells", results->width_cells);
+    g_key_file_set_integer (key_file, CACHE_GROUP, "height-cells", results->height_cells);
+    g_key_file_set_integer (key_file, CACHE_GROUP, "width-px", results->width_px);
+    g_key_file_set_integer (key_file, CACHE_GROUP, "height-px", results->height_px);
+    g_key_file_set_integer (key_file, CACHE_GROUP, "cell-width-px", results->cell_width_px);
+    g_key_file_set_integer (key_file, CACHE_GROUP, "cell-height-px", results->cell_height_px);
+    g_key_file_set_integer (key_file, CACHE_GROUP, "sixel", results->found_sixel ? 1 : 0);
+
+    data = g_key_file_to_data (key_file, &data_len, NULL);
+
+    /* The cache is best-effort, so errors are ignored. Entries are replaced
+     * atomically, so concurrent readers never see a partial one. */
+    dir = g_path_get_dirname (path);
+    if (g_mkdir_with_parents (dir, 0700) == 0)
+        g_file_set_contents (path, data, data_len, NULL);
+
+    g_free (dir);
+    g_free (data);
+    g_key_file_free (key_file);
+    g_free (path);
+}
+
+void
+chafa_probe_cache_remove (const gchar *key)
+{
+    gchar *path;
+
+    g_return_if_fail (key != NULL);
+
+    path = get_entry_path (key);
+    if (!path)
+        return;
+
+    g_unlink (path);
+    g_free (path);
+}
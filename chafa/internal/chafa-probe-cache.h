@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __CHAFA_PROBE_CACHE_H__
+#define __CHAFA_PROBE_CACHE_H__
+
+#include <glib.h>
+#include "chafa.h"
+
+G_BEGIN_DECLS
+
+/* Remembers terminal probe results across processes, so that programs that
+ * are started over and over in the same terminal (e.g. file previewers)
+ * don't have to wait for replies every time. Entries are stored in
+ * $XDG_RUNTIME_DIR, which is private to the user and cleared on logout,
+ * and are keyed by everything that identifies the terminal: The relevant
+ * environment variables, the tty device and the session. */
+
+typedef struct
+{
+    gint32 default_fg_rgb;
+    gint32 default_bg_rgb;
+
+    /* Text area size at the time of probing. The results are only valid
+     * for this size, since the font may have changed otherwise. */
+    gint width_cells, height_cells;
+    gint width_px, height_px;
+    gint cell_width_px, cell_height_px;
+
+    guint found_sixel : 1;
+}
+ChafaProbeResults;
+
+/* Returns a newly allocated key for the terminal on tty_fd, or NULL if the
+ * terminal can't be identified or there is nowhere to store the cache. */
+gchar *chafa_probe_cache_get_key (gint tty_fd);
+
+gboolean chafa_probe_cache_load (const gchar *key, ChafaProbeResults *results_out);
+void chafa_probe_cache_store (const gchar *key, const ChafaProbeResults *results);
+void chafa_probe_cache_remove (const gchar *key);
+
+G_END_DECLS
+
+#endif /* __CHAFA_PROBE_CACHE_H__ */
@@ -0,0 +1,299 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include "config.h"
+
+#include <string.h>  /* memcpy */
+#include "chafa.h"
+#include "internal/chafa-seq-trie.h"
+#include "internal/chafa-string-util.h"
+
+#define NODE_NONE -1
+#define SEQ_NONE CHAFA_TERM_SEQ_MAX
+
+/* Edge types. Argument edges are offset by one from ChafaSeqTrieArgType. */
+#define EDGE_BYTE 0
+#define EDGE_ARG(arg_type) ((arg_type) + 1)
+
+typedef struct
+{
+    gint parent;
+    gint first_child;
+    gint next_sibling;
+
+    /* Edge leading to this node from its parent */
+    guint8 edge_type;
+    guint8 edge_value;  /* Byte or argument index */
+
+    /* Sequence ending at this node, and lowest sequence ending in the
+     * subtree rooted here. The latter lets us prune the walk. */
+    gint16 seq;
+    gint16 min_seq;
+}
+SeqTrieNode;
+
+struct ChafaSeqTrie
+{
+    GArray *nodes;
+};
+
+typedef struct
+{
+    const SeqTrieNode *nodes;
+    const gchar *start;
+
+    gint best_seq;
+    const gchar *best_end;
+    guint best_args [CHAFA_TERM_SEQ_ARGS_MAX];
+    gint best_n_args;
+
+    guint need_more : 1;
+}
+TrieWalk;
+
+static gint
+add_node (ChafaSeqTrie *trie, gint parent, guint8 edge_type, guint8 edge_value)
+{
+    SeqTrieNode node;
+    gint index;
+
+    node.parent = parent;
+    node.first_child = NODE_NONE;
+    node.next_sibling = NODE_NONE;
+    node.edge_type = edge_type;
+    node.edge_value = edge_value;
+    node.seq = SEQ_NONE;
+    node.min_seq = SEQ_NONE;
+
+    index = trie->nodes->len;
+    g_array_append_val (trie->nodes, node);
+
+    if (parent != NODE_NONE)
+    {
+        SeqTrieNode *p = &g_array_index (trie->nodes, SeqTrieNode, parent);
+
+        g_array_index (trie->nodes, SeqTrieNode, index).next_sibling = p->first_child;
+        p->first_child = index;
+    }
+
+    return index;
+}
+
+static gint
+get_child (ChafaSeqTrie *trie, gint parent, guint8 edge_type, guint8 edge_value)
+{
+    gint i;
+
+    for (i = g_array_index (trie->nodes, SeqTrieNode, parent).first_child;
+         i != NODE_NONE;
+         i = g_array_index (trie->nodes, SeqTrieNode, i).next_sibling)
+    {
+        const SeqTrieNode *node = &g_array_index (trie->nodes, SeqTrieNode, i);
+
+        if (node->edge_type == edge_type && node->edge_value == edge_value)
+            return i;
+    }
+
+    return add_node (trie, parent, edge_type, edge_value);
+}
+
+static void walk (TrieWalk *w, gint node_index, const gchar *in, gint in_len,
+                  const guint *args, gint n_args);
+
+static void
+walk_arg (TrieWalk *w, gint node_index, const gchar *in, gint in_len,
+          const guint *args, gint n_args)
+{
+    const SeqTrieNode *node = &w->nodes [node_index];
+    guint args_copy [CHAFA_TERM_SEQ_ARGS_MAX];
+    gboolean is_hex, is_varargs;
+    gint j;
+
+    if (node->min_seq >= w->best_seq)
+        return;
+
+    is_hex = (node->edge_type == EDGE_ARG (CHAFA_SEQ_TRIE_ARG_HEX)
+              || node->edge_type == EDGE_ARG (CHAFA_SEQ_TRIE_ARG_HEX_VARARGS));
+    is_varargs = (node->edge_type == EDGE_ARG (CHAFA_SEQ_TRIE_ARG_DEC_VARARGS)
+                  || node->edge_type == EDGE_ARG (CHAFA_SEQ_TRIE_ARG_HEX_VARARGS));
+
+    memcpy (args_copy, args, sizeof (args_copy));
+
+    for (j = 0; ; j++)
+    {
+        gint arg_ofs = node->edge_value + j;
+        gint len;
+
+        if (arg_ofs > CHAFA_TERM_SEQ_ARGS_MAX - 1)
+            return;
+        if (in_len == 0)
+        {
+            w->need_more = TRUE;
+            return;
+        }
+
+        n_args = arg_ofs + 1;
+
+        if (is_hex)
+            len = chafa_parse_hex4_uint (in, in_len, &args_copy [arg_ofs]);
+        else
+            len = chafa_parse_dec_uint (in, in_len, &args_copy [arg_ofs]);
+
+        in += len;
+        in_len -= len;
+
+        if (!is_varargs)
+            break;
+        if (in_len > 0)
+        {
+            if (*in != ';')
+                break;
+            in++;
+            in_len--;
+        }
+    }
+
+    walk (w, node_index, in, in_len, args_copy, n_args);
+}
+
+static void
+walk (TrieWalk *w, gint node_index, const gchar *in, gint in_len,
+      const guint *args, gint n_args)
+{
+    const SeqTrieNode *node = &w->nodes [node_index];
+    gint i;
+
+    if (node->min_seq >= w->best_seq)
+        return;
+
+    /* A match must consume at least one byte */
+    if (node->seq < w->best_seq && in != w->start)
+    {
+        w->best_seq = node->seq;
+        w->best_end = in;
+        memcpy (w->best_args, args, sizeof (w->best_args));
+        w->best_n_args = n_args;
+    }
+
+    for (i = node->first_child; i != NODE_NONE; i = w->nodes [i].next_sibling)
+    {
+        const SeqTrieNode *child = &w->nodes [i];
+
+        if (child->edge_type != EDGE_BYTE)
+        {
+            walk_arg (w, i, in, in_len, args, n_args);
+        }
+        else if (in_len == 0)
+        {
+            w->need_more = TRUE;
+        }
+        else if ((guchar) *in == child->edge_value)
+        {
+            walk (w, i, in + 1, in_len - 1, args, n_args);
+        }
+    }
+}
+
+ChafaSeqTrie *
+chafa_seq_trie_new (void)
+{
+    ChafaSeqTrie *trie;
+
+    trie = g_new0 (ChafaSeqTrie, 1);
+    trie->nodes = g_array_new (FALSE, FALSE, sizeof (SeqTrieNode));
+    add_node (trie, NODE_NONE, EDGE_BYTE, 0);
+
+    return trie;
+}
+
+void
+chafa_seq_trie_destroy (ChafaSeqTrie *trie)
+{
+    g_return_if_fail (trie != NULL);
+
+    g_array_free (trie->nodes, TRUE);
+    g_free (trie);
+}
+
+gint
+chafa_seq_trie_add_bytes (ChafaSeqTrie *trie, gint node, const gchar *bytes, gint n_bytes)
+{
+    gint i;
+
+    for (i = 0; i < n_bytes; i++)
+        node = get_child (trie, node, EDGE_BYTE, (guchar) bytes [i]);
+
+    return node;
+}
+
+gint
+chafa_seq_trie_add_arg (ChafaSeqTrie *trie, gint node, ChafaSeqTrieArgType arg_type,
+                        gint arg_index)
+{
+    g_assert (arg_index >= 0 && arg_index < CHAFA_TERM_SEQ_ARGS_MAX);
+
+    return get_child (trie, node, EDGE_ARG (arg_type), arg_index);
+}
+
+void
+chafa_seq_trie_set_seq (ChafaSeqTrie *trie, gint node, ChafaTermSeq seq)
+{
+    SeqTrieNode *n = &g_array_index (trie->nodes, SeqTrieNode, node);
+
+    if (seq >= n->seq)
+        return;
+
+    n->seq = seq;
+
+    for ( ; node != NODE_NONE; node = n->parent)
+    {
+        n = &g_array_index (trie->nodes, SeqTrieNode, node);
+        if (seq >= n->min_seq)
+            break;
+        n->min_seq = seq;
+    }
+}
+
+ChafaParseResult
+chafa_seq_trie_parse (const ChafaSeqTrie *trie,
+                      gchar **input, gint *input_len,
+                      ChafaTermSeq *seq_out,
+                      guint *args_out, gint *n_args_out)
+{
+    TrieWalk w;
+    guint args [CHAFA_TERM_SEQ_ARGS_MAX] = { 0 };
+
+    w.nodes = (const SeqTrieNode *) trie->nodes->data;
+    w.start = *input;
+    w.best_seq = SEQ_NONE;
+    w.need_more = FALSE;
+
+    walk (&w, CHAFA_SEQ_TRIE_ROOT, *input, *input_len, args, 0);
+
+    if (w.best_seq == SEQ_NONE)
+        return w.need_more ? CHAFA_PARSE_AGAIN : CHAFA_PARSE_FAILURE;
+
+    *seq_out = w.best_seq;
+    memcpy (args_out, w.best_args, sizeof (w.best_args));
+    *n_args_out = w.best_n_args;
+
+    *input_len -= w.best_end - *input;
+    *input = (gchar *) w.best_end;
+    return CHAFA_PARSE_SUCCESS;
+}
@@ -0,0 +1,64 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __CHAFA_SEQ_TRIE_H__
+#define __CHAFA_SEQ_TRIE_H__
+
+#include <glib.h>
+#include "chafa.h"
+
+G_BEGIN_DECLS
+
+/* A trie of control sequences. Literal bytes are matched one edge at a
+ * time, and arguments are parsed by special edges that consume a run of
+ * digits. A single walk over the input yields the same result as trying
+ * each sequence in turn with chafa_term_info_parse_seq_varargs (): The
+ * match with the lowest sequence number wins, and if there is none, the
+ * input is reported as incomplete if any sequence could still match it. */
+
+#define CHAFA_SEQ_TRIE_ROOT 0
+
+typedef enum
+{
+    CHAFA_SEQ_TRIE_ARG_DEC,
+    CHAFA_SEQ_TRIE_ARG_HEX,
+    CHAFA_SEQ_TRIE_ARG_DEC_VARARGS,
+    CHAFA_SEQ_TRIE_ARG_HEX_VARARGS
+}
+ChafaSeqTrieArgType;
+
+typedef struct ChafaSeqTrie ChafaSeqTrie;
+
+ChafaSeqTrie *chafa_seq_trie_new (void);
+void chafa_seq_trie_destroy (ChafaSeqTrie *trie);
+
+/* Builders. These return the node reached after the added edges. */
+gint chafa_seq_trie_add_bytes (ChafaSeqTrie *trie, gint node, const gchar *bytes, gint n_bytes);
+gint chafa_seq_trie_add_arg (ChafaSeqTrie *trie, gint node, ChafaSeqTrieArgType arg_type,
+                             gint arg_index);
+void chafa_seq_trie_set_seq (ChafaSeqTrie *trie, gint node, ChafaTermSeq seq);
+
+ChafaParseResult chafa_seq_trie_parse (const ChafaSeqTrie *trie,
+                                       gchar **input, gint *input_len,
+                                       ChafaTermSeq *seq_out,
+                                       guint *args_out, gint *n_args_out);
+
+G_END_DECLS
+
+#endif /* __CHAFA_SEQ_TRIE_H__ */
@@ -26,18 +26,44 @@
 #include "internal/chafa-indexed-image.h"
 #include "internal/chafa-math-util.h"
 #include "internal/chafa-passthrough-encoder.h"
+#include "internal/chafa-private.h"
 #include "internal/chafa-sixel-renderer.h"
 #include "internal/chafa-string-util.h"
 
 #define SIXEL_CELL_HEIGHT 6
 
+/* Number of sixel bands each worker encodes per round. Output is produced
+ * in rounds of (n_threads * SIXEL_BANDS_PER_BATCH) bands, so the amount of
+ * memory used for encoding is independent of the image's height. */
+#define SIXEL_BANDS_PER_BATCH 2
+
 typedef struct
 {
     ChafaSixelRenderer *sixel_renderer;
     ChafaPassthroughEncoder *ptenc;
+
+    /* First pixel row of the current round */
+    gint first_row;
+
+    /* Worst-case encoded size of a single band */
+    gsize band_len_max;
+
+    /* If set, output is handed off after every batch instead of being
+     * accumulated in ptenc's string */
+    ChafaCanvasWriteFunc write_func;
+    gpointer write_func_data;
+
+    /* If set, only pixels that differ from this frame will be drawn. The
+     * lookup tables map pens to packed RGB for comparison. */
+    const ChafaSixelRenderer *prev_renderer;
+    guint32 pen_to_rgb [256];
+    guint32 prev_pen_to_rgb [256];
 }
 BuildSixelsCtx;
 
+/* Outside the range of packed RGB; never equal to a real color */
+#define PEN_RGB_TRANSPARENT 0xffffffff
+
 typedef struct
 {
     /* Lower six bytes are vertical pixel strip; LSB is bottom pixel */
@@ -247,7 +273,8 @@ format_pen (guint8 pen, gchar *p)
  * otherwise the first row with non-transparent pixels will have
  * garbage rendered in it */
 static gchar *
-build_sixel_row_ansi (const ChafaSixelRenderer *scanvas, const SixelRow *srow, gchar *p, gboolean force_full_width)
+build_sixel_row_ansi (const ChafaSixelRenderer *scanvas, const SixelRow *srow,
+                      const guint8 *delta_mask, gchar *p, gboolean force_full_width)
 {
     gint pen = 0;
     gboolean need_cr = FALSE;
@@ -313,6 +340,8 @@ build_sixel_row_ansi (const ChafaSixelRenderer *scanvas, const SixelRow *srow, g
             for ( ; step > 0; step--, i++)
             {
                 schar = sixel_data_to_schar (&sdata [i], expanded_pen);
+                if (delta_mask)
+                    schar = '?' + ((schar - '?') & delta_mask [i]);
 
                 if (schar == rep_schar)
                 {
@@ -372,44 +401,241 @@ build_sixel_row_ansi (const ChafaSixelRenderer *scanvas, const SixelRow *srow, g
     return p;
 }
 
+/* Computes a per-column mask of the pixels in a band that must be drawn;
+ * i.e. the ones that are opaque and differ in color from the previous frame.
+ * Bit n corresponds to row n of the band, like in a sixel. Returns FALSE if
+ * the band is unchanged. */
+static gboolean
+calc_band_delta_mask (const BuildSixelsCtx *ctx, gint first_row, guint8 *mask_out)
+{
+    const guint8 *pixels, *prev_pixels;
+    gint width = ctx->sixel_renderer->width;
+    guint8 any_changed = 0;
+    gint x, i;
+
+    memset (mask_out, 0, width);
+
+    pixels = ctx->sixel_renderer->image->pixels + (gsize) width * first_row;
+    prev_pixels = ctx->prev_renderer->image->pixels + (gsize) width * first_row;
+
+    for (i = 0; i < SIXEL_CELL_HEIGHT; i++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            guint32 rgb = ctx->pen_to_rgb [pixels [x]];
+            guint8 bit = (rgb != PEN_RGB_TRANSPARENT
+                          && rgb != ctx->prev_pen_to_rgb [prev_pixels [x]]) << i;
+
+            mask_out [x] |= bit;
+            any_changed |= bit;
+        }
+
+        pixels += width;
+        prev_pixels += width;
+    }
+
+    return any_changed ? TRUE : FALSE;
+}
+
 static void
-build_sixel_row_worker (ChafaBatchInfo *batch, const BuildSixelsCtx *ctx)
+build_pen_to_rgb_table (const ChafaSixelRenderer *sixel_renderer, guint32 *table_out)
+{
+    const ChafaPalette *palette = &sixel_renderer->image->palette;
+    gint first_color = chafa_palette_get_first_color (palette);
+    gint n_colors = chafa_palette_get_n_colors (palette);
+    gint pen;
+
+    for (pen = 0; pen < 256; pen++)
+    {
+        const ChafaColor *col;
+
+        if (pen >= n_colors || pen == chafa_palette_get_transparent_index (palette))
+        {
+            table_out [pen] = PEN_RGB_TRANSPARENT;
+            continue;
+        }
+
+        col = chafa_palette_get_color (palette, CHAFA_COLOR_SPACE_RGB, first_color + pen);
+        table_out [pen] = ((guint32) col->ch [0] << 16) | ((guint32) col->ch [1] << 8) | col->ch [2];
+    }
+}
+
+#ifdef HAVE_AVX2_INTRINSICS
+
+/* Vectorized equivalent of build_sixel_row_ansi(). Instead of transposing
+ * the band into SixelData and filtering by bank, we compute each pen's
+ * sixel characters for the entire row directly from the six pixel rows,
+ * then emit runs found with vector compares. The output is identical to
+ * that of the scalar path. */
+static gchar *
+build_sixel_row_ansi_avx2 (const ChafaSixelRenderer *scanvas, const guint8 *pixels,
+                           const guint8 *delta_mask, guint8 *schars,
+                           gchar *p, gboolean force_full_width)
+{
+    gint transparent_index = chafa_palette_get_transparent_index (&scanvas->image->palette);
+    gint n_colors = chafa_palette_get_n_colors (&scanvas->image->palette);
+    gint width = scanvas->width;
+    gboolean need_cr = FALSE;
+    gint pen;
+
+    for (pen = 0; pen < n_colors; pen++)
+    {
+        gint n_used;
+        gint i;
+
+        if (pen == transparent_index)
+            continue;
+
+        n_used = chafa_sixel_band_to_schars_avx2 (pixels, width, pen, delta_mask, schars);
+
+        /* Trailing blanks are omitted, except for the first pen in
+         * rows that must be drawn in full (see build_sixel_row_ansi()) */
+        if (force_full_width)
+        {
+            n_used = width;
+            force_full_width = FALSE;
+        }
+
+        if (n_used == 0)
+            continue;
+
+        if (need_cr)
+            *(p++) = '$';
+        p = format_pen (pen, p);
+
+        for (i = 0; i < n_used; )
+        {
+            gint run_end = chafa_find_byte_run_end_avx2 (schars, i, n_used);
+
+            p = format_schar_reps (schars [i], run_end - i, p);
+            i = run_end;
+        }
+
+        need_cr = TRUE;
+    }
+
+    return p;
+}
+
+static gchar *
+build_sixel_rows_avx2 (const BuildSixelsCtx *ctx, gint first_row,
+                       gint n_sixel_rows, gchar *p)
+{
+    const ChafaSixelRenderer *sixel_renderer = ctx->sixel_renderer;
+    guint8 *schars;
+    guint8 *delta_mask = NULL;
+    gint i;
+
+    schars = g_malloc (sixel_renderer->width);
+    if (ctx->prev_renderer)
+        delta_mask = g_malloc (sixel_renderer->width);
+
+    for (i = 0; i < n_sixel_rows; i++)
+    {
+        gint row = first_row + i * SIXEL_CELL_HEIGHT;
+        gboolean is_global_first_row = first_row + i == 0;
+        gboolean is_global_last_row = first_row + (i + 1) * SIXEL_CELL_HEIGHT >= sixel_renderer->height;
+
+        if (!delta_mask
+            || calc_band_delta_mask (ctx, row, delta_mask)
+            || is_global_first_row || is_global_last_row)
+        {
+            p = build_sixel_row_ansi_avx2 (sixel_renderer,
+                                           sixel_renderer->image->pixels
+                                           + (gsize) sixel_renderer->image->width * row,
+                                           delta_mask, schars, p,
+                                           (is_global_first_row) || (is_global_last_row)
+                                           ? TRUE : FALSE);
+        }
+
+        /* GNL after every row except final */
+        if (!is_global_last_row)
+            *(p++) = '-';
+    }
+
+    g_free (delta_mask);
+    g_free (schars);
+    return p;
+}
+
+#endif
+
+static gchar *
+build_sixel_rows (const BuildSixelsCtx *ctx, gint first_row,
+                  gint n_sixel_rows, gchar *p)
 {
     SixelRow srow;
-    gchar *sixel_ansi, *p;
-    gint n_sixel_rows;
+    guint8 *delta_mask = NULL;
     gint i;
 
-    n_sixel_rows = (batch->n_rows + SIXEL_CELL_HEIGHT - 1) / SIXEL_CELL_HEIGHT;
+#ifdef HAVE_AVX2_INTRINSICS
+    if (chafa_have_avx2 ())
+        return build_sixel_rows_avx2 (ctx, first_row, n_sixel_rows, p);
+#endif
+
     srow.data = g_malloc (sizeof (SixelData) * (gsize) ctx->sixel_renderer->width);
     chafa_bitfield_init (&srow.filter_bits, ((ctx->sixel_renderer->width + FILTER_BANK_WIDTH - 1) / FILTER_BANK_WIDTH) * 256);
-
-    sixel_ansi = p = g_malloc (256 * ((gsize) ctx->sixel_renderer->width + 5) * n_sixel_rows + 1);
+    if (ctx->prev_renderer)
+        delta_mask = g_malloc (ctx->sixel_renderer->width);
 
     for (i = 0; i < n_sixel_rows; i++)
     {
-        gboolean is_global_first_row = batch->first_row + i == 0;
-        gboolean is_global_last_row = batch->first_row + (i + 1) * SIXEL_CELL_HEIGHT >= ctx->sixel_renderer->height;
-
-        fetch_sixel_row (&srow,
-                         ctx->sixel_renderer->image->pixels
-                         + (gsize) ctx->sixel_renderer->image->width * (batch->first_row + i * SIXEL_CELL_HEIGHT),
-                         ctx->sixel_renderer->image->width);
-        p = build_sixel_row_ansi (ctx->sixel_renderer, &srow, p,
-                                  (is_global_first_row) || (is_global_last_row)
-                                  ? TRUE : FALSE);
-        chafa_bitfield_clear (&srow.filter_bits);
+        gint row = first_row + i * SIXEL_CELL_HEIGHT;
+        gboolean is_global_first_row = first_row + i == 0;
+        gboolean is_global_last_row = first_row + (i + 1) * SIXEL_CELL_HEIGHT >= ctx->sixel_renderer->height;
+
+        /* In delta mode, bands that didn't change are skipped entirely. The
+         * first and last bands are always emitted; see build_sixel_row_ansi(). */
+        if (!delta_mask
+            || calc_band_delta_mask (ctx, row, delta_mask)
+            || is_global_first_row || is_global_last_row)
+        {
+            fetch_sixel_row (&srow,
+                             ctx->sixel_renderer->image->pixels
+                             + (gsize) ctx->sixel_renderer->image->width * row,
+                             ctx->sixel_renderer->image->width);
+            p = build_sixel_row_ansi (ctx->sixel_renderer, &srow, delta_mask, p,
+                                      (is_global_first_row) || (is_global_last_row)
+                                      ? TRUE : FALSE);
+            chafa_bitfield_clear (&srow.filter_bits);
+        }
 
         /* GNL after every row except final */
         if (!is_global_last_row)
             *(p++) = '-';
     }
 
+    g_free (delta_mask);
+    chafa_bitfield_deinit (&srow.filter_bits);
+    g_free (srow.data);
+    return p;
+}
+
+static void
+build_sixel_row_worker (ChafaBatchInfo *batch, const BuildSixelsCtx *ctx)
+{
+    gchar *sixel_ansi, *p;
+    gint n_sixel_rows;
+
+    n_sixel_rows = (batch->n_rows + SIXEL_CELL_HEIGHT - 1) / SIXEL_CELL_HEIGHT;
+    sixel_ansi = p = g_malloc (ctx->band_len_max * n_sixel_rows + 1);
+
+    p = build_sixel_rows (ctx, ctx->first_row + batch->first_row, n_sixel_rows, p);
+
     batch->ret_p = sixel_ansi;
     batch->ret_n = p - sixel_ansi;
+}
 
-    chafa_bitfield_deinit (&srow.filter_bits);
-    g_free (srow.data);
+static void
+maybe_write_out (BuildSixelsCtx *ctx)
+{
+    GString *out = ctx->ptenc->out;
+
+    if (!ctx->write_func || out->len == 0)
+        return;
+
+    ctx->write_func (out->str, out->len, ctx->write_func_data);
+    g_string_truncate (out, 0);
 }
 
 static void
@@ -417,6 +643,9 @@ build_sixel_row_post (ChafaBatchInfo *batch, BuildSixelsCtx *ctx)
 {
     chafa_passthrough_encoder_append_len (ctx->ptenc, batch->ret_p, batch->ret_n);
     g_free (batch->ret_p);
+
+    /* Batches are posted in order, so we can stream them out as we go */
+    maybe_write_out (ctx);
 }
 
 static void
@@ -483,13 +712,17 @@ end_sixels (ChafaPassthroughEncoder *ptenc, ChafaTermInfo *term_info)
     chafa_passthrough_encoder_flush (ptenc);
 }
 
-void
-chafa_sixel_renderer_build_ansi (ChafaSixelRenderer *sixel_renderer, ChafaTermInfo *term_info,
-                                 GString *str, ChafaPassthrough passthrough)
+static void
+build_ansi (ChafaSixelRenderer *sixel_renderer, const ChafaSixelRenderer *prev_renderer,
+            ChafaTermInfo *term_info,
+            GString *str, ChafaPassthrough passthrough,
+            ChafaCanvasWriteFunc write_func, gpointer write_func_data)
 {
     ChafaPassthroughEncoder ptenc;
     BuildSixelsCtx ctx;
     gchar buf [CHAFA_TERM_SEQ_LENGTH_MAX + 1];
+    gint n_threads;
+    gint round_rows;
 
     g_assert (sixel_renderer->image->height % SIXEL_CELL_HEIGHT == 0);
 
@@ -507,16 +740,75 @@ chafa_sixel_renderer_build_ansi (ChafaSixelRenderer *sixel_renderer, ChafaTermIn
 
     ctx.sixel_renderer = sixel_renderer;
     ctx.ptenc = &ptenc;
+    ctx.write_func = write_func;
+    ctx.write_func_data = write_func_data;
+    ctx.prev_renderer = NULL;
+
+    if (prev_renderer
+        && prev_renderer->width == sixel_renderer->width
+        && prev_renderer->height == sixel_renderer->height)
+    {
+        ctx.prev_renderer = prev_renderer;
+        build_pen_to_rgb_table (sixel_renderer, ctx.pen_to_rgb);
+        build_pen_to_rgb_table (prev_renderer, ctx.prev_pen_to_rgb);
+    }
+
+    /* Each pen can contribute at most one character per column, plus the
+     * pen selector and a carriage return. Add one for the band separator. */
+    ctx.band_len_max = (gsize) MAX (chafa_palette_get_n_colors (&sixel_renderer->image->palette), 1)
+        * ((gsize) sixel_renderer->width + 5) + 1;
 
     build_sixel_palette (sixel_renderer, &ptenc);
+    maybe_write_out (&ctx);
 
-    chafa_process_batches (&ctx,
-                           (GFunc) build_sixel_row_worker,
-                           (GFunc) build_sixel_row_post,
-                           sixel_renderer->image->height,
-                           chafa_get_n_actual_threads (),
-                           SIXEL_CELL_HEIGHT);
+    n_threads = chafa_get_n_actual_threads ();
+    round_rows = n_threads * SIXEL_BANDS_PER_BATCH * SIXEL_CELL_HEIGHT;
+
+    for (ctx.first_row = 0;
+         ctx.first_row < sixel_renderer->image->height;
+         ctx.first_row += round_rows)
+    {
+        chafa_process_batches (&ctx,
+                               (GFunc) build_sixel_row_worker,
+                               (GFunc) build_sixel_row_post,
+                               MIN (round_rows, sixel_renderer->image->height - ctx.first_row),
+                               n_threads,
+                               SIXEL_CELL_HEIGHT);
+    }
 
     end_sixels (&ptenc, term_info);
     chafa_passthrough_encoder_end (&ptenc);
+    maybe_write_out (&ctx);
+}
+
+void
+chafa_sixel_renderer_build_ansi (ChafaSixelRenderer *sixel_renderer, ChafaTermInfo *term_info,
+                                 GString *str, ChafaPassthrough passthrough)
+{
+    build_ansi (sixel_renderer, NULL, term_info, str, passthrough, NULL, NULL);
+}
+
+/* Like chafa_sixel_renderer_build_ansi(), but hands off output in order as
+ * each batch of bands completes. Peak memory use depends on the image's
+ * width and the number of threads, but not its height.
+ *
+ * If prev_renderer is not NULL and has the same dimensions, it is assumed
+ * to hold the image currently displayed at the output location. Only bands
+ * and pixels that changed since then will be drawn; the rest are left
+ * transparent so the terminal keeps showing the previous frame there. */
+void
+chafa_sixel_renderer_write_ansi (ChafaSixelRenderer *sixel_renderer,
+                                 const ChafaSixelRenderer *prev_renderer,
+                                 ChafaTermInfo *term_info,
+                                 ChafaPassthrough passthrough,
+                                 ChafaCanvasWriteFunc write_func, gpointer write_func_data)
+{
+    GString *str;
+
+    g_assert (write_func != NULL);
+
+    str = g_string_new ("");
+    build_ansi (sixel_renderer, prev_renderer, term_info, str, passthrough,
+                write_func, write_func_data);
+    g_string_free (str, TRUE);
 }
@@ -47,6 +47,11 @@ void chafa_sixel_renderer_draw_all_pixels (ChafaSixelRenderer *sixel_renderer,
                                            gfloat quality);
 void chafa_sixel_renderer_build_ansi (ChafaSixelRenderer *sixel_renderer, ChafaTermInfo *term_info,
                                       GString *out_str, ChafaPassthrough passthrough);
+void chafa_sixel_renderer_write_ansi (ChafaSixelRenderer *sixel_renderer,
+                                      const ChafaSixelRenderer *prev_renderer,
+                                      ChafaTermInfo *term_info,
+                                      ChafaPassthrough passthrough,
+                                      ChafaCanvasWriteFunc write_func, gpointer write_func_data);
 
 G_END_DECLS
 
@@ -49,3 +49,64 @@ chafa_calc_cell_error_sse41 (const ChafaPixel *pixels, const ChafaColorPair *col
     return _mm_extract_epi32 (err, 0) + _mm_extract_epi32 (err, 1)
         + _mm_extract_epi32 (err, 2) + _mm_extract_epi32 (err, 3);
 }
+
+/* Base64 encoding, 12 input bytes to 16 output bytes at a time. This is the
+ * usual reshuffle-and-translate approach by Wojciech Muła et al. */
+
+static inline __m128i
+base64_reshuffle_sse41 (__m128i in)
+{
+    __m128i t0, t1, t2, t3;
+
+    /* Spread each 3-byte group over a 32-bit lane, duplicating the middle
+     * byte: [b1 b0 b2 b1] */
+    in = _mm_shuffle_epi8 (in, _mm_set_epi8 (10, 11,  9, 10,
+                                             7,  8,  6,  7,
+                                             4,  5,  3,  4,
+                                             1,  2,  0,  1));
+
+    /* Move the four 6-bit fields into separate bytes */
+    t0 = _mm_and_si128 (in, _mm_set1_epi32 (0x0fc0fc00));
+    t1 = _mm_mulhi_epu16 (t0, _mm_set1_epi32 (0x04000040));
+    t2 = _mm_and_si128 (in, _mm_set1_epi32 (0x003f03f0));
+    t3 = _mm_mullo_epi16 (t2, _mm_set1_epi32 (0x01000010));
+
+    return _mm_or_si128 (t1, t3);
+}
+
+static inline __m128i
+base64_translate_sse41 (__m128i in)
+{
+    /* Offsets to add to each 6-bit value, indexed by range: A-Z, a-z,
+     * 0-9 (ten entries), '+' and '/' */
+    const __m128i lut = _mm_setr_epi8 (65, 71, -4, -4, -4, -4, -4, -4,
+                                       -4, -4, -4, -4, -19, -16, 0, 0);
+    __m128i indices, mask;
+
+    indices = _mm_subs_epu8 (in, _mm_set1_epi8 (51));
+    mask = _mm_cmpgt_epi8 (in, _mm_set1_epi8 (25));
+    indices = _mm_sub_epi8 (indices, mask);
+
+    return _mm_add_epi8 (in, _mm_shuffle_epi8 (lut, indices));
+}
+
+/* Encodes as much of the input as can be done safely with 16-byte loads.
+ * Returns the number of input bytes consumed, which is a multiple of 3.
+ * The output is not padded or terminated. */
+gsize
+chafa_base64_encode_sse41 (const guint8 *in, gsize in_len, gchar *out)
+{
+    gsize i;
+
+    for (i = 0; i + 16 <= in_len; i += 12)
+    {
+        __m128i t;
+
+        t = _mm_loadu_si128 ((const __m128i *) (in + i));
+        t = base64_translate_sse41 (base64_reshuffle_sse41 (t));
+        _mm_storeu_si128 ((__m128i *) out, t);
+        out += 16;
+    }
+
+    return i;
+}
@@ -144,3 +144,54 @@ chafa_format_dec_u16_hex (char *dest, guint16 arg)
     *(dest++) = format_hex_digit (arg & 0xf);
     return dest;
 }
+
+gint
+chafa_parse_dec_uint (const gchar *in, gint in_len, guint *args_out)
+{
+    gint i = 0;
+    guint result = 0;
+
+    while (in_len > 0 && *in >= '0' && *in <= '9')
+    {
+        result *= 10;
+        result += *in - '0';
+        in++;
+        in_len--;
+        i++;
+    }
+
+    *args_out = result;
+    return i;
+}
+
+gint
+chafa_parse_hex4_uint (const gchar *in, gint in_len, guint *args_out)
+{
+    gint i = 0;
+    guint result = 0;
+
+    while (in_len > 0)
+    {
+        gchar c = g_ascii_tolower (*in);
+
+        if (c >= '0' && c <= '9')
+        {
+            result *= 16;
+            result += c - '0';
+        }
+        else if (c >= 'a' && c <= 'f')
+        {
+            result *= 16;
+            result += c - 'a' + 10;
+        }
+        else
+            break;
+
+        in++;
+        in_len--;
+        i++;
+    }
+
+    *args_out = result;
+    return i;
+}
@@ -44,6 +44,12 @@ gchar *chafa_format_dec_uint_0_to_9999 (char *dest, guint arg);
  * byte after the formatted ASCII hexadecimal number (dest + 4). */
 gchar *chafa_format_dec_u16_hex (char *dest, guint16 arg);
 
+/* Parse an unsigned decimal or hexadecimal number, stopping at the first
+ * non-digit or after in_len bytes. Returns the number of bytes consumed. A
+ * blank argument yields zero. */
+gint chafa_parse_dec_uint (const gchar *in, gint in_len, guint *args_out);
+gint chafa_parse_hex4_uint (const gchar *in, gint in_len, guint *args_out);
+
 G_END_DECLS
 
 #endif /* __CHAFA_STRING_UTIL_H__ */
@@ -0,0 +1,152 @@
+#include "config.h"
+
+#include <string.h>
+#include <chafa.h>
+#include "internal/chafa-base64.h"
+#include "internal/chafa-private.h"
+
+#define FUZZ_ITERATIONS 20000
+#define FUZZ_LEN_MAX 4200
+#define LARGE_LEN (3 * 1024 * 1024 + 1)
+
+static guint8 *
+random_bytes (gsize len)
+{
+    guint8 *data;
+    gsize i;
+
+    data = g_malloc (len + 1);
+    for (i = 0; i < len; i++)
+        data [i] = g_test_rand_int_range (0, 256);
+
+    return data;
+}
+
+/* Feeds the input to the streaming encoder in randomly sized pieces */
+static gchar *
+encode_stream (const guint8 *data, gsize len)
+{
+    ChafaBase64 base64;
+    GString *gs;
+    gsize ofs = 0;
+
+    gs = g_string_new ("");
+    chafa_base64_init (&base64);
+
+    while (ofs < len)
+    {
+        gsize n = g_test_rand_int_range (0, 100);
+
+        /* MIN () would evaluate the random number twice */
+        n = MIN (n, len - ofs);
+
+        /* Occasionally send the whole remainder, to hit the fast paths */
+        if (g_test_rand_bit ())
+            n = len - ofs;
+
+        chafa_base64_encode (&base64, gs, data + ofs, n);
+        ofs += n;
+    }
+
+    chafa_base64_encode_end (&base64, gs);
+    chafa_base64_deinit (&base64);
+
+    return g_string_free (gs, FALSE);
+}
+
+static void
+check_simd (G_GNUC_UNUSED const guint8 *data, G_GNUC_UNUSED gsize len,
+            G_GNUC_UNUSED const gchar *expected, G_GNUC_UNUSED gchar *out)
+{
+    G_GNUC_UNUSED gsize n;
+
+#ifdef HAVE_SSE41_INTRINSICS
+    if (chafa_have_sse41 ())
+    {
+        n = chafa_base64_encode_sse41 (data, len, out);
+        g_assert_cmpuint (n % 3, ==, 0);
+        g_assert_cmpuint (n, <=, len);
+        g_assert (!memcmp (out, expected, (n / 3) * 4));
+    }
+#endif
+
+#ifdef HAVE_AVX2_INTRINSICS
+    if (chafa_have_avx2 ())
+    {
+        n = chafa_base64_encode_avx2 (data, len, out);
+        g_assert_cmpuint (n % 3, ==, 0);
+        g_assert_cmpuint (n, <=, len);
+        g_assert (!memcmp (out, expected, (n / 3) * 4));
+    }
+#endif
+}
+
+static void
+check_encode (const guint8 *data, gsize len)
+{
+    gchar *expected;
+    gchar *out, *end;
+    gchar *streamed;
+
+    expected = g_base64_encode (data, len);
+    out = g_malloc (CHAFA_BASE64_ENCODED_LEN (len) + 1);
+
+    end = chafa_base64_encode_buf (data, len, out);
+    g_assert_cmpuint (end - out, ==, strlen (expected));
+    g_assert (!memcmp (out, expected, end - out));
+
+    streamed = encode_stream (data, len);
+    g_assert_cmpstr (streamed, ==, expected);
+
+    check_simd (data, len, expected, out);
+
+    g_free (streamed);
+    g_free (out);
+    g_free (expected);
+}
+
+static void
+base64_fuzz_test (void)
+{
+    guint8 *data;
+    gint i;
+
+    chafa_init ();
+
+    data = random_bytes (FUZZ_LEN_MAX + 32);
+
+    for (i = 0; i < FUZZ_ITERATIONS; i++)
+    {
+        gsize len = g_test_rand_int_range (0, FUZZ_LEN_MAX);
+        gsize ofs = g_test_rand_int_range (0, 32);
+
+        /* Vary the alignment along with the length */
+        check_encode (data + ofs, len);
+    }
+
+    g_free (data);
+}
+
+static void
+base64_large_test (void)
+{
+    guint8 *data;
+
+    chafa_init ();
+
+    /* Big enough to be split across threads */
+    data = random_bytes (LARGE_LEN);
+    check_encode (data, LARGE_LEN);
+    g_free (data);
+}
+
+int
+main (int argc, char *argv [])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/base64/fuzz", base64_fuzz_test);
+    g_test_add_func ("/base64/large", base64_large_test);
+
+    return g_test_run ();
+}
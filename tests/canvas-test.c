@@ -273,6 +273,518 @@ colors_fgbg_test (void)
     }
 }
 
+/* Output must match the control sequences formatted one by one, also when
+ * colors repeat and formatted sequences get reused. If fgbg_seq is set, it
+ * replaces the pair sequence for the mode. */
+static void
+print_colors_test_params (ChafaCanvasMode mode, const gchar *fgbg_seq,
+                          gint width, gint height, gboolean many_colors)
+{
+    gchar *envp [] = { "TERM=xterm-256color", "COLORTERM=truecolor", NULL };
+    const guint8 src_pixels [4] = { 0x80, 0x80, 0x80, 0xff };
+    ChafaTermInfo *term_info;
+    ChafaTermSeq seq_id;
+    ChafaCanvasConfig *config;
+    ChafaCanvas *canvas;
+    GString *expected, *printed;
+    gchar *reset;
+    gint x, y;
+
+    seq_id = mode == CHAFA_CANVAS_MODE_TRUECOLOR ? CHAFA_TERM_SEQ_SET_COLOR_FGBG_DIRECT
+        : mode == CHAFA_CANVAS_MODE_INDEXED_16 ? CHAFA_TERM_SEQ_SET_COLOR_FGBG_16
+        : CHAFA_TERM_SEQ_SET_COLOR_FGBG_256;
+
+    term_info = chafa_term_db_detect (chafa_term_db_get_default (), envp);
+    if (fgbg_seq)
+        g_assert_true (chafa_term_info_set_seq (term_info, seq_id, fgbg_seq, NULL));
+    reset = chafa_term_info_emit_seq (term_info, CHAFA_TERM_SEQ_RESET_ATTRIBUTES, -1);
+
+    config = chafa_canvas_config_new ();
+    chafa_canvas_config_set_canvas_mode (config, mode);
+    chafa_canvas_config_set_geometry (config, width, height);
+    chafa_canvas_config_set_optimizations (config, CHAFA_OPTIMIZATION_NONE);
+
+    canvas = chafa_canvas_new (config);
+    chafa_canvas_draw_all_pixels (canvas,
+                                  CHAFA_PIXEL_RGBA8_UNASSOCIATED,
+                                  src_pixels,
+                                  1, 1, 4);
+
+    expected = g_string_new ("");
+    g_string_append (expected, reset);
+
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            /* Few distinct colors, so most are repeats, or nearly all
+             * distinct ones, covering all the pens in indexed modes */
+            gint fg = many_colors ? (x * 0x010203 + y * 0x0b0501) & 0xffffff
+                : ((x * 7 + y * 3) % 5) * 0x3f1f0f;
+            gint bg = many_colors ? (x * 0x030201 + y * 0x0107b3) & 0xffffff
+                : ((x + y) % 3) * 0x0f1f3f;
+            gint fg_raw, bg_raw;
+            gchar *seq;
+
+            chafa_canvas_set_char_at (canvas, x, y, 'x');
+            chafa_canvas_set_colors_at (canvas, x, y, fg, bg);
+            chafa_canvas_get_raw_colors_at (canvas, x, y, &fg_raw, &bg_raw);
+
+            if (mode == CHAFA_CANVAS_MODE_TRUECOLOR)
+                seq = chafa_term_info_emit_seq (term_info, seq_id,
+                                                (fg >> 16) & 0xff, (fg >> 8) & 0xff, fg & 0xff,
+                                                (bg >> 16) & 0xff, (bg >> 8) & 0xff, bg & 0xff, -1);
+            else if (mode == CHAFA_CANVAS_MODE_INDEXED_16)
+                /* The arguments are aixterm color codes, not pens */
+                seq = chafa_term_info_emit_seq (term_info, seq_id,
+                                                fg_raw < 8 ? 30 + fg_raw : 90 + fg_raw - 8,
+                                                bg_raw < 8 ? 40 + bg_raw : 100 + bg_raw - 8, -1);
+            else
+                seq = chafa_term_info_emit_seq (term_info, seq_id, fg_raw, bg_raw, -1);
+
+            g_string_append (expected, reset);
+            g_string_append (expected, seq);
+            g_string_append_c (expected, 'x');
+            g_free (seq);
+        }
+
+        g_string_append (expected, reset);
+        if (y < height - 1)
+            g_string_append_c (expected, '\n');
+    }
+
+    /* A single thread, so one print context sees all the cells */
+    chafa_set_n_threads (1);
+    printed = chafa_canvas_print (canvas, term_info);
+    chafa_set_n_threads (-1);
+    g_assert_cmpstr (printed->str, ==, expected->str);
+
+    g_string_free (printed, TRUE);
+    g_string_free (expected, TRUE);
+    g_free (reset);
+    chafa_canvas_unref (canvas);
+    chafa_canvas_config_unref (config);
+    chafa_term_info_unref (term_info);
+}
+
+static void
+print_colors_test (void)
+{
+    ChafaCanvasMode modes [] = { CHAFA_CANVAS_MODE_TRUECOLOR,
+                                 CHAFA_CANVAS_MODE_INDEXED_256,
+                                 CHAFA_CANVAS_MODE_INDEXED_16 };
+    gint i;
+
+    for (i = 0; i < (gint) G_N_ELEMENTS (modes); i++)
+    {
+        print_colors_test_params (modes [i], NULL, 23, 7, FALSE);
+        print_colors_test_params (modes [i], NULL, 120, 40, FALSE);
+        print_colors_test_params (modes [i], NULL, 120, 40, TRUE);
+    }
+
+    /* Pair sequences that can't be assembled from a head and a tail */
+    print_colors_test_params (CHAFA_CANVAS_MODE_INDEXED_256,
+                              "\033[48;5;%2;38;5;%1m", 120, 40, TRUE);
+    print_colors_test_params (CHAFA_CANVAS_MODE_INDEXED_256,
+                              "\033[38;5;%1;48;5;%2;58;5;%1m", 120, 40, TRUE);
+    print_colors_test_params (CHAFA_CANVAS_MODE_INDEXED_256,
+                              "\033[38;5;%1;38;5;%1;48;5;%2m", 120, 40, TRUE);
+}
+
+/* Output must not depend on how rows are divided among threads */
+static void
+print_threads_test_params (ChafaCanvasMode mode, gboolean fg_only,
+                           ChafaOptimizations optimizations)
+{
+    const gint width = 160, height = 100;
+    gchar *envp [] = { "TERM=xterm-256color", "COLORTERM=truecolor", NULL };
+    ChafaTermInfo *term_info;
+    ChafaCanvasConfig *config;
+    ChafaCanvas *canvas;
+    guint8 *src_pixels;
+    GString *printed_st, *printed_mt, *joined;
+    GString **rows;
+    gint i;
+
+    term_info = chafa_term_db_detect (chafa_term_db_get_default (), envp);
+
+    /* Stripes with a transparent gap, so rows end in different states */
+    src_pixels = g_malloc (width * height * 4);
+    for (i = 0; i < width * height; i++)
+    {
+        src_pixels [i * 4] = (i * 5) & 0xff;
+        src_pixels [i * 4 + 1] = (i / width) * 2;
+        src_pixels [i * 4 + 2] = (i % 7) * 30;
+        src_pixels [i * 4 + 3] = (i % width) > width - 9 && (i / width) % 3 ? 0x00 : 0xff;
+    }
+
+    config = chafa_canvas_config_new ();
+    chafa_canvas_config_set_canvas_mode (config, mode);
+    chafa_canvas_config_set_geometry (config, width, height);
+    chafa_canvas_config_set_fg_only_enabled (config, fg_only);
+    chafa_canvas_config_set_optimizations (config, optimizations);
+
+    canvas = chafa_canvas_new (config);
+    chafa_canvas_draw_all_pixels (canvas,
+                                  CHAFA_PIXEL_RGBA8_UNASSOCIATED,
+                                  src_pixels,
+                                  width, height, width * 4);
+
+    chafa_set_n_threads (1);
+    printed_st = chafa_canvas_print (canvas, term_info);
+    chafa_set_n_threads (4);
+    printed_mt = chafa_canvas_print (canvas, term_info);
+    chafa_canvas_print_rows (canvas, term_info, &rows, NULL);
+    chafa_set_n_threads (-1);
+
+    joined = g_string_new ("");
+    for (i = 0; rows [i]; i++)
+    {
+        g_string_append_len (joined, rows [i]->str, rows [i]->len);
+        if (rows [i + 1])
+            g_string_append_c (joined, '\n');
+    }
+
+    g_assert_cmpstr (printed_mt->str, ==, printed_st->str);
+    g_assert_cmpstr (joined->str, ==, printed_st->str);
+
+    chafa_free_gstring_array (rows);
+    g_string_free (joined, TRUE);
+    g_string_free (printed_mt, TRUE);
+    g_string_free (printed_st, TRUE);
+    g_free (src_pixels);
+    chafa_canvas_unref (canvas);
+    chafa_canvas_config_unref (config);
+    chafa_term_info_unref (term_info);
+}
+
+static void
+print_threads_test (void)
+{
+    gint mode;
+
+    for (mode = 0; mode < CHAFA_CANVAS_MODE_MAX; mode++)
+    {
+        print_threads_test_params (mode, FALSE, CHAFA_OPTIMIZATION_ALL);
+        print_threads_test_params (mode, TRUE, CHAFA_OPTIMIZATION_ALL);
+        print_threads_test_params (mode, FALSE, CHAFA_OPTIMIZATION_NONE);
+    }
+}
+
+/* Minimal terminal that keeps track of the characters and colors written to
+ * it. Colors are only set with truecolor SGRs. Like most terminals, writing
+ * to the last column leaves the cursor there with a wrap pending. */
+typedef struct
+{
+    gunichar c;
+    gint64 fg, bg;
+}
+ScreenCell;
+
+typedef struct
+{
+    gint width, height;
+    gint x, y;
+    gboolean wrap_pending;
+    gint64 fg, bg;
+    ScreenCell *cells;
+}
+Screen;
+
+static Screen *
+screen_new (gint width, gint height)
+{
+    Screen *screen = g_new0 (Screen, 1);
+
+    screen->width = width;
+    screen->height = height;
+    screen->fg = screen->bg = -1;
+    screen->cells = g_new0 (ScreenCell, width * height);
+    return screen;
+}
+
+static void
+screen_free (Screen *screen)
+{
+    g_free (screen->cells);
+    g_free (screen);
+}
+
+static void
+screen_move_to (Screen *screen, gint x, gint y)
+{
+    screen->x = CLAMP (x, 0, screen->width - 1);
+    screen->y = CLAMP (y, 0, screen->height - 1);
+    screen->wrap_pending = FALSE;
+}
+
+static const gchar *
+screen_feed_sgr (Screen *screen, const gchar *p)
+{
+    gint64 args [16];
+    gint n_args = 0;
+    gint i;
+
+    for (;;)
+    {
+        gchar *q;
+
+        g_assert_cmpint (n_args, <, 16);
+        args [n_args++] = g_ascii_strtoll (p, &q, 10);
+        p = q;
+        if (*p != ';')
+            break;
+        p++;
+    }
+
+    g_assert_cmpint (*p, ==, 'm');
+
+    for (i = 0; i < n_args; i++)
+    {
+        if (args [i] == 0)
+        {
+            screen->fg = screen->bg = -1;
+        }
+        else if (args [i] == 39)
+        {
+            screen->fg = -1;
+        }
+        else if (args [i] == 49)
+        {
+            screen->bg = -1;
+        }
+        else if ((args [i] == 38 || args [i] == 48) && i + 4 < n_args && args [i + 1] == 2)
+        {
+            gint64 color = (args [i + 2] << 16) | (args [i + 3] << 8) | args [i + 4];
+
+            if (args [i] == 38)
+                screen->fg = color;
+            else
+                screen->bg = color;
+            i += 4;
+        }
+        else
+        {
+            g_error ("Unexpected SGR argument %" G_GINT64_FORMAT, args [i]);
+        }
+    }
+
+    return p + 1;
+}
+
+static void
+screen_feed (Screen *screen, const gchar *str, gsize len)
+{
+    const gchar *p = str, *end = str + len;
+
+    while (p < end)
+    {
+        if (*p == '\033')
+        {
+            gchar *q;
+            gint n;
+
+            g_assert_cmpint (p [1], ==, '[');
+            p += 2;
+
+            if (g_ascii_isdigit (*p))
+            {
+                n = g_ascii_strtoll (p, &q, 10);
+                if (*q == ';' || *q == 'm')
+                {
+                    p = screen_feed_sgr (screen, p);
+                    continue;
+                }
+                p = q;
+            }
+            else
+            {
+                n = 1;
+            }
+
+            switch (*p)
+            {
+                case 'm':
+                    screen->fg = screen->bg = -1;
+                    break;
+                case 'B':
+                    screen_move_to (screen, screen->x, screen->y + n);
+                    break;
+                case 'C':
+                    screen_move_to (screen, screen->x + n, screen->y);
+                    break;
+                case 'D':
+                    screen_move_to (screen, screen->x - n, screen->y);
+                    break;
+                default:
+                    g_error ("Unexpected control sequence ending in '%c'", *p);
+            }
+
+            p++;
+        }
+        else
+        {
+            ScreenCell *cell;
+
+            g_assert_false (screen->wrap_pending);
+
+            cell = &screen->cells [screen->y * screen->width + screen->x];
+            cell->c = g_utf8_get_char (p);
+            cell->fg = screen->fg;
+            cell->bg = screen->bg;
+
+            if (screen->x == screen->width - 1)
+                screen->wrap_pending = TRUE;
+            else
+                screen->x++;
+
+            p = g_utf8_next_char (p);
+        }
+    }
+}
+
+/* Prints each row of the canvas at the indent, like the chafa tool does */
+static void
+screen_print_canvas (Screen *screen, ChafaCanvas *canvas, ChafaTermInfo *term_info,
+                     gint indent)
+{
+    GString **rows;
+    gint i;
+
+    chafa_canvas_print_rows (canvas, term_info, &rows, NULL);
+
+    for (i = 0; rows [i]; i++)
+    {
+        screen_move_to (screen, indent, i);
+        screen_feed (screen, rows [i]->str, rows [i]->len);
+    }
+
+    chafa_free_gstring_array (rows);
+}
+
+/* Makes a canvas with the same cells as orig, or blank ones if orig is NULL */
+static ChafaCanvas *
+copy_cells_canvas_new (ChafaCanvasConfig *config, ChafaCanvas *orig,
+                       gint width, gint height)
+{
+    const guint8 src_pixels [4] = { 0x00, 0x00, 0x00, 0xff };
+    ChafaCanvas *canvas;
+    gint x, y;
+
+    canvas = chafa_canvas_new (config);
+
+    /* Drawing something keeps the cells from being cleared when printing */
+    chafa_canvas_draw_all_pixels (canvas,
+                                  CHAFA_PIXEL_RGBA8_UNASSOCIATED,
+                                  src_pixels,
+                                  1, 1, 4);
+
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            gint fg = 0, bg = 0;
+
+            if (orig)
+                chafa_canvas_get_colors_at (orig, x, y, &fg, &bg);
+            chafa_canvas_set_char_at (canvas, x, y,
+                                      orig ? chafa_canvas_get_char_at (orig, x, y) : ' ');
+            chafa_canvas_set_colors_at (canvas, x, y, fg, bg);
+        }
+    }
+
+    return canvas;
+}
+
+static void
+randomize_cells (ChafaCanvas *canvas, gint width, gint height, gint n_cells)
+{
+    gint i;
+
+    for (i = 0; i < n_cells; i++)
+    {
+        gint x = g_test_rand_int_range (0, width);
+        gint y = g_test_rand_int_range (0, height);
+
+        /* Favor the edges, where the cursor handling is tricky */
+        if (g_test_rand_bit ())
+            x = g_test_rand_bit () ? width - 1 : 0;
+
+        chafa_canvas_set_char_at (canvas, x, y, g_test_rand_int_range ('a', 'e'));
+        chafa_canvas_set_colors_at (canvas, x, y,
+                                    g_test_rand_int_range (0, 4) * 0x3f3f3f,
+                                    g_test_rand_int_range (0, 4) * 0x002f5f);
+    }
+}
+
+/* A delta printed over the previous frame must leave the screen looking like
+ * a full print would, with the cursor in the same place */
+static void
+print_delta_test_params (gint term_width, gint indent)
+{
+    const gint width = 24, height = 8;
+    gchar *envp [] = { "TERM=xterm-256color", "COLORTERM=truecolor", NULL };
+    ChafaTermInfo *term_info;
+    ChafaCanvasConfig *config;
+    ChafaCanvas *canvas, *prev_canvas;
+    Screen *full_screen, *delta_screen;
+    gint i;
+
+    term_info = chafa_term_db_detect (chafa_term_db_get_default (), envp);
+
+    config = chafa_canvas_config_new ();
+    chafa_canvas_config_set_canvas_mode (config, CHAFA_CANVAS_MODE_TRUECOLOR);
+    chafa_canvas_config_set_geometry (config, width, height);
+    chafa_canvas_config_set_optimizations (config, CHAFA_OPTIMIZATION_ALL);
+
+    prev_canvas = copy_cells_canvas_new (config, NULL, width, height);
+    randomize_cells (prev_canvas, width, height, width * height * 2);
+
+    delta_screen = screen_new (term_width, height);
+    screen_print_canvas (delta_screen, prev_canvas, term_info, indent);
+
+    for (i = 0; i < 50; i++)
+    {
+        GString *gs;
+
+        canvas = copy_cells_canvas_new (config, prev_canvas, width, height);
+        randomize_cells (canvas, width, height, g_test_rand_int_range (0, 40));
+
+        screen_move_to (delta_screen, indent, 0);
+        gs = chafa_canvas_print_delta (canvas, prev_canvas, term_info);
+        screen_feed (delta_screen, gs->str, gs->len);
+        g_string_free (gs, TRUE);
+
+        full_screen = screen_new (term_width, height);
+        screen_print_canvas (full_screen, canvas, term_info, indent);
+
+        g_assert_cmpmem (delta_screen->cells, term_width * height * sizeof (ScreenCell),
+                         full_screen->cells, term_width * height * sizeof (ScreenCell));
+        g_assert_cmpint (delta_screen->x, ==, full_screen->x);
+        g_assert_cmpint (delta_screen->y, ==, full_screen->y);
+
+        screen_free (full_screen);
+        chafa_canvas_unref (prev_canvas);
+        prev_canvas = canvas;
+    }
+
+    screen_free (delta_screen);
+    chafa_canvas_unref (prev_canvas);
+    chafa_canvas_config_unref (config);
+    chafa_term_info_unref (term_info);
+}
+
+static void
+print_delta_test (void)
+{
+    /* Canvas spanning the terminal, and narrower ones with and without an
+     * indent. The last one ends right before the terminal's margin. */
+    print_delta_test_params (24, 0);
+    print_delta_test_params (30, 0);
+    print_delta_test_params (30, 3);
+    print_delta_test_params (30, 5);
+}
+
 int
 main (int argc, char *argv [])
 {
@@ -281,6 +793,9 @@ main (int argc, char *argv [])
     g_test_add_func ("/canvas/symbols/fgbg/st", symbols_fgbg_test_st);
     g_test_add_func ("/canvas/symbols/fgbg/mt", symbols_fgbg_test_mt);
     g_test_add_func ("/canvas/colors/fgbg", colors_fgbg_test);
+    g_test_add_func ("/canvas/print/colors", print_colors_test);
+    g_test_add_func ("/canvas/print/threads", print_threads_test);
+    g_test_add_func ("/canvas/print/delta", print_delta_test);
 
     return g_test_run ();
 }
@@ -10,3 +10,51 @@ for ext in $extensions; do
     [ "x${ext}" = "xcoregraphics" ] && continue
     run_cmd_single_file "$tool -f sixel --threads 12 --animate no" "good/pixel.$ext" || exit $?
 done
+
+check_preview () {
+    cmd="$tool -v -f symbol $1 ${top_srcdir}/tests/data/good/camera.tiff 2>&1 >/dev/null"
+    echo "$cmd" >&2
+    result="$(sh -c "$cmd")" || exit $?
+    case "$result" in
+        *"(embedded preview)"*) used=yes ;;
+        *) used=no ;;
+    esac
+    if test "x$used" != "x$2"; then
+        echo "Expected preview use: $2, got: $used" >&2
+        exit 1
+    fi
+}
+
+check_portrait () {
+    cmd="$tool -f symbol -c none --symbols ascii -s 40x10 $1 ${top_srcdir}/tests/data/good/camera.tiff"
+    echo "$cmd" >&2
+    width="$(sh -c "$cmd" | awk '{ if (length > n) n = length } END { print n }')"
+
+    # 10 rows of a 2:3 image at the default font ratio take up about 13
+    # columns. Unrotated, it would be about 30.
+    if test "$width" -ge 20; then
+        echo "Expected a portrait image, got $width columns" >&2
+        exit 1
+    fi
+}
+
+# Tiled TIFF with two SubIFD pyramid levels at 1/2 and 1/4 scale. Only the
+# first is marked as a reduced image. The sizes pick the 1/4 level, the 1/2
+# level and the main image respectively.
+case " $extensions " in
+    *" tiff "*)
+        for size in 8x4 40x20 80x40; do
+            run_cmd_single_file "$tool -f symbol -s $size" "good/pyramid.tiff" || exit $?
+            run_cmd_single_file "$tool -f sixel -s $size" "good/pyramid.tiff" || exit $?
+        done
+
+        # Camera-style TIFF: 768x512 with a 384x256 reduced-image SubIFD and
+        # orientation 6, so both are shown rotated to portrait. The preview
+        # covers 20x15 cells, but not 35x8 once the axes are swapped.
+        check_preview "--previews on -s 20x15" yes || exit $?
+        check_preview "--previews off -s 20x15" no || exit $?
+        check_preview "--previews on -s 35x8" no || exit $?
+        check_portrait "--previews on" || exit $?
+        check_portrait "--previews off" || exit $?
+        ;;
+esac
@@ -4,3 +4,12 @@
 . "${srcdir}/chafa-tool-test-common.sh"
 
 run_cmd "$tool -f symbol -c full -s 63 --threads 12 --animate no < " || exit $?
+
+# Animation frames are queued and drained by a background writer. Any file
+# can be read as raw frames. Without frame dropping, the output must be the
+# same, complete and in order, whether the reader keeps up or not.
+cmd="$tool -f symbol -c full -s 80x25 --realtime off --stream rgb --stream-size 32x32 ${top_srcdir}/tests/data/good/card-full-alpha.png"
+echo "$cmd" >&2
+fast="$(sh -c "$cmd" | od -An -tx1)" || exit $?
+slow="$(sh -c "$cmd" | (sleep 1; od -An -tx1))" || exit $?
+[ "x$fast" = "x$slow" ] || exit 1
@@ -0,0 +1,157 @@
+#include "config.h"
+
+#include <string.h>
+#include <chafa.h>
+#include "internal/chafa-deflate.h"
+
+#ifdef HAVE_ZLIB
+
+#include <zlib.h>
+
+/* Bands are at least 128KiB, so this is enough to get one per thread */
+#define N_THREADS 6
+#define LARGE_LEN (N_THREADS * 128 * 1024 * 2 + 4321)
+
+typedef enum
+{
+    FILL_RANDOM,
+    FILL_REPEATING,
+    FILL_MIXED
+}
+FillType;
+
+static guint8 *
+make_input (gsize len, FillType fill_type)
+{
+    guint8 *data;
+    gsize i;
+
+    data = g_malloc (len + 1);
+
+    for (i = 0; i < len; i++)
+    {
+        switch (fill_type)
+        {
+            case FILL_RANDOM:
+                data [i] = g_test_rand_int_range (0, 256);
+                break;
+            case FILL_REPEATING:
+                /* Long-distance repeats, so matches reach across bands */
+                data [i] = (i % 30011) * 7 + (i / 30011 % 3);
+                break;
+            case FILL_MIXED:
+                data [i] = ((i / 4096) & 1) ? g_test_rand_int_range (0, 4) : i & 0xff;
+                break;
+        }
+    }
+
+    return data;
+}
+
+static void
+check_round_trip (const guint8 *data, gsize row_len, gint n_rows, gint level)
+{
+    gsize in_len = row_len * (gsize) n_rows;
+    guint8 *deflated, *inflated;
+    gsize deflated_len;
+    z_stream zs;
+    gint ret;
+
+    deflated = chafa_deflate_rows (data, row_len, n_rows, level, &deflated_len);
+    g_assert_nonnull (deflated);
+    g_assert_cmpuint (deflated_len, >=, 2 + 2 + 4);
+
+    /* One byte extra, so trailing garbage from the inflater would show */
+    inflated = g_malloc (in_len + 1);
+
+    memset (&zs, 0, sizeof (zs));
+    ret = inflateInit (&zs);
+    g_assert_cmpint (ret, ==, Z_OK);
+
+    zs.next_in = deflated;
+    zs.avail_in = deflated_len;
+    zs.next_out = inflated;
+    zs.avail_out = in_len + 1;
+
+    /* Z_STREAM_END means the stream was complete and the Adler-32 matched */
+    ret = inflate (&zs, Z_FINISH);
+    g_assert_cmpint (ret, ==, Z_STREAM_END);
+    g_assert_cmpuint (zs.avail_in, ==, 0);
+    g_assert_cmpuint (zs.total_out, ==, in_len);
+    g_assert_cmpmem (inflated, in_len, data, in_len);
+
+    inflateEnd (&zs);
+    g_free (inflated);
+    g_free (deflated);
+}
+
+static void
+empty_test (void)
+{
+    gint level;
+
+    for (level = 1; level <= CHAFA_DEFLATE_LEVEL_MAX; level++)
+    {
+        check_round_trip (NULL, 0, 0, level);
+        check_round_trip ((const guint8 *) "", 0, 5, level);
+        check_round_trip ((const guint8 *) "", 4, 0, level);
+    }
+}
+
+static void
+small_test (void)
+{
+    guint8 *data;
+    gint i;
+
+    data = make_input (4096, FILL_MIXED);
+
+    for (i = 0; i < 200; i++)
+    {
+        gsize row_len = g_test_rand_int_range (1, 64);
+        gint n_rows = g_test_rand_int_range (1, 4096 / row_len + 1);
+
+        check_round_trip (data, row_len, n_rows, g_test_rand_int_range (1, 10));
+    }
+
+    g_free (data);
+}
+
+static void
+multi_band_test (void)
+{
+    FillType fill_type;
+
+    chafa_set_n_threads (N_THREADS);
+
+    for (fill_type = FILL_RANDOM; fill_type <= FILL_MIXED; fill_type++)
+    {
+        guint8 *data = make_input (LARGE_LEN, fill_type);
+
+        /* Rows of one byte let the bands split anywhere, and the odd
+         * row length leaves a partial band at the end */
+        check_round_trip (data, 1, LARGE_LEN, 1);
+        check_round_trip (data, 1, LARGE_LEN, 6);
+        check_round_trip (data, 4321, LARGE_LEN / 4321, 9);
+
+        g_free (data);
+    }
+
+    chafa_set_n_threads (-1);
+}
+
+#endif /* HAVE_ZLIB */
+
+int
+main (int argc, char *argv [])
+{
+    g_test_init (&argc, &argv, NULL);
+
+#ifdef HAVE_ZLIB
+    g_test_add_func ("/deflate/empty", empty_test);
+    g_test_add_func ("/deflate/small", small_test);
+    g_test_add_func ("/deflate/multi-band", multi_band_test);
+#endif
+
+    return g_test_run ();
+}
@@ -0,0 +1,824 @@
+#include "config.h"
+
+#include <chafa.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#define WIDTH_CELLS 4
+#define HEIGHT_CELLS 2
+#define CELL_WIDTH_PX 8
+#define CELL_HEIGHT_PX 16
+#define WIDTH_PX (WIDTH_CELLS * CELL_WIDTH_PX)
+#define HEIGHT_PX (HEIGHT_CELLS * CELL_HEIGHT_PX)
+
+typedef enum
+{
+    REPLY_OK,
+    REPLY_ERROR,
+    REPLY_NONE
+}
+ReplyMode;
+
+typedef struct
+{
+    gint master_fd;
+    gint slave_fd;
+    GThread *thread;
+    gint stop;
+    gint reply_mode;
+
+    /* Protected by mutex */
+    GMutex mutex;
+    gint n_local;
+    gint n_inline;
+    gint n_put;
+    GHashTable *resident_ids;
+    gchar *last_local_payload;
+    gsize last_local_payload_len;
+}
+FakeTerminal;
+
+/* Reads and removes the object named in a local transfer, like the
+ * terminal would */
+static gchar *
+read_local (const gchar *control, const gchar *payload, gsize *len_out)
+{
+    gchar *name;
+    gsize name_len;
+    gchar *contents = NULL;
+    gsize len = 0;
+
+    name = (gchar *) g_base64_decode (payload, &name_len);
+    name = g_realloc (name, name_len + 1);
+    name [name_len] = '\0';
+
+    if (strstr (control, "t=s"))
+    {
+        struct stat st;
+        gint fd;
+
+        fd = shm_open (name, O_RDONLY, 0);
+        g_assert_cmpint (fd, >=, 0);
+        g_assert_cmpint (fstat (fd, &st), ==, 0);
+        len = st.st_size;
+        contents = g_malloc (len);
+        g_assert_cmpint (read (fd, contents, len), ==, (gssize) len);
+        close (fd);
+        shm_unlink (name);
+    }
+    else
+    {
+        g_assert_true (g_file_get_contents (name, &contents, &len, NULL));
+        g_unlink (name);
+    }
+
+    g_free (name);
+    *len_out = len;
+    return contents;
+}
+
+static gchar *
+get_key (const gchar *control, const gchar *key)
+{
+    gchar **pairs = g_strsplit (control, ",", -1);
+    gchar *value = NULL;
+    gint i;
+
+    for (i = 0; pairs [i]; i++)
+    {
+        if (g_str_has_prefix (pairs [i], key) && pairs [i] [strlen (key)] == '=')
+        {
+            value = g_strdup (pairs [i] + strlen (key) + 1);
+            break;
+        }
+    }
+
+    g_strfreev (pairs);
+    return value;
+}
+
+static void
+handle_command (FakeTerminal *ft, const gchar *control, const gchar *payload)
+{
+    gchar *action = get_key (control, "a");
+    gchar *transmission = get_key (control, "t");
+    gchar *id = get_key (control, "i");
+    gchar *quiet = get_key (control, "q");
+    gboolean success = TRUE;
+
+    /* Continuation chunks have no action */
+    if (!action)
+        goto out;
+
+    g_mutex_lock (&ft->mutex);
+
+    if (transmission && (!strcmp (transmission, "s") || !strcmp (transmission, "t")))
+    {
+        gsize len;
+        gchar *contents = read_local (control, payload, &len);
+
+        ft->n_local++;
+        g_free (ft->last_local_payload);
+        ft->last_local_payload = contents;
+        ft->last_local_payload_len = len;
+
+        success = (g_atomic_int_get (&ft->reply_mode) == REPLY_OK);
+    }
+    else if (!strcmp (action, "T"))
+    {
+        ft->n_inline++;
+    }
+    else if (!strcmp (action, "p"))
+    {
+        ft->n_put++;
+        success = id && g_hash_table_contains (ft->resident_ids, id);
+    }
+
+    if (id && success && !strcmp (action, "T"))
+        g_hash_table_add (ft->resident_ids, g_strdup (id));
+
+    g_mutex_unlock (&ft->mutex);
+
+    if (id && !(quiet && !strcmp (quiet, "2"))
+        && g_atomic_int_get (&ft->reply_mode) != REPLY_NONE)
+    {
+        gchar *reply = success
+            ? g_strdup_printf ("\033_Gi=%s;OK\033\\", id)
+            : g_strdup_printf ("\033_Gi=%s;EBADF:Failed to open file\033\\", id);
+
+        g_assert_cmpint (write (ft->master_fd, reply, strlen (reply)),
+                         ==, (gint) strlen (reply));
+        g_free (reply);
+    }
+
+out:
+    g_free (action);
+    g_free (transmission);
+    g_free (id);
+    g_free (quiet);
+}
+
+/* Plays the terminal's side. Acts on graphics commands and replies to
+ * them like Kitty does. */
+static gpointer
+responder_main (gpointer data)
+{
+    FakeTerminal *ft = data;
+    GString *input = g_string_new ("");
+
+    while (!g_atomic_int_get (&ft->stop))
+    {
+        GPollFD pfd = { ft->master_fd, G_IO_IN, 0 };
+        gchar buf [4096];
+        gchar *begin, *end;
+        gint len;
+
+        if (g_poll (&pfd, 1, 20) < 1)
+            continue;
+
+        len = read (ft->master_fd, buf, sizeof (buf));
+        if (len < 1)
+            break;
+
+        g_string_append_len (input, buf, len);
+
+        while ((begin = strstr (input->str, "\033_G"))
+               && (end = strstr (begin, "\033\\")))
+        {
+            gchar *cmd = g_strndup (begin + 3, end - begin - 3);
+            gchar *payload = strchr (cmd, ';');
+
+            if (payload)
+                *(payload++) = '\0';
+
+            handle_command (ft, cmd, payload ? payload : "");
+            g_free (cmd);
+            g_string_erase (input, 0, end + 2 - input->str);
+        }
+    }
+
+    g_string_free (input, TRUE);
+    return NULL;
+}
+
+static void
+fake_terminal_init (FakeTerminal *ft, ReplyMode reply_mode)
+{
+    struct winsize w;
+
+    memset (ft, 0, sizeof (*ft));
+    g_mutex_init (&ft->mutex);
+    ft->reply_mode = reply_mode;
+    ft->resident_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    ft->master_fd = posix_openpt (O_RDWR | O_NOCTTY);
+    g_assert_cmpint (ft->master_fd, >=, 0);
+    g_assert_cmpint (grantpt (ft->master_fd), ==, 0);
+    g_assert_cmpint (unlockpt (ft->master_fd), ==, 0);
+
+    ft->slave_fd = open (ptsname (ft->master_fd), O_RDWR | O_NOCTTY);
+    g_assert_cmpint (ft->slave_fd, >=, 0);
+
+    w.ws_col = 80;
+    w.ws_row = 24;
+    w.ws_xpixel = 80 * CELL_WIDTH_PX;
+    w.ws_ypixel = 24 * CELL_HEIGHT_PX;
+    g_assert_cmpint (ioctl (ft->slave_fd, TIOCSWINSZ, &w), ==, 0);
+
+    ft->thread = g_thread_new ("responder", responder_main, ft);
+}
+
+static void
+fake_terminal_deinit (FakeTerminal *ft)
+{
+    g_atomic_int_set (&ft->stop, 1);
+    g_thread_join (ft->thread);
+    close (ft->slave_fd);
+    close (ft->master_fd);
+
+    g_free (ft->last_local_payload);
+    g_hash_table_destroy (ft->resident_ids);
+    g_mutex_clear (&ft->mutex);
+}
+
+/* Waits for the terminal to catch up with everything we sent */
+static void
+fake_terminal_sync (FakeTerminal *ft, ChafaTerm *term)
+{
+    chafa_term_flush (term);
+    tcdrain (ft->slave_fd);
+    g_usleep (100000);
+}
+
+static void
+fake_terminal_get_counts (FakeTerminal *ft, gint *n_local_out, gint *n_inline_out)
+{
+    g_mutex_lock (&ft->mutex);
+    *n_local_out = ft->n_local;
+    *n_inline_out = ft->n_inline;
+    g_mutex_unlock (&ft->mutex);
+}
+
+static gint
+fake_terminal_get_n_put (FakeTerminal *ft)
+{
+    gint n_put;
+
+    g_mutex_lock (&ft->mutex);
+    n_put = ft->n_put;
+    g_mutex_unlock (&ft->mutex);
+    return n_put;
+}
+
+/* Forgets all images, like a terminal that ran out of quota */
+static void
+fake_terminal_evict_all (FakeTerminal *ft)
+{
+    g_mutex_lock (&ft->mutex);
+    g_hash_table_remove_all (ft->resident_ids);
+    g_mutex_unlock (&ft->mutex);
+}
+
+static guint8 *
+make_pixels (void)
+{
+    guint8 *pixels = g_malloc (WIDTH_PX * HEIGHT_PX * 4);
+    gint i;
+
+    for (i = 0; i < WIDTH_PX * HEIGHT_PX; i++)
+    {
+        pixels [i * 4] = i;
+        pixels [i * 4 + 1] = i * 3;
+        pixels [i * 4 + 2] = i * 7;
+        pixels [i * 4 + 3] = 0xff;
+    }
+
+    return pixels;
+}
+
+static ChafaCanvas *
+kitty_canvas_new (const guint8 *pixels, gboolean local_transfer, gint placement_id)
+{
+    ChafaCanvasConfig *config;
+    ChafaCanvas *canvas;
+    ChafaFrame *frame;
+    ChafaImage *image;
+    ChafaPlacement *placement;
+
+    /* Without a placement ID, this is what the tool does for still images */
+
+    config = chafa_canvas_config_new ();
+    chafa_canvas_config_set_pixel_mode (config, CHAFA_PIXEL_MODE_KITTY);
+    chafa_canvas_config_set_cell_geometry (config, CELL_WIDTH_PX, CELL_HEIGHT_PX);
+    chafa_canvas_config_set_geometry (config, WIDTH_CELLS, HEIGHT_CELLS);
+    chafa_canvas_config_set_local_transfer_enabled (config, local_transfer);
+    g_assert_true (chafa_canvas_config_get_local_transfer_enabled (config) == local_transfer);
+
+    canvas = chafa_canvas_new (config);
+    chafa_canvas_config_unref (config);
+
+    if (placement_id <= 0)
+    {
+        chafa_canvas_draw_all_pixels (canvas, CHAFA_PIXEL_RGBA8_UNASSOCIATED, pixels,
+                                      WIDTH_PX, HEIGHT_PX, WIDTH_PX * 4);
+        return canvas;
+    }
+
+    frame = chafa_frame_new (pixels, CHAFA_PIXEL_RGBA8_UNASSOCIATED,
+                             WIDTH_PX, HEIGHT_PX, WIDTH_PX * 4);
+    image = chafa_image_new ();
+    chafa_image_set_frame (image, frame);
+    placement = chafa_placement_new (image, placement_id);
+    chafa_canvas_set_placement (canvas, placement);
+
+    chafa_placement_unref (placement);
+    chafa_image_unref (image);
+    chafa_frame_unref (frame);
+    return canvas;
+}
+
+static ChafaTerm *
+kitty_term_new (FakeTerminal *ft)
+{
+    ChafaTerm *term;
+
+    term = chafa_term_new (NULL, ft->slave_fd, ft->slave_fd, ft->slave_fd);
+    g_assert_true (chafa_term_info_have_seq (chafa_term_get_term_info (term),
+                                             CHAFA_TERM_SEQ_BEGIN_KITTY_IMMEDIATE_IMAGE_SHM_V1));
+    return term;
+}
+
+static void
+setup_env (void)
+{
+    g_setenv ("TERM", "xterm-kitty", TRUE);
+    g_unsetenv ("SSH_CONNECTION");
+    g_unsetenv ("SSH_CLIENT");
+    g_unsetenv ("SSH_TTY");
+}
+
+static void
+opt_in_test (void)
+{
+    FakeTerminal ft;
+    ChafaTerm *term;
+    ChafaCanvas *canvas;
+    guint8 *pixels;
+    GString *gs;
+    gint n_local, n_inline;
+
+    fake_terminal_init (&ft, REPLY_OK);
+    term = kitty_term_new (&ft);
+    pixels = make_pixels ();
+
+    /* Off by default */
+    canvas = kitty_canvas_new (pixels, FALSE, 1);
+    chafa_term_print_canvas (term, canvas, NULL);
+    chafa_canvas_unref (canvas);
+
+    /* Plain printing never does it, since nobody reads the reply */
+    canvas = kitty_canvas_new (pixels, TRUE, 2);
+    gs = chafa_canvas_print (canvas, chafa_term_get_term_info (term));
+    g_assert_null (strstr (gs->str, "t=s"));
+    g_assert_null (strstr (gs->str, "t=t"));
+    chafa_term_write (term, gs->str, gs->len);
+    g_string_free (gs, TRUE);
+    chafa_canvas_unref (canvas);
+
+    fake_terminal_sync (&ft, term);
+    fake_terminal_get_counts (&ft, &n_local, &n_inline);
+    g_assert_cmpint (n_local, ==, 0);
+    g_assert_cmpint (n_inline, ==, 2);
+
+    chafa_term_destroy (term);
+    fake_terminal_deinit (&ft);
+    g_free (pixels);
+}
+
+static void
+transfer_ok_test (void)
+{
+    FakeTerminal ft;
+    ChafaTerm *term;
+    ChafaCanvas *canvas;
+    guint8 *pixels;
+    gint n_local, n_inline;
+    gint i;
+
+    fake_terminal_init (&ft, REPLY_OK);
+    term = kitty_term_new (&ft);
+    pixels = make_pixels ();
+
+    for (i = 1; i <= 3; i++)
+    {
+        canvas = kitty_canvas_new (pixels, TRUE, i);
+        chafa_term_print_canvas (term, canvas, NULL);
+        chafa_canvas_unref (canvas);
+    }
+
+    fake_terminal_sync (&ft, term);
+    fake_terminal_get_counts (&ft, &n_local, &n_inline);
+    g_assert_cmpint (n_local, ==, 3);
+    g_assert_cmpint (n_inline, ==, 0);
+
+    g_mutex_lock (&ft.mutex);
+    g_assert_cmpmem (ft.last_local_payload, ft.last_local_payload_len,
+                     pixels, WIDTH_PX * HEIGHT_PX * 4);
+    g_mutex_unlock (&ft.mutex);
+
+    chafa_term_destroy (term);
+    fake_terminal_deinit (&ft);
+    g_free (pixels);
+}
+
+static void
+transfer_fail_test_mode (ReplyMode reply_mode)
+{
+    FakeTerminal ft;
+    ChafaTerm *term;
+    ChafaCanvas *canvas;
+    guint8 *pixels;
+    gint n_local, n_inline;
+
+    fake_terminal_init (&ft, reply_mode);
+    term = kitty_term_new (&ft);
+    pixels = make_pixels ();
+
+    /* The failed transfer is followed by an inline one */
+    canvas = kitty_canvas_new (pixels, TRUE, 1);
+    chafa_term_print_canvas (term, canvas, NULL);
+    chafa_canvas_unref (canvas);
+
+    fake_terminal_sync (&ft, term);
+    fake_terminal_get_counts (&ft, &n_local, &n_inline);
+    g_assert_cmpint (n_local, ==, 1);
+    g_assert_cmpint (n_inline, ==, 1);
+
+    /* We don't try again */
+    canvas = kitty_canvas_new (pixels, TRUE, 2);
+    chafa_term_print_canvas (term, canvas, NULL);
+    chafa_canvas_unref (canvas);
+
+    fake_terminal_sync (&ft, term);
+    fake_terminal_get_counts (&ft, &n_local, &n_inline);
+    g_assert_cmpint (n_local, ==, 1);
+    g_assert_cmpint (n_inline, ==, 2);
+
+    chafa_term_destroy (term);
+    fake_terminal_deinit (&ft);
+    g_free (pixels);
+}
+
+static void
+transfer_error_test (void)
+{
+    transfer_fail_test_mode (REPLY_ERROR);
+}
+
+static void
+transfer_timeout_test (void)
+{
+    transfer_fail_test_mode (REPLY_NONE);
+}
+
+static void
+cached_upload_test_local (gboolean local_transfer)
+{
+    FakeTerminal ft;
+    ChafaTerm *term;
+    ChafaCanvas *canvas;
+    guint8 *pixels;
+    gint n_local, n_inline;
+
+    fake_terminal_init (&ft, REPLY_OK);
+    term = kitty_term_new (&ft);
+    pixels = make_pixels ();
+    canvas = kitty_canvas_new (pixels, local_transfer, -1);
+
+    /* The first print uploads the image with an ID */
+    chafa_term_print_canvas (term, canvas, NULL);
+    fake_terminal_sync (&ft, term);
+    fake_terminal_get_counts (&ft, &n_local, &n_inline);
+    g_assert_cmpint (n_local, ==, local_transfer ? 1 : 0);
+    g_assert_cmpint (n_inline, ==, local_transfer ? 0 : 1);
+    g_assert_cmpint (fake_terminal_get_n_put (&ft), ==, 0);
+
+    /* The next ones place it by ID */
+    chafa_term_print_canvas (term, canvas, NULL);
+    chafa_term_print_canvas (term, canvas, NULL);
+    fake_terminal_sync (&ft, term);
+    fake_terminal_get_counts (&ft, &n_local, &n_inline);
+    g_assert_cmpint (n_local + n_inline, ==, 1);
+    g_assert_cmpint (fake_terminal_get_n_put (&ft), ==, 2);
+
+    /* If the terminal lost it, it's uploaded again */
+    fake_terminal_evict_all (&ft);
+    chafa_term_print_canvas (term, canvas, NULL);
+    fake_terminal_sync (&ft, term);
+    fake_terminal_get_counts (&ft, &n_local, &n_inline);
+    g_assert_cmpint (n_local, ==, local_transfer ? 2 : 0);
+    g_assert_cmpint (n_inline, ==, local_transfer ? 0 : 2);
+    g_assert_cmpint (fake_terminal_get_n_put (&ft), ==, 3);
+
+    /* And placed by ID after that */
+    chafa_term_print_canvas (term, canvas, NULL);
+    fake_terminal_sync (&ft, term);
+    fake_terminal_get_counts (&ft, &n_local, &n_inline);
+    g_assert_cmpint (n_local + n_inline, ==, 2);
+    g_assert_cmpint (fake_terminal_get_n_put (&ft), ==, 4);
+
+    chafa_canvas_unref (canvas);
+    chafa_term_destroy (term);
+    fake_terminal_deinit (&ft);
+    g_free (pixels);
+}
+
+static void
+cached_upload_test (void)
+{
+    cached_upload_test_local (FALSE);
+    cached_upload_test_local (TRUE);
+}
+
+static void
+cached_upload_error_test (void)
+{
+    FakeTerminal ft;
+    ChafaTerm *term;
+    ChafaCanvas *canvas;
+    guint8 *pixels;
+    gint n_local, n_inline;
+
+    fake_terminal_init (&ft, REPLY_ERROR);
+    term = kitty_term_new (&ft);
+    pixels = make_pixels ();
+    canvas = kitty_canvas_new (pixels, TRUE, -1);
+
+    /* The failed local upload is followed by an inline one, and the image
+     * is placed by ID after that */
+    chafa_term_print_canvas (term, canvas, NULL);
+    chafa_term_print_canvas (term, canvas, NULL);
+    fake_terminal_sync (&ft, term);
+    fake_terminal_get_counts (&ft, &n_local, &n_inline);
+    g_assert_cmpint (n_local, ==, 1);
+    g_assert_cmpint (n_inline, ==, 1);
+    g_assert_cmpint (fake_terminal_get_n_put (&ft), ==, 1);
+
+    chafa_canvas_unref (canvas);
+    chafa_term_destroy (term);
+    fake_terminal_deinit (&ft);
+    g_free (pixels);
+}
+
+/* A Kitty graphics command, with its chunked payload put back together */
+typedef struct
+{
+    gchar *control;
+    GString *payload;
+}
+KittyCommand;
+
+static void
+kitty_command_free (gpointer data)
+{
+    KittyCommand *cmd = data;
+
+    g_free (cmd->control);
+    g_string_free (cmd->payload, TRUE);
+    g_free (cmd);
+}
+
+static GPtrArray *
+parse_kitty_commands (const gchar *str)
+{
+    GPtrArray *cmds = g_ptr_array_new_with_free_func (kitty_command_free);
+    const gchar *begin, *end;
+
+    while ((begin = strstr (str, "\033_G")) && (end = strstr (begin, "\033\\")))
+    {
+        gchar *control = g_strndup (begin + 3, end - begin - 3);
+        gchar *payload = strchr (control, ';');
+        gchar *action;
+
+        if (payload)
+            *(payload++) = '\0';
+
+        action = get_key (control, "a");
+
+        if (action)
+        {
+            KittyCommand *cmd = g_new0 (KittyCommand, 1);
+
+            cmd->control = g_strdup (control);
+            cmd->payload = g_string_new ("");
+            g_ptr_array_add (cmds, cmd);
+        }
+        else
+        {
+            /* Continuation chunk */
+            g_assert_cmpuint (cmds->len, >, 0);
+            if (payload)
+                g_string_append (((KittyCommand *) g_ptr_array_index (cmds, cmds->len - 1))->payload,
+                                 payload);
+        }
+
+        g_free (action);
+        g_free (control);
+        str = end + 2;
+    }
+
+    return cmds;
+}
+
+static gint
+get_int_key (const gchar *control, const gchar *key)
+{
+    gchar *value = get_key (control, key);
+    gint i;
+
+    g_assert_nonnull (value);
+    i = atoi (value);
+    g_free (value);
+    return i;
+}
+
+static guint8 *
+decode_payload (KittyCommand *cmd, gsize expected_len)
+{
+    guint8 *data;
+    gsize len;
+
+    data = g_base64_decode (cmd->payload->str, &len);
+    g_assert_cmpuint (len, ==, expected_len);
+    return data;
+}
+
+/* Prints the pixels as a still image and returns what was transmitted. This
+ * needs a separate canvas, since printing resets its animation state. */
+static guint8 *
+get_full_image (const guint8 *pixels, ChafaTermInfo *term_info)
+{
+    ChafaCanvas *canvas;
+    GPtrArray *cmds;
+    GString *gs;
+    guint8 *image;
+
+    canvas = kitty_canvas_new (pixels, FALSE, -1);
+    gs = chafa_canvas_print (canvas, term_info);
+    chafa_canvas_unref (canvas);
+    cmds = parse_kitty_commands (gs->str);
+    g_assert_cmpuint (cmds->len, ==, 1);
+    image = decode_payload (g_ptr_array_index (cmds, 0), WIDTH_PX * HEIGHT_PX * 4);
+
+    g_ptr_array_unref (cmds);
+    g_string_free (gs, TRUE);
+    return image;
+}
+
+/* Prints canvas as a delta against prev_canvas, checks that the frame it
+ * adds has the expected bounds and base frame, and composes it onto image
+ * like Kitty would. The result must match a full print of the canvas. */
+static void
+check_animation_frame (ChafaCanvas *canvas, ChafaCanvas *prev_canvas,
+                       const guint8 *pixels, ChafaTermInfo *term_info,
+                       guint8 *image, gint frame_index,
+                       gint x, gint y, gint width, gint height)
+{
+    KittyCommand *cmd;
+    GPtrArray *cmds;
+    GString *gs;
+    guint8 *rect, *expected;
+    gint row;
+
+    gs = chafa_canvas_print_delta (canvas, prev_canvas, term_info);
+    cmds = parse_kitty_commands (gs->str);
+    g_assert_cmpuint (cmds->len, ==, 2);
+
+    cmd = g_ptr_array_index (cmds, 0);
+    g_assert_cmpint (get_int_key (cmd->control, "i"), ==, 7);
+    g_assert_cmpint (get_int_key (cmd->control, "f"), ==, 32);
+    g_assert_cmpint (get_int_key (cmd->control, "x"), ==, x);
+    g_assert_cmpint (get_int_key (cmd->control, "y"), ==, y);
+    g_assert_cmpint (get_int_key (cmd->control, "s"), ==, width);
+    g_assert_cmpint (get_int_key (cmd->control, "v"), ==, height);
+    g_assert_cmpint (get_int_key (cmd->control, "c"), ==, frame_index - 1);
+
+    /* The rectangle replaces the base frame's pixels instead of being
+     * blended onto them */
+    g_assert_cmpint (get_int_key (cmd->control, "X"), ==, 1);
+
+    rect = decode_payload (cmd, (gsize) width * height * 4);
+    for (row = 0; row < height; row++)
+        memcpy (image + ((y + row) * WIDTH_PX + x) * 4, rect + row * width * 4, width * 4);
+
+    /* Then the new frame is shown */
+    cmd = g_ptr_array_index (cmds, 1);
+    g_assert_cmpint (get_int_key (cmd->control, "i"), ==, 7);
+    g_assert_cmpint (get_int_key (cmd->control, "c"), ==, frame_index);
+
+    expected = get_full_image (pixels, term_info);
+    g_assert_cmpmem (image, WIDTH_PX * HEIGHT_PX * 4, expected, WIDTH_PX * HEIGHT_PX * 4);
+
+    g_free (expected);
+    g_free (rect);
+    g_ptr_array_unref (cmds);
+    g_string_free (gs, TRUE);
+}
+
+static void
+set_pixel (guint8 *pixels, gint x, gint y, guint32 rgba)
+{
+    memcpy (pixels + (y * WIDTH_PX + x) * 4, &rgba, 4);
+}
+
+static void
+animation_frames_test (void)
+{
+    ChafaTermDb *term_db;
+    ChafaTermInfo *term_info;
+    ChafaCanvas *canvas, *prev_canvas;
+    GPtrArray *cmds;
+    GString *gs;
+    guint8 *pixels, *image;
+    gchar **envp;
+    gint x, y;
+
+    envp = g_get_environ ();
+    term_db = chafa_term_db_get_default ();
+    term_info = chafa_term_db_detect (term_db, envp);
+    g_strfreev (envp);
+    g_assert_true (chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_BEGIN_KITTY_ANIMATION_FRAME_V1));
+
+    /* The first frame is transmitted in full, with the animation's ID */
+    pixels = make_pixels ();
+    prev_canvas = kitty_canvas_new (pixels, FALSE, 7);
+    gs = chafa_canvas_print_delta (prev_canvas, NULL, term_info);
+    cmds = parse_kitty_commands (gs->str);
+    g_assert_cmpuint (cmds->len, ==, 1);
+    g_assert_nonnull (strstr (((KittyCommand *) g_ptr_array_index (cmds, 0))->control, "a=T"));
+    g_assert_cmpint (get_int_key (((KittyCommand *) g_ptr_array_index (cmds, 0))->control, "i"), ==, 7);
+    image = decode_payload (g_ptr_array_index (cmds, 0), WIDTH_PX * HEIGHT_PX * 4);
+    g_ptr_array_unref (cmds);
+    g_string_free (gs, TRUE);
+
+    /* A changed block, partly transparent */
+    for (y = 3; y < 10; y++)
+        for (x = 5; x < 13; x++)
+            set_pixel (pixels, x, y, (x + y) % 3 ? 0xff2080c0 : 0x00000000);
+
+    canvas = kitty_canvas_new (pixels, FALSE, 7);
+    check_animation_frame (canvas, prev_canvas, pixels, term_info, image, 2, 5, 3, 8, 7);
+    chafa_canvas_unref (prev_canvas);
+    prev_canvas = canvas;
+
+    /* Nothing changed, so one pixel is sent */
+    canvas = kitty_canvas_new (pixels, FALSE, 7);
+    check_animation_frame (canvas, prev_canvas, pixels, term_info, image, 3, 0, 0, 1, 1);
+    chafa_canvas_unref (prev_canvas);
+    prev_canvas = canvas;
+
+    /* Two distant pixels give the rectangle that covers both */
+    set_pixel (pixels, 1, HEIGHT_PX - 2, 0xff00ff00);
+    set_pixel (pixels, WIDTH_PX - 1, 4, 0xff0000ff);
+    canvas = kitty_canvas_new (pixels, FALSE, 7);
+    check_animation_frame (canvas, prev_canvas, pixels, term_info, image, 4,
+                           1, 4, WIDTH_PX - 1, HEIGHT_PX - 2 - 4 + 1);
+    chafa_canvas_unref (prev_canvas);
+    prev_canvas = canvas;
+
+    /* A single pixel in the last row and column */
+    set_pixel (pixels, WIDTH_PX - 1, HEIGHT_PX - 1, 0xff102030);
+    canvas = kitty_canvas_new (pixels, FALSE, 7);
+    check_animation_frame (canvas, prev_canvas, pixels, term_info, image, 5,
+                           WIDTH_PX - 1, HEIGHT_PX - 1, 1, 1);
+    chafa_canvas_unref (prev_canvas);
+
+    chafa_canvas_unref (canvas);
+    chafa_term_info_unref (term_info);
+    g_free (image);
+    g_free (pixels);
+}
+
+int
+main (int argc, char *argv [])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    /* Before any threads are started */
+    setup_env ();
+
+    g_test_add_func ("/kitty-term/opt-in", opt_in_test);
+    g_test_add_func ("/kitty-term/transfer-ok", transfer_ok_test);
+    g_test_add_func ("/kitty-term/transfer-error", transfer_error_test);
+    g_test_add_func ("/kitty-term/transfer-timeout", transfer_timeout_test);
+    g_test_add_func ("/kitty-term/cached-upload", cached_upload_test);
+    g_test_add_func ("/kitty-term/cached-upload-error", cached_upload_error_test);
+    g_test_add_func ("/kitty-term/animation-frames", animation_frames_test);
+
+    return g_test_run ();
+}
@@ -0,0 +1,131 @@
+#include "config.h"
+
+#include <chafa.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Measures how fast terminal input is parsed into events. This isn't run
+ * as part of the test suite; invoke it manually after building with
+ * "make check". */
+
+#define READ_CHUNK_SIZE 4096
+#define RUN_SECONDS 2.0
+
+/* Recorded from xterm; see parser-test.c */
+static const gchar key_input [] =
+    "\033[A\033[A\033[B\033[1;5D\033[1;5C\033[1;2H\033[F"
+    "\033[5~\033[6;5~\033[3~\033[2;2~"
+    "\033OP\033OQ\033[1;5P\033[15~\033[24;2~"
+    "ls -l\rbl\xc3\xa5b\xc3\xa6rsyltet\xc3\xb8y\x7f\x7f\t\033[Z";
+
+static const gchar mouse_input [] =
+    "\033[<0;10;20M\033[<32;11;20M\033[<32;12;21M\033[<32;13;21M"
+    "\033[<32;14;22M\033[<32;15;22M\033[<32;16;23M\033[<0;16;23m"
+    "\033[<64;16;23M\033[<65;16;23M";
+
+static const gchar reply_input [] =
+    "\033]10;rgb:ffff/ffff/ffff\033\\"
+    "\033]11;rgb:0000/0000/0000\033\\"
+    "\033[8;50;160t\033[4;800;1280t\033[6;16;8t"
+    "\033[?62;4;22c";
+
+static gint
+parse_all (ChafaParser *parser, ChafaEvent *event, const gchar *data, gint data_len,
+           gint chunk_size)
+{
+    gint n_events = 0;
+    gint ofs;
+
+    for (ofs = 0; ofs < data_len; ofs += chunk_size)
+    {
+        chafa_parser_push_data (parser, data + ofs, MIN (chunk_size, data_len - ofs));
+
+        if (event)
+        {
+            while (chafa_parser_pop_event_into (parser, event))
+                n_events++;
+        }
+        else
+        {
+            ChafaEvent *e;
+
+            while ((e = chafa_parser_pop_event (parser)))
+            {
+                g_free (e);
+                n_events++;
+            }
+        }
+    }
+
+    return n_events;
+}
+
+static void
+run_bench (const gchar *name, ChafaTermInfo *term_info, const gchar *sample,
+           gint input_size, gint chunk_size, gboolean use_heap)
+{
+    GString *input;
+    GTimer *timer, *total_timer;
+    ChafaEvent *event = NULL;
+    gdouble elapsed, best = G_MAXDOUBLE;
+    gint n_events = 0;
+
+    input = g_string_new ("");
+    while (input->len < (gsize) input_size)
+        g_string_append (input, sample);
+
+    if (!use_heap)
+        event = chafa_event_new ();
+
+    timer = g_timer_new ();
+    total_timer = g_timer_new ();
+
+    do
+    {
+        ChafaParser *parser;
+
+        parser = chafa_parser_new (term_info);
+
+        g_timer_start (timer);
+        n_events = parse_all (parser, event, input->str, input->len, chunk_size);
+        elapsed = g_timer_elapsed (timer, NULL);
+
+        if (elapsed < best)
+            best = elapsed;
+
+        chafa_parser_destroy (parser);
+    }
+    while (g_timer_elapsed (total_timer, NULL) < RUN_SECONDS);
+
+    g_print ("%-24s %8.1f MB/s %10.0f events/s\n",
+             name, input->len / best / 1000000.0, n_events / best);
+
+    if (event)
+        chafa_event_destroy (event);
+    g_timer_destroy (total_timer);
+    g_timer_destroy (timer);
+    g_string_free (input, TRUE);
+}
+
+int
+main (int argc, char *argv [])
+{
+    gchar *envp [] = { "TERM=xterm-256color", "COLORTERM=truecolor", NULL };
+    ChafaTermInfo *term_info;
+
+    g_test_init (&argc, &argv, NULL);
+
+    term_info = chafa_term_db_detect (chafa_term_db_get_default (), envp);
+
+    /* About 64kiB of input, delivered in read()-sized chunks */
+    run_bench ("keys", term_info, key_input, 65536, READ_CHUNK_SIZE, FALSE);
+    run_bench ("keys, heap events", term_info, key_input, 65536, READ_CHUNK_SIZE, TRUE);
+    run_bench ("mouse", term_info, mouse_input, 65536, READ_CHUNK_SIZE, FALSE);
+    run_bench ("replies", term_info, reply_input, 65536, READ_CHUNK_SIZE, FALSE);
+
+    /* A large paste pushed all at once */
+    run_bench ("paste, 1MiB", term_info, key_input, 1 << 20, 1 << 20, FALSE);
+
+    chafa_term_info_unref (term_info);
+    return 0;
+}
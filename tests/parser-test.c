@@ -0,0 +1,378 @@
+#include "config.h"
+
+#include <chafa.h>
+#include <string.h>
+
+/* Recorded input from xterm: Typing, cursor keys with modifiers, function
+ * keys, an SGR mouse drag (which we don't have sequences for, so it should
+ * come through as characters), UTF-8 text and probe replies. */
+static const gchar recorded_input [] =
+    "ls -l\r"
+    "\033[A\033[A\033[B\033[1;5D\033[1;5C\033[1;2H\033[F"
+    "\033[5~\033[6;5~\033[3~\033[2;2~"
+    "\033OP\033OQ\033[1;5P\033[15~\033[24;2~"
+    "\033[<0;10;20M\033[<32;11;20M\033[<32;12;21M\033[<0;12;21m"
+    "bl\xc3\xa5b\xc3\xa6rsyltet\xc3\xb8y\x7f\x7f\t\033[Z"
+    "\033]10;rgb:ffff/ffff/ffff\033\\"
+    "\033]11;rgb:0000/0000/0000\033\\"
+    "\033[8;50;160t\033[4;800;1280t\033[6;16;8t"
+    "\033[?62;4;22c"
+    "\r";
+
+typedef struct
+{
+    ChafaEventType type;
+    gunichar c;
+    ChafaTermSeq seq;
+    guint args [CHAFA_TERM_SEQ_ARGS_MAX];
+    gint n_args;
+}
+TestEvent;
+
+/* Reference parser. Tries each sequence in turn, like the original
+ * implementation did. Returns FALSE if no event could be produced. */
+static gboolean
+ref_pop_event (ChafaTermInfo *ti, gchar **input, gint *input_len, TestEvent *event_out)
+{
+    gboolean have_again = FALSE;
+    gint i;
+
+    memset (event_out, 0, sizeof (*event_out));
+
+    for (i = 0; i < CHAFA_TERM_SEQ_MAX; i++)
+    {
+        ChafaParseResult result;
+
+        /* Failed attempts may leave a count behind */
+        event_out->n_args = 0;
+
+        result = chafa_term_info_parse_seq_varargs (ti, i, input, input_len,
+                                                    event_out->args,
+                                                    &event_out->n_args);
+        if (result == CHAFA_PARSE_SUCCESS)
+        {
+            event_out->type = CHAFA_SEQ_EVENT;
+            event_out->seq = i;
+            return TRUE;
+        }
+        else if (result == CHAFA_PARSE_AGAIN)
+        {
+            have_again = TRUE;
+        }
+    }
+
+    memset (event_out, 0, sizeof (*event_out));
+
+    while (!have_again && *input_len > 0)
+    {
+        gunichar c = g_utf8_get_char_validated (*input, *input_len);
+
+        if (c == (gunichar) -1)
+        {
+            (*input)++;
+            (*input_len)--;
+        }
+        else if (c == (gunichar) -2)
+        {
+            gchar *p1 = memchr (*input, '\0', *input_len);
+            if (!p1)
+                break;
+            *input_len -= p1 - *input + 1;
+            *input = p1 + 1;
+        }
+        else
+        {
+            gchar *p1 = g_utf8_next_char (*input);
+
+            event_out->type = CHAFA_UNICHAR_EVENT;
+            event_out->c = c;
+            *input_len -= p1 - *input;
+            *input = p1;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+assert_event_equal (ChafaEvent *event, const TestEvent *ref)
+{
+    gint i;
+
+    g_assert_cmpint (chafa_event_get_type (event), ==, ref->type);
+
+    if (ref->type == CHAFA_UNICHAR_EVENT)
+    {
+        g_assert_cmpuint (chafa_event_get_unichar (event), ==, ref->c);
+    }
+    else if (ref->type == CHAFA_SEQ_EVENT)
+    {
+        g_assert_cmpint (chafa_event_get_seq (event), ==, ref->seq);
+        g_assert_cmpint (chafa_event_get_n_seq_args (event), ==, ref->n_args);
+
+        for (i = 0; i < ref->n_args; i++)
+            g_assert_cmpint (chafa_event_get_seq_arg (event, i), ==, ref->args [i]);
+    }
+}
+
+/* Parses all of data in one go and compares against the reference. Returns
+ * the number of events. */
+static gint
+compare_with_ref (ChafaTermInfo *ti, const gchar *data, gint data_len)
+{
+    ChafaParser *parser;
+    ChafaEvent *event;
+    TestEvent ref;
+    gchar *buf, *p;
+    gint len;
+    gint n_events = 0;
+
+    buf = p = g_memdup (data, data_len + 1);
+    len = data_len;
+
+    parser = chafa_parser_new (ti);
+    chafa_parser_push_data (parser, data, data_len);
+    chafa_parser_push_eof (parser);
+    event = chafa_event_new ();
+
+    while (ref_pop_event (ti, &p, &len, &ref))
+    {
+        g_assert_true (chafa_parser_pop_event_into (parser, event));
+        assert_event_equal (event, &ref);
+        n_events++;
+    }
+
+    /* The reference doesn't know about EOF */
+    g_assert_true (chafa_parser_pop_event_into (parser, event));
+    g_assert_cmpint (chafa_event_get_type (event), ==, CHAFA_EOF_EVENT);
+    g_assert_false (chafa_parser_pop_event_into (parser, event));
+
+    chafa_event_destroy (event);
+    chafa_parser_destroy (parser);
+    g_free (buf);
+    return n_events;
+}
+
+static ChafaTermInfo *
+get_xterm_term_info (void)
+{
+    const gchar *envp [] = { "TERM=xterm-256color", NULL };
+
+    return chafa_term_db_detect (chafa_term_db_get_default (), (gchar **) envp);
+}
+
+static void
+recorded_test (void)
+{
+    ChafaTermInfo *ti;
+    gint n_events;
+
+    ti = get_xterm_term_info ();
+    n_events = compare_with_ref (ti, recorded_input, sizeof (recorded_input) - 1);
+    g_assert_cmpint (n_events, >, 50);
+    chafa_term_info_unref (ti);
+}
+
+static void
+split_test (void)
+{
+    ChafaTermInfo *ti;
+    ChafaParser *parser;
+    ChafaEvent *event;
+    TestEvent ref;
+    gchar *buf, *p;
+    gint len, i;
+
+    ti = get_xterm_term_info ();
+
+    buf = p = g_strdup (recorded_input);
+    len = strlen (recorded_input);
+
+    /* Feed one byte at a time. Incomplete sequences must be held back
+     * until the rest arrives. */
+    parser = chafa_parser_new (ti);
+    event = chafa_event_new ();
+
+    for (i = 0; recorded_input [i]; i++)
+    {
+        chafa_parser_push_data (parser, &recorded_input [i], 1);
+
+        while (chafa_parser_pop_event_into (parser, event))
+        {
+            g_assert_true (ref_pop_event (ti, &p, &len, &ref));
+            assert_event_equal (event, &ref);
+        }
+    }
+
+    g_assert_cmpint (len, ==, 0);
+
+    chafa_event_destroy (event);
+    chafa_parser_destroy (parser);
+    chafa_term_info_unref (ti);
+    g_free (buf);
+}
+
+static void
+random_test (void)
+{
+    const gchar alphabet [] = "\033\033\033[[[;;;O<?0123456789ABCDFHMPQRZ~ctm\\\r\x7f\tx";
+    ChafaTermInfo *ti;
+    gchar buf [256];
+    gint i, j;
+
+    ti = get_xterm_term_info ();
+
+    for (i = 0; i < 2000; i++)
+    {
+        gint len = g_test_rand_int_range (1, sizeof (buf));
+
+        for (j = 0; j < len; j++)
+            buf [j] = alphabet [g_test_rand_int_range (0, sizeof (alphabet) - 1)];
+
+        compare_with_ref (ti, buf, len);
+    }
+
+    chafa_term_info_unref (ti);
+}
+
+static ChafaTermInfo *
+get_custom_term_info (void)
+{
+    ChafaTermInfo *ti;
+
+    ti = chafa_term_info_new ();
+    chafa_term_info_set_seq (ti, CHAFA_TERM_SEQ_CURSOR_UP_1, "up", NULL);
+    chafa_term_info_set_seq (ti, CHAFA_TERM_SEQ_CURSOR_UP, "up%1.", NULL);
+    chafa_term_info_set_seq (ti, CHAFA_TERM_SEQ_CURSOR_TO_POS, "pos%2,%1.", NULL);
+    chafa_term_info_set_seq (ti, CHAFA_TERM_SEQ_SET_DEFAULT_FG, "fg%1/%2/%3.", NULL);
+    chafa_term_info_set_seq (ti, CHAFA_TERM_SEQ_PRIMARY_DEVICE_ATTRIBUTES, "da%v.", NULL);
+
+    return ti;
+}
+
+static void
+custom_seqs_test (void)
+{
+    const gchar *inputs [] =
+    {
+        /* Shared prefixes, reordered arguments and hex arguments */
+        "upup12.up.pos3,4.pos,.fgffff/0/A0b.da1;2;3.da.",
+        /* Too many arguments */
+        "da1;2;3;4;5;6;7;8;9;10;11;12;13;14;15;16;17;18;19;20;21;22;23;24;25.",
+        /* Truncated */
+        "fg1/2",
+        NULL
+    };
+    ChafaTermInfo *ti;
+    gint i;
+
+    ti = get_custom_term_info ();
+
+    for (i = 0; inputs [i]; i++)
+        compare_with_ref (ti, inputs [i], strlen (inputs [i]));
+
+    chafa_term_info_unref (ti);
+}
+
+static void
+changed_seqs_test (void)
+{
+    ChafaTermInfo *ti;
+    ChafaParser *parser;
+    ChafaEvent *event;
+
+    ti = get_custom_term_info ();
+    parser = chafa_parser_new (ti);
+    event = chafa_event_new ();
+
+    chafa_parser_push_data (parser, "up", 2);
+    g_assert_true (chafa_parser_pop_event_into (parser, event));
+    g_assert_cmpint (chafa_event_get_seq (event), ==, CHAFA_TERM_SEQ_CURSOR_UP_1);
+
+    /* The parser must pick up changes made after it was created */
+    chafa_term_info_set_seq (ti, CHAFA_TERM_SEQ_CURSOR_UP_1, "UP", NULL);
+    chafa_parser_push_data (parser, "UP", 2);
+    g_assert_true (chafa_parser_pop_event_into (parser, event));
+    g_assert_cmpint (chafa_event_get_seq (event), ==, CHAFA_TERM_SEQ_CURSOR_UP_1);
+
+    chafa_event_destroy (event);
+    chafa_parser_destroy (parser);
+    chafa_term_info_unref (ti);
+}
+
+/* Error replies end in free-form text, which must not come through as
+ * characters, even when split across reads */
+static void
+kitty_reply_test (void)
+{
+    static const gchar input [] =
+        "\033_Gi=31;OK\033\\"
+        "\033_Gi=32;ENOENT:No image with id: 32 \033 found\033\\"
+        "x";
+    const gchar *envp [] = { "TERM=xterm-kitty", NULL };
+    gint input_len = sizeof (input) - 1;
+    ChafaTermInfo *ti;
+    gint step;
+
+    ti = chafa_term_db_detect (chafa_term_db_get_default (), (gchar **) envp);
+
+    for (step = 1; step <= input_len; step++)
+    {
+        ChafaParser *parser;
+        ChafaEvent *event;
+        gint n_events = 0;
+        gint i;
+
+        parser = chafa_parser_new (ti);
+        event = chafa_event_new ();
+
+        for (i = 0; i < input_len; i += step)
+        {
+            chafa_parser_push_data (parser, &input [i], MIN (step, input_len - i));
+
+            while (chafa_parser_pop_event_into (parser, event))
+            {
+                switch (n_events++)
+                {
+                    case 0:
+                        g_assert_cmpint (chafa_event_get_seq (event), ==, CHAFA_TERM_SEQ_KITTY_IMAGE_OK_V1);
+                        g_assert_cmpint (chafa_event_get_seq_arg (event, 0), ==, 31);
+                        break;
+                    case 1:
+                        g_assert_cmpint (chafa_event_get_seq (event), ==, CHAFA_TERM_SEQ_KITTY_IMAGE_ERROR_V1);
+                        g_assert_cmpint (chafa_event_get_seq_arg (event, 0), ==, 32);
+                        break;
+                    case 2:
+                        g_assert_cmpint (chafa_event_get_type (event), ==, CHAFA_UNICHAR_EVENT);
+                        g_assert_cmpint (chafa_event_get_unichar (event), ==, 'x');
+                        break;
+                    default:
+                        g_assert_not_reached ();
+                }
+            }
+        }
+
+        g_assert_cmpint (n_events, ==, 3);
+
+        chafa_event_destroy (event);
+        chafa_parser_destroy (parser);
+    }
+
+    chafa_term_info_unref (ti);
+}
+
+int
+main (int argc, char *argv [])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/parser/recorded", recorded_test);
+    g_test_add_func ("/parser/split", split_test);
+    g_test_add_func ("/parser/random", random_test);
+    g_test_add_func ("/parser/custom-seqs", custom_seqs_test);
+    g_test_add_func ("/parser/changed-seqs", changed_seqs_test);
+    g_test_add_func ("/parser/kitty-reply", kitty_reply_test);
+
+    return g_test_run ();
+}
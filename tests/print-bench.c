@@ -0,0 +1,116 @@
+#include "config.h"
+
+#include <chafa.h>
+#include <stdio.h>
+
+/* Measures how fast canvases are formatted for output. This isn't run as
+ * part of the test suite; invoke it manually after building with
+ * "make check". */
+
+#define CANVAS_WIDTH 240
+#define CANVAS_HEIGHT 70
+#define RUN_SECONDS 2.0
+
+static guint8 *
+generate_pixels (gint width, gint height)
+{
+    guint8 *pixels;
+    gint x, y;
+
+    pixels = g_malloc ((gsize) width * height * 4);
+
+    /* Smooth gradients with some noise, so neighboring cells tend to share
+     * colors the way they do in photos */
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            guint8 *p = pixels + ((gsize) y * width + x) * 4;
+
+            p [0] = (x * 255) / width ^ (g_test_rand_int () & 0x0f);
+            p [1] = (y * 255) / height ^ (g_test_rand_int () & 0x0f);
+            p [2] = ((x + y) * 127) / (width + height);
+            p [3] = 0xff;
+        }
+    }
+
+    return pixels;
+}
+
+static void
+run_bench (const gchar *name, ChafaCanvasMode mode, ChafaOptimizations optimizations,
+           ChafaTermInfo *term_info, const guint8 *pixels, gint width, gint height)
+{
+    ChafaCanvasConfig *config;
+    ChafaCanvas *canvas;
+    GTimer *timer, *total_timer;
+    gdouble elapsed, best = G_MAXDOUBLE;
+    gsize n_bytes = 0;
+
+    config = chafa_canvas_config_new ();
+    chafa_canvas_config_set_geometry (config, CANVAS_WIDTH, CANVAS_HEIGHT);
+    chafa_canvas_config_set_canvas_mode (config, mode);
+    chafa_canvas_config_set_optimizations (config, optimizations);
+
+    canvas = chafa_canvas_new (config);
+    chafa_canvas_draw_all_pixels (canvas, CHAFA_PIXEL_RGBA8_UNASSOCIATED,
+                                  pixels, width, height, width * 4);
+
+    timer = g_timer_new ();
+    total_timer = g_timer_new ();
+
+    /* Report the fastest frame, since that's the least disturbed by
+     * whatever else is running */
+    do
+    {
+        GString *gs;
+
+        g_timer_start (timer);
+        gs = chafa_canvas_print (canvas, term_info);
+        elapsed = g_timer_elapsed (timer, NULL);
+
+        if (elapsed < best)
+            best = elapsed;
+
+        n_bytes = gs->len;
+        g_string_free (gs, TRUE);
+    }
+    while (g_timer_elapsed (total_timer, NULL) < RUN_SECONDS);
+
+    g_print ("%-24s %8.1f MB/s %8.1f frames/s %8" G_GSIZE_FORMAT " bytes/frame\n",
+             name, n_bytes / best / 1000000.0, 1.0 / best, n_bytes);
+
+    g_timer_destroy (total_timer);
+    g_timer_destroy (timer);
+    chafa_canvas_unref (canvas);
+    chafa_canvas_config_unref (config);
+}
+
+int
+main (int argc, char *argv [])
+{
+    gchar *envp [] = { "TERM=xterm-256color", "COLORTERM=truecolor", NULL };
+    ChafaTermInfo *term_info;
+    gint width = CANVAS_WIDTH * 8, height = CANVAS_HEIGHT * 8;
+    guint8 *pixels;
+
+    g_test_init (&argc, &argv, NULL);
+
+    term_info = chafa_term_db_detect (chafa_term_db_get_default (), envp);
+    pixels = generate_pixels (width, height);
+
+    run_bench ("truecolor", CHAFA_CANVAS_MODE_TRUECOLOR,
+               CHAFA_OPTIMIZATION_REUSE_ATTRIBUTES, term_info, pixels, width, height);
+    run_bench ("truecolor, no reuse", CHAFA_CANVAS_MODE_TRUECOLOR,
+               CHAFA_OPTIMIZATION_NONE, term_info, pixels, width, height);
+    run_bench ("256", CHAFA_CANVAS_MODE_INDEXED_256,
+               CHAFA_OPTIMIZATION_REUSE_ATTRIBUTES, term_info, pixels, width, height);
+    run_bench ("256, no reuse", CHAFA_CANVAS_MODE_INDEXED_256,
+               CHAFA_OPTIMIZATION_NONE, term_info, pixels, width, height);
+    run_bench ("16", CHAFA_CANVAS_MODE_INDEXED_16,
+               CHAFA_OPTIMIZATION_REUSE_ATTRIBUTES, term_info, pixels, width, height);
+
+    g_free (pixels);
+    chafa_term_info_unref (term_info);
+    return 0;
+}
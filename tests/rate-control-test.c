@@ -0,0 +1,224 @@
+#include "config.h"
+
+#include <chafa.h>
+#include "chicle-rate-control.h"
+
+#define FRAME_BYTES 1000
+
+/* Steps up one level per frame over budget. The frame after a level change
+ * isn't counted, so each step takes two. */
+static ChicleRateControl *
+rate_control_new_at_level (gint level, gboolean have_fill_symbols)
+{
+    ChicleRateControl *rate_control;
+    gint i;
+
+    rate_control = chicle_rate_control_new (0.0, FRAME_BYTES, have_fill_symbols);
+
+    for (i = 0; i < level; i++)
+    {
+        g_assert_true (chicle_rate_control_update (rate_control, FRAME_BYTES * 2, 0.1));
+        g_assert_false (chicle_rate_control_update (rate_control, FRAME_BYTES * 2, 0.1));
+    }
+
+    return rate_control;
+}
+
+static ChafaCanvasConfig *
+config_new (ChafaPixelMode pixel_mode, ChafaCanvasMode canvas_mode,
+            ChafaOptimizations optimizations)
+{
+    ChafaCanvasConfig *config;
+
+    config = chafa_canvas_config_new ();
+    chafa_canvas_config_set_pixel_mode (config, pixel_mode);
+    chafa_canvas_config_set_canvas_mode (config, canvas_mode);
+    chafa_canvas_config_set_optimizations (config, optimizations);
+    return config;
+}
+
+static ChafaCanvasMode
+canvas_mode_at_level (ChafaPixelMode pixel_mode, ChafaCanvasMode canvas_mode,
+                      gboolean have_fill_symbols, gint level)
+{
+    ChicleRateControl *rate_control;
+    ChafaCanvasConfig *config;
+
+    rate_control = rate_control_new_at_level (level, have_fill_symbols);
+    config = config_new (pixel_mode, canvas_mode, CHAFA_OPTIMIZATION_ALL);
+
+    chicle_rate_control_apply (rate_control, config);
+    canvas_mode = chafa_canvas_config_get_canvas_mode (config);
+
+    chafa_canvas_config_unref (config);
+    chicle_rate_control_destroy (rate_control);
+    return canvas_mode;
+}
+
+/* Returns the number of levels it's possible to step up with the given
+ * settings */
+static gint
+get_n_levels (ChafaPixelMode pixel_mode, ChafaCanvasMode canvas_mode,
+              ChafaOptimizations optimizations, gboolean have_fill_symbols)
+{
+    ChicleRateControl *rate_control;
+    ChafaCanvasConfig *config;
+    gint n_levels = 0;
+
+    rate_control = chicle_rate_control_new (0.0, FRAME_BYTES, have_fill_symbols);
+    config = config_new (pixel_mode, canvas_mode, optimizations);
+    chicle_rate_control_apply (rate_control, config);
+
+    while (chicle_rate_control_update (rate_control, FRAME_BYTES * 2, 0.1))
+    {
+        g_assert_false (chicle_rate_control_update (rate_control, FRAME_BYTES * 2, 0.1));
+        n_levels++;
+    }
+
+    chafa_canvas_config_unref (config);
+    chicle_rate_control_destroy (rate_control);
+    return n_levels;
+}
+
+static void
+symbols_test (void)
+{
+    static const ChafaCanvasMode expected_fill [] =
+    {
+        CHAFA_CANVAS_MODE_TRUECOLOR,
+        CHAFA_CANVAS_MODE_INDEXED_256,
+        CHAFA_CANVAS_MODE_INDEXED_256,  /* Fill symbols go instead */
+        CHAFA_CANVAS_MODE_INDEXED_16,
+        CHAFA_CANVAS_MODE_INDEXED_16_8
+    };
+    static const ChafaCanvasMode expected_no_fill [] =
+    {
+        CHAFA_CANVAS_MODE_TRUECOLOR,
+        CHAFA_CANVAS_MODE_INDEXED_256,
+        CHAFA_CANVAS_MODE_INDEXED_16,
+        CHAFA_CANVAS_MODE_INDEXED_16_8
+    };
+    gint level;
+
+    for (level = 0; level < (gint) G_N_ELEMENTS (expected_fill); level++)
+    {
+        g_assert_cmpint (canvas_mode_at_level (CHAFA_PIXEL_MODE_SYMBOLS,
+                                               CHAFA_CANVAS_MODE_TRUECOLOR, TRUE, level),
+                         ==, expected_fill [level]);
+    }
+
+    for (level = 0; level < (gint) G_N_ELEMENTS (expected_no_fill); level++)
+    {
+        g_assert_cmpint (canvas_mode_at_level (CHAFA_PIXEL_MODE_SYMBOLS,
+                                               CHAFA_CANVAS_MODE_TRUECOLOR, FALSE, level),
+                         ==, expected_no_fill [level]);
+    }
+}
+
+/* Every step must shrink the sixel palette; a fixed 256-color one is no
+ * smaller than the dynamic one we start out with */
+static void
+sixels_test (void)
+{
+    static const ChafaCanvasMode expected [] =
+    {
+        CHAFA_CANVAS_MODE_TRUECOLOR,
+        CHAFA_CANVAS_MODE_INDEXED_16,
+        CHAFA_CANVAS_MODE_INDEXED_8
+    };
+    gint level;
+
+    for (level = 0; level < (gint) G_N_ELEMENTS (expected); level++)
+    {
+        g_assert_cmpint (canvas_mode_at_level (CHAFA_PIXEL_MODE_SIXELS,
+                                               CHAFA_CANVAS_MODE_TRUECOLOR, TRUE, level),
+                         ==, expected [level]);
+    }
+
+    g_assert_cmpint (canvas_mode_at_level (CHAFA_PIXEL_MODE_SIXELS,
+                                           CHAFA_CANVAS_MODE_INDEXED_256, TRUE, 1),
+                     ==, CHAFA_CANVAS_MODE_INDEXED_16);
+}
+
+/* Levels that wouldn't change the output are skipped, and there's no
+ * stepping up past the last useful one */
+static void
+levels_test (void)
+{
+    g_assert_cmpint (get_n_levels (CHAFA_PIXEL_MODE_SYMBOLS, CHAFA_CANVAS_MODE_TRUECOLOR,
+                                   CHAFA_OPTIMIZATION_ALL, TRUE), ==, 4);
+    g_assert_cmpint (get_n_levels (CHAFA_PIXEL_MODE_SYMBOLS, CHAFA_CANVAS_MODE_TRUECOLOR,
+                                   CHAFA_OPTIMIZATION_ALL, FALSE), ==, 3);
+    g_assert_cmpint (get_n_levels (CHAFA_PIXEL_MODE_SYMBOLS, CHAFA_CANVAS_MODE_TRUECOLOR,
+                                   CHAFA_OPTIMIZATION_NONE, FALSE), ==, 4);
+    g_assert_cmpint (get_n_levels (CHAFA_PIXEL_MODE_SYMBOLS, CHAFA_CANVAS_MODE_INDEXED_8,
+                                   CHAFA_OPTIMIZATION_ALL, FALSE), ==, 0);
+    g_assert_cmpint (get_n_levels (CHAFA_PIXEL_MODE_SIXELS, CHAFA_CANVAS_MODE_TRUECOLOR,
+                                   CHAFA_OPTIMIZATION_ALL, TRUE), ==, 2);
+    g_assert_cmpint (get_n_levels (CHAFA_PIXEL_MODE_SIXELS, CHAFA_CANVAS_MODE_TRUECOLOR,
+                                   CHAFA_OPTIMIZATION_NONE, TRUE), ==, 3);
+    g_assert_cmpint (get_n_levels (CHAFA_PIXEL_MODE_SIXELS, CHAFA_CANVAS_MODE_INDEXED_8,
+                                   CHAFA_OPTIMIZATION_ALL, TRUE), ==, 0);
+    g_assert_cmpint (get_n_levels (CHAFA_PIXEL_MODE_KITTY, CHAFA_CANVAS_MODE_TRUECOLOR,
+                                   CHAFA_OPTIMIZATION_ALL, TRUE), ==, 4);
+}
+
+/* Kitty keeps its colors, but gets more compression */
+static void
+kitty_test (void)
+{
+    ChicleRateControl *rate_control;
+    ChafaCanvasConfig *config;
+    gint level, prev_compression = 0;
+
+    for (level = 1; level <= 4; level++)
+    {
+        gint compression;
+
+        rate_control = rate_control_new_at_level (level, TRUE);
+        config = chafa_canvas_config_new ();
+        chafa_canvas_config_set_pixel_mode (config, CHAFA_PIXEL_MODE_KITTY);
+
+        chicle_rate_control_apply (rate_control, config);
+
+        g_assert_cmpint (chafa_canvas_config_get_canvas_mode (config),
+                         ==, CHAFA_CANVAS_MODE_TRUECOLOR);
+        compression = chafa_canvas_config_get_compression_level (config);
+        g_assert_cmpint (compression, >, prev_compression);
+        prev_compression = compression;
+
+        chafa_canvas_config_unref (config);
+        chicle_rate_control_destroy (rate_control);
+    }
+}
+
+/* Frames well under budget bring the level back down, but only after a
+ * while, so it doesn't oscillate */
+static void
+recovery_test (void)
+{
+    ChicleRateControl *rate_control;
+    gint i;
+
+    rate_control = rate_control_new_at_level (1, TRUE);
+
+    for (i = 0; i < 7; i++)
+        g_assert_false (chicle_rate_control_update (rate_control, FRAME_BYTES / 4, 0.1));
+    g_assert_true (chicle_rate_control_update (rate_control, FRAME_BYTES / 4, 0.1));
+
+    chicle_rate_control_destroy (rate_control);
+}
+
+int
+main (int argc, char *argv [])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/rate-control/symbols", symbols_test);
+    g_test_add_func ("/rate-control/sixels", sixels_test);
+    g_test_add_func ("/rate-control/levels", levels_test);
+    g_test_add_func ("/rate-control/kitty", kitty_test);
+    g_test_add_func ("/rate-control/recovery", recovery_test);
+
+    return g_test_run ();
+}
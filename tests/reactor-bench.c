@@ -0,0 +1,178 @@
+#include "config.h"
+
+#include <chafa.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+/* Echoes short messages through many loopback ptys at once, with and
+ * without a shared reactor, and reports throughput and thread count. This
+ * isn't run as part of the test suite; invoke it manually after building
+ * with "make check". The optional argument is the number of ptys. */
+
+#define N_PTYS_DEFAULT 1000
+#define N_ROUNDS 20
+#define MESSAGE "The quick brown fox jumps over the lazy dog\n"
+
+typedef struct
+{
+    gint master_fd;
+    gint slave_fd;
+    ChafaStreamReader *reader;
+    ChafaStreamWriter *writer;
+}
+Pty;
+
+static gboolean
+open_pty (Pty *pty)
+{
+    struct termios t;
+    gchar *name;
+
+    pty->master_fd = posix_openpt (O_RDWR | O_NOCTTY);
+    if (pty->master_fd < 0)
+        return FALSE;
+
+    if (grantpt (pty->master_fd) < 0 || unlockpt (pty->master_fd) < 0
+        || !(name = ptsname (pty->master_fd)))
+    {
+        close (pty->master_fd);
+        return FALSE;
+    }
+
+    pty->slave_fd = open (name, O_RDWR | O_NOCTTY);
+    if (pty->slave_fd < 0)
+    {
+        close (pty->master_fd);
+        return FALSE;
+    }
+
+    /* No echo or line discipline; bytes go straight through */
+    tcgetattr (pty->slave_fd, &t);
+    cfmakeraw (&t);
+    tcsetattr (pty->slave_fd, TCSANOW, &t);
+
+    return TRUE;
+}
+
+static gint
+get_n_threads (void)
+{
+    gchar *status = NULL, *p;
+    gint n = -1;
+
+    if (g_file_get_contents ("/proc/self/status", &status, NULL, NULL)
+        && (p = strstr (status, "\nThreads:")))
+        n = atoi (p + strlen ("\nThreads:"));
+
+    g_free (status);
+    return n;
+}
+
+static void
+run_bench (Pty *ptys, gint n_ptys, ChafaReactor *reactor)
+{
+    const gint msg_len = strlen (MESSAGE);
+    GTimer *timer;
+    gchar buf [256];
+    gint64 total_bytes = 0;
+    gint n_threads;
+    gint i, j;
+
+    for (i = 0; i < n_ptys; i++)
+    {
+        ptys [i].reader = chafa_stream_reader_new_from_fd (ptys [i].master_fd);
+        ptys [i].writer = chafa_stream_writer_new_from_fd (ptys [i].slave_fd);
+
+        if (reactor)
+        {
+            chafa_stream_reader_set_reactor (ptys [i].reader, reactor);
+            chafa_stream_writer_set_reactor (ptys [i].writer, reactor);
+        }
+    }
+
+    timer = g_timer_new ();
+
+    for (j = 0; j < N_ROUNDS; j++)
+    {
+        for (i = 0; i < n_ptys; i++)
+            chafa_stream_writer_write (ptys [i].writer, MESSAGE, msg_len);
+
+        for (i = 0; i < n_ptys; i++)
+        {
+            gint got = 0;
+
+            while (got < msg_len)
+            {
+                gint n = chafa_stream_reader_read (ptys [i].reader, buf, msg_len - got);
+
+                if (n > 0)
+                    got += n;
+                else
+                    chafa_stream_reader_wait (ptys [i].reader, 100);
+            }
+
+            total_bytes += got;
+        }
+    }
+
+    /* Every stream has been started by now */
+    n_threads = get_n_threads ();
+
+    g_print ("%-12s %6d ptys %6d threads %8.1f ms %8.2f MB/s\n",
+             reactor ? "reactor" : "threads",
+             n_ptys, n_threads,
+             g_timer_elapsed (timer, NULL) * 1000.0,
+             total_bytes / g_timer_elapsed (timer, NULL) / 1000000.0);
+
+    for (i = 0; i < n_ptys; i++)
+    {
+        chafa_stream_writer_flush (ptys [i].writer);
+        chafa_stream_writer_unref (ptys [i].writer);
+        chafa_stream_reader_unref (ptys [i].reader);
+    }
+
+    g_timer_destroy (timer);
+}
+
+int
+main (int argc, char *argv [])
+{
+    ChafaReactor *reactor;
+    Pty *ptys;
+    gint n_ptys = N_PTYS_DEFAULT;
+    gint i;
+
+    if (argc > 1)
+        n_ptys = atoi (argv [1]);
+
+    ptys = g_new0 (Pty, n_ptys);
+
+    for (i = 0; i < n_ptys; i++)
+    {
+        if (!open_pty (&ptys [i]))
+        {
+            g_printerr ("Could only open %d ptys.\n", i);
+            n_ptys = i;
+            break;
+        }
+    }
+
+    run_bench (ptys, n_ptys, NULL);
+
+    reactor = chafa_reactor_new (2);
+    run_bench (ptys, n_ptys, reactor);
+    chafa_reactor_unref (reactor);
+
+    for (i = 0; i < n_ptys; i++)
+    {
+        close (ptys [i].slave_fd);
+        close (ptys [i].master_fd);
+    }
+
+    g_free (ptys);
+    return 0;
+}
@@ -0,0 +1,295 @@
+#include "config.h"
+
+#include <chafa.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <glib/gstdio.h>
+
+#define N_PIPES 64
+#define PAYLOAD_LEN (256 * 1024)
+
+static void
+fill_payload (guint8 *payload, gint len, gint seed)
+{
+    gint i;
+
+    for (i = 0; i < len; i++)
+        payload [i] = (i * 31 + seed) ^ (i >> 8);
+}
+
+/* Reads until EOF or until len bytes have arrived, whichever comes first.
+ * Returns the number of bytes read. */
+static gint
+read_all (ChafaStreamReader *reader, guint8 *out, gint len)
+{
+    gint ofs = 0;
+
+    while (ofs < len)
+    {
+        gint n = chafa_stream_reader_read (reader, out + ofs, len - ofs);
+
+        if (n > 0)
+        {
+            ofs += n;
+            continue;
+        }
+
+        if (chafa_stream_reader_is_eof (reader))
+            break;
+
+        chafa_stream_reader_wait (reader, 100);
+    }
+
+    return ofs;
+}
+
+static void
+pipes_test (void)
+{
+    ChafaReactor *reactor;
+    ChafaStreamReader *readers [N_PIPES];
+    ChafaStreamWriter *writers [N_PIPES];
+    gint fds [N_PIPES] [2];
+    guint8 *payload, *result;
+    gint i;
+
+    reactor = chafa_reactor_new (2);
+    g_assert_cmpint (chafa_reactor_get_n_threads (reactor), >=, 1);
+
+    payload = g_malloc (PAYLOAD_LEN);
+    result = g_malloc (PAYLOAD_LEN + 1);
+
+    for (i = 0; i < N_PIPES; i++)
+    {
+        g_assert_cmpint (pipe (fds [i]), ==, 0);
+
+        readers [i] = chafa_stream_reader_new_from_fd (fds [i] [0]);
+        chafa_stream_reader_set_reactor (readers [i], reactor);
+        writers [i] = chafa_stream_writer_new_from_fd (fds [i] [1]);
+        chafa_stream_writer_set_reactor (writers [i], reactor);
+    }
+
+    /* Queue up far more data than the pipes and the reader buffers will
+     * hold, so both sides have to apply backpressure */
+    for (i = 0; i < N_PIPES; i++)
+    {
+        fill_payload (payload, PAYLOAD_LEN, i);
+        chafa_stream_writer_write (writers [i], payload, PAYLOAD_LEN);
+    }
+
+    for (i = 0; i < N_PIPES; i++)
+    {
+        fill_payload (payload, PAYLOAD_LEN, i);
+        g_assert_cmpint (read_all (readers [i], result, PAYLOAD_LEN), ==, PAYLOAD_LEN);
+        g_assert_true (memcmp (payload, result, PAYLOAD_LEN) == 0);
+
+        /* Keep every other pipe open, so we get to tear down readers
+         * that are still waiting for input */
+        if (i % 2 == 0)
+        {
+            chafa_stream_writer_flush (writers [i]);
+            chafa_stream_writer_unref (writers [i]);
+            close (fds [i] [1]);
+
+            g_assert_cmpint (read_all (readers [i], result, 1), ==, 0);
+            g_assert_true (chafa_stream_reader_is_eof (readers [i]));
+        }
+    }
+
+    for (i = 0; i < N_PIPES; i++)
+    {
+        chafa_stream_reader_unref (readers [i]);
+        close (fds [i] [0]);
+
+        if (i % 2 != 0)
+        {
+            chafa_stream_writer_unref (writers [i]);
+            close (fds [i] [1]);
+        }
+    }
+
+    chafa_reactor_unref (reactor);
+    g_free (payload);
+    g_free (result);
+}
+
+/* Each socket gets both a reader and a writer, so the reactor has to
+ * watch the same fd twice */
+static void
+shared_fd_test (void)
+{
+    ChafaReactor *reactor;
+    ChafaStreamReader *readers [2];
+    ChafaStreamWriter *writers [2];
+    guint8 *payload, *result;
+    gint fds [2];
+    gint i;
+
+    g_assert_cmpint (socketpair (AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+
+    reactor = chafa_reactor_new (1);
+    payload = g_malloc (PAYLOAD_LEN);
+    result = g_malloc (PAYLOAD_LEN);
+
+    for (i = 0; i < 2; i++)
+    {
+        readers [i] = chafa_stream_reader_new_from_fd (fds [i]);
+        chafa_stream_reader_set_reactor (readers [i], reactor);
+        writers [i] = chafa_stream_writer_new_from_fd (fds [i]);
+        chafa_stream_writer_set_reactor (writers [i], reactor);
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        fill_payload (payload, PAYLOAD_LEN, i);
+        chafa_stream_writer_write (writers [i], payload, PAYLOAD_LEN);
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        fill_payload (payload, PAYLOAD_LEN, 1 - i);
+        g_assert_cmpint (read_all (readers [i], result, PAYLOAD_LEN), ==, PAYLOAD_LEN);
+        g_assert_true (memcmp (payload, result, PAYLOAD_LEN) == 0);
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        chafa_stream_writer_flush (writers [i]);
+        chafa_stream_writer_unref (writers [i]);
+        chafa_stream_reader_unref (readers [i]);
+        close (fds [i]);
+    }
+
+    chafa_reactor_unref (reactor);
+    g_free (payload);
+    g_free (result);
+}
+
+/* Regular files can't be polled with epoll. The reader must fall back to
+ * a thread of its own. */
+static void
+file_fallback_test (void)
+{
+    ChafaReactor *reactor;
+    ChafaStreamReader *reader;
+    guint8 *payload, *result;
+    gchar *path;
+    gint fd;
+
+    payload = g_malloc (PAYLOAD_LEN);
+    result = g_malloc (PAYLOAD_LEN + 1);
+    fill_payload (payload, PAYLOAD_LEN, 0);
+
+    fd = g_file_open_tmp ("chafa-reactor-test-XXXXXX", &path, NULL);
+    g_assert_cmpint (fd, >=, 0);
+    g_assert_cmpint (write (fd, payload, PAYLOAD_LEN), ==, PAYLOAD_LEN);
+    g_assert_cmpint (lseek (fd, 0, SEEK_SET), ==, 0);
+
+    reactor = chafa_reactor_new (1);
+    reader = chafa_stream_reader_new_from_fd (fd);
+    chafa_stream_reader_set_reactor (reader, reactor);
+
+    g_assert_cmpint (read_all (reader, result, PAYLOAD_LEN + 1), ==, PAYLOAD_LEN);
+    g_assert_true (memcmp (payload, result, PAYLOAD_LEN) == 0);
+    g_assert_true (chafa_stream_reader_is_eof (reader));
+
+    chafa_stream_reader_unref (reader);
+    chafa_reactor_unref (reactor);
+
+    close (fd);
+    g_unlink (path);
+    g_free (path);
+    g_free (payload);
+    g_free (result);
+}
+
+/* Vectored writes must come out in order with the queued ones around them,
+ * and report failure when the other end is gone */
+static void
+writev_test_reactor (ChafaReactor *reactor)
+{
+    ChafaStreamReader *reader;
+    ChafaStreamWriter *writer;
+    ChafaOutputVector vecs [300];
+    guint8 *payload, *result;
+    gint fds [2];
+    gint i, ofs;
+
+    payload = g_malloc (PAYLOAD_LEN);
+    result = g_malloc (PAYLOAD_LEN + 1);
+    fill_payload (payload, PAYLOAD_LEN, 7);
+
+    g_assert_cmpint (pipe (fds), ==, 0);
+
+    reader = chafa_stream_reader_new_from_fd (fds [0]);
+    writer = chafa_stream_writer_new_from_fd (fds [1]);
+    if (reactor)
+    {
+        chafa_stream_reader_set_reactor (reader, reactor);
+        chafa_stream_writer_set_reactor (writer, reactor);
+    }
+
+    /* More vectors than a single writev () takes, of varying lengths. The
+     * reader isn't draining the pipe yet, so it must hold all of them. */
+    chafa_stream_writer_write (writer, payload, 1000);
+
+    for (i = 0, ofs = 1000; i < (gint) G_N_ELEMENTS (vecs); i++)
+    {
+        gint len = (i % 5 == 0) ? 0 : (i * 37) % 150;
+
+        vecs [i].data = payload + ofs;
+        vecs [i].len = len;
+        ofs += len;
+    }
+
+    g_assert_cmpint (ofs, <, 32768);
+
+    g_assert_true (chafa_stream_writer_writev (writer, vecs, G_N_ELEMENTS (vecs)));
+    chafa_stream_writer_write (writer, payload + ofs, PAYLOAD_LEN - ofs);
+
+    g_assert_cmpint (read_all (reader, result, PAYLOAD_LEN), ==, PAYLOAD_LEN);
+    g_assert_true (memcmp (payload, result, PAYLOAD_LEN) == 0);
+    g_assert_true (chafa_stream_writer_flush (writer));
+
+    /* Closing the read end makes the write fail with EPIPE */
+    chafa_stream_reader_unref (reader);
+    close (fds [0]);
+
+    vecs [0].data = payload;
+    vecs [0].len = PAYLOAD_LEN;
+    g_assert_false (chafa_stream_writer_writev (writer, vecs, 1));
+
+    chafa_stream_writer_unref (writer);
+    close (fds [1]);
+    g_free (payload);
+    g_free (result);
+}
+
+static void
+writev_test (void)
+{
+    ChafaReactor *reactor;
+
+    signal (SIGPIPE, SIG_IGN);
+
+    writev_test_reactor (NULL);
+
+    reactor = chafa_reactor_new (1);
+    writev_test_reactor (reactor);
+    chafa_reactor_unref (reactor);
+}
+
+int
+main (int argc, char *argv [])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/reactor/pipes", pipes_test);
+    g_test_add_func ("/reactor/shared-fd", shared_fd_test);
+    g_test_add_func ("/reactor/file-fallback", file_fallback_test);
+    g_test_add_func ("/reactor/writev", writev_test);
+
+    return g_test_run ();
+}
@@ -0,0 +1,349 @@
+#include "config.h"
+
+#include <string.h>
+#include <chafa.h>
+#include "internal/chafa-private.h"
+
+#define N_RANDOM_IMAGES 20
+
+/* Minimal sixel decoder. Draws the first sixel image in str onto the
+ * width x height RGB buffer in rgb_inout. Pixels that aren't drawn keep their
+ * previous contents, like on a terminal with the transparent background
+ * attribute set. Colors are kept in sixel percentages. */
+static void
+decode_sixels (const gchar *str, gsize len, guint32 *rgb_inout,
+               gint width, gint height)
+{
+    const gchar *p = str, *end = str + len;
+    guint32 palette [256] = { 0 };
+    guint32 pen_rgb = 0;
+    gint x = 0, y = 0;
+
+    /* Skip to the start of the sixel data */
+    while (p < end && *p != 'q')
+        p++;
+    g_assert_true (p < end);
+    p++;
+
+    while (p < end)
+    {
+        gint reps = 1;
+        gint i;
+
+        if (*p == '\033')
+            break;
+
+        if (*p == '"')
+        {
+            /* Raster attributes */
+            for (p++; p < end && (g_ascii_isdigit (*p) || *p == ';'); p++)
+                ;
+            continue;
+        }
+
+        if (*p == '#')
+        {
+            gint64 args [5];
+            gint n_args = 0;
+
+            for (p++; p < end && n_args < 5; )
+            {
+                gchar *q;
+
+                args [n_args++] = g_ascii_strtoll (p, &q, 10);
+                p = q;
+                if (*p != ';')
+                    break;
+                p++;
+            }
+
+            g_assert_cmpint (args [0], >=, 0);
+            g_assert_cmpint (args [0], <, 256);
+
+            if (n_args == 5)
+            {
+                g_assert_cmpint (args [1], ==, 2);
+                palette [args [0]] = (args [2] << 16) | (args [3] << 8) | args [4];
+            }
+            else
+            {
+                g_assert_cmpint (n_args, ==, 1);
+                pen_rgb = palette [args [0]];
+            }
+
+            continue;
+        }
+
+        if (*p == '$')
+        {
+            x = 0;
+            p++;
+            continue;
+        }
+
+        if (*p == '-')
+        {
+            x = 0;
+            y += 6;
+            p++;
+            continue;
+        }
+
+        if (*p == '!')
+        {
+            gchar *q;
+
+            reps = g_ascii_strtoll (p + 1, &q, 10);
+            p = q;
+        }
+
+        g_assert_true (*p >= '?' && *p <= '~');
+
+        for ( ; reps > 0; reps--, x++)
+        {
+            for (i = 0; i < 6; i++)
+            {
+                if (!((*p - '?') & (1 << i)))
+                    continue;
+
+                g_assert_cmpint (x, <, width);
+                if (y + i < height)
+                    rgb_inout [(y + i) * width + x] = pen_rgb;
+            }
+        }
+
+        p++;
+    }
+}
+
+static guint8 *
+random_image (gint width, gint height, gint n_colors, gboolean with_alpha)
+{
+    guint32 *colors;
+    guint8 *pixels;
+    gint i;
+
+    /* Draw from a small set of colors so the indexed image ends up with
+     * long runs as well as short ones */
+    colors = g_new (guint32, n_colors);
+    for (i = 0; i < n_colors; i++)
+        colors [i] = g_test_rand_int ();
+
+    pixels = g_malloc ((gsize) width * height * 4);
+
+    for (i = 0; i < width * height; i++)
+    {
+        guint32 c;
+
+        if (i > 0 && g_test_rand_int_range (0, 4) != 0)
+            c = ((guint32 *) pixels) [i - 1];
+        else
+            c = colors [g_test_rand_int_range (0, n_colors)];
+
+        ((guint32 *) pixels) [i] = c;
+        pixels [i * 4 + 3] = (with_alpha && (c & 7) == 0) ? 0x00 : 0xff;
+    }
+
+    g_free (colors);
+    return pixels;
+}
+
+static ChafaCanvas *
+sixel_canvas_new (gint width, gint height)
+{
+    ChafaCanvasConfig *config;
+    ChafaCanvas *canvas;
+
+    config = chafa_canvas_config_new ();
+    chafa_canvas_config_set_pixel_mode (config, CHAFA_PIXEL_MODE_SIXELS);
+    /* One pixel per cell, so the sixel image gets the exact size asked for */
+    chafa_canvas_config_set_cell_geometry (config, 1, 1);
+    chafa_canvas_config_set_geometry (config, width, height);
+
+    canvas = chafa_canvas_new (config);
+    chafa_canvas_config_unref (config);
+
+    return canvas;
+}
+
+static ChafaTermInfo *
+sixel_term_info_new (void)
+{
+    ChafaTermDb *term_db;
+    ChafaTermInfo *term_info;
+    gchar *envp [] = { "TERMINAL_NAME=contour", NULL };
+
+    term_db = chafa_term_db_get_default ();
+    term_info = chafa_term_db_detect (term_db, envp);
+    g_assert_true (chafa_term_info_have_seq (term_info, CHAFA_TERM_SEQ_BEGIN_SIXELS));
+
+    return term_info;
+}
+
+static void
+avx2_identity_test (void)
+{
+    ChafaTermInfo *term_info;
+    gint i;
+
+    if (!(chafa_get_supported_features () & CHAFA_FEATURE_AVX2))
+    {
+        g_test_skip ("AVX2 not supported");
+        return;
+    }
+
+    term_info = sixel_term_info_new ();
+
+    for (i = 0; i < N_RANDOM_IMAGES; i++)
+    {
+        /* Cover widths that aren't a multiple of the vector size and
+         * heights that end in a partial band */
+        gint width = g_test_rand_int_range (1, 300);
+        gint height = g_test_rand_int_range (1, 100);
+        gint n_colors = g_test_rand_int_range (1, 300);
+        gboolean with_alpha = g_test_rand_bit ();
+        ChafaCanvas *canvas;
+        GString *scalar_gs, *avx2_gs;
+        guint8 *pixels;
+
+        pixels = random_image (width, height, n_colors, with_alpha);
+        canvas = sixel_canvas_new (width, height);
+        chafa_canvas_draw_all_pixels (canvas,
+                                      CHAFA_PIXEL_RGBA8_UNASSOCIATED,
+                                      pixels,
+                                      width, height, width * 4);
+
+        chafa_restrict_features (0);
+        scalar_gs = chafa_canvas_print (canvas, term_info);
+        chafa_restrict_features (CHAFA_FEATURE_AVX2 | CHAFA_FEATURE_SSE41
+                                 | CHAFA_FEATURE_POPCNT | CHAFA_FEATURE_MMX);
+        avx2_gs = chafa_canvas_print (canvas, term_info);
+
+        g_assert_cmpuint (avx2_gs->len, ==, scalar_gs->len);
+        g_assert_cmpstr (avx2_gs->str, ==, scalar_gs->str);
+
+        g_string_free (avx2_gs, TRUE);
+        g_string_free (scalar_gs, TRUE);
+        chafa_canvas_unref (canvas);
+        g_free (pixels);
+    }
+
+    chafa_term_info_unref (term_info);
+}
+
+static void
+print_and_decode (ChafaCanvas *canvas, ChafaCanvas *prev_canvas,
+                  ChafaTermInfo *term_info, guint32 *rgb_inout,
+                  gint width, gint height)
+{
+    GString *gs;
+
+    gs = chafa_canvas_print_delta (canvas, prev_canvas, term_info);
+    decode_sixels (gs->str, gs->len, rgb_inout, width, height);
+    g_string_free (gs, TRUE);
+}
+
+/* Applies random changes in horizontal and vertical spans, so some bands
+ * end up untouched and others only change in part */
+static void
+mutate_image (guint8 *pixels, gint width, gint height)
+{
+    gint n_changes = g_test_rand_int_range (0, 6);
+    gint i;
+
+    for (i = 0; i < n_changes; i++)
+    {
+        gint x0 = g_test_rand_int_range (0, width);
+        gint y0 = g_test_rand_int_range (0, height);
+        gint x1 = g_test_rand_int_range (x0, width) + 1;
+        gint y1 = g_test_rand_int_range (y0, MIN (y0 + 8, height)) + 1;
+        guint32 c = g_test_rand_int () | 0xff000000;
+        gint x, y;
+
+        for (y = y0; y < y1; y++)
+            for (x = x0; x < x1; x++)
+                memcpy (pixels + (y * width + x) * 4, &c, 4);
+    }
+}
+
+static void
+delta_decode_test_features (ChafaFeatures features)
+{
+    ChafaTermInfo *term_info;
+    gint i;
+
+    term_info = sixel_term_info_new ();
+    chafa_restrict_features (features);
+
+    for (i = 0; i < N_RANDOM_IMAGES; i++)
+    {
+        gint width = g_test_rand_int_range (1, 300);
+        gint height = g_test_rand_int_range (1, 100);
+        gint n_colors = g_test_rand_int_range (1, 300);
+        ChafaCanvas *canvas, *prev_canvas;
+        guint32 *full_rgb, *delta_rgb;
+        guint8 *pixels;
+        gint j;
+
+        /* Opaque images only; transparent pixels let the previous frame
+         * show through in delta mode, but not in a full print */
+        pixels = random_image (width, height, n_colors, FALSE);
+        full_rgb = g_new0 (guint32, width * height);
+        delta_rgb = g_new0 (guint32, width * height);
+
+        prev_canvas = sixel_canvas_new (width, height);
+        chafa_canvas_draw_all_pixels (prev_canvas,
+                                      CHAFA_PIXEL_RGBA8_UNASSOCIATED,
+                                      pixels,
+                                      width, height, width * 4);
+        print_and_decode (prev_canvas, NULL, term_info, delta_rgb, width, height);
+
+        /* Several frames in a row, so errors would accumulate */
+        for (j = 0; j < 4; j++)
+        {
+            mutate_image (pixels, width, height);
+
+            canvas = sixel_canvas_new (width, height);
+            chafa_canvas_draw_all_pixels (canvas,
+                                          CHAFA_PIXEL_RGBA8_UNASSOCIATED,
+                                          pixels,
+                                          width, height, width * 4);
+
+            print_and_decode (canvas, prev_canvas, term_info, delta_rgb, width, height);
+            memset (full_rgb, 0, width * height * sizeof (guint32));
+            print_and_decode (canvas, NULL, term_info, full_rgb, width, height);
+
+            g_assert_cmpmem (delta_rgb, width * height * sizeof (guint32),
+                             full_rgb, width * height * sizeof (guint32));
+
+            chafa_canvas_unref (prev_canvas);
+            prev_canvas = canvas;
+        }
+
+        chafa_canvas_unref (prev_canvas);
+        g_free (delta_rgb);
+        g_free (full_rgb);
+        g_free (pixels);
+    }
+
+    chafa_restrict_features (~0);
+    chafa_term_info_unref (term_info);
+}
+
+static void
+delta_decode_test (void)
+{
+    delta_decode_test_features (0);
+    delta_decode_test_features (~0);
+}
+
+int
+main (int argc, char *argv [])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/sixel/avx2-identity", avx2_identity_test);
+    g_test_add_func ("/sixel/delta-decode", delta_decode_test);
+
+    return g_test_run ();
+}
@@ -0,0 +1,212 @@
+#include "config.h"
+
+#include <chafa.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <glib/gstdio.h>
+
+#define PROBE_TIMEOUT_MS 5000
+
+/* Replies in the order a real terminal would send them */
+static const gchar probe_replies [] =
+    "\033]10;rgb:ffff/8080/0000\033\\"
+    "\033]11;rgb:0000/0000/2020\033\\"
+    "\033[?62;4;22c";
+
+typedef struct
+{
+    gint master_fd;
+    gint slave_fd;
+    GThread *thread;
+    gint n_probes;
+    gint stop;
+}
+FakeTerminal;
+
+/* Plays the terminal's side. Answers every primary DA query. */
+static gpointer
+responder_main (gpointer data)
+{
+    FakeTerminal *ft = data;
+    GString *input = g_string_new ("");
+
+    while (!g_atomic_int_get (&ft->stop))
+    {
+        GPollFD pfd = { ft->master_fd, G_IO_IN, 0 };
+        gchar buf [256];
+        gchar *p;
+        gint len;
+
+        if (g_poll (&pfd, 1, 20) < 1)
+            continue;
+
+        len = read (ft->master_fd, buf, sizeof (buf));
+        if (len < 1)
+            break;
+
+        g_string_append_len (input, buf, len);
+
+        while ((p = strstr (input->str, "\033[0c")))
+        {
+            g_string_erase (input, 0, p - input->str + 4);
+            g_atomic_int_inc (&ft->n_probes);
+            g_assert_cmpint (write (ft->master_fd, probe_replies, strlen (probe_replies)),
+                             ==, (gint) strlen (probe_replies));
+        }
+    }
+
+    g_string_free (input, TRUE);
+    return NULL;
+}
+
+static void
+set_size (FakeTerminal *ft, gint width_cells, gint height_cells)
+{
+    struct winsize w;
+
+    w.ws_col = width_cells;
+    w.ws_row = height_cells;
+    w.ws_xpixel = width_cells * 10;
+    w.ws_ypixel = height_cells * 20;
+
+    g_assert_cmpint (ioctl (ft->slave_fd, TIOCSWINSZ, &w), ==, 0);
+}
+
+static void
+fake_terminal_init (FakeTerminal *ft)
+{
+    memset (ft, 0, sizeof (*ft));
+
+    ft->master_fd = posix_openpt (O_RDWR | O_NOCTTY);
+    g_assert_cmpint (ft->master_fd, >=, 0);
+    g_assert_cmpint (grantpt (ft->master_fd), ==, 0);
+    g_assert_cmpint (unlockpt (ft->master_fd), ==, 0);
+
+    ft->slave_fd = open (ptsname (ft->master_fd), O_RDWR | O_NOCTTY);
+    g_assert_cmpint (ft->slave_fd, >=, 0);
+
+    set_size (ft, 80, 24);
+    ft->thread = g_thread_new ("responder", responder_main, ft);
+}
+
+static void
+fake_terminal_deinit (FakeTerminal *ft)
+{
+    g_atomic_int_set (&ft->stop, 1);
+    g_thread_join (ft->thread);
+    close (ft->slave_fd);
+    close (ft->master_fd);
+}
+
+/* Probes with a new ChafaTerm. Returns the number of queries the terminal
+ * saw. */
+static gint
+probe (FakeTerminal *ft, gboolean use_cache, gboolean resize_after)
+{
+    ChafaTerm *term;
+    gint n_probes_before = g_atomic_int_get (&ft->n_probes);
+
+    term = chafa_term_new (NULL, ft->slave_fd, ft->slave_fd, ft->slave_fd);
+    chafa_term_set_probe_cache_enabled (term, use_cache);
+
+    g_assert_true (chafa_term_sync_probe (term, PROBE_TIMEOUT_MS));
+    g_assert_cmpint (chafa_term_get_default_fg_color (term), ==, 0xff8000);
+    g_assert_cmpint (chafa_term_get_default_bg_color (term), ==, 0x000020);
+    g_assert_true (chafa_term_info_have_seq (chafa_term_get_term_info (term),
+                                             CHAFA_TERM_SEQ_BEGIN_SIXELS));
+
+    if (resize_after)
+    {
+        /* The cached results no longer apply; this must probe for real */
+        set_size (ft, 100, 30);
+        chafa_term_notify_size_changed (term);
+        g_assert_true (chafa_term_sync_probe (term, PROBE_TIMEOUT_MS));
+    }
+
+    chafa_term_destroy (term);
+    return g_atomic_int_get (&ft->n_probes) - n_probes_before;
+}
+
+static void
+probe_cache_test (void)
+{
+    FakeTerminal ft, ft2;
+    gchar *runtime_dir, *cache_dir;
+    const gchar *name;
+    GDir *dir;
+
+    runtime_dir = g_dir_make_tmp ("chafa-probe-cache-test-XXXXXX", NULL);
+    g_assert_nonnull (runtime_dir);
+    g_setenv ("XDG_RUNTIME_DIR", runtime_dir, TRUE);
+    g_setenv ("TERM", "xterm", TRUE);
+
+    fake_terminal_init (&ft);
+
+    /* Without the cache, we always probe */
+    g_assert_cmpint (probe (&ft, FALSE, FALSE), ==, 1);
+    g_assert_cmpint (probe (&ft, FALSE, FALSE), ==, 1);
+
+    /* The first cached probe fills the cache, the next one uses it */
+    g_assert_cmpint (probe (&ft, TRUE, FALSE), ==, 1);
+    g_assert_cmpint (probe (&ft, TRUE, FALSE), ==, 0);
+
+    /* A different terminal type must not match */
+    g_setenv ("TERM", "xterm-256color", TRUE);
+    g_assert_cmpint (probe (&ft, TRUE, FALSE), ==, 1);
+    g_setenv ("TERM", "xterm", TRUE);
+    g_assert_cmpint (probe (&ft, TRUE, FALSE), ==, 0);
+
+    /* Resizing revalidates */
+    g_assert_cmpint (probe (&ft, TRUE, TRUE), ==, 1);
+    g_assert_cmpint (probe (&ft, TRUE, FALSE), ==, 0);
+
+    /* So does starting at a different size */
+    set_size (&ft, 120, 40);
+    g_assert_cmpint (probe (&ft, TRUE, FALSE), ==, 1);
+    g_assert_cmpint (probe (&ft, TRUE, FALSE), ==, 0);
+
+    /* Another tty is another terminal. Keep the first one open, so the
+     * device isn't reused. */
+    fake_terminal_init (&ft2);
+    set_size (&ft2, 120, 40);
+    g_assert_cmpint (probe (&ft2, TRUE, FALSE), ==, 1);
+    fake_terminal_deinit (&ft2);
+    fake_terminal_deinit (&ft);
+
+    /* Without a runtime dir, there's no cache */
+    g_unsetenv ("XDG_RUNTIME_DIR");
+    fake_terminal_init (&ft);
+    g_assert_cmpint (probe (&ft, TRUE, FALSE), ==, 1);
+    g_assert_cmpint (probe (&ft, TRUE, FALSE), ==, 1);
+    fake_terminal_deinit (&ft);
+
+    cache_dir = g_build_filename (runtime_dir, "chafa", NULL);
+    dir = g_dir_open (cache_dir, 0, NULL);
+    g_assert_nonnull (dir);
+
+    while ((name = g_dir_read_name (dir)))
+    {
+        gchar *path = g_build_filename (cache_dir, name, NULL);
+        g_unlink (path);
+        g_free (path);
+    }
+
+    g_dir_close (dir);
+    g_rmdir (cache_dir);
+    g_rmdir (runtime_dir);
+    g_free (cache_dir);
+    g_free (runtime_dir);
+}
+
+int
+main (int argc, char *argv [])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/term/probe-cache", probe_cache_test);
+
+    return g_test_run ();
+}
@@ -44,8 +44,10 @@
 #include "chicle-grid-layout.h"
 #include "chicle-media-pipeline.h"
 #include "chicle-options.h"
+#include "chicle-pacer.h"
 #include "chicle-path-queue.h"
 #include "chicle-placement-counter.h"
+#include "chicle-rate-control.h"
 #include "chicle-util.h"
 
 /* Include after glib.h for G_OS_WIN32 */
@@ -64,6 +66,14 @@
  * this long for processing to finish before forcing an exit. */
 #define EXIT_GRACE_USEC (500 * 1000)
 
+/* Size of the pieces an image file is base64-encoded in for iTerm2 */
+#define ITERM2_FILE_CHUNK_LEN (48 * 1024)
+
+/* Kitty keeps every frame of an uploaded animation, and silently drops
+ * images when it runs out of storage. This leaves room for other images
+ * within the 256MiB the library's Kitty image cache assumes. */
+#define KITTY_ANIM_BYTES_MAX (128 * 1024 * 1024)
+
 #ifdef G_OS_WIN32
 /* Enable command line globbing on Windows.
  *
@@ -76,6 +86,9 @@ extern int _CRT_glob = 1;
 static volatile sig_atomic_t interrupted_by_user = FALSE;
 static ChiclePlacementCounter *placement_counter;
 
+/* Image data written for the current frame. Used for rate control. */
+static gsize frame_n_bytes;
+
 #ifdef HAVE_TERMIOS_H
 static struct termios saved_termios;
 #endif
@@ -272,15 +285,57 @@ static void
 write_gstring_to_stdout (GString *gs)
 {
     chafa_term_write (term, gs->str, gs->len);
+    frame_n_bytes += gs->len;
 }
 
+/* Writes the rows, optionally with a separator between each pair.
+ *
+ * Still images are passed to the OS as-is, without being copied. That
+ * blocks until the terminal has taken all of it, though, so animation
+ * frames are queued instead. This lets us get on with the next frame
+ * while the writer drains this one. */
 static void
-write_gstrings_to_stdout (GString **gsa)
+write_gstrings_to_stdout (GString **gsa, const gchar *sep, gint sep_len,
+                          gboolean is_animation)
 {
+    ChafaOutputVector *vecs;
+    gint n_vecs = 0;
     gint i;
 
+    if (is_animation)
+    {
+        for (i = 0; gsa [i]; i++)
+        {
+            chafa_term_write (term, gsa [i]->str, gsa [i]->len);
+            frame_n_bytes += gsa [i]->len;
+
+            if (gsa [i + 1] && sep_len > 0)
+                chafa_term_write (term, sep, sep_len);
+        }
+
+        return;
+    }
+
     for (i = 0; gsa [i]; i++)
-        write_gstring_to_stdout (gsa [i]);
+        ;
+
+    vecs = g_new (ChafaOutputVector, i * 2);
+
+    for (i = 0; gsa [i]; i++)
+    {
+        vecs [n_vecs].data = gsa [i]->str;
+        vecs [n_vecs++].len = gsa [i]->len;
+        frame_n_bytes += gsa [i]->len;
+
+        if (gsa [i + 1] && sep_len > 0)
+        {
+            vecs [n_vecs].data = sep;
+            vecs [n_vecs++].len = sep_len;
+        }
+    }
+
+    chafa_term_writev (term, vecs, n_vecs);
+    g_free (vecs);
 }
 
 static void
@@ -473,9 +528,9 @@ write_image_epilogue (const gchar *path, gboolean is_animation, gint dest_width)
     }
 }
 
-/* Write out the image data, possibly centering it */
-static void
-write_image (GString **gsa, gint dest_width)
+/* Indent top left corner: Common for all modes */
+static gint
+write_image_indent (gint dest_width)
 {
     gint left_space;
 
@@ -485,45 +540,162 @@ write_image (GString **gsa, gint dest_width)
         : (options.view_width - dest_width - options.margin_right);
     left_space = MAX (left_space, 0);
 
-    /* Indent top left corner: Common for all modes */
-
     if (options.relative && left_space > 0)
         chafa_term_print_seq (term, CHAFA_TERM_SEQ_CURSOR_RIGHT, left_space, -1);
     else
         write_pad_spaces (left_space);
 
+    return left_space;
+}
+
+static void
+write_to_term_cb (gconstpointer data, gint len, G_GNUC_UNUSED gpointer user_data)
+{
+    chafa_term_write (term, data, len);
+    frame_n_bytes += len;
+}
+
+/* Stream the image data straight to the terminal as it's being generated.
+ * Used in sixel mode, where the encoded image can be very large. If
+ * prev_canvas is set, only the parts that changed since it was printed to
+ * the same location will be drawn. */
+static void
+write_image_streamed (ChafaCanvas *canvas, ChafaCanvas *prev_canvas, gint dest_width)
+{
+    write_image_indent (dest_width);
+    chafa_canvas_print_delta_to_func (canvas, prev_canvas, options.term_info,
+                                      write_to_term_cb, NULL);
+}
+
+static gboolean
+same_geometry (ChafaCanvas *canvas, ChafaCanvas *prev_canvas)
+{
+    gint width, height, prev_width, prev_height;
+
+    if (!canvas || !prev_canvas)
+        return FALSE;
+
+    chafa_canvas_config_get_geometry (chafa_canvas_peek_config (canvas), &width, &height);
+    chafa_canvas_config_get_geometry (chafa_canvas_peek_config (prev_canvas),
+                                      &prev_width, &prev_height);
+    return width == prev_width && height == prev_height;
+}
+
+/* Check if the image would fill the destination cells to within a cell,
+ * so the terminal can do the scaling without visible distortion. We can't
+ * tell if the cell size is unknown. */
+static gboolean
+image_fills_cells (gint src_width, gint src_height, gint dest_width, gint dest_height)
+{
+    gdouble box_width, box_height;
+    gdouble scale;
+
+    if (options.stretch)
+        return TRUE;
+    if (src_width < 1 || src_height < 1
+        || options.cell_width < 1 || options.cell_height < 1)
+        return FALSE;
+
+    box_width = (gdouble) dest_width * options.cell_width;
+    box_height = (gdouble) dest_height * options.cell_height;
+
+    scale = MIN (box_width / src_width, box_height / src_height);
+    return box_width - src_width * scale < options.cell_width
+        && box_height - src_height * scale < options.cell_height;
+}
+
+/* Check if any of the options would change the image's appearance. The
+ * terminal would show the file as it is. */
+static gboolean
+options_allow_file_passthrough (void)
+{
+    return !options.bg_color_set
+        && !options.transparency_threshold_set
+        && !options.invert
+        && !options.preprocess_set
+        && !options.fg_only;
+}
+
+/* Send an unmodified image file to an iTerm2-compatible terminal, letting it
+ * do the decoding and scaling. This is much smaller than our TIFF wrapping.
+ * The file is encoded in pieces, since it can be large. */
+static void
+write_iterm2_file (gconstpointer data, gsize len, gint dest_width, gint dest_height)
+{
+    const guint8 *p = data;
+    gchar *seq;
+    gchar *b64;
+    gint state = 0, save = 0;
+    gsize b64_len;
+
+    seq = chafa_term_info_emit_seq (options.term_info, CHAFA_TERM_SEQ_BEGIN_ITERM2_IMAGE,
+                                    dest_width, dest_height, -1);
+    chafa_term_write (term, seq, strlen (seq));
+    g_free (seq);
+
+    b64 = g_malloc ((ITERM2_FILE_CHUNK_LEN / 3 + 1) * 4 + 4);
+
+    while (len > 0)
+    {
+        gsize chunk_len = MIN (len, ITERM2_FILE_CHUNK_LEN);
+
+        b64_len = g_base64_encode_step (p, chunk_len, FALSE, b64, &state, &save);
+        chafa_term_write (term, b64, b64_len);
+        p += chunk_len;
+        len -= chunk_len;
+    }
+
+    b64_len = g_base64_encode_close (FALSE, b64, &state, &save);
+    chafa_term_write (term, b64, b64_len);
+    g_free (b64);
+
+    seq = chafa_term_info_emit_seq (options.term_info, CHAFA_TERM_SEQ_END_ITERM2_IMAGE, -1);
+    chafa_term_write (term, seq, strlen (seq));
+    g_free (seq);
+}
+
+/* Write out the image data, possibly centering it */
+static void
+write_image (GString **gsa, gint dest_width, gboolean is_animation)
+{
+    gint left_space;
+
+    left_space = write_image_indent (dest_width);
+
     if (options.pixel_mode == CHAFA_PIXEL_MODE_SYMBOLS)
     {
-        gint i;
+        GString *sep = g_string_new ("");
 
-        /* Indent subsequent rows: Symbols mode only */
+        /* Indent subsequent rows: Symbols mode only. The separator is the
+         * same for every row, so it's built once and reused. */
 
-        for (i = 0; gsa [i]; i++)
+        if (options.relative)
         {
-            write_gstring_to_stdout (gsa [i]);
+            ChafaTermInfo *term_info = chafa_term_get_term_info (term);
+            gchar buf [CHAFA_TERM_SEQ_LENGTH_MAX * 3];
+            gchar *p0 = buf;
 
-            if (gsa [i + 1])
-            {
-                if (options.relative)
-                {
-                    chafa_term_print_seq (term, CHAFA_TERM_SEQ_CURSOR_LEFT,
-                                          left_space + dest_width, -1);
-                    chafa_term_print_seq (term, CHAFA_TERM_SEQ_CURSOR_DOWN_SCROLL, -1);
+            p0 = chafa_term_info_emit_cursor_left (term_info, p0, left_space + dest_width);
+            p0 = chafa_term_info_emit_cursor_down_scroll (term_info, p0);
 
-                    if (left_space > 0)
-                        chafa_term_print_seq (term, CHAFA_TERM_SEQ_CURSOR_RIGHT, left_space, -1);
-                }
-                else
-                {
-                    chafa_term_write (term, "\n", 1);
-                    write_pad_spaces (left_space);
-                }
-            }
+            if (left_space > 0)
+                p0 = chafa_term_info_emit_cursor_right (term_info, p0, left_space);
+
+            g_string_append_len (sep, buf, p0 - buf);
+        }
+        else
+        {
+            g_string_append_c (sep, '\n');
+            g_string_set_size (sep, left_space + 1);
+            memset (sep->str + 1, ' ', left_space);
         }
+
+        write_gstrings_to_stdout (gsa, sep->str, sep->len, is_animation);
+        g_string_free (sep, TRUE);
     }
     else
     {
-        write_gstrings_to_stdout (gsa);
+        write_gstrings_to_stdout (gsa, NULL, 0, is_animation);
     }
 }
 
@@ -568,6 +740,11 @@ build_config (gint dest_width, gint dest_height, gboolean is_animation)
     chafa_canvas_config_set_work_factor (config, (options.work_factor - 1) / 8.0f);
 
     chafa_canvas_config_set_optimizations (config, options.optimizations);
+    chafa_canvas_config_set_compression_level (config, options.compression_level);
+
+    /* Only takes effect when printing to the terminal, which lets us
+     * check that it worked */
+    chafa_canvas_config_set_local_transfer_enabled (config, TRUE);
     return config;
 }
 
@@ -609,6 +786,72 @@ typedef enum
 }
 RunResult;
 
+/* Animation frames are rendered while the terminal is still busy with the
+ * previous one, so there are at most two frames in flight: One draining and
+ * one waiting to be written. Before writing the next frame, this waits for
+ * the previous one to drain and for its display time to run out. Returns the
+ * time by which the previous frame overran its nominal duration, which is
+ * nonzero when rendering or output can't keep up. */
+static gdouble
+wait_for_frame_slot (gint64 shown_us, gint64 due_us, gint nominal_ms)
+{
+    gint64 now_us, remain_us;
+    gdouble overrun_s;
+
+    chafa_term_flush (term);
+
+    if (shown_us <= 0)
+        return 0.0;
+
+    now_us = g_get_monotonic_time ();
+    overrun_s = MAX ((now_us - shown_us) / 1000000.0 - nominal_ms / 1000.0, 0.0);
+
+    remain_us = due_us - now_us;
+    if (remain_us > 0 && 1000000.0 / (gdouble) remain_us < CHICLE_ANIM_FPS_MAX)
+        interruptible_usleep (remain_us);
+
+    return overrun_s;
+}
+
+/* Returns the size of a Kitty frame in the terminal's memory */
+static guint64
+get_kitty_frame_bytes (const ChafaCanvasConfig *config)
+{
+    gint width, height, cell_width, cell_height;
+
+    chafa_canvas_config_get_geometry (config, &width, &height);
+    chafa_canvas_config_get_cell_geometry (config, &cell_width, &cell_height);
+
+    return (guint64) width * cell_width * height * cell_height * 4;
+}
+
+/* Hands playback of an uploaded Kitty animation over to the terminal, then
+ * waits until the time is up or we're interrupted. Returns the updated
+ * elapsed time. */
+static gdouble
+play_kitty_animation (gint image_id, GArray *gaps, gdouble elapsed_s, gdouble duration_s)
+{
+    gint64 start_us;
+    guint i;
+
+    for (i = 0; i < gaps->len; i++)
+    {
+        chafa_term_print_seq (term, CHAFA_TERM_SEQ_SET_KITTY_ANIMATION_FRAME_GAP_V1,
+                              image_id, i + 1, g_array_index (gaps, gint, i), -1);
+    }
+
+    /* A loop count of 1 means forever */
+    chafa_term_print_seq (term, CHAFA_TERM_SEQ_START_KITTY_ANIMATION_V1, image_id, 1, -1);
+    chafa_term_flush (term);
+
+    start_us = g_get_monotonic_time ();
+    interruptible_usleep ((duration_s - elapsed_s) * 1000000.0);
+    elapsed_s += (g_get_monotonic_time () - start_us) / 1000000.0;
+
+    chafa_term_print_seq (term, CHAFA_TERM_SEQ_STOP_KITTY_ANIMATION_V1, image_id, -1);
+    return elapsed_s;
+}
+
 /* Prescaling is for structured formats like SVG where the intrinsic size may be
  * too small or too large and we'd rather rasterize to something closer to our
  * final output size. */
@@ -642,24 +885,55 @@ run_generic (const gchar *filename, ChicleMediaLoader *media_loader,
              gboolean is_first_file, gboolean is_first_frame)
 {
     gboolean is_animation = FALSE;
+    gboolean use_kitty_anim = FALSE;
+    GArray *kitty_gaps = NULL;
+    guint64 kitty_anim_bytes = 0;
     gdouble anim_duration_s = options.file_duration_s >= 0.0 ? options.file_duration_s : G_MAXDOUBLE;
     gdouble anim_elapsed_s = 0.0;
-    GTimer *timer;
+    gint64 frame_shown_us = 0, frame_due_us = 0;
+    gint frame_delay_ms = 0;
     gint loop_n = 0;
-    GString **gsa;
+    ChafaCanvas *prev_canvas = NULL;
+    ChicleRateControl *rate_control = NULL;
+    ChiclePacer *pacer = NULL;
     gint placement_id = -1;
     gint frame_count = 0;
     RunResult result = FILE_FAILED;
     gint dest_width = 0, dest_height = 0;
     GError *error = NULL;
 
-    timer = g_timer_new ();
-
     if (interrupted_by_user)
         goto out;
 
+    is_animation = options.animate ? chicle_media_loader_get_is_animation (media_loader) : FALSE;
+    result = is_animation ? FILE_WAS_ANIMATION : FILE_WAS_STILL;
+
+    if (is_animation && (options.bitrate > 0.0 || options.frame_bytes > 0))
+        rate_control = chicle_rate_control_new (options.bitrate, options.frame_bytes,
+                                                options.fill_specified);
+
+    /* If the terminal supports it, upload Kitty animations frame by frame
+     * to a single image, then let the terminal loop them. Streams can't be
+     * looped, and their frames must be shown as they arrive. */
+    if (is_animation
+        && chicle_media_loader_get_can_loop (media_loader)
+        && options.pixel_mode == CHAFA_PIXEL_MODE_KITTY
+        && options.passthrough == CHAFA_PASSTHROUGH_NONE
+        && chafa_term_info_have_seq (options.term_info, CHAFA_TERM_SEQ_BEGIN_KITTY_ANIMATION_FRAME_V1)
+        && chafa_term_info_have_seq (options.term_info, CHAFA_TERM_SEQ_SET_KITTY_ANIMATION_FRAME_GAP_V1)
+        && chafa_term_info_have_seq (options.term_info, CHAFA_TERM_SEQ_START_KITTY_ANIMATION_V1)
+        && chafa_term_info_have_seq (options.term_info, CHAFA_TERM_SEQ_STOP_KITTY_ANIMATION_V1))
+    {
+        use_kitty_anim = TRUE;
+        kitty_gaps = g_array_new (FALSE, FALSE, sizeof (gint));
+    }
+
+    /* Kitty animations are played back by the terminal */
+    if (is_animation && options.realtime && !use_kitty_anim)
+        pacer = chicle_pacer_new (options.work_factor);
+
     if (options.pixel_mode == CHAFA_PIXEL_MODE_KITTY
-        && options.passthrough != CHAFA_PASSTHROUGH_NONE)
+        && (options.passthrough != CHAFA_PASSTHROUGH_NONE || use_kitty_anim))
     {
         if (!placement_counter)
             placement_counter = chicle_placement_counter_new ();
@@ -667,9 +941,6 @@ run_generic (const gchar *filename, ChicleMediaLoader *media_loader,
         placement_id = chicle_placement_counter_get_next_id (placement_counter);
     }
 
-    is_animation = options.animate ? chicle_media_loader_get_is_animation (media_loader) : FALSE;
-    result = is_animation ? FILE_WAS_ANIMATION : FILE_WAS_STILL;
-
     do
     {
         gboolean have_frame;
@@ -682,18 +953,23 @@ run_generic (const gchar *filename, ChicleMediaLoader *media_loader,
              have_frame && !interrupted_by_user && (loop_n == 0 || anim_elapsed_s < anim_duration_s);
              have_frame = chicle_media_loader_goto_next_frame (media_loader))
         {
-            gdouble elapsed_ms, remain_ms;
+            gdouble remain_ms;
             gint delay_ms;
             ChafaPixelType pixel_type;
             gint src_width, src_height, src_rowstride;
             gint uncorrected_src_width, uncorrected_src_height;
             gint virt_src_width, virt_src_height;
             const guint8 *pixels;
+            gconstpointer file_data = NULL;
+            gsize file_data_len = 0;
             ChafaCanvasConfig *config;
             ChafaCanvas *canvas;
+            GString *gs = NULL;
+            GString **gsa = NULL;
             ChafaTuck tuck;
+            gboolean keep_canvas;
 
-            g_timer_start (timer);
+            frame_n_bytes = 0;
 
             if (options.use_exact_size == CHICLE_TRISTATE_TRUE)
             {
@@ -739,6 +1015,20 @@ run_generic (const gchar *filename, ChicleMediaLoader *media_loader,
 
             delay_ms = chicle_media_loader_get_frame_delay (media_loader);
 
+            if (options.anim_fps > 0.0)
+                remain_ms = 1000.0 / options.anim_fps;
+            else
+                remain_ms = delay_ms;
+            remain_ms /= options.anim_speed_multiplier;
+
+            /* Skip frames that can't be shown in time. They still have to be
+             * decoded, since most formats build on the previous frame. */
+            if (pacer && !chicle_pacer_begin_frame (pacer, remain_ms / 1000.0))
+            {
+                anim_elapsed_s = chicle_pacer_get_elapsed (pacer);
+                continue;
+            }
+
             /* Hack to work around the fact that chafa_calc_canvas_geometry() doesn't
              * support arbitrary scaling. Instead, we manipulate the source size to
              * achieve the desired effect. */
@@ -800,45 +1090,177 @@ run_generic (const gchar *filename, ChicleMediaLoader *media_loader,
                         dest_width, dest_height);
 #endif
 
+            /* When compressing for iTerm2, send suitable files as they are */
+            if (!is_animation
+                && options.pixel_mode == CHAFA_PIXEL_MODE_ITERM2
+                && options.compression_level > 0
+                && options.passthrough == CHAFA_PASSTHROUGH_NONE
+                && chafa_term_info_have_seq (options.term_info, CHAFA_TERM_SEQ_BEGIN_ITERM2_IMAGE)
+                && chafa_term_info_have_seq (options.term_info, CHAFA_TERM_SEQ_END_ITERM2_IMAGE)
+                && options_allow_file_passthrough ()
+                && image_fills_cells (src_width, src_height, dest_width, dest_height))
+                file_data = chicle_media_loader_get_file_data (media_loader, &file_data_len);
+
             config = build_config (dest_width, dest_height, is_animation);
-            canvas = build_canvas (pixel_type, pixels,
-                                   src_width, src_height, src_rowstride, config,
-                                   placement_id >= 0 ? placement_id + ((frame_count++) % 2) : -1,
-                                   tuck);
+            if (rate_control)
+                chicle_rate_control_apply (rate_control, config);
+            if (pacer)
+                chicle_pacer_apply (pacer, config);
+
+            canvas = file_data ? NULL
+                : build_canvas (pixel_type, pixels,
+                                src_width, src_height, src_rowstride, config,
+                                use_kitty_anim ? placement_id
+                                : placement_id >= 0 ? placement_id + ((frame_count++) % 2) : -1,
+                                tuck);
+
+            /* Print the frame to memory first, so that in animations, this
+             * overlaps with the terminal draining the previous frame. Sixels
+             * can be very large, so they're still streamed. */
+            if (file_data || options.pixel_mode == CHAFA_PIXEL_MODE_SIXELS)
+            {
+                /* Written directly */
+            }
+            else if (use_kitty_anim
+                     || (options.pixel_mode == CHAFA_PIXEL_MODE_SYMBOLS
+                         && same_geometry (canvas, prev_canvas)))
+            {
+                /* Skip unchanged cells. The output only uses relative cursor
+                 * movement, so a single indent covers all the rows. */
+                gs = chafa_canvas_print_delta (canvas, prev_canvas, options.term_info);
+            }
+            else if (options.pixel_mode != CHAFA_PIXEL_MODE_KITTY || is_animation)
+            {
+                chafa_canvas_print_rows (canvas, options.term_info, &gsa, NULL);
+            }
 
-            chafa_canvas_print_rows (canvas, options.term_info, &gsa, NULL);
+            if (is_animation)
+            {
+                if (pacer)
+                {
+                    chafa_term_flush (term);
+                    chicle_pacer_frame_ready (pacer);
+                    frame_due_us = chicle_pacer_get_frame_start (pacer);
+                }
+
+                anim_elapsed_s += wait_for_frame_slot (frame_shown_us, frame_due_us,
+                                                       frame_delay_ms);
+                frame_shown_us = g_get_monotonic_time ();
+            }
 
             write_image_prologue (filename, is_first_file, is_first_frame, is_animation, dest_height);
-            write_image (gsa, dest_width);
+
+            if (file_data)
+            {
+                write_image_indent (dest_width);
+                write_iterm2_file (file_data, file_data_len, dest_width, dest_height);
+            }
+            else if (options.pixel_mode == CHAFA_PIXEL_MODE_SIXELS)
+            {
+                write_image_streamed (canvas, prev_canvas, dest_width);
+            }
+            else if (gs)
+            {
+                write_image_indent (dest_width);
+                write_gstring_to_stdout (gs);
+                g_string_free (gs, TRUE);
+            }
+            else if (gsa)
+            {
+                write_image (gsa, dest_width, is_animation);
+                chafa_free_gstring_array (gsa);
+            }
+            else
+            {
+                /* Lets the terminal session reuse images it has seen before */
+                write_image_indent (dest_width);
+                chafa_term_print_canvas (term, canvas, options.term_info);
+            }
 
             /* No inter-frame epilogue in animations; this prevents unwanted
              * scrolling when we get the sixel overshoot quirk wrong (#255). */
             if (!is_animation)
                 write_image_epilogue (filename, is_animation, dest_width);
 
-            chafa_term_flush (term);
-            chafa_free_gstring_array (gsa);
-            chafa_canvas_unref (canvas);
-            chafa_canvas_config_unref (config);
+            /* Animation frames are flushed before the next one is written */
+            if (!is_animation)
+                chafa_term_flush (term);
+
+            /* Keep the canvas around so the next frame can be printed as a
+             * delta against it. Requires -O 7 or higher, except for Kitty
+             * animation frames. */
+            keep_canvas = is_animation
+                && (use_kitty_anim
+                    || (chafa_canvas_config_get_optimizations (config)
+                        & CHAFA_OPTIMIZATION_SKIP_CELLS));
+
+            if (prev_canvas)
+                chafa_canvas_unref (prev_canvas);
+            prev_canvas = NULL;
+
+            if (keep_canvas)
+                prev_canvas = canvas;
+            else if (canvas)
+                chafa_canvas_unref (canvas);
 
             if (is_animation)
             {
-                /* Account for time spent converting and printing frame */
-                elapsed_ms = g_timer_elapsed (timer, NULL) * 1000.0;
+                if (use_kitty_anim)
+                {
+                    gint gap_ms = MAX ((gint) (remain_ms + 0.5), 1);
+                    guint64 frame_bytes = get_kitty_frame_bytes (config);
+
+                    g_array_append_val (kitty_gaps, gap_ms);
+                    kitty_anim_bytes += frame_bytes;
+
+                    /* If the next frame would take us over budget, send each
+                     * frame as a separate image from now on. The first one
+                     * reuses the animation's ID, which frees its frames. The
+                     * timeline is already running, so frames aren't dropped
+                     * even with --realtime. */
+                    if (kitty_anim_bytes + frame_bytes > KITTY_ANIM_BYTES_MAX)
+                    {
+                        if (options.verbose)
+                            g_printerr ("%s: %s: Animation too large to upload, sending frames one by one.\n",
+                                        options.executable_name, filename);
+
+                        use_kitty_anim = FALSE;
+
+                        if (prev_canvas)
+                            chafa_canvas_unref (prev_canvas);
+                        prev_canvas = NULL;
+                    }
+                }
 
-                if (options.anim_fps > 0.0)
-                    remain_ms = 1000.0 / options.anim_fps;
-                else
-                    remain_ms = delay_ms;
-                remain_ms /= options.anim_speed_multiplier;
-                remain_ms = MAX (remain_ms - elapsed_ms, 0);
+                /* If the output settings change, the next frame can't be
+                 * a delta against this one */
+                if (rate_control
+                    && chicle_rate_control_update (rate_control, frame_n_bytes,
+                                                   remain_ms / 1000.0)
+                    && prev_canvas && !use_kitty_anim)
+                {
+                    chafa_canvas_unref (prev_canvas);
+                    prev_canvas = NULL;
+                }
 
-                if (remain_ms > 0.0001 && 1000.0 / (gdouble) remain_ms < CHICLE_ANIM_FPS_MAX)
-                    interruptible_usleep (remain_ms * 1000.0);
+                frame_delay_ms = delay_ms;
 
-                anim_elapsed_s += MAX (elapsed_ms, delay_ms) / 1000.0;
+                if (pacer)
+                {
+                    /* Playback follows the clock */
+                    frame_due_us = chicle_pacer_get_frame_end (pacer);
+                    anim_elapsed_s = chicle_pacer_get_elapsed (pacer);
+                }
+                else
+                {
+                    /* The next frame is written when this one has drained and
+                     * its time is up. Any overrun is accounted for then. */
+                    frame_due_us = frame_shown_us + (gint64) (remain_ms * 1000.0);
+                    anim_elapsed_s += delay_ms / 1000.0;
+                }
             }
 
+            chafa_canvas_config_unref (config);
             is_first_frame = FALSE;
 
             if (!is_animation)
@@ -846,21 +1268,57 @@ run_generic (const gchar *filename, ChicleMediaLoader *media_loader,
         }
 
         loop_n++;
+
+        /* All frames of the Kitty animation are in the terminal now, so we
+         * don't have to send anything more */
+        if (use_kitty_anim && !have_frame && !interrupted_by_user
+            && !options.watch)
+        {
+            anim_elapsed_s += wait_for_frame_slot (frame_shown_us, frame_due_us,
+                                                   frame_delay_ms);
+            frame_shown_us = 0;
+            anim_elapsed_s = play_kitty_animation (placement_id, kitty_gaps,
+                                                   anim_elapsed_s, anim_duration_s);
+            break;
+        }
     }
     while (is_animation && !interrupted_by_user
-           && !options.watch && anim_elapsed_s < anim_duration_s);
+           && !options.watch && anim_elapsed_s < anim_duration_s
+           && chicle_media_loader_get_can_loop (media_loader));
+
+    /* Let the final frame run its course */
+    if (frame_shown_us > 0)
+        wait_for_frame_slot (frame_shown_us, frame_due_us, frame_delay_ms);
 
     if (is_animation)
         write_image_epilogue (filename, is_animation, dest_width);
 
+    if (pacer && options.verbose)
+    {
+        gint n_shown, n_dropped, work_factor;
+
+        chafa_term_flush (term);
+        chicle_pacer_get_stats (pacer, &n_shown, &n_dropped, &work_factor);
+        g_printerr ("%s: %s: Showed %d frames, dropped %d. Final work factor %d.\n",
+                    options.executable_name, filename, n_shown, n_dropped, work_factor);
+    }
+
 out:
     /* We need two IDs per animation in order to do flicker-free flips. If the
      * final frame got the higher ID, increment the global counter so the next
      * image doesn't clobber it. */
-    if (placement_id >= 0 && !(frame_count % 2))
+    if (placement_id >= 0 && !use_kitty_anim && !(frame_count % 2))
         placement_id = chicle_placement_counter_get_next_id (placement_counter);
 
-    g_timer_destroy (timer);
+    if (prev_canvas)
+        chafa_canvas_unref (prev_canvas);
+    if (kitty_gaps)
+        g_array_free (kitty_gaps, TRUE);
+    if (rate_control)
+        chicle_rate_control_destroy (rate_control);
+    if (pacer)
+        chicle_pacer_destroy (pacer);
+
     g_clear_error (&error);
     return result;
 }
@@ -913,6 +1371,40 @@ run_watch (const gchar *filename)
     return 0;
 }
 
+static int
+run_stream (const gchar *filename)
+{
+    ChicleMediaLoader *media_loader;
+    RunResult result;
+    GError *error = NULL;
+
+    media_loader = chicle_media_loader_new_stream (filename, options.stream_format,
+                                                   options.stream_width,
+                                                   options.stream_height,
+                                                   &error);
+    if (!media_loader)
+    {
+        gchar *safe_path = g_strdup (filename);
+
+        chicle_flatten_cntrl_inplace (safe_path);
+        g_printerr ("%s: Failed to open '%s': %s\n",
+                    options.executable_name, safe_path,
+                    error ? error->message : "Unknown error");
+
+        g_free (safe_path);
+        g_clear_error (&error);
+        return 2;
+    }
+
+    result = run_generic (filename, media_loader, TRUE, TRUE);
+    chicle_media_loader_destroy (media_loader);
+
+    if (!options.have_parking_row)
+        chafa_term_write (term, "\n", 1);
+
+    return result == FILE_FAILED ? 2 : 0;
+}
+
 static int
 run_vertical (ChiclePathQueue *path_queue)
 {
@@ -962,6 +1454,18 @@ run_vertical (ChiclePathQueue *path_queue)
             continue;
         }
 
+        if (options.verbose)
+        {
+            const gchar *format_name = chicle_media_loader_get_format_name (media_loader);
+
+            g_printerr ("%s: %s: Opened as %s%s in %.2f ms.\n",
+                        options.executable_name, path,
+                        format_name ? format_name : "?",
+                        chicle_media_loader_get_used_preview (media_loader)
+                        ? " (embedded preview)" : "",
+                        chicle_media_loader_get_open_time_us (media_loader) / 1000.0);
+        }
+
         result = run_generic (path, media_loader, n_processed > 1 ? FALSE : TRUE, TRUE);
         if (result == FILE_FAILED)
             n_failed++;
@@ -1067,7 +1571,21 @@ main (int argc, char *argv [])
     prepare_fast_exit (options.term_info);
     tty_options_init ();
 
-    if (options.grid_width > 0 || options.grid_height > 0)
+    /* At low work factors, decoding can be a big part of the total */
+    chicle_media_loader_set_fast_decode (options.work_factor <= 3);
+    chicle_media_loader_set_use_previews (options.use_previews);
+
+    if (options.stream_format != CHICLE_STREAM_FORMAT_NONE)
+    {
+        gchar *path = chicle_path_queue_try_pop (global_path_queue);
+
+        if (path)
+        {
+            ret = run_stream (path);
+            g_free (path);
+        }
+    }
+    else if (options.grid_width > 0 || options.grid_height > 0)
     {
         ret = run_grid (global_path_queue);
     }
@@ -43,6 +43,11 @@
 #define PAD_TO_N(p, n) (((p) + ((n) - 1)) & ~((unsigned) (n) - 1))
 #define ROWSTRIDE_PAD(rowstride) (PAD_TO_N ((rowstride), (ROWSTRIDE_ALIGN)))
 
+/* Set once at startup; see chicle_jpeg_loader_set_fast_decode () and
+ * chicle_jpeg_loader_set_use_previews () */
+static gboolean fast_decode;
+static gboolean use_previews;
+
 struct JpegLoader
 {
     ChicleFileMapping *mapping;
@@ -50,6 +55,8 @@ struct JpegLoader
     size_t file_data_len;
     gpointer frame_data;
     gint width, height, rowstride;
+    guint used_preview : 1;
+    guint reoriented : 1;
 };
 
 /* ----------------------- *
@@ -72,100 +79,179 @@ read_uint32 (const guchar *p, gboolean is_big_endian)
         ((p [3] << 24) | (p [2] << 16) | (p [1] << 8) | p [0]);
 }
 
-static ChicleRotationType
-read_orientation (JpegLoader *loader)
+/* Finds the first APPn segment with the given signature, and returns its
+ * payload following the signature. Only looks at the metadata segments
+ * preceding the image data. */
+static const guchar *
+find_app_segment (JpegLoader *loader, guint marker, const gchar *sig, gsize sig_len,
+                  gsize *len_out)
 {
     const guchar *p0, *end;
-    size_t len;
-    ChicleRotationType rot = CHICLE_ROTATION_NONE;
-    gboolean is_big_endian;
-    guint n, m, o;
 
     p0 = loader->file_data;
-    len = loader->file_data_len;
-    end = p0 + len;
+    end = p0 + loader->file_data_len;
 
-    /* Assume we already checked the JPEG header. Now find the Exif header. */
+    /* Assume we already checked the JPEG header. Skip the SOI marker. */
     p0 += 2;
 
-    for (;;)
+    while (p0 + 4 <= end)
     {
-        if (p0 + 20 > end)
-            goto out;
+        guint m, n;
 
         /* Get app type */
-        if (read_uint16 (p0, TRUE) < 0xffdb)
-            goto out;
-        p0 += 2;
+        m = read_uint16 (p0, TRUE);
+        if (m < 0xffdb)
+            break;
 
         /* Get marker length; note length field includes itself */
-        n = read_uint16 (p0, TRUE);
-        if (n < 2 || p0 + n > end)
-            goto out;
+        n = read_uint16 (p0 + 2, TRUE);
+        if (n < 2 || p0 + 2 + n > end)
+            break;
 
-        if (!memcmp (p0 + 2, "Exif\0\0", 6))
+        if (m == marker && n - 2 >= sig_len && !memcmp (p0 + 4, sig, sig_len))
         {
-            p0 += 8;
-            break;
+            *len_out = n - 2 - sig_len;
+            return p0 + 4 + sig_len;
         }
 
-        /* Not an Exif marker; skip it */
-        p0 += n;
+        p0 += 2 + n;
     }
 
+    return NULL;
+}
+
+/* A TIFF structure embedded in a JPEG segment, as used by Exif and MPF.
+ * Offsets are relative to the TIFF header. */
+typedef struct
+{
+    const guchar *data;
+    gsize len;
+    gboolean is_big_endian;
+}
+TiffBlock;
+
+static gboolean
+tiff_block_init (TiffBlock *tb, const guchar *data, gsize len)
+{
+    guint m;
+
+    if (!data || len < 8)
+        return FALSE;
+
     /* Get byte order */
-    m = read_uint16 (p0, TRUE);
+    m = read_uint16 (data, TRUE);
     if (m == 0x4949)
-        is_big_endian = FALSE;
+        tb->is_big_endian = FALSE;
     else if (m == 0x4d4d)
-        is_big_endian = TRUE;
+        tb->is_big_endian = TRUE;
     else
-        goto out;
+        return FALSE;
 
     /* Tag mark */
-    if (read_uint16 (p0 + 2, is_big_endian) != 0x002a)
-        goto out;
+    if (read_uint16 (data + 2, tb->is_big_endian) != 0x002a)
+        return FALSE;
 
-    /* First IFD offset */
-    m = read_uint32 (p0 + 4, is_big_endian);
-    if (m > 0xffff)
-        goto out;
-    if (p0 + m + 2 > end)
-        goto out;
-    if (m + 2 > n)
-        goto out;
+    tb->data = data;
+    tb->len = len;
+    return TRUE;
+}
 
-    /* Number of directory entries in this IFD */
-    o = read_uint16 (p0 + m, is_big_endian);
-    m += 2;
+static guint32
+tiff_block_get_first_ifd (const TiffBlock *tb)
+{
+    return read_uint32 (tb->data + 4, tb->is_big_endian);
+}
 
-    for (;;)
-    {
-        guint16 tagnum;
+/* Returns the number of entries in the IFD at ofs, or 0 if it's invalid */
+static guint
+tiff_block_get_n_entries (const TiffBlock *tb, guint32 ofs)
+{
+    guint n;
 
-        if (!o)
-            goto out;
-        if (p0 + m + 12 > end)
-            goto out;
-        if (m + 12 > n)
-            goto out;
+    if (ofs < 8 || ofs > tb->len - 2)
+        return 0;
 
-        tagnum = read_uint16 (p0 + m, is_big_endian);
-        if (tagnum == 0x0112)
-            break;
+    n = read_uint16 (tb->data + ofs, tb->is_big_endian);
+    if ((tb->len - ofs - 2) / 12 < n)
+        return 0;
+
+    return n;
+}
+
+/* Returns the 12-byte directory entry for a tag, or NULL if not found */
+static const guchar *
+tiff_block_find_tag (const TiffBlock *tb, guint32 ifd_ofs, guint16 tag)
+{
+    guint n, i;
+
+    n = tiff_block_get_n_entries (tb, ifd_ofs);
+
+    for (i = 0; i < n; i++)
+    {
+        const guchar *entry = tb->data + ifd_ofs + 2 + i * 12;
 
-        o--;
-        m += 12;
+        if (read_uint16 (entry, tb->is_big_endian) == tag)
+            return entry;
     }
 
-    m = read_uint16 (p0 + m + 8, is_big_endian);
-    if (m > 9)
-        goto out;
+    return NULL;
+}
 
-    rot = m;
+static guint32
+tiff_block_get_next_ifd (const TiffBlock *tb, guint32 ifd_ofs)
+{
+    guint n = tiff_block_get_n_entries (tb, ifd_ofs);
+    gsize next = ifd_ofs + 2 + n * 12;
 
-out:
-    return rot;
+    if (n == 0 || next + 4 > tb->len)
+        return 0;
+
+    return read_uint32 (tb->data + next, tb->is_big_endian);
+}
+
+/* Gets a single SHORT or LONG value. Returns FALSE for other types. */
+static gboolean
+tiff_block_get_uint (const TiffBlock *tb, guint32 ifd_ofs, guint16 tag, guint32 *value_out)
+{
+    const guchar *entry = tiff_block_find_tag (tb, ifd_ofs, tag);
+    guint type;
+
+    if (!entry)
+        return FALSE;
+
+    type = read_uint16 (entry + 2, tb->is_big_endian);
+    if (type == 3)
+        *value_out = read_uint16 (entry + 8, tb->is_big_endian);
+    else if (type == 4)
+        *value_out = read_uint32 (entry + 8, tb->is_big_endian);
+    else
+        return FALSE;
+
+    return TRUE;
+}
+
+static gboolean
+find_exif (JpegLoader *loader, TiffBlock *tb_out)
+{
+    const guchar *p;
+    gsize len;
+
+    p = find_app_segment (loader, 0xffe1, "Exif\0\0", 6, &len);
+    return tiff_block_init (tb_out, p, len);
+}
+
+static ChicleRotationType
+read_orientation (JpegLoader *loader)
+{
+    TiffBlock tb;
+    guint32 m;
+
+    if (!find_exif (loader, &tb)
+        || !tiff_block_get_uint (&tb, tiff_block_get_first_ifd (&tb), 0x0112, &m)
+        || m > 9)
+        return CHICLE_ROTATION_NONE;
+
+    return m;
 }
 
 /* ----------- *
@@ -274,6 +360,161 @@ have_any_apptype_magic (ChicleFileMapping *mapping)
     return chicle_file_mapping_has_magic (mapping, 0, magic, 4);
 }
 
+/* --- Embedded previews --- */
+
+/* Exif can have one thumbnail, and MPF is usually limited to a couple of
+ * previews in practice */
+#define N_PREVIEWS_MAX 8
+
+typedef struct
+{
+    const guchar *data;
+    gsize len;
+}
+JpegStream;
+
+/* Reads the image size from a stream's header without decoding it */
+static gboolean
+get_stream_size (const JpegStream *stream, guint *width_out, guint *height_out)
+{
+    struct jpeg_decompress_struct cinfo = { 0 };
+    struct my_jpeg_error_mgr my_jerr;
+    volatile gboolean success = FALSE;
+
+    cinfo.err = jpeg_std_error ((struct jpeg_error_mgr *) &my_jerr);
+    my_jerr.jerr.error_exit = my_jpeg_error_exit;
+    my_jerr.jerr.output_message = my_jpeg_output_message;
+
+    if (setjmp (my_jerr.setjmp_buffer))
+        goto out;
+
+    jpeg_create_decompress (&cinfo);
+    my_jpeg_mem_src (&cinfo, stream->data, stream->len);
+    (void) jpeg_read_header (&cinfo, TRUE);
+
+    *width_out = cinfo.image_width;
+    *height_out = cinfo.image_height;
+    success = TRUE;
+
+out:
+    jpeg_destroy_decompress (&cinfo);
+    return success;
+}
+
+/* The Exif thumbnail is a JPEG stream stored in IFD1 */
+static gint
+collect_exif_thumbnail (JpegLoader *loader, JpegStream *out)
+{
+    TiffBlock tb;
+    guint32 ifd1, ofs, len;
+
+    if (!find_exif (loader, &tb))
+        return 0;
+
+    ifd1 = tiff_block_get_next_ifd (&tb, tiff_block_get_first_ifd (&tb));
+    if (!ifd1
+        || !tiff_block_get_uint (&tb, ifd1, 0x0201, &ofs)
+        || !tiff_block_get_uint (&tb, ifd1, 0x0202, &len)
+        || ofs > tb.len || len > tb.len - ofs)
+        return 0;
+
+    out->data = tb.data + ofs;
+    out->len = len;
+    return 1;
+}
+
+/* Multi-Picture Format (CIPA DC-007) images follow the main image in the
+ * file. Many cameras use them for large previews. */
+static gint
+collect_mpf_previews (JpegLoader *loader, JpegStream *out, gint n_max)
+{
+    const guchar *p, *entry;
+    gsize len, avail;
+    TiffBlock tb;
+    guint32 count, values, i;
+    gint n = 0;
+
+    p = find_app_segment (loader, 0xffe2, "MPF\0", 4, &len);
+    if (!tiff_block_init (&tb, p, len))
+        return 0;
+
+    /* MPEntry; an array of 16-byte records of type UNDEFINED */
+    entry = tiff_block_find_tag (&tb, tiff_block_get_first_ifd (&tb), 0xb002);
+    if (!entry || read_uint16 (entry + 2, tb.is_big_endian) != 7)
+        return 0;
+
+    count = read_uint32 (entry + 4, tb.is_big_endian);
+    values = read_uint32 (entry + 8, tb.is_big_endian);
+    if (values > tb.len || count > tb.len - values)
+        return 0;
+
+    /* Image offsets are relative to the MPF header, but point past the end
+     * of the segment */
+    avail = loader->file_data + loader->file_data_len - tb.data;
+
+    /* The first record is the main image */
+    for (i = 16; i + 16 <= count && n < n_max; i += 16)
+    {
+        const guchar *rec = tb.data + values + i;
+        guint32 size = read_uint32 (rec + 4, tb.is_big_endian);
+        guint32 ofs = read_uint32 (rec + 8, tb.is_big_endian);
+
+        if (ofs == 0 || ofs > avail || size > avail - ofs)
+            continue;
+
+        out [n].data = tb.data + ofs;
+        out [n].len = size;
+        n++;
+    }
+
+    return n;
+}
+
+/* Picks the smallest embedded preview that covers the target size. It must
+ * also have the main image's aspect; small thumbnails are often letterboxed
+ * to 4:3, and we don't want to show the bars. */
+static gboolean
+find_preview (JpegLoader *loader, guint main_width, guint main_height,
+              gint target_width, gint target_height, JpegStream *preview_out)
+{
+    JpegStream candidates [N_PREVIEWS_MAX];
+    guint64 best_area = G_MAXUINT64;
+    gint n, i;
+
+    if (target_width < 1 || target_height < 1)
+        return FALSE;
+
+    n = collect_exif_thumbnail (loader, candidates);
+    n += collect_mpf_previews (loader, candidates + n, N_PREVIEWS_MAX - n);
+
+    for (i = 0; i < n; i++)
+    {
+        guint width, height;
+
+        if (candidates [i].len < 4
+            || read_uint16 (candidates [i].data, TRUE) != 0xffd8
+            || !get_stream_size (&candidates [i], &width, &height))
+            continue;
+
+        if (width < (guint) target_width || height < (guint) target_height
+            || width >= main_width)
+            continue;
+
+        /* Allow for 1% rounding error */
+        if (ABS ((gint64) width * main_height - (gint64) height * main_width) * 100
+            > (gint64) main_width * height)
+            continue;
+
+        if ((guint64) width * height < best_area)
+        {
+            best_area = (guint64) width * height;
+            *preview_out = candidates [i];
+        }
+    }
+
+    return best_area != G_MAXUINT64;
+}
+
 /* --- Loader --- */
 
 static JpegLoader *
@@ -314,36 +555,55 @@ convert_cmyk_row_to_rgb (const guchar *cmyk, guchar *rgb, gint width)
         convert_cmyk_pixel_to_rgb (cmyk + 4 * i, rgb + 3 * i);
 }
 
-JpegLoader *
-chicle_jpeg_loader_new_from_mapping (ChicleFileMapping *mapping)
+static gboolean
+rotation_swaps_axes (ChicleRotationType rot)
+{
+    return rot == CHICLE_ROTATION_270_MIRROR
+        || rot == CHICLE_ROTATION_270
+        || rot == CHICLE_ROTATION_90_MIRROR
+        || rot == CHICLE_ROTATION_90;
+}
+
+/* Picks the largest power-of-two reduction that still covers the target
+ * size, so we don't decode pixels only to throw them away in the scaler.
+ * This is done in the DCT domain, so it's much cheaper than a full decode.
+ * The 1/2, 1/4 and 1/8 scales are supported by every libjpeg version. */
+static void
+set_output_scale (struct jpeg_decompress_struct *cinfo,
+                  gint target_width, gint target_height)
+{
+    guint denom;
+
+    if (target_width < 1 || target_height < 1)
+        return;
+
+    for (denom = 8; denom > 1; denom /= 2)
+    {
+        if ((cinfo->image_width + denom - 1) / denom >= (guint) target_width
+            && (cinfo->image_height + denom - 1) / denom >= (guint) target_height)
+            break;
+    }
+
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = denom;
+}
+
+/* Decodes a complete JPEG stream to RGB8. Returns the pixel data, or NULL
+ * on failure. */
+static gpointer
+decode_stream (const JpegStream *stream, gint target_width, gint target_height,
+               guint *width_out, guint *height_out, guint *rowstride_out)
 {
     guint width, height;
     guint rowstride;
     struct jpeg_decompress_struct cinfo = { 0 };
     struct my_jpeg_error_mgr my_jerr;
-    JpegLoader * volatile loader = NULL;
-    gpointer frame_data = NULL;
+    gpointer volatile frame_data = NULL;
     volatile gboolean convert_cmyk_to_rgb = FALSE;
-    guchar *cmyk_buf = NULL;
+    guchar * volatile cmyk_buf = NULL;
     volatile gboolean have_decompress = FALSE;
     volatile gboolean success = FALSE;
 
-    g_return_val_if_fail (mapping != NULL, NULL);
-
-    /* Check magic */
-
-    if (!have_any_apptype_magic (mapping))
-        goto out;
-
-    loader = chicle_jpeg_loader_new ();
-    loader->mapping = mapping;
-
-    /* Get file data */
-
-    loader->file_data = chicle_file_mapping_get_data (loader->mapping, &loader->file_data_len);
-    if (!loader->file_data)
-        goto out;
-
     /* Prepare to decode */
 
     cinfo.err = jpeg_std_error ((struct jpeg_error_mgr *) &my_jerr);
@@ -365,7 +625,7 @@ chicle_jpeg_loader_new_from_mapping (ChicleFileMapping *mapping)
     cinfo.mem->max_memory_to_use = IMAGE_BUFFER_SIZE_MAX;
     have_decompress = TRUE;
 
-    my_jpeg_mem_src (&cinfo, loader->file_data, loader->file_data_len);
+    my_jpeg_mem_src (&cinfo, stream->data, stream->len);
     (void) jpeg_read_header (&cinfo, TRUE);
 
     if (cinfo.jpeg_color_space == JCS_CMYK
@@ -381,6 +641,14 @@ chicle_jpeg_loader_new_from_mapping (ChicleFileMapping *mapping)
 
     cinfo.output_components = 3;
 
+    set_output_scale (&cinfo, target_width, target_height);
+
+    if (fast_decode)
+    {
+        cinfo.dct_method = JDCT_IFAST;
+        cinfo.do_fancy_upsampling = FALSE;
+    }
+
     jpeg_start_decompress (&cinfo);
 
     width = cinfo.output_width;
@@ -408,7 +676,7 @@ chicle_jpeg_loader_new_from_mapping (ChicleFileMapping *mapping)
 
         if (convert_cmyk_to_rgb)
         {
-            if (jpeg_read_scanlines (&cinfo, &cmyk_buf, 1) < 1)
+            if (jpeg_read_scanlines (&cinfo, (JSAMPARRAY) &cmyk_buf, 1) < 1)
                 goto out;
 
             convert_cmyk_row_to_rgb (cmyk_buf, row_data, width);
@@ -420,17 +688,11 @@ chicle_jpeg_loader_new_from_mapping (ChicleFileMapping *mapping)
         }
     }
 
-    /* Orientation and cleanup */
-
     (void) jpeg_finish_decompress (&cinfo);
 
-    chicle_rotate_image (&frame_data, &width, &height, &rowstride, 3,
-                         chicle_invert_rotation (read_orientation (loader)));
-
-    loader->frame_data = frame_data;
-    loader->width = (gint) width;
-    loader->height = (gint) height;
-    loader->rowstride = (gint) rowstride;
+    *width_out = width;
+    *height_out = height;
+    *rowstride_out = rowstride;
 
     success = TRUE;
 
@@ -442,9 +704,88 @@ out:
 
     if (!success)
     {
+        g_free (frame_data);
+        frame_data = NULL;
+    }
+
+    return frame_data;
+}
+
+JpegLoader *
+chicle_jpeg_loader_new_from_mapping (ChicleFileMapping *mapping,
+                                     gint target_width, gint target_height)
+{
+    JpegLoader *loader = NULL;
+    JpegStream stream, preview;
+    gpointer frame_data = NULL;
+    guint width, height;
+    guint rowstride;
+    ChicleRotationType rot;
+    gboolean success = FALSE;
+
+    g_return_val_if_fail (mapping != NULL, NULL);
+
+    /* Check magic */
+
+    if (!have_any_apptype_magic (mapping))
+        goto out;
+
+    loader = chicle_jpeg_loader_new ();
+    loader->mapping = mapping;
+
+    /* Get file data */
+
+    loader->file_data = chicle_file_mapping_get_data (loader->mapping, &loader->file_data_len);
+    if (!loader->file_data)
+        goto out;
+
+    stream.data = loader->file_data;
+    stream.len = loader->file_data_len;
+
+    /* The target size applies after rotation */
+    rot = read_orientation (loader);
+    if (rotation_swaps_axes (rot))
+    {
+        gint t = target_width;
+        target_width = target_height;
+        target_height = t;
+    }
+
+    /* Decode. Prefer an embedded preview if allowed and one is suitable. */
+
+    if (use_previews
+        && get_stream_size (&stream, &width, &height)
+        && find_preview (loader, width, height, target_width, target_height, &preview))
+    {
+        frame_data = decode_stream (&preview, target_width, target_height,
+                                    &width, &height, &rowstride);
         if (frame_data)
-            g_free (frame_data);
+            loader->used_preview = TRUE;
+    }
+
+    if (!frame_data)
+        frame_data = decode_stream (&stream, target_width, target_height,
+                                    &width, &height, &rowstride);
 
+    if (!frame_data)
+        goto out;
+
+    /* Orientation applies to previews too, since they don't have their own */
+
+    chicle_rotate_image (&frame_data, &width, &height, &rowstride, 3,
+                         chicle_invert_rotation (rot));
+    loader->reoriented = (rot != CHICLE_ROTATION_NONE && rot != CHICLE_ROTATION_0);
+
+    loader->frame_data = frame_data;
+    loader->width = (gint) width;
+    loader->height = (gint) height;
+    loader->rowstride = (gint) rowstride;
+
+    success = TRUE;
+
+out:
+    if (!success)
+    {
         if (loader)
         {
             g_free (loader);
@@ -455,6 +796,42 @@ out:
     return loader;
 }
 
+/* Lets the loader substitute an embedded preview for the main image when
+ * the preview covers the target size. This is meant to be called once
+ * before any loaders are created. */
+void
+chicle_jpeg_loader_set_use_previews (gboolean use)
+{
+    use_previews = use;
+}
+
+/* Returns TRUE if the frame came from an embedded preview */
+gboolean
+chicle_jpeg_loader_get_used_preview (JpegLoader *loader)
+{
+    g_return_val_if_fail (loader != NULL, FALSE);
+
+    return loader->used_preview;
+}
+
+/* Returns TRUE if the frame shows the main image as stored in the file,
+ * with no orientation applied and no preview substituted */
+gboolean
+chicle_jpeg_loader_get_is_verbatim (JpegLoader *loader)
+{
+    g_return_val_if_fail (loader != NULL, FALSE);
+
+    return !loader->used_preview && !loader->reoriented;
+}
+
+/* Trades some quality for speed in all subsequent decodes. This is meant
+ * to be called once before any loaders are created. */
+void
+chicle_jpeg_loader_set_fast_decode (gboolean fast)
+{
+    fast_decode = fast;
+}
+
 void
 chicle_jpeg_loader_destroy (JpegLoader *loader)
 {
@@ -27,10 +27,16 @@ G_BEGIN_DECLS
 
 typedef struct JpegLoader JpegLoader;
 
-JpegLoader *chicle_jpeg_loader_new_from_mapping (ChicleFileMapping *mapping);
+JpegLoader *chicle_jpeg_loader_new_from_mapping (ChicleFileMapping *mapping,
+                                                 gint target_width,
+                                                 gint target_height);
+void chicle_jpeg_loader_set_fast_decode (gboolean fast);
+void chicle_jpeg_loader_set_use_previews (gboolean use);
 void chicle_jpeg_loader_destroy (JpegLoader *loader);
 
 gboolean chicle_jpeg_loader_get_is_animation (JpegLoader *loader);
+gboolean chicle_jpeg_loader_get_used_preview (JpegLoader *loader);
+gboolean chicle_jpeg_loader_get_is_verbatim (JpegLoader *loader);
 
 gconstpointer chicle_jpeg_loader_get_frame_data (JpegLoader *loader,
                                                  ChafaPixelType *pixel_type_out,
@@ -43,6 +43,7 @@
 #include "chicle-jxl-loader.h"
 #include "chicle-heif-loader.h"
 #include "chicle-coregraphics-loader.h"
+#include "chicle-stream-loader.h"
 
 typedef enum
 {
@@ -59,6 +60,9 @@ typedef enum
     LOADER_TYPE_COREGRAPHICS,
     LOADER_TYPE_HEIF,
 
+    /* Not probed for; see chicle_media_loader_new_stream() */
+    LOADER_TYPE_STREAM,
+
     LOADER_TYPE_LAST
 }
 LoaderType;
@@ -240,14 +244,36 @@ loader_vtable [LOADER_TYPE_LAST] =
         (gint (*) (gpointer)) chicle_heif_loader_get_frame_delay
     },
 #endif
+    [LOADER_TYPE_STREAM] =
+    {
+        NULL,
+        (void (*)(void)) NULL,
+        (gpointer (*)(gconstpointer)) NULL,
+        (void (*)(gpointer)) chicle_stream_loader_destroy,
+        (gboolean (*)(gpointer)) chicle_stream_loader_get_is_animation,
+        (void (*)(gpointer)) chicle_stream_loader_goto_first_frame,
+        (gboolean (*)(gpointer)) chicle_stream_loader_goto_next_frame,
+        (gconstpointer (*) (gpointer, gpointer, gpointer, gpointer, gpointer)) chicle_stream_loader_get_frame_data,
+        (gint (*) (gpointer)) chicle_stream_loader_get_frame_delay
+    },
 };
 
 struct ChicleMediaLoader
 {
     LoaderType loader_type;
     gpointer loader;
+
+    /* Owned by the format loader. Only set for formats that terminals can
+     * typically decode on their own. */
+    ChicleFileMapping *mapping;
+
+    /* Time it took to identify the format and open the file */
+    gint64 open_time_us;
 };
 
+/* Enough to hold the longest signature below */
+#define SNIFF_LEN 32
+
 static int
 ascii_strcasecmp_ptrs (const void *a, const void *b)
 {
@@ -256,49 +282,133 @@ ascii_strcasecmp_ptrs (const void *a, const void *b)
     return g_ascii_strcasecmp (*sa, *sb);
 }
 
+static gboolean
+have_magic (const guint8 *buf, gint buf_len, gint ofs, const gchar *magic, gint magic_len)
+{
+    return ofs + magic_len <= buf_len && !memcmp (buf + ofs, magic, magic_len);
+}
+
+/* Guesses the format from the first few bytes, so we can go straight to the
+ * right loader instead of letting each one reject the file in turn. This
+ * only needs to be good enough to pick a loader; the loader still does its
+ * own checks. Returns LOADER_TYPE_LAST if the data isn't recognized. */
+static LoaderType
+sniff_loader_type (ChicleFileMapping *mapping)
+{
+    guint8 buf [SNIFF_LEN];
+    gssize len;
+
+    len = chicle_file_mapping_read (mapping, buf, 0, SNIFF_LEN);
+    if (len < 4)
+        return LOADER_TYPE_LAST;
+
+    if (have_magic (buf, len, 0, "GIF87a", 6) || have_magic (buf, len, 0, "GIF89a", 6))
+        return LOADER_TYPE_GIF;
+    if (have_magic (buf, len, 0, "\x89PNG", 4))
+        return LOADER_TYPE_PNG;
+    if (have_magic (buf, len, 0, "\xff\xd8\xff", 3))
+        return LOADER_TYPE_JPEG;
+    if (have_magic (buf, len, 0, "qoif", 4))
+        return LOADER_TYPE_QOI;
+    if (have_magic (buf, len, 0, "II*\0", 4) || have_magic (buf, len, 0, "MM\0*", 4))
+        return LOADER_TYPE_TIFF;
+    if (have_magic (buf, len, 0, "RIFF", 4) && have_magic (buf, len, 8, "WEBP", 4))
+        return LOADER_TYPE_WEBP;
+    if (have_magic (buf, len, 0, "\xff\x0a", 2)
+        || have_magic (buf, len, 0, "\0\0\0\x0cJXL \x0d\x0a\x87\x0a", 12))
+        return LOADER_TYPE_JXL;
+
+    /* ISOBMFF. The major brand tells AVIF apart from other HEIF variants.
+     * If we guess wrong, the fallback probe will sort it out. */
+    if (have_magic (buf, len, 4, "ftyp", 4))
+    {
+        if (have_magic (buf, len, 8, "avif", 4) || have_magic (buf, len, 8, "avis", 4))
+            return LOADER_TYPE_AVIF;
+        return LOADER_TYPE_HEIF;
+    }
+
+    if (have_magic (buf, len, 0, "<svg", 4) || have_magic (buf, len, 0, "<?xml", 5))
+        return LOADER_TYPE_SVG;
+
+    /* XWD has no magic as such, but the big-endian file version is always 7 */
+    if (have_magic (buf, len, 4, "\0\0\0\x07", 4))
+        return LOADER_TYPE_XWD;
+
+    return LOADER_TYPE_LAST;
+}
+
+/* Tries a single loader. On success, the mapping is either transferred to
+ * the format loader or destroyed, and *mapping is cleared. */
+static gboolean
+try_loader (ChicleMediaLoader *loader, LoaderType loader_type, ChicleFileMapping **mapping,
+            const gchar *path, gint target_width, gint target_height)
+{
+    loader->loader_type = loader_type;
+
+    if (*mapping && loader_vtable [loader_type].new_from_mapping)
+    {
+        loader->loader = (*(NewFromMappingFunc *) loader_vtable [loader_type].new_from_mapping)
+            (*mapping, target_width, target_height);
+    }
+    else if (loader_vtable [loader_type].new_from_path)
+    {
+        loader->loader = loader_vtable [loader_type].new_from_path (path);
+        if (loader->loader)
+            chicle_file_mapping_destroy (*mapping);
+    }
+
+    if (!loader->loader)
+        return FALSE;
+
+    if (loader_vtable [loader_type].new_from_mapping
+        && (loader_type == LOADER_TYPE_PNG
+            || loader_type == LOADER_TYPE_JPEG
+            || loader_type == LOADER_TYPE_GIF
+            || loader_type == LOADER_TYPE_TIFF))
+        loader->mapping = *mapping;
+
+    *mapping = NULL;
+    return TRUE;
+}
+
 ChicleMediaLoader *
 chicle_media_loader_new (const gchar *path, gint target_width, gint target_height, GError **error)
 {
     ChicleMediaLoader *loader;
     ChicleFileMapping *mapping = NULL;
+    LoaderType sniffed_type;
     gboolean success = FALSE;
+    gint64 start_time;
     gint i;
 
     g_return_val_if_fail (path != NULL, NULL);
 
+    start_time = g_get_monotonic_time ();
+
     loader = g_new0 (ChicleMediaLoader, 1);
     mapping = chicle_file_mapping_new (path);
 
     if (!chicle_file_mapping_open_now (mapping, error))
         goto out;
 
-    for (i = 0; i < LOADER_TYPE_LAST && !loader->loader; i++)
-    {
-        loader->loader_type = i;
+    sniffed_type = sniff_loader_type (mapping);
 
-        if (mapping && loader_vtable [i].new_from_mapping)
-        {
-            loader->loader = (*(NewFromMappingFunc *) loader_vtable [i].new_from_mapping)
-                (mapping, target_width, target_height);
-        }
-        else if (loader_vtable [i].new_from_path)
-        {
-            loader->loader = loader_vtable [i].new_from_path (path);
-            if (loader->loader)
-                chicle_file_mapping_destroy (mapping);
-        }
-
-        if (loader->loader)
+    if (sniffed_type == LOADER_TYPE_LAST
+        || !try_loader (loader, sniffed_type, &mapping, path, target_width, target_height))
+    {
+        /* Unrecognized, or the loader disagreed. Let everyone else have a go */
+        for (i = 0; i < LOADER_TYPE_STREAM; i++)
         {
-            /* Mapping was either transferred to the loader or destroyed by us above */
-            mapping = NULL;
-            break;
+            if (i != (gint) sniffed_type
+                && try_loader (loader, i, &mapping, path, target_width, target_height))
+                break;
         }
     }
 
     if (!loader->loader)
         goto out;
 
+    loader->open_time_us = g_get_monotonic_time () - start_time;
     success = TRUE;
 
 out:
@@ -320,6 +430,54 @@ out:
     return loader;
 }
 
+/* Lets loaders trade some quality for speed where their libraries offer
+ * the option. Must be called before any loaders are created. */
+void
+chicle_media_loader_set_fast_decode (gboolean fast)
+{
+#ifdef HAVE_JPEG
+    chicle_jpeg_loader_set_fast_decode (fast);
+#else
+    (void) fast;
+#endif
+}
+
+/* Lets loaders show a preview embedded in the file instead of the main
+ * image, when the preview covers the target size. Must be called before
+ * any loaders are created. */
+void
+chicle_media_loader_set_use_previews (G_GNUC_UNUSED gboolean use)
+{
+#ifdef HAVE_JPEG
+    chicle_jpeg_loader_set_use_previews (use);
+#endif
+#ifdef HAVE_TIFF
+    chicle_tiff_loader_set_use_previews (use);
+#endif
+}
+
+/* Reads raw frames from a pipe or fifo as they arrive, instead of loading
+ * a file. There's no format detection, since we can't look ahead. */
+ChicleMediaLoader *
+chicle_media_loader_new_stream (const gchar *path, ChicleStreamFormat format,
+                                gint width, gint height, GError **error)
+{
+    ChicleMediaLoader *loader;
+    ChicleStreamLoader *stream_loader;
+
+    g_return_val_if_fail (path != NULL, NULL);
+
+    stream_loader = chicle_stream_loader_new (path, format, width, height, error);
+    if (!stream_loader)
+        return NULL;
+
+    loader = g_new0 (ChicleMediaLoader, 1);
+    loader->loader_type = LOADER_TYPE_STREAM;
+    loader->loader = stream_loader;
+
+    return loader;
+}
+
 void
 chicle_media_loader_destroy (ChicleMediaLoader *loader)
 {
@@ -338,6 +496,13 @@ chicle_media_loader_get_is_animation (ChicleMediaLoader *loader)
     return loader_vtable [loader->loader_type].get_is_animation (loader->loader);
 }
 
+/* Streams are played once, since earlier frames are gone */
+gboolean
+chicle_media_loader_get_can_loop (ChicleMediaLoader *loader)
+{
+    return loader->loader_type != LOADER_TYPE_STREAM;
+}
+
 void
 chicle_media_loader_goto_first_frame (ChicleMediaLoader *loader)
 {
@@ -367,6 +532,75 @@ chicle_media_loader_get_frame_delay (ChicleMediaLoader *loader)
     return loader_vtable [loader->loader_type].get_frame_delay (loader->loader);
 }
 
+/* Returns the unmodified file contents if they're in a common format
+ * (PNG, JPEG, GIF or TIFF) that the terminal may be able to display
+ * directly, and it would show the same thing we do. Returns NULL otherwise.
+ * The data belongs to the loader. */
+gconstpointer
+chicle_media_loader_get_file_data (ChicleMediaLoader *loader, gsize *length_out)
+{
+    if (!loader->mapping)
+        return NULL;
+
+    switch (loader->loader_type)
+    {
+        case LOADER_TYPE_PNG:
+        case LOADER_TYPE_GIF:
+            break;
+#ifdef HAVE_JPEG
+        case LOADER_TYPE_JPEG:
+            if (!chicle_jpeg_loader_get_is_verbatim (loader->loader))
+                return NULL;
+            break;
+#endif
+#ifdef HAVE_TIFF
+        case LOADER_TYPE_TIFF:
+            if (!chicle_tiff_loader_get_is_verbatim (loader->loader))
+                return NULL;
+            break;
+#endif
+        default:
+            return NULL;
+    }
+
+    /* The terminal would play the frames on its own, ignoring --animate,
+     * --duration and our loop handling */
+    if (chicle_media_loader_get_is_animation (loader))
+        return NULL;
+
+    return chicle_file_mapping_get_data (loader->mapping, length_out);
+}
+
+/* Returns TRUE if the image was taken from an embedded preview */
+gboolean
+chicle_media_loader_get_used_preview (ChicleMediaLoader *loader)
+{
+#ifdef HAVE_JPEG
+    if (loader->loader_type == LOADER_TYPE_JPEG)
+        return chicle_jpeg_loader_get_used_preview (loader->loader);
+#endif
+#ifdef HAVE_TIFF
+    if (loader->loader_type == LOADER_TYPE_TIFF)
+        return chicle_tiff_loader_get_used_preview (loader->loader);
+#endif
+
+    return FALSE;
+}
+
+const gchar *
+chicle_media_loader_get_format_name (ChicleMediaLoader *loader)
+{
+    return loader_vtable [loader->loader_type].name;
+}
+
+/* Returns the time spent identifying the format and opening the file, in
+ * microseconds. Decoding happens later and isn't included. */
+gint64
+chicle_media_loader_get_open_time_us (ChicleMediaLoader *loader)
+{
+    return loader->open_time_us;
+}
+
 gchar **
 chicle_get_loader_names (void)
 {
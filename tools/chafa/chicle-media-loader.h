@@ -21,6 +21,7 @@
 #define __CHICLE_MEDIA_LOADER_H__
 
 #include <glib.h>
+#include "chicle-stream-loader.h"
 
 G_BEGIN_DECLS
 
@@ -30,9 +31,17 @@ ChicleMediaLoader *chicle_media_loader_new (const gchar *path,
                                             gint target_width,
                                             gint target_height,
                                             GError **error);
+ChicleMediaLoader *chicle_media_loader_new_stream (const gchar *path,
+                                                   ChicleStreamFormat format,
+                                                   gint width,
+                                                   gint height,
+                                                   GError **error);
+void chicle_media_loader_set_fast_decode (gboolean fast);
+void chicle_media_loader_set_use_previews (gboolean use);
 void chicle_media_loader_destroy (ChicleMediaLoader *loader);
 
 gboolean chicle_media_loader_get_is_animation (ChicleMediaLoader *loader);
+gboolean chicle_media_loader_get_can_loop (ChicleMediaLoader *loader);
 
 void chicle_media_loader_goto_first_frame (ChicleMediaLoader *loader);
 gboolean chicle_media_loader_goto_next_frame (ChicleMediaLoader *loader);
@@ -43,6 +52,11 @@ gconstpointer chicle_media_loader_get_frame_data (ChicleMediaLoader *loader,
                                                   gint *height_out,
                                                   gint *rowstride_out);
 gint chicle_media_loader_get_frame_delay (ChicleMediaLoader *loader);
+gconstpointer chicle_media_loader_get_file_data (ChicleMediaLoader *loader,
+                                                gsize *length_out);
+gboolean chicle_media_loader_get_used_preview (ChicleMediaLoader *loader);
+const gchar *chicle_media_loader_get_format_name (ChicleMediaLoader *loader);
+gint64 chicle_media_loader_get_open_time_us (ChicleMediaLoader *loader);
 
 gchar **chicle_get_loader_names (void);
 
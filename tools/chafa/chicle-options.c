@@ -219,11 +219,17 @@ print_summary (void)
     "                     to wait for a response, in seconds. Defaults to "
                           G_STRINGIFY (CHICLE_PROBE_DURATION_DEFAULT) ".\n"
     "      --probe-mode=ARG  How to probe the terminal [any, ctty, stdio].\n"
+    "      --probe-cache=BOOL  Reuse probe results from earlier runs in the same\n"
+    "                     terminal session [on, off]. Defaults to off.\n"
     "      --version      Show version.\n"
     "  -v, --verbose      Be verbose.\n"
 
     "\nOutput encoding:\n"
 
+    "      --compress=NUM  Compress pixel data where the graphics protocol allows\n"
+    "                     it [0-9]. 0 disables, 9 is the slowest and most compact.\n"
+    "                     Useful over slow links. Applies to kitty and iterm.\n"
+    "                     Defaults to 0.\n"
     "  -f, --format=FORMAT  Set output format; one of [iterm, kitty, sixels,\n"
     "                     symbols]. Iterm, kitty and sixels yield much higher\n"
     "                     quality but enjoy limited support. Symbols mode yields\n"
@@ -277,12 +283,23 @@ print_summary (void)
 
     "      --animate=BOOL  Whether to allow animation [on, off]. Defaults to on.\n"
     "                     When off, will show a still frame from each animation.\n"
+    "      --bitrate=RATE  Bandwidth of the link to the terminal, in bits per\n"
+    "                     second (e.g. 115200, 512k, 2M). Animations will reduce\n"
+    "                     color depth and other details as needed to keep up.\n"
     "  -d, --duration=SECONDS  How long to show each file. If showing a single file,\n"
     "                     defaults to zero for a still image and infinite for an\n"
     "                     animation. For multiple files, defaults to zero. Animations\n"
     "                     will always be played through at least once.\n"
+    "      --frame-bytes=NUM  Like --bitrate, but as a size budget per frame.\n"
+    "      --realtime=BOOL  Keep animations in step with the clock [on, off]. Late\n"
+    "                     frames are dropped, and the work factor is lowered if\n"
+    "                     rendering can't keep up. Defaults to off.\n"
     "      --speed=SPEED  Animation speed. Either a unitless multiplier, or a real\n"
     "                     number followed by \"fps\" to apply a specific framerate.\n"
+    "      --stream=FORMAT  Play a stream of raw frames from a pipe or fifo, e.g.\n"
+    "                     from a video decoder. One of [y4m, rgb, rgba]. Implies\n"
+    "                     --realtime on.\n"
+    "      --stream-size=WxH  Frame size in pixels for rgb and rgba streams.\n"
     "      --watch        Watch a single input file, redisplaying it whenever its\n"
     "                     contents change. Will run until manually interrupted\n"
     "                     or, if --duration is set, until it expires.\n"
@@ -311,6 +328,9 @@ print_summary (void)
 
     "\nResource allocation:\n"
 
+    "      --previews=BOOL  Show the preview embedded in a photo instead of the\n"
+    "                     full image when it's big enough [on, off]. Faster, but\n"
+    "                     previews may not reflect later edits. Defaults to off.\n"
     "      --threads=NUM  Maximum number of CPU threads to use. If left unspecified\n"
     "                     or negative, this will equal available CPU cores.\n"
     "  -w, --work=NUM     How hard to work in terms of CPU and memory [1-9]. 1 is the\n"
@@ -453,6 +473,19 @@ parse_probe_mode_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value
     return result;
 }
 
+static gboolean
+parse_probe_cache_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
+{
+    gboolean result;
+
+    result = parse_boolean_token (value, &options.probe_cache);
+    if (!result)
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                     "Probe cache must be one of [on, off].");
+
+    return result;
+}
+
 static gboolean
 parse_colors_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
 {
@@ -810,6 +843,65 @@ out:
     return success;
 }
 
+/* Parses a positive number with an optional decimal SI suffix [k, M, G] */
+static gboolean
+parse_si_quantity (const gchar *str, gdouble *value_out)
+{
+    gdouble value;
+    gchar *endptr;
+
+    value = g_strtod (str, &endptr);
+    if (endptr == str || value <= 0.0)
+        return FALSE;
+
+    while (g_ascii_isspace (*endptr))
+        endptr++;
+
+    if (*endptr == 'k' || *endptr == 'K')
+        value *= 1000.0;
+    else if (*endptr == 'M')
+        value *= 1000000.0;
+    else if (*endptr == 'G')
+        value *= 1000000000.0;
+    else if (*endptr != '\0')
+        return FALSE;
+
+    if (*endptr != '\0' && endptr [1] != '\0')
+        return FALSE;
+
+    *value_out = value;
+    return TRUE;
+}
+
+static gboolean
+parse_bitrate_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
+{
+    if (!parse_si_quantity (value, &options.bitrate))
+    {
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                     "Bitrate must be a positive number, optionally followed by k, M or G.");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+parse_frame_bytes_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
+{
+    gdouble d;
+
+    if (!parse_si_quantity (value, &d) || d < 1.0 || d > G_MAXINT)
+    {
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                     "Frame size must be a positive number, optionally followed by k, M or G.");
+        return FALSE;
+    }
+
+    options.frame_bytes = d;
+    return TRUE;
+}
+
 static gboolean
 parse_symbols_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
 {
@@ -826,6 +918,7 @@ parse_symbols_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G
 static gboolean
 parse_fill_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
 {
+    options.fill_specified = TRUE;
     return chafa_symbol_map_apply_selectors (options.fill_symbol_map, value, error);
 }
 
@@ -969,6 +1062,25 @@ parse_size_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GN
     return result;
 }
 
+static gboolean
+parse_stream_size_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
+{
+    gint width, height;
+
+    parse_2d_size (value, &width, &height);
+
+    if (width < 1 || height < 1)
+    {
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                     "Stream size must be specified as [width]x[height], e.g. 640x360.");
+        return FALSE;
+    }
+
+    options.stream_width = width;
+    options.stream_height = height;
+    return TRUE;
+}
+
 static gboolean
 parse_grid_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
 {
@@ -1278,6 +1390,41 @@ parse_animate_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G
     return result;
 }
 
+static gboolean
+parse_realtime_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
+{
+    gboolean result;
+
+    result = parse_boolean_token (value, &options.realtime);
+    if (!result)
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                     "Realtime mode must be one of [on, off].");
+
+    options.realtime_set = TRUE;
+    return result;
+}
+
+static gboolean
+parse_stream_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
+{
+    gboolean result = TRUE;
+
+    if (!g_ascii_strcasecmp (value, "y4m"))
+        options.stream_format = CHICLE_STREAM_FORMAT_Y4M;
+    else if (!g_ascii_strcasecmp (value, "rgb"))
+        options.stream_format = CHICLE_STREAM_FORMAT_RGB;
+    else if (!g_ascii_strcasecmp (value, "rgba"))
+        options.stream_format = CHICLE_STREAM_FORMAT_RGBA;
+    else
+    {
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                     "Stream format must be one of [y4m, rgb, rgba].");
+        result = FALSE;
+    }
+
+    return result;
+}
+
 static gboolean
 parse_center_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
 {
@@ -1320,6 +1467,19 @@ parse_link_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GN
     return result;
 }
 
+static gboolean
+parse_previews_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
+{
+    gboolean result;
+
+    result = parse_boolean_token (value, &options.use_previews);
+    if (!result)
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                     "Previews must be one of [on, off].");
+
+    return result;
+}
+
 static gboolean
 parse_preprocess_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value, G_GNUC_UNUSED gpointer data, GError **error)
 {
@@ -1329,6 +1489,8 @@ parse_preprocess_arg (G_GNUC_UNUSED const gchar *option_name, const gchar *value
     if (!result)
         g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
                      "Preprocessing must be one of [on, off].");
+    else
+        options.preprocess_set = TRUE;
 
     return result;
 }
@@ -1848,11 +2010,13 @@ chicle_parse_options (int *argc, char **argv [])
         { "align",       '\0', 0, G_OPTION_ARG_CALLBACK, parse_align_arg,       "Align", NULL },
         { "animate",     '\0', 0, G_OPTION_ARG_CALLBACK, parse_animate_arg,     "Animate", NULL },
         { "bg",          '\0', 0, G_OPTION_ARG_CALLBACK, parse_bg_color_arg,    "Background color of display", NULL },
+        { "bitrate",     '\0', 0, G_OPTION_ARG_CALLBACK, parse_bitrate_arg,     "Link bitrate", NULL },
         { "center",      'C',  0, G_OPTION_ARG_CALLBACK, parse_center_arg,      "Center", NULL },
         { "clear",       '\0', 0, G_OPTION_ARG_NONE,     &options.clear,        "Clear", NULL },
         { "colors",      'c',  0, G_OPTION_ARG_CALLBACK, parse_colors_arg,      "Colors (none, 2, 16, 256, 240 or full)", NULL },
         { "color-extractor", '\0', 0, G_OPTION_ARG_CALLBACK, parse_color_extractor_arg, "Color extractor (average or median)", NULL },
         { "color-space", '\0', 0, G_OPTION_ARG_CALLBACK, parse_color_space_arg, "Color space (rgb or din99d)", NULL },
+        { "compress",    '\0', 0, G_OPTION_ARG_INT,      &options.compression_level, "Compression level", NULL },
         { "dither",      '\0', 0, G_OPTION_ARG_CALLBACK, parse_dither_arg,      "Dither", NULL },
         { "dither-grain",'\0', 0, G_OPTION_ARG_CALLBACK, parse_dither_grain_arg, "Dither grain", NULL },
         { "dither-intensity", '\0', 0, G_OPTION_ARG_CALLBACK, parse_dither_intensity_arg, "Dither intensity", NULL },
@@ -1867,6 +2031,7 @@ chicle_parse_options (int *argc, char **argv [])
         { "fill",        '\0', 0, G_OPTION_ARG_CALLBACK, parse_fill_arg,        "Fill symbols", NULL },
         { "fit-width",   '\0', 0, G_OPTION_ARG_NONE,     &options.fit_to_width, "Fit to width", NULL },
         { "font-ratio",  '\0', 0, G_OPTION_ARG_CALLBACK, parse_font_ratio_arg,  "Font ratio", NULL },
+        { "frame-bytes", '\0', 0, G_OPTION_ARG_CALLBACK, parse_frame_bytes_arg, "Frame size budget", NULL },
         { "format",      'f',  0, G_OPTION_ARG_CALLBACK, parse_format_arg,      "Format of output pixel data (iterm, kitty, sixels or symbols)", NULL },
         { "fuzz-options", '\0', 0, G_OPTION_ARG_NONE,    &options.fuzz_options, "Fuzz the options", NULL },
         { "glyph-file",  '\0', 0, G_OPTION_ARG_CALLBACK, parse_glyph_file_arg,  "Glyph file", NULL },
@@ -1882,12 +2047,17 @@ chicle_parse_options (int *argc, char **argv [])
         { "passthrough", '\0', 0, G_OPTION_ARG_CALLBACK, parse_passthrough_arg, "Passthrough", NULL },
         { "polite",      '\0', 0, G_OPTION_ARG_CALLBACK, parse_polite_arg,      "Polite", NULL },
         { "preprocess",  'p',  0, G_OPTION_ARG_CALLBACK, parse_preprocess_arg,  "Preprocessing", NULL },
+        { "previews",    '\0', 0, G_OPTION_ARG_CALLBACK, parse_previews_arg,    "Embedded previews", NULL },
         { "probe",       '\0', 0, G_OPTION_ARG_CALLBACK, parse_probe_arg,       "Terminal probing", NULL },
         { "probe-mode",  '\0', 0, G_OPTION_ARG_CALLBACK, parse_probe_mode_arg,  "Probe mode", NULL },
+        { "probe-cache", '\0', 0, G_OPTION_ARG_CALLBACK, parse_probe_cache_arg, "Probe cache", NULL },
+        { "realtime",    '\0', 0, G_OPTION_ARG_CALLBACK, parse_realtime_arg,    "Real-time playback", NULL },
         { "relative",    '\0', 0, G_OPTION_ARG_CALLBACK, parse_relative_arg,    "Relative", NULL },
         { "scale",       '\0', 0, G_OPTION_ARG_CALLBACK, parse_scale_arg,       "Scale", NULL },
         { "size",        's',  0, G_OPTION_ARG_CALLBACK, parse_size_arg,        "Output size", NULL },
         { "speed",       '\0', 0, G_OPTION_ARG_CALLBACK, parse_anim_speed_arg,  "Animation speed", NULL },
+        { "stream",      '\0', 0, G_OPTION_ARG_CALLBACK, parse_stream_arg,      "Raw frame stream", NULL },
+        { "stream-size", '\0', 0, G_OPTION_ARG_CALLBACK, parse_stream_size_arg, "Raw frame size", NULL },
         { "stretch",     '\0', 0, G_OPTION_ARG_NONE,     &options.stretch,      "Stretch image to fix output dimensions", NULL },
         { "symbols",     '\0', 0, G_OPTION_ARG_CALLBACK, parse_symbols_arg,     "Output symbols", NULL },
         { "threads",     '\0', 0, G_OPTION_ARG_INT,      &options.n_threads,    "Number of threads", NULL },
@@ -2042,6 +2212,7 @@ chicle_parse_options (int *argc, char **argv [])
              || options.probe == CHICLE_TRISTATE_AUTO)
             && options.probe_duration >= 0.0)
         {
+            chafa_term_set_probe_cache_enabled (probe_term, options.probe_cache);
             chafa_term_sync_probe (probe_term, options.probe_duration * 1000);
 
             if (!options.pixel_mode_set)
@@ -2307,6 +2478,12 @@ chicle_parse_options (int *argc, char **argv [])
         goto out;
     }
 
+    if (options.compression_level < 0 || options.compression_level > 9)
+    {
+        g_printerr ("%s: Compression level must be in the range [0-9].\n", options.executable_name);
+        goto out;
+    }
+
     if (options.transparency_threshold == G_MAXDOUBLE)
         options.transparency_threshold = 0.5;
     else
@@ -2365,6 +2542,32 @@ chicle_parse_options (int *argc, char **argv [])
         }
     }
 
+    if (options.stream_format != CHICLE_STREAM_FORMAT_NONE)
+    {
+        if (g_list_length (options.args) != 1 || chicle_path_queue_get_length (global_path_queue) != 0)
+        {
+            g_printerr ("%s: Can only use --stream with exactly one input.\n", options.executable_name);
+            goto out;
+        }
+
+        if (options.watch || options.grid_width > 0 || options.grid_height > 0)
+        {
+            g_printerr ("%s: Can't use --stream with --watch or --grid.\n", options.executable_name);
+            goto out;
+        }
+
+        if (options.stream_format != CHICLE_STREAM_FORMAT_Y4M
+            && (options.stream_width < 1 || options.stream_height < 1))
+        {
+            g_printerr ("%s: Must specify --stream-size for rgb and rgba streams.\n", options.executable_name);
+            goto out;
+        }
+
+        /* A live stream can't wait for us */
+        if (!options.realtime_set)
+            options.realtime = TRUE;
+    }
+
     if (options.zoom)
     {
         g_printerr ("%s: Warning: --zoom is deprecated, use --scale max instead.\n",
@@ -47,6 +47,7 @@ G_BEGIN_DECLS
 
 #include <chafa.h>
 #include "chicle-named-colors.h"
+#include "chicle-stream-loader.h"
 
 /* Include after glib.h for G_OS_WIN32 */
 #ifdef G_OS_WIN32
@@ -105,12 +106,15 @@ typedef struct
     ChafaSymbolMap *symbol_map;
     ChafaSymbolMap *fill_symbol_map;
     gboolean symbols_specified;
+    gboolean fill_specified;
     gboolean is_interactive;
     gboolean clear;
     gboolean verbose;
     gboolean invert;
     gboolean preprocess;
+    gboolean preprocess_set;
     gboolean polite;
+    gboolean probe_cache;
     gboolean stretch;
     gboolean zoom;
     gboolean watch;
@@ -136,7 +140,9 @@ typedef struct
     gdouble scale;
     gdouble font_ratio;
     gint work_factor;
+    gboolean use_previews;
     gint optimization_level;
+    gint compression_level;
     gint n_threads;
     ChafaOptimizations optimizations;
     ChafaPassthrough passthrough;
@@ -156,6 +162,20 @@ typedef struct
      * eliminate interframe delay altogether. */
     gdouble anim_speed_multiplier;
 
+    /* Lock animations to the wall clock, dropping late frames */
+    gboolean realtime;
+    gboolean realtime_set;
+
+    /* Raw frame input. Width and height are only used for headerless
+     * formats. */
+    ChicleStreamFormat stream_format;
+    gint stream_width, stream_height;
+
+    /* Output budget for animations. If either is > 0, rate control is
+     * enabled. Bitrate is in bits per second. */
+    gdouble bitrate;
+    gint frame_bytes;
+
     ChicleTristate use_exact_size;
 
     /* Automatically set if terminal size is detected and there is
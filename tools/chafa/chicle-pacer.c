@@ -0,0 +1,207 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include "config.h"
+
+#include <chafa.h>
+#include "chicle-pacer.h"
+
+/* Lowering the work factor takes this many late frames in a row. Raising
+ * it again takes more frames in a row with plenty of time to spare, so we
+ * don't oscillate between two settings. */
+#define LATE_FRAMES_MIN 8
+#define EARLY_FRAMES_MIN 32
+
+/* If we fall this far behind, e.g. because the input stalled, the timeline
+ * is restarted at the current frame instead of dropping everything until
+ * we've caught up */
+#define LAG_MAX_US (1000 * 1000)
+
+/* Locks animation playback to the wall clock. Each frame gets a window on
+ * a presentation timeline that starts with the first frame. Frames whose
+ * window will have passed by the time they could be rendered are dropped,
+ * and if frames keep coming in late, the work factor is lowered. */
+struct ChiclePacer
+{
+    gint work_factor_max;
+    gint work_factor;
+
+    /* Monotonic time at which the timeline started */
+    gint64 start_us;
+
+    /* Window of the current frame, relative to start_us */
+    gint64 pts_us;
+    gint64 next_pts_us;
+
+    /* When the current frame was begun, and a running average of the time
+     * it takes from there until a frame can be written */
+    gint64 begin_us;
+    gint64 cost_us;
+
+    gint n_shown;
+    gint n_dropped;
+    gint n_dropped_run;
+    gint n_late;
+    gint n_early;
+
+    guint started : 1;
+};
+
+ChiclePacer *
+chicle_pacer_new (gint work_factor)
+{
+    ChiclePacer *pacer;
+
+    pacer = g_new0 (ChiclePacer, 1);
+    pacer->work_factor_max = CLAMP (work_factor, 1, 9);
+    pacer->work_factor = pacer->work_factor_max;
+
+    return pacer;
+}
+
+void
+chicle_pacer_destroy (ChiclePacer *pacer)
+{
+    g_free (pacer);
+}
+
+/* Advances the timeline by one frame. Returns TRUE if the frame should be
+ * rendered, or FALSE if it should be dropped. */
+gboolean
+chicle_pacer_begin_frame (ChiclePacer *pacer, gdouble frame_interval_s)
+{
+    gint64 now_us = g_get_monotonic_time ();
+    gint64 interval_us = MAX (frame_interval_s * 1000000.0, 0.0);
+    gboolean is_first = FALSE;
+
+    if (!pacer->started)
+    {
+        pacer->start_us = now_us;
+        pacer->started = TRUE;
+        is_first = TRUE;
+    }
+
+    pacer->pts_us = pacer->next_pts_us;
+    pacer->next_pts_us += interval_us;
+
+    if (now_us - (pacer->start_us + pacer->pts_us) > LAG_MAX_US)
+    {
+        pacer->start_us = now_us - pacer->pts_us;
+        is_first = TRUE;
+    }
+
+    /* The first frame is always shown. Without a delay, there's no
+     * timeline to keep up with. */
+    if (!is_first && interval_us > 0
+        && now_us + pacer->cost_us > pacer->start_us + pacer->next_pts_us)
+    {
+        pacer->n_dropped++;
+        pacer->n_dropped_run++;
+        return FALSE;
+    }
+
+    pacer->begin_us = now_us;
+    return TRUE;
+}
+
+/* Called when the current frame has been rendered and the previous one has
+ * drained, just before waiting for the frame's window to start. */
+void
+chicle_pacer_frame_ready (ChiclePacer *pacer)
+{
+    gint64 now_us = g_get_monotonic_time ();
+    gint64 cost_us = now_us - pacer->begin_us;
+    gint64 frame_start_us = pacer->start_us + pacer->pts_us;
+    gint64 interval_us = pacer->next_pts_us - pacer->pts_us;
+
+    pacer->cost_us = pacer->n_shown > 0 ? (pacer->cost_us * 3 + cost_us) / 4 : cost_us;
+
+    if (pacer->n_dropped_run > 0 || now_us > frame_start_us)
+    {
+        pacer->n_early = 0;
+
+        if (++pacer->n_late >= LATE_FRAMES_MIN && pacer->work_factor > 1)
+        {
+            pacer->work_factor--;
+            pacer->n_late = 0;
+        }
+    }
+    else if (now_us + interval_us / 2 < frame_start_us)
+    {
+        pacer->n_late = 0;
+
+        if (++pacer->n_early >= EARLY_FRAMES_MIN
+            && pacer->work_factor < pacer->work_factor_max)
+        {
+            pacer->work_factor++;
+            pacer->n_early = 0;
+        }
+    }
+    else
+    {
+        pacer->n_late = 0;
+        pacer->n_early = 0;
+    }
+
+    pacer->n_dropped_run = 0;
+    pacer->n_shown++;
+}
+
+/* Monotonic time at which the current frame should be written */
+gint64
+chicle_pacer_get_frame_start (ChiclePacer *pacer)
+{
+    return pacer->start_us + pacer->pts_us;
+}
+
+/* Monotonic time at which the current frame should be replaced */
+gint64
+chicle_pacer_get_frame_end (ChiclePacer *pacer)
+{
+    return pacer->start_us + pacer->next_pts_us;
+}
+
+/* Position on the timeline at the end of the current frame, in seconds */
+gdouble
+chicle_pacer_get_elapsed (ChiclePacer *pacer)
+{
+    return pacer->next_pts_us / 1000000.0;
+}
+
+void
+chicle_pacer_apply (ChiclePacer *pacer, ChafaCanvasConfig *config)
+{
+    if (pacer->work_factor == pacer->work_factor_max)
+        return;
+
+    /* Same normalization as the -w option */
+    chafa_canvas_config_set_work_factor (config, (pacer->work_factor - 1) / 8.0f);
+}
+
+void
+chicle_pacer_get_stats (ChiclePacer *pacer, gint *n_shown_out, gint *n_dropped_out,
+                        gint *work_factor_out)
+{
+    if (n_shown_out)
+        *n_shown_out = pacer->n_shown;
+    if (n_dropped_out)
+        *n_dropped_out = pacer->n_dropped;
+    if (work_factor_out)
+        *work_factor_out = pacer->work_factor;
+}
@@ -0,0 +1,44 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __CHICLE_PACER_H__
+#define __CHICLE_PACER_H__
+
+#include <chafa.h>
+
+G_BEGIN_DECLS
+
+typedef struct ChiclePacer ChiclePacer;
+
+ChiclePacer *chicle_pacer_new (gint work_factor);
+void chicle_pacer_destroy (ChiclePacer *pacer);
+
+gboolean chicle_pacer_begin_frame (ChiclePacer *pacer, gdouble frame_interval_s);
+void chicle_pacer_frame_ready (ChiclePacer *pacer);
+gint64 chicle_pacer_get_frame_start (ChiclePacer *pacer);
+gint64 chicle_pacer_get_frame_end (ChiclePacer *pacer);
+gdouble chicle_pacer_get_elapsed (ChiclePacer *pacer);
+
+void chicle_pacer_apply (ChiclePacer *pacer, ChafaCanvasConfig *config);
+void chicle_pacer_get_stats (ChiclePacer *pacer, gint *n_shown_out, gint *n_dropped_out,
+                             gint *work_factor_out);
+
+G_END_DECLS
+
+#endif /* __CHICLE_PACER_H__ */
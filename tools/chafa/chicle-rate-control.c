@@ -0,0 +1,325 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include "config.h"
+
+#include <chafa.h>
+#include "chicle-rate-control.h"
+
+/* Each level trades away some quality for smaller output. Level 0 leaves
+ * the user's settings alone. See chicle_rate_control_apply(). */
+#define LEVEL_MAX 5
+
+/* A frame over budget steps the level up right away. Stepping down takes
+ * this many frames in a row that came in under half the budget, so we
+ * don't oscillate between two levels. */
+#define UNDER_BUDGET_FRAMES_MIN 8
+
+typedef enum
+{
+    STEP_OPTIMIZE,
+    STEP_REDUCE_COLORS,
+    STEP_NO_FILL,
+    STEP_COMPRESS
+}
+Step;
+
+static const Step symbol_steps [LEVEL_MAX] =
+{
+    STEP_OPTIMIZE,
+    STEP_REDUCE_COLORS,
+    STEP_NO_FILL,
+    STEP_REDUCE_COLORS,
+    STEP_REDUCE_COLORS
+};
+
+static const Step sixel_steps [] =
+{
+    STEP_OPTIMIZE,
+    STEP_REDUCE_COLORS,
+    STEP_REDUCE_COLORS
+};
+
+static const Step image_steps [] =
+{
+    STEP_COMPRESS,
+    STEP_COMPRESS,
+    STEP_COMPRESS,
+    STEP_COMPRESS
+};
+
+struct ChicleRateControl
+{
+    gdouble bitrate;
+    gint frame_bytes;
+    gint level;
+    gint level_max;
+    gint n_under_budget;
+
+    guint have_fill_symbols : 1;
+    guint have_level_max : 1;
+
+    /* The first frame after a level change is a full redraw, so its size
+     * says little about the new level */
+    guint skip_next : 1;
+};
+
+static ChafaCanvasMode
+reduce_color_depth (ChafaCanvasMode mode)
+{
+    switch (mode)
+    {
+        case CHAFA_CANVAS_MODE_TRUECOLOR:
+            return CHAFA_CANVAS_MODE_INDEXED_256;
+        case CHAFA_CANVAS_MODE_INDEXED_256:
+        case CHAFA_CANVAS_MODE_INDEXED_240:
+            return CHAFA_CANVAS_MODE_INDEXED_16;
+        case CHAFA_CANVAS_MODE_INDEXED_16:
+            return CHAFA_CANVAS_MODE_INDEXED_16_8;
+        case CHAFA_CANVAS_MODE_INDEXED_16_8:
+            return CHAFA_CANVAS_MODE_INDEXED_8;
+        default:
+            return mode;
+    }
+}
+
+/* Sixel output grows with the number of colors in use. The fixed 256-color
+ * palette is no smaller than a dynamic one, so we go straight to 16. */
+static ChafaCanvasMode
+reduce_sixel_color_depth (ChafaCanvasMode mode)
+{
+    switch (mode)
+    {
+        case CHAFA_CANVAS_MODE_TRUECOLOR:
+        case CHAFA_CANVAS_MODE_INDEXED_256:
+        case CHAFA_CANVAS_MODE_INDEXED_240:
+            return CHAFA_CANVAS_MODE_INDEXED_16;
+        case CHAFA_CANVAS_MODE_INDEXED_16:
+        case CHAFA_CANVAS_MODE_INDEXED_16_8:
+            return CHAFA_CANVAS_MODE_INDEXED_8;
+        default:
+            return mode;
+    }
+}
+
+static void
+get_steps (ChafaPixelMode pixel_mode, const Step **steps_out, gint *n_steps_out)
+{
+    switch (pixel_mode)
+    {
+        case CHAFA_PIXEL_MODE_SYMBOLS:
+            *steps_out = symbol_steps;
+            *n_steps_out = G_N_ELEMENTS (symbol_steps);
+            break;
+        case CHAFA_PIXEL_MODE_SIXELS:
+            *steps_out = sixel_steps;
+            *n_steps_out = G_N_ELEMENTS (sixel_steps);
+            break;
+        default:
+            *steps_out = image_steps;
+            *n_steps_out = G_N_ELEMENTS (image_steps);
+            break;
+    }
+}
+
+/* Returns TRUE if the step changed the config */
+static gboolean
+apply_step (ChicleRateControl *rate_control, ChafaCanvasConfig *config, Step step)
+{
+    static const gint compression_levels [] = { 1, 3, 6, 9 };
+    ChafaCanvasMode canvas_mode, new_canvas_mode;
+    ChafaSymbolMap *fill_symbol_map;
+    gint compression_level;
+    gint i;
+
+    switch (step)
+    {
+        case STEP_OPTIMIZE:
+            if (chafa_canvas_config_get_optimizations (config) == CHAFA_OPTIMIZATION_ALL)
+                return FALSE;
+            chafa_canvas_config_set_optimizations (config, CHAFA_OPTIMIZATION_ALL);
+            return TRUE;
+
+        case STEP_REDUCE_COLORS:
+            canvas_mode = chafa_canvas_config_get_canvas_mode (config);
+            if (chafa_canvas_config_get_pixel_mode (config) == CHAFA_PIXEL_MODE_SIXELS)
+                new_canvas_mode = reduce_sixel_color_depth (canvas_mode);
+            else
+                new_canvas_mode = reduce_color_depth (canvas_mode);
+            if (new_canvas_mode == canvas_mode)
+                return FALSE;
+            chafa_canvas_config_set_canvas_mode (config, new_canvas_mode);
+            return TRUE;
+
+        case STEP_NO_FILL:
+            if (!rate_control->have_fill_symbols)
+                return FALSE;
+            fill_symbol_map = chafa_symbol_map_new ();
+            chafa_canvas_config_set_fill_symbol_map (config, fill_symbol_map);
+            chafa_symbol_map_unref (fill_symbol_map);
+            return TRUE;
+
+        case STEP_COMPRESS:
+            compression_level = chafa_canvas_config_get_compression_level (config);
+            for (i = 0; i < (gint) G_N_ELEMENTS (compression_levels); i++)
+            {
+                if (compression_levels [i] > compression_level)
+                {
+                    chafa_canvas_config_set_compression_level (config, compression_levels [i]);
+                    return TRUE;
+                }
+            }
+            return FALSE;
+    }
+
+    return FALSE;
+}
+
+/* Counts the steps that would change the config. The levels stop there,
+ * so we don't step up without shrinking the output. */
+static gint
+count_useful_steps (ChicleRateControl *rate_control, const ChafaCanvasConfig *config)
+{
+    ChafaCanvasConfig *scratch;
+    const Step *steps;
+    gint n_steps, n_useful = 0;
+    gint i;
+
+    scratch = chafa_canvas_config_copy (config);
+    get_steps (chafa_canvas_config_get_pixel_mode (config), &steps, &n_steps);
+
+    for (i = 0; i < n_steps; i++)
+    {
+        if (apply_step (rate_control, scratch, steps [i]))
+            n_useful++;
+    }
+
+    chafa_canvas_config_unref (scratch);
+    return n_useful;
+}
+
+/* If have_fill_symbols is FALSE, the fill symbol map is empty, and the
+ * level that removes fill symbols is skipped */
+ChicleRateControl *
+chicle_rate_control_new (gdouble bitrate, gint frame_bytes, gboolean have_fill_symbols)
+{
+    ChicleRateControl *rate_control;
+
+    rate_control = g_new0 (ChicleRateControl, 1);
+    rate_control->bitrate = bitrate;
+    rate_control->frame_bytes = frame_bytes;
+    rate_control->level_max = LEVEL_MAX;
+    rate_control->have_fill_symbols = have_fill_symbols ? TRUE : FALSE;
+
+    return rate_control;
+}
+
+void
+chicle_rate_control_destroy (ChicleRateControl *rate_control)
+{
+    g_free (rate_control);
+}
+
+/* Adjusts the config according to the current level. Each level applies
+ * one more step from a ladder that depends on the pixel mode:
+ *
+ * Symbols: All optimizations (REP, attribute reuse, skipping unchanged
+ * cells), one step down in color depth, no fill symbols, then two further
+ * steps down in color depth.
+ *
+ * Sixels: All optimizations (allows deltas), then shrink the palette to
+ * 16 colors and finally to 8.
+ *
+ * Kitty and iTerm2 get their pixels as-is, so each step raises the
+ * compression level instead.
+ *
+ * Steps that wouldn't change anything with the user's settings are
+ * skipped, and the highest level is the last one that does something. */
+void
+chicle_rate_control_apply (ChicleRateControl *rate_control, ChafaCanvasConfig *config)
+{
+    const Step *steps;
+    gint n_steps, n_applied = 0;
+    gint i;
+
+    if (!rate_control->have_level_max)
+    {
+        rate_control->level_max = count_useful_steps (rate_control, config);
+        rate_control->level = MIN (rate_control->level, rate_control->level_max);
+        rate_control->have_level_max = TRUE;
+    }
+
+    get_steps (chafa_canvas_config_get_pixel_mode (config), &steps, &n_steps);
+
+    for (i = 0; i < n_steps && n_applied < rate_control->level; i++)
+    {
+        if (apply_step (rate_control, config, steps [i]))
+            n_applied++;
+    }
+}
+
+/* Feeds back the number of bytes the last frame took and the time it was
+ * given. Returns TRUE if the level changed, in which case the next frame
+ * must not be printed as a delta against the previous one. */
+gboolean
+chicle_rate_control_update (ChicleRateControl *rate_control,
+                            gsize frame_bytes, gdouble frame_interval_s)
+{
+    gdouble budget;
+    gint prev_level = rate_control->level;
+
+    if (rate_control->skip_next)
+    {
+        rate_control->skip_next = FALSE;
+        return FALSE;
+    }
+
+    if (rate_control->frame_bytes > 0)
+        budget = rate_control->frame_bytes;
+    else
+        budget = rate_control->bitrate / 8.0 * frame_interval_s;
+
+    /* No delay between frames; nothing to aim for */
+    if (budget < 1.0)
+        return FALSE;
+
+    if (frame_bytes > budget)
+    {
+        rate_control->level = MIN (rate_control->level + 1, rate_control->level_max);
+        rate_control->n_under_budget = 0;
+    }
+    else if (frame_bytes * 2 < budget && rate_control->level > 0)
+    {
+        if (++rate_control->n_under_budget >= UNDER_BUDGET_FRAMES_MIN)
+        {
+            rate_control->level--;
+            rate_control->n_under_budget = 0;
+        }
+    }
+    else
+    {
+        rate_control->n_under_budget = 0;
+    }
+
+    if (rate_control->level == prev_level)
+        return FALSE;
+
+    rate_control->skip_next = TRUE;
+    return TRUE;
+}
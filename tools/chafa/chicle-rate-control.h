@@ -0,0 +1,39 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __CHICLE_RATE_CONTROL_H__
+#define __CHICLE_RATE_CONTROL_H__
+
+#include <chafa.h>
+
+G_BEGIN_DECLS
+
+typedef struct ChicleRateControl ChicleRateControl;
+
+ChicleRateControl *chicle_rate_control_new (gdouble bitrate, gint frame_bytes,
+                                            gboolean have_fill_symbols);
+void chicle_rate_control_destroy (ChicleRateControl *rate_control);
+
+void chicle_rate_control_apply (ChicleRateControl *rate_control, ChafaCanvasConfig *config);
+gboolean chicle_rate_control_update (ChicleRateControl *rate_control,
+                                     gsize frame_bytes, gdouble frame_interval_s);
+
+G_END_DECLS
+
+#endif /* __CHICLE_RATE_CONTROL_H__ */
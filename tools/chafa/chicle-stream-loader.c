@@ -0,0 +1,597 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+#include <chafa.h>
+#include "chicle-stream-loader.h"
+#include "chicle-util.h"
+
+/* Streams frames of raw pixels from a pipe or fifo, e.g.
+ *
+ *   ffmpeg -i video.mp4 -f yuv4mpegpipe - | chafa --stream y4m -
+ *   ffmpeg -i video.mp4 -f rawvideo -pix_fmt rgba -s 640x360 - \
+ *     | chafa --stream rgba --stream-size 640x360 -
+ *
+ * A thread reads ahead into a ring of frame buffers, so the producer doesn't
+ * have to wait while we render. The buffers are passed on as-is, to be
+ * borrowed by a ChafaFrame. Y4M is converted to RGB on the way in. */
+
+/* MS Windows needs files to be explicitly opened as O_BINARY */
+#ifndef O_BINARY
+# ifdef _O_BINARY
+#  define O_BINARY _O_BINARY
+# else
+#  define O_BINARY 0
+# endif
+#endif
+
+#define IMAGE_BUFFER_SIZE_MAX (0xffffffffU >> 2)
+
+/* Number of frame buffers. The one being shown is never touched, so this
+ * allows for N_SLOTS - 1 frames of read-ahead. */
+#define N_SLOTS 4
+
+/* Y4M header lines can't be longer than this */
+#define LINE_LENGTH_MAX 1024
+
+/* How often the reader thread checks whether it should quit */
+#define WAIT_MS 100
+
+/* Frame rate of headerless streams. Can be changed with --speed. */
+#define FPS_DEFAULT 25
+
+struct ChicleStreamLoader
+{
+    ChicleStreamFormat format;
+    gint fd;
+    ChafaStreamReader *reader;
+
+    gint width, height;
+    ChafaPixelType pixel_type;
+    gint n_channels;
+    gsize frame_size;
+    gint delay_ms;
+
+    /* Y4M only: Input planes and their layout */
+    guint8 *yuv_buf;
+    gsize yuv_size;
+    gint chroma_shift_x, chroma_shift_y;
+    gint chroma_width, chroma_height;
+
+    guint8 *slots [N_SLOTS];
+
+    GThread *thread;
+    GMutex mutex;
+    GCond cond;
+
+    /* Number of frames read so far, and the index of the current one */
+    gint64 n_read;
+    gint64 current;
+
+    guint has_chroma : 1;
+    guint full_range : 1;
+    guint close_fd : 1;
+    guint eof : 1;
+    guint stop : 1;
+};
+
+/* --- *
+ * I/O *
+ * --- */
+
+static gboolean
+should_stop (ChicleStreamLoader *loader)
+{
+    gboolean stop;
+
+    g_mutex_lock (&loader->mutex);
+    stop = loader->stop;
+    g_mutex_unlock (&loader->mutex);
+
+    return stop;
+}
+
+static gboolean
+read_exact (ChicleStreamLoader *loader, gpointer out, gsize len)
+{
+    guint8 *p = out;
+
+    while (len > 0)
+    {
+        gint n = chafa_stream_reader_read (loader->reader, p, MIN (len, G_MAXINT));
+
+        if (n > 0)
+        {
+            p += n;
+            len -= n;
+            continue;
+        }
+
+        if (chafa_stream_reader_is_eof (loader->reader) || should_stop (loader))
+            return FALSE;
+
+        chafa_stream_reader_wait (loader->reader, WAIT_MS);
+    }
+
+    return TRUE;
+}
+
+/* Reads a line, not including the newline */
+static gboolean
+read_line (ChicleStreamLoader *loader, gchar *out, gint len_max)
+{
+    gint i;
+
+    for (i = 0; i < len_max - 1; i++)
+    {
+        if (!read_exact (loader, out + i, 1))
+            return FALSE;
+
+        if (out [i] == '\n')
+        {
+            out [i] = '\0';
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* --- *
+ * Y4M *
+ * --- */
+
+static gboolean
+parse_y4m_colorspace (ChicleStreamLoader *loader, const gchar *cs)
+{
+    loader->has_chroma = TRUE;
+
+    if (g_str_has_prefix (cs, "420")
+        && (cs [3] == '\0' || !strcmp (cs + 3, "jpeg")
+            || !strcmp (cs + 3, "paldv") || !strcmp (cs + 3, "mpeg2")))
+    {
+        loader->chroma_shift_x = loader->chroma_shift_y = 1;
+    }
+    else if (!strcmp (cs, "422"))
+    {
+        loader->chroma_shift_x = 1;
+        loader->chroma_shift_y = 0;
+    }
+    else if (!strcmp (cs, "444"))
+    {
+        loader->chroma_shift_x = loader->chroma_shift_y = 0;
+    }
+    else if (!strcmp (cs, "mono"))
+    {
+        loader->has_chroma = FALSE;
+    }
+    else
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+read_y4m_header (ChicleStreamLoader *loader, GError **error)
+{
+    gchar line [LINE_LENGTH_MAX];
+    gchar **tokens;
+    gint fps_num = FPS_DEFAULT, fps_den = 1;
+    gboolean success = FALSE;
+    gint i;
+
+    if (!read_line (loader, line, sizeof (line))
+        || !g_str_has_prefix (line, "YUV4MPEG2 "))
+    {
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                     "Not a Y4M stream");
+        return FALSE;
+    }
+
+    /* 4:2:0 is the default */
+    loader->has_chroma = TRUE;
+    loader->chroma_shift_x = loader->chroma_shift_y = 1;
+
+    tokens = g_strsplit (line + strlen ("YUV4MPEG2 "), " ", -1);
+
+    for (i = 0; tokens [i]; i++)
+    {
+        const gchar *arg = tokens [i] + 1;
+
+        switch (tokens [i] [0])
+        {
+            case 'W':
+                loader->width = atoi (arg);
+                break;
+            case 'H':
+                loader->height = atoi (arg);
+                break;
+            case 'F':
+                if (sscanf (arg, "%d:%d", &fps_num, &fps_den) != 2)
+                    fps_num = 0;
+                break;
+            case 'C':
+                if (!parse_y4m_colorspace (loader, arg))
+                {
+                    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                                 "Unsupported Y4M color space");
+                    goto out;
+                }
+                break;
+            case 'X':
+                if (!strcmp (arg, "COLORRANGE=FULL"))
+                    loader->full_range = TRUE;
+                break;
+            default:
+                /* Interlacing, aspect ratio and comments are ignored */
+                break;
+        }
+    }
+
+    if (fps_num > 0 && fps_den > 0)
+        loader->delay_ms = ((gint64) fps_den * 1000 + fps_num / 2) / fps_num;
+
+    success = TRUE;
+
+out:
+    g_strfreev (tokens);
+    return success;
+}
+
+static inline guint8
+clamp_u8 (gint v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/* BT.601, which is what Y4M producers use unless told otherwise */
+static void
+convert_yuv_to_rgb (ChicleStreamLoader *loader, guint8 *out)
+{
+    const guint8 *y_plane = loader->yuv_buf;
+    const guint8 *u_plane = y_plane + loader->width * loader->height;
+    const guint8 *v_plane = u_plane + loader->chroma_width * loader->chroma_height;
+    gint x, y;
+
+    for (y = 0; y < loader->height; y++)
+    {
+        const guint8 *y_row = y_plane + y * loader->width;
+        const guint8 *u_row = u_plane + (y >> loader->chroma_shift_y) * loader->chroma_width;
+        const guint8 *v_row = v_plane + (y >> loader->chroma_shift_y) * loader->chroma_width;
+
+        for (x = 0; x < loader->width; x++)
+        {
+            gint c = y_row [x], d = 0, e = 0;
+
+            if (loader->has_chroma)
+            {
+                d = u_row [x >> loader->chroma_shift_x] - 128;
+                e = v_row [x >> loader->chroma_shift_x] - 128;
+            }
+
+            if (loader->full_range)
+            {
+                out [0] = clamp_u8 (c + ((359 * e + 128) >> 8));
+                out [1] = clamp_u8 (c - ((88 * d + 183 * e + 128) >> 8));
+                out [2] = clamp_u8 (c + ((454 * d + 128) >> 8));
+            }
+            else
+            {
+                c = 298 * (c - 16);
+                out [0] = clamp_u8 ((c + 409 * e + 128) >> 8);
+                out [1] = clamp_u8 ((c - 100 * d - 208 * e + 128) >> 8);
+                out [2] = clamp_u8 ((c + 516 * d + 128) >> 8);
+            }
+
+            out += 3;
+        }
+    }
+}
+
+static gboolean
+read_y4m_frame (ChicleStreamLoader *loader, guint8 *out)
+{
+    gchar line [LINE_LENGTH_MAX];
+
+    /* Frame parameters are ignored */
+    if (!read_line (loader, line, sizeof (line))
+        || strncmp (line, "FRAME", 5)
+        || !read_exact (loader, loader->yuv_buf, loader->yuv_size))
+        return FALSE;
+
+    convert_yuv_to_rgb (loader, out);
+    return TRUE;
+}
+
+/* ------------- *
+ * Reader thread *
+ * ------------- */
+
+static gpointer
+thread_main (gpointer data)
+{
+    ChicleStreamLoader *loader = data;
+
+    for (;;)
+    {
+        guint8 *slot;
+        gboolean success;
+
+        g_mutex_lock (&loader->mutex);
+
+        while (!loader->stop && loader->n_read >= loader->current + N_SLOTS)
+            g_cond_wait (&loader->cond, &loader->mutex);
+
+        if (loader->stop)
+        {
+            g_mutex_unlock (&loader->mutex);
+            break;
+        }
+
+        slot = loader->slots [loader->n_read % N_SLOTS];
+        g_mutex_unlock (&loader->mutex);
+
+        if (loader->format == CHICLE_STREAM_FORMAT_Y4M)
+            success = read_y4m_frame (loader, slot);
+        else
+            success = read_exact (loader, slot, loader->frame_size);
+
+        g_mutex_lock (&loader->mutex);
+
+        if (success)
+            loader->n_read++;
+        else
+            loader->eof = TRUE;
+
+        g_cond_broadcast (&loader->cond);
+        g_mutex_unlock (&loader->mutex);
+
+        if (!success)
+            break;
+    }
+
+    return NULL;
+}
+
+/* Waits for the frame at index to arrive. Returns FALSE if the stream ended
+ * first. Must be called with the mutex held. */
+static gboolean
+wait_for_frame_locked (ChicleStreamLoader *loader, gint64 index)
+{
+    while (loader->n_read <= index && !loader->eof)
+        g_cond_wait (&loader->cond, &loader->mutex);
+
+    return loader->n_read > index;
+}
+
+/* ---------- *
+ * Public API *
+ * ---------- */
+
+ChicleStreamLoader *
+chicle_stream_loader_new (const gchar *path, ChicleStreamFormat format,
+                          gint width, gint height, GError **error)
+{
+    ChicleStreamLoader *loader;
+    gboolean success = FALSE;
+    gint i;
+
+    g_return_val_if_fail (path != NULL, NULL);
+    g_return_val_if_fail (format > CHICLE_STREAM_FORMAT_NONE
+                          && format < CHICLE_STREAM_FORMAT_MAX, NULL);
+
+    loader = g_new0 (ChicleStreamLoader, 1);
+    loader->format = format;
+    loader->width = width;
+    loader->height = height;
+    loader->delay_ms = (1000 + FPS_DEFAULT / 2) / FPS_DEFAULT;
+    g_mutex_init (&loader->mutex);
+    g_cond_init (&loader->cond);
+
+    if (!strcmp (path, "-"))
+    {
+        loader->fd = fileno (stdin);  /* Can't use STDIN_FILENO on Windows */
+    }
+    else
+    {
+        /* Opening a fifo blocks until there's a writer */
+        loader->fd = g_open (path, O_RDONLY | O_BINARY, 0);
+        if (loader->fd < 0)
+        {
+            gint saved_errno = errno;
+
+            g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                         "%s", g_strerror (saved_errno));
+            goto out;
+        }
+
+        loader->close_fd = TRUE;
+    }
+
+    loader->reader = chafa_stream_reader_new_from_fd (loader->fd);
+
+    if (format == CHICLE_STREAM_FORMAT_Y4M)
+    {
+        gsize luma_size, chroma_size = 0;
+
+        if (!read_y4m_header (loader, error))
+            goto out;
+
+        loader->pixel_type = CHAFA_PIXEL_RGB8;
+        loader->n_channels = 3;
+
+        loader->chroma_width = (loader->width + (1 << loader->chroma_shift_x) - 1)
+            >> loader->chroma_shift_x;
+        loader->chroma_height = (loader->height + (1 << loader->chroma_shift_y) - 1)
+            >> loader->chroma_shift_y;
+
+        if (!chicle_checked_image_buffer_size (loader->width, loader->height, 1,
+                                               IMAGE_BUFFER_SIZE_MAX, &luma_size)
+            || (loader->has_chroma
+                && !chicle_checked_image_buffer_size (loader->chroma_width, loader->chroma_height, 2,
+                                                      IMAGE_BUFFER_SIZE_MAX, &chroma_size)))
+            goto bad_size;
+
+        loader->yuv_size = luma_size + chroma_size;
+        loader->yuv_buf = g_malloc (loader->yuv_size);
+    }
+    else
+    {
+        loader->pixel_type = format == CHICLE_STREAM_FORMAT_RGBA
+            ? CHAFA_PIXEL_RGBA8_UNASSOCIATED : CHAFA_PIXEL_RGB8;
+        loader->n_channels = format == CHICLE_STREAM_FORMAT_RGBA ? 4 : 3;
+    }
+
+    if (!chicle_checked_image_buffer_size (loader->width, loader->height, loader->n_channels,
+                                           IMAGE_BUFFER_SIZE_MAX, &loader->frame_size))
+        goto bad_size;
+
+    for (i = 0; i < N_SLOTS; i++)
+        loader->slots [i] = g_malloc (loader->frame_size);
+
+    loader->thread = g_thread_new ("stream-loader", thread_main, loader);
+    success = TRUE;
+    goto out;
+
+bad_size:
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                 "Invalid frame size %dx%d", loader->width, loader->height);
+
+out:
+    if (!success)
+    {
+        chicle_stream_loader_destroy (loader);
+        loader = NULL;
+    }
+
+    return loader;
+}
+
+void
+chicle_stream_loader_destroy (ChicleStreamLoader *loader)
+{
+    gint i;
+
+    if (loader->thread)
+    {
+        g_mutex_lock (&loader->mutex);
+        loader->stop = TRUE;
+        g_cond_broadcast (&loader->cond);
+        g_mutex_unlock (&loader->mutex);
+
+        g_thread_join (loader->thread);
+    }
+
+    if (loader->reader)
+        chafa_stream_reader_unref (loader->reader);
+    if (loader->close_fd)
+        close (loader->fd);
+
+    for (i = 0; i < N_SLOTS; i++)
+        g_free (loader->slots [i]);
+
+    g_free (loader->yuv_buf);
+    g_mutex_clear (&loader->mutex);
+    g_cond_clear (&loader->cond);
+    g_free (loader);
+}
+
+gboolean
+chicle_stream_loader_get_is_animation (G_GNUC_UNUSED ChicleStreamLoader *loader)
+{
+    return TRUE;
+}
+
+/* The data stays valid until the next call to
+ * chicle_stream_loader_goto_next_frame (). */
+gconstpointer
+chicle_stream_loader_get_frame_data (ChicleStreamLoader *loader,
+                                     ChafaPixelType *pixel_type_out,
+                                     gint *width_out,
+                                     gint *height_out,
+                                     gint *rowstride_out)
+{
+    gboolean have_frame;
+
+    g_return_val_if_fail (loader != NULL, NULL);
+
+    g_mutex_lock (&loader->mutex);
+    have_frame = wait_for_frame_locked (loader, loader->current);
+    g_mutex_unlock (&loader->mutex);
+
+    if (!have_frame)
+        return NULL;
+
+    if (pixel_type_out)
+        *pixel_type_out = loader->pixel_type;
+    if (width_out)
+        *width_out = loader->width;
+    if (height_out)
+        *height_out = loader->height;
+    if (rowstride_out)
+        *rowstride_out = loader->width * loader->n_channels;
+
+    return loader->slots [loader->current % N_SLOTS];
+}
+
+gint
+chicle_stream_loader_get_frame_delay (ChicleStreamLoader *loader)
+{
+    g_return_val_if_fail (loader != NULL, 0);
+
+    return loader->delay_ms;
+}
+
+void
+chicle_stream_loader_goto_first_frame (G_GNUC_UNUSED ChicleStreamLoader *loader)
+{
+    /* Streams can't be rewound */
+}
+
+gboolean
+chicle_stream_loader_goto_next_frame (ChicleStreamLoader *loader)
+{
+    gboolean have_frame;
+
+    g_return_val_if_fail (loader != NULL, FALSE);
+
+    g_mutex_lock (&loader->mutex);
+
+    have_frame = wait_for_frame_locked (loader, loader->current + 1);
+    if (have_frame)
+    {
+        /* Frees up the previous frame's buffer */
+        loader->current++;
+        g_cond_broadcast (&loader->cond);
+    }
+
+    g_mutex_unlock (&loader->mutex);
+    return have_frame;
+}
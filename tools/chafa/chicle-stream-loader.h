@@ -0,0 +1,59 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2025 Hans Petter Jansson
+ *
+ * This file is part of Chafa, a program that shows pictures on text terminals.
+ *
+ * Chafa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Chafa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Chafa.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __CHICLE_STREAM_LOADER_H__
+#define __CHICLE_STREAM_LOADER_H__
+
+#include <glib.h>
+#include <chafa.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+    CHICLE_STREAM_FORMAT_NONE,
+    CHICLE_STREAM_FORMAT_Y4M,
+    CHICLE_STREAM_FORMAT_RGB,
+    CHICLE_STREAM_FORMAT_RGBA,
+
+    CHICLE_STREAM_FORMAT_MAX
+}
+ChicleStreamFormat;
+
+typedef struct ChicleStreamLoader ChicleStreamLoader;
+
+ChicleStreamLoader *chicle_stream_loader_new (const gchar *path, ChicleStreamFormat format,
+                                              gint width, gint height, GError **error);
+void chicle_stream_loader_destroy (ChicleStreamLoader *loader);
+
+gboolean chicle_stream_loader_get_is_animation (ChicleStreamLoader *loader);
+
+gconstpointer chicle_stream_loader_get_frame_data (ChicleStreamLoader *loader,
+                                                   ChafaPixelType *pixel_type_out,
+                                                   gint *width_out,
+                                                   gint *height_out,
+                                                   gint *rowstride_out);
+gint chicle_stream_loader_get_frame_delay (ChicleStreamLoader *loader);
+
+void chicle_stream_loader_goto_first_frame (ChicleStreamLoader *loader);
+gboolean chicle_stream_loader_goto_next_frame (ChicleStreamLoader *loader);
+
+G_END_DECLS
+
+#endif /* __CHICLE_STREAM_LOADER_H__ */
@@ -33,6 +33,7 @@
 
 #include <chafa.h>
 #include "chicle-tiff-loader.h"
+#include "chicle-util.h"
 
 /* ----------------------- *
  * Global macros and types *
@@ -41,14 +42,26 @@
 #define BYTES_PER_PIXEL 4
 #define IMAGE_BUFFER_SIZE_MAX (0xffffffffU >> 2)
 
+/* Upper bound on directories to consider when looking for previews
+ * or pyramid levels */
+#define N_CANDIDATES_MAX 16
+
+/* Largest box we'll average over when reducing; keeps the sums in 32 bits */
+#define REDUCE_FACTOR_MAX 4096
+
+/* Set once at startup; see chicle_tiff_loader_set_use_previews () */
+static gboolean use_previews;
+
 struct ChicleTiffLoader
 {
     ChicleFileMapping *mapping;
     const guint8 *file_data;
     size_t file_data_len;
     gpointer frame_data;
-    gint width, height;
+    gint width, height, rowstride;
     ChafaPixelType pixel_type;
+    guint used_preview : 1;
+    guint verbatim : 1;
 
     toff_t file_pos;
 };
@@ -167,6 +180,355 @@ have_tiff_magic (ChicleFileMapping *mapping, gchar tiff_version)
         || chicle_file_mapping_has_magic (mapping, 0, magic_be, 4);
 }
 
+/* --- Previews and pyramid levels --- */
+
+/* Returns TRUE if size is main_size reduced by a power of two, rounding
+ * either way. */
+static gboolean
+is_power_of_two_reduction (uint32_t main_size, uint32_t size)
+{
+    gint shift;
+
+    for (shift = 1; shift < 32 && (main_size >> shift) > 0; shift++)
+    {
+        if (size == main_size >> shift
+            || size == (uint32_t) (((guint64) main_size + (1u << shift) - 1) >> shift))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Returns the size of the directory at ofs if it's a reduced-resolution
+ * copy of the main image. Camera TIFFs and TIFF/EP store their previews
+ * like this, either in SubIFDs or further down the main IFD chain.
+ *
+ * When the main image is tiled, other tiled directories are taken to be
+ * pyramid levels. Whole-slide formats like SVS don't always mark them as
+ * reduced images, so untagged ones are accepted from SubIFDs, or from the
+ * main chain if they're a power-of-two reduction. Anything else in the
+ * main chain could be an unrelated page. */
+static gboolean
+get_reduced_image_size (TIFF *tiff, toff_t ofs, gboolean is_subifd,
+                        uint32_t main_width, uint32_t main_height,
+                        gboolean main_is_tiled,
+                        uint32_t *width_out, uint32_t *height_out)
+{
+    uint32_t subfile_type = 0;
+    uint32_t width, height;
+    gboolean is_reduced;
+
+    if (!TIFFSetSubDirectory (tiff, ofs))
+        return FALSE;
+
+    if (!TIFFGetField (tiff, TIFFTAG_IMAGEWIDTH, &width)
+        || !TIFFGetField (tiff, TIFFTAG_IMAGELENGTH, &height))
+        return FALSE;
+
+    is_reduced = TIFFGetField (tiff, TIFFTAG_SUBFILETYPE, &subfile_type)
+        && (subfile_type & FILETYPE_REDUCEDIMAGE);
+
+    if (main_is_tiled && TIFFIsTiled (tiff))
+    {
+        if (!is_reduced && !is_subifd
+            && !(is_power_of_two_reduction (main_width, width)
+                 && is_power_of_two_reduction (main_height, height)))
+            return FALSE;
+    }
+    else if (!use_previews || !is_reduced)
+    {
+        return FALSE;
+    }
+
+    *width_out = width;
+    *height_out = height;
+    return TRUE;
+}
+
+/* Orientations 5-8 transpose the image, so the target size has to be
+ * swapped before it's compared to the stored size. */
+static gboolean
+orientation_swaps_axes (uint16_t orientation)
+{
+    return orientation == ORIENTATION_LEFTTOP
+        || orientation == ORIENTATION_RIGHTTOP
+        || orientation == ORIENTATION_RIGHTBOT
+        || orientation == ORIENTATION_LEFTBOT;
+}
+
+/* Picks the smallest reduced image that covers the target size and has
+ * the main image's aspect. Must be called with the first directory
+ * current. Returns its offset, or 0 if there's none. Leaves the current
+ * directory in an undefined state. */
+static toff_t
+find_reduced_image (TIFF *tiff, uint32_t main_width, uint32_t main_height,
+                    gint target_width, gint target_height)
+{
+    toff_t candidates [N_CANDIDATES_MAX];
+    toff_t best = 0;
+    guint64 best_area = G_MAXUINT64;
+    uint16_t n_subifds = 0;
+    toff_t *subifds = NULL;
+    gboolean main_is_tiled;
+    gint n = 0, n_from_subifds, i;
+
+    if (target_width < 1 || target_height < 1)
+        return 0;
+
+    main_is_tiled = TIFFIsTiled (tiff);
+
+    /* Copy the SubIFD offsets, since they're owned by the current directory */
+    if (TIFFGetField (tiff, TIFFTAG_SUBIFD, &n_subifds, &subifds) && subifds)
+    {
+        for (i = 0; i < n_subifds && n < N_CANDIDATES_MAX; i++)
+            candidates [n++] = subifds [i];
+    }
+
+    n_from_subifds = n;
+
+    while (n < N_CANDIDATES_MAX && TIFFReadDirectory (tiff))
+        candidates [n++] = TIFFCurrentDirOffset (tiff);
+
+    for (i = 0; i < n; i++)
+    {
+        uint32_t width, height;
+
+        if (!get_reduced_image_size (tiff, candidates [i], i < n_from_subifds,
+                                     main_width, main_height, main_is_tiled,
+                                     &width, &height))
+            continue;
+
+        if (width < (uint32_t) target_width || height < (uint32_t) target_height
+            || width >= main_width)
+            continue;
+
+        /* Allow for 1% rounding error */
+        if (ABS ((gint64) width * main_height - (gint64) height * main_width) * 100
+            > (gint64) main_width * height)
+            continue;
+
+        if ((guint64) width * height < best_area)
+        {
+            best_area = (guint64) width * height;
+            best = candidates [i];
+        }
+    }
+
+    return best;
+}
+
+/* --- Incremental decoding --- */
+
+/* Averages the source image over factor*factor boxes as it's being read,
+ * so large images can be decoded one tile or strip at a time without
+ * ever holding the full raster. */
+typedef struct
+{
+    guint32 *sums;
+    gint src_width, src_height;
+    gint width, height;
+    gint factor;
+}
+BoxReducer;
+
+static gboolean
+box_reducer_init (BoxReducer *reducer, gint src_width, gint src_height, gint factor)
+{
+    reducer->src_width = src_width;
+    reducer->src_height = src_height;
+    reducer->factor = factor;
+    reducer->width = (src_width + factor - 1) / factor;
+    reducer->height = (src_height + factor - 1) / factor;
+
+    if ((guint64) reducer->width * reducer->height * BYTES_PER_PIXEL > IMAGE_BUFFER_SIZE_MAX)
+        return FALSE;
+
+    reducer->sums = g_try_new0 (guint32, (gsize) reducer->width * reducer->height * BYTES_PER_PIXEL);
+    return reducer->sums != NULL;
+}
+
+static void
+box_reducer_deinit (BoxReducer *reducer)
+{
+    g_free (reducer->sums);
+    reducer->sums = NULL;
+}
+
+/* Adds n_pixels of libtiff ABGR data starting at (x, y) in the source */
+static void
+box_reducer_add_row (BoxReducer *reducer, const uint32_t *src,
+                     gint x, gint y, gint n_pixels, gboolean premultiply)
+{
+    guint32 *sums = reducer->sums
+        + ((gsize) (y / reducer->factor) * reducer->width + x / reducer->factor) * BYTES_PER_PIXEL;
+    gint phase = x % reducer->factor;
+    gint i;
+
+    for (i = 0; i < n_pixels; i++)
+    {
+        uint32_t p = src [i];
+        guint32 a = TIFFGetA (p);
+
+        if (premultiply)
+        {
+            sums [0] += (TIFFGetR (p) * a + 127) / 255;
+            sums [1] += (TIFFGetG (p) * a + 127) / 255;
+            sums [2] += (TIFFGetB (p) * a + 127) / 255;
+        }
+        else
+        {
+            sums [0] += TIFFGetR (p);
+            sums [1] += TIFFGetG (p);
+            sums [2] += TIFFGetB (p);
+        }
+
+        sums [3] += a;
+
+        if (++phase == reducer->factor)
+        {
+            phase = 0;
+            sums += BYTES_PER_PIXEL;
+        }
+    }
+}
+
+/* Writes the box averages to dest as premultiplied RGBA8. Boxes on the
+ * right and bottom edges may be partial. */
+static void
+box_reducer_finish (BoxReducer *reducer, guint8 *dest)
+{
+    const guint32 *sums = reducer->sums;
+    gint x, y, i;
+
+    for (y = 0; y < reducer->height; y++)
+    {
+        gint box_height = MIN (reducer->factor, reducer->src_height - y * reducer->factor);
+
+        for (x = 0; x < reducer->width; x++)
+        {
+            gint box_width = MIN (reducer->factor, reducer->src_width - x * reducer->factor);
+            guint32 n = box_width * box_height;
+
+            for (i = 0; i < BYTES_PER_PIXEL; i++)
+                *(dest++) = (*(sums++) + n / 2) / n;
+        }
+    }
+}
+
+/* libtiff's RGBA tile and strip readers return rows bottom-up. The
+ * orientation tag must be reset to top-left beforehand so they don't
+ * flip anything. */
+
+static gboolean
+read_tiles_reduced (TIFF *tiff, BoxReducer *reducer, gboolean premultiply)
+{
+    uint32_t tile_width, tile_height;
+    uint32_t *raster;
+    gboolean success = FALSE;
+    gint x, y, i;
+
+    if (!TIFFGetField (tiff, TIFFTAG_TILEWIDTH, &tile_width)
+        || !TIFFGetField (tiff, TIFFTAG_TILELENGTH, &tile_height)
+        || tile_width < 1 || tile_height < 1
+        || (tile_width * (guint64) tile_height * BYTES_PER_PIXEL > IMAGE_BUFFER_SIZE_MAX))
+        return FALSE;
+
+    raster = _TIFFmalloc (tile_width * (tmsize_t) tile_height * BYTES_PER_PIXEL);
+    if (!raster)
+        return FALSE;
+
+    for (y = 0; y < reducer->src_height; y += tile_height)
+    {
+        gint n_rows = MIN ((gint64) tile_height, reducer->src_height - y);
+
+        for (x = 0; x < reducer->src_width; x += tile_width)
+        {
+            gint n_cols = MIN ((gint64) tile_width, reducer->src_width - x);
+
+            if (!TIFFReadRGBATile (tiff, x, y, raster))
+                goto out;
+
+            for (i = 0; i < n_rows; i++)
+                box_reducer_add_row (reducer, raster + (gsize) (tile_height - 1 - i) * tile_width,
+                                     x, y + i, n_cols, premultiply);
+        }
+    }
+
+    success = TRUE;
+
+out:
+    _TIFFfree (raster);
+    return success;
+}
+
+static gboolean
+read_strips_reduced (TIFF *tiff, BoxReducer *reducer, gboolean premultiply)
+{
+    uint32_t rows_per_strip = 0;
+    uint32_t *raster;
+    gboolean success = FALSE;
+    gint y, i;
+
+    TIFFGetFieldDefaulted (tiff, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+    rows_per_strip = CLAMP (rows_per_strip, 1, (uint32_t) reducer->src_height);
+
+    if (reducer->src_width * (guint64) rows_per_strip * BYTES_PER_PIXEL > IMAGE_BUFFER_SIZE_MAX)
+        return FALSE;
+
+    raster = _TIFFmalloc (reducer->src_width * (tmsize_t) rows_per_strip * BYTES_PER_PIXEL);
+    if (!raster)
+        return FALSE;
+
+    for (y = 0; y < reducer->src_height; y += rows_per_strip)
+    {
+        gint n_rows = MIN ((gint64) rows_per_strip, reducer->src_height - y);
+
+        if (!TIFFReadRGBAStrip (tiff, y, raster))
+            goto out;
+
+        for (i = 0; i < n_rows; i++)
+            box_reducer_add_row (reducer, raster + (gsize) (n_rows - 1 - i) * reducer->src_width,
+                                 0, y + i, reducer->src_width, premultiply);
+    }
+
+    success = TRUE;
+
+out:
+    _TIFFfree (raster);
+    return success;
+}
+
+/* Decodes the current directory at 1/factor scale */
+static gpointer
+read_reduced (TIFF *tiff, gint width, gint height, gint factor, gboolean premultiply,
+              gint *width_out, gint *height_out)
+{
+    BoxReducer reducer;
+    gpointer frame_data = NULL;
+    gboolean success;
+
+    if (!box_reducer_init (&reducer, width, height, factor))
+        return NULL;
+
+    if (TIFFIsTiled (tiff))
+        success = read_tiles_reduced (tiff, &reducer, premultiply);
+    else
+        success = read_strips_reduced (tiff, &reducer, premultiply);
+
+    if (success)
+        frame_data = g_try_malloc ((gsize) reducer.width * reducer.height * BYTES_PER_PIXEL);
+
+    if (frame_data)
+    {
+        box_reducer_finish (&reducer, frame_data);
+        *width_out = reducer.width;
+        *height_out = reducer.height;
+    }
+
+    box_reducer_deinit (&reducer);
+    return frame_data;
+}
+
 static ChicleTiffLoader *
 chicle_tiff_loader_new (void)
 {
@@ -174,7 +536,8 @@ chicle_tiff_loader_new (void)
 }
 
 ChicleTiffLoader *
-chicle_tiff_loader_new_from_mapping (ChicleFileMapping *mapping)
+chicle_tiff_loader_new_from_mapping (ChicleFileMapping *mapping,
+                                     gint target_width, gint target_height)
 {
     ChicleTiffLoader *loader = NULL;
     gboolean success = FALSE;
@@ -182,6 +545,10 @@ chicle_tiff_loader_new_from_mapping (ChicleFileMapping *mapping)
     TIFF *tiff = NULL;
     gint samples_per_pixel = 4;
     uint32_t width, height;
+    uint16_t orientation;
+    toff_t reduced_ofs = 0;
+    gint factor = 1;
+    guint rot_width, rot_height, rowstride;
 
     g_return_val_if_fail (mapping != NULL, NULL);
 
@@ -213,12 +580,70 @@ chicle_tiff_loader_new_from_mapping (ChicleFileMapping *mapping)
         goto out;
     if (!TIFFGetField (tiff, TIFFTAG_IMAGELENGTH, &height))
         goto out;
+
+    /* Switch to the smallest pyramid level that covers the target, or to
+     * an embedded preview if allowed. Reduced images usually don't have
+     * their own orientation tag, so they inherit the main image's. */
+
+    TIFFGetFieldDefaulted (tiff, TIFFTAG_ORIENTATION, &orientation);
+
+    /* The target size applies after rotation */
+    if (orientation_swaps_axes (orientation))
+    {
+        gint t = target_width;
+        target_width = target_height;
+        target_height = t;
+    }
+
+    if (use_previews || TIFFIsTiled (tiff))
+    {
+        gboolean main_is_tiled = TIFFIsTiled (tiff);
+
+        reduced_ofs = find_reduced_image (tiff, width, height, target_width, target_height);
+
+        if (reduced_ofs && TIFFSetSubDirectory (tiff, reduced_ofs))
+        {
+            uint16_t reduced_orientation;
+
+            TIFFGetField (tiff, TIFFTAG_IMAGEWIDTH, &width);
+            TIFFGetField (tiff, TIFFTAG_IMAGELENGTH, &height);
+
+            if (TIFFGetField (tiff, TIFFTAG_ORIENTATION, &reduced_orientation))
+                orientation = reduced_orientation;
+
+            /* Pyramid levels are exact downsamples, not previews */
+            loader->used_preview = !(main_is_tiled && TIFFIsTiled (tiff));
+        }
+        else if (!TIFFSetDirectory (tiff, 0))
+        {
+            goto out;
+        }
+    }
+
     if (!TIFFGetField (tiff, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel))
         goto out;
 
     if (width < 1 || width > (1 << 28)
-        || height < 1 || height > (1 << 28)
-        || (width * (guint64) height * BYTES_PER_PIXEL > IMAGE_BUFFER_SIZE_MAX))
+        || height < 1 || height > (1 << 28))
+        goto out;
+
+    /* libtiff only flips rows to match the orientation; it can't transpose.
+     * Decode in storage order instead and rotate the result ourselves. */
+
+    TIFFSetField (tiff, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+
+    /* If the image is still much larger than the target, read it piecewise
+     * and reduce it on the fly. This is what lets us open huge tiled and
+     * stripped images without allocating the full raster. */
+
+    if (target_width > 0 && target_height > 0)
+    {
+        factor = MIN (width / (uint32_t) target_width, height / (uint32_t) target_height);
+        factor = MIN (factor, REDUCE_FACTOR_MAX);
+    }
+
+    if (factor < 2
+        && (width * (guint64) height * BYTES_PER_PIXEL > IMAGE_BUFFER_SIZE_MAX))
         goto out;
 
     /* An opaque image with unassociated alpha set to 0xff is equivalent to
@@ -241,21 +666,50 @@ chicle_tiff_loader_new_from_mapping (ChicleFileMapping *mapping)
             loader->pixel_type = CHAFA_PIXEL_RGBA8_UNASSOCIATED;
     }
 
-    frame_data = _TIFFmalloc (width * height * (guint64) BYTES_PER_PIXEL);
-    if (!frame_data)
-        goto out;
+    if (factor >= 2)
+    {
+        gint reduced_width, reduced_height;
+
+        /* Box averages are always premultiplied */
+        frame_data = read_reduced (tiff, width, height, factor,
+                                   loader->pixel_type == CHAFA_PIXEL_RGBA8_UNASSOCIATED,
+                                   &reduced_width, &reduced_height);
+        if (!frame_data)
+            goto out;
+
+        width = reduced_width;
+        height = reduced_height;
+        loader->pixel_type = CHAFA_PIXEL_RGBA8_PREMULTIPLIED;
+    }
+    else
+    {
+        frame_data = g_try_malloc (width * height * (gsize) BYTES_PER_PIXEL);
+        if (!frame_data)
+            goto out;
 
-    /* Decode and rotate the image */
+        if (!TIFFReadRGBAImageOriented (tiff, width, height, (uint32_t *) frame_data, ORIENTATION_TOPLEFT, 0))
+            goto out;
+    }
 
-    if (!TIFFReadRGBAImageOriented (tiff, width, height, (uint32_t *) frame_data, ORIENTATION_TOPLEFT, 0))
-        goto out;
+    /* Rotate and finish up */
 
-    /* Finish up */
+    rot_width = width;
+    rot_height = height;
+    rowstride = width * BYTES_PER_PIXEL;
 
-    loader->width = width;
-    loader->height = height;
+    chicle_rotate_image (&frame_data, &rot_width, &rot_height, &rowstride, BYTES_PER_PIXEL,
+                         chicle_invert_rotation ((ChicleRotationType) orientation));
+
+    loader->width = rot_width;
+    loader->height = rot_height;
+    loader->rowstride = rowstride;
     loader->frame_data = frame_data;
 
+    /* Reduced images and orientations would get lost if the file were
+     * passed on to the terminal as is */
+    loader->verbatim = (reduced_ofs == 0 && factor < 2
+                        && orientation == ORIENTATION_TOPLEFT);
+
     success = TRUE;
 
 out:
@@ -264,8 +718,7 @@ out:
 
     if (!success)
     {
-        if (frame_data)
-            _TIFFfree (frame_data);
+        g_free (frame_data);
 
         if (loader)
         {
@@ -277,14 +730,41 @@ out:
     return loader;
 }
 
+/* Lets the loader substitute an embedded preview for the main image when
+ * the preview covers the target size. This is meant to be called once
+ * before any loaders are created. */
+void
+chicle_tiff_loader_set_use_previews (gboolean use)
+{
+    use_previews = use;
+}
+
+/* Returns TRUE if the frame came from an embedded preview */
+gboolean
+chicle_tiff_loader_get_used_preview (ChicleTiffLoader *loader)
+{
+    g_return_val_if_fail (loader != NULL, FALSE);
+
+    return loader->used_preview;
+}
+
+/* Returns TRUE if the frame shows the main image as stored in the file,
+ * at full size and with no orientation applied */
+gboolean
+chicle_tiff_loader_get_is_verbatim (ChicleTiffLoader *loader)
+{
+    g_return_val_if_fail (loader != NULL, FALSE);
+
+    return loader->verbatim;
+}
+
 void
 chicle_tiff_loader_destroy (ChicleTiffLoader *loader)
 {
     if (loader->mapping)
         chicle_file_mapping_destroy (loader->mapping);
 
-    if (loader->frame_data)
-        _TIFFfree (loader->frame_data);
+    g_free (loader->frame_data);
 
     g_free (loader);
 }
@@ -313,7 +793,7 @@ chicle_tiff_loader_get_frame_data (ChicleTiffLoader *loader,
     if (height_out)
         *height_out = loader->height;
     if (rowstride_out)
-        *rowstride_out = loader->width * BYTES_PER_PIXEL;
+        *rowstride_out = loader->rowstride;
 
     return loader->frame_data;
 }
@@ -27,10 +27,15 @@ G_BEGIN_DECLS
 
 typedef struct ChicleTiffLoader ChicleTiffLoader;
 
-ChicleTiffLoader *chicle_tiff_loader_new_from_mapping (ChicleFileMapping *mapping);
+ChicleTiffLoader *chicle_tiff_loader_new_from_mapping (ChicleFileMapping *mapping,
+                                                       gint target_width,
+                                                       gint target_height);
+void chicle_tiff_loader_set_use_previews (gboolean use);
 void chicle_tiff_loader_destroy (ChicleTiffLoader *loader);
 
 gboolean chicle_tiff_loader_get_is_animation (ChicleTiffLoader *loader);
+gboolean chicle_tiff_loader_get_used_preview (ChicleTiffLoader *loader);
+gboolean chicle_tiff_loader_get_is_verbatim (ChicleTiffLoader *loader);
 
 gconstpointer chicle_tiff_loader_get_frame_data (ChicleTiffLoader *loader,
                                                  ChafaPixelType *pixel_type_out,
@@ -5,7 +5,7 @@ _chafa()
   cur="${COMP_WORDS[COMP_CWORD]}"
   prev="${COMP_WORDS[COMP_CWORD-1]}"
 
-  opts="--help -h --version -v --verbose --probe --files --files0 --format -f --optimize -O --relative --passthrough --polite --align --clear --center -C --exact-size --fit-width --font-ratio --grid -g --label -l --link --margin-bottom --margin-right --scale --size -s --stretch --view-size --animate --duration -d --speed --watch --bg --colors -c --color-extractor --color-space --dither --dither-grain --dither-intensity --fg --invert --preprocess -p --threshold -t --threads --work -w --fg-only --fill --glyph-file --symbols --dump-detect --fuzz-options --zoom"
+  opts="--help -h --version -v --verbose --probe --files --files0 --compress --format -f --optimize -O --relative --passthrough --polite --align --clear --center -C --exact-size --fit-width --font-ratio --grid -g --label -l --link --margin-bottom --margin-right --scale --size -s --stretch --view-size --animate --duration -d --speed --watch --bg --colors -c --color-extractor --color-space --dither --dither-grain --dither-intensity --fg --invert --preprocess -p --threshold -t --threads --work -w --fg-only --fill --glyph-file --symbols --dump-detect --fuzz-options --zoom"
 
   if [[ ${cur} == -* ]] ; then
     COMPREPLY=( $(compgen -W "${opts}" -- "${cur}") )
@@ -16,7 +16,7 @@ _chafa()
     --format|-f)
       COMPREPLY=( $(compgen -W "iterm kitty sixels symbols" -- "${cur}") )
       ;;
-    --optimize|-O)
+    --optimize|-O|--compress)
       COMPREPLY=( $(compgen -W "0 1 2 3 4 5 6 7 8 9" -- "${cur}") )
       ;;
     --relative|--polite|--animate|--preprocess|-p|--center|-C|--label)
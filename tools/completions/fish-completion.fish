@@ -9,6 +9,7 @@ complete -c chafa -o 'v' -l 'verbose'                     -d 'Be verbose'
 
 complete -c chafa -o 'f' -l 'format'      -x -a 'iterm kitty sixels symbols' -d 'Set output format'
 complete -c chafa -o 'O' -l 'optimize'    -x -a "(seq 0 9)"                  -d 'Compress the output by using control sequences intelligently'
+complete -c chafa        -l 'compress'    -x -a "(seq 0 9)"                  -d 'Compress pixel data where the graphics protocol allows it'
 complete -c chafa        -l 'relative'    -x -a 'on off'                     -d 'Use relative cursor positioning'
 complete -c chafa        -l 'passthrough' -x -a 'auto none screen tmux'      -d 'Graphics protocol passthrough'
 complete -c chafa        -l 'polite'      -x -a 'on off'                     -d 'Polite mode'